@@ -7,17 +7,36 @@
 #include <sstream>
 #include <cmath>
 #include <mutex>
+#include <utility>
 #include <signal.h>
 #include <cstring>
 
 #include <xv-sdk.h>
 #include "colors.h"
+#include "async_log.h"
+#include "frame_trace.hpp"
+#include "detection_stage.hpp"
+#ifdef USE_FILLHOLES
+#include "hole_filler.h"
+#endif
 
 #define USE_EX
 //#define USE_PRIVATE
 
 bool s_stop = false;
 static std::map<std::string,int> enableDevMap;
+static AsyncLog s_log;
+
+// writes the spans traced so far, for chrome://tracing or Perfetto (json) and later conversion (bin)
+static void dumpTrace()
+{
+    FrameTraceSnapshot trace = FrameTrace::snapshot();
+    if (trace.writeChrome("all_stream_trace.json") && trace.writeBinary("all_stream_trace.bin")) {
+        std::cout << trace.spans.size() << " spans written to all_stream_trace.json / .bin" << std::endl;
+    } else {
+        std::cout << "Cannot write all_stream_trace.json / .bin" << std::endl;
+    }
+}
 
 static struct xv::sgbm_config global_config = {
     1 ,//enable_dewarp
@@ -47,6 +66,14 @@ static struct xv::sgbm_config global_config = {
 
 #ifdef USE_OPENCV_
 #include <opencv2/opencv.hpp>
+#include "rgbd_unpack.h"
+#include "frame_pool.h"
+#include "pooled_mat_allocator.h"
+#include "display_service.h"
+#ifdef USE_SHM
+#include "shm_ring.h"
+#include "xvrec_xv.h"
+#endif
 
 int s_x=-1,s_y=-1;
 static int k = 0;
@@ -64,11 +91,13 @@ void onMouse(int event,int x,int y,int flag,void* _user_data)
 }
 
 cv::Mat raw_to_opencv( std::shared_ptr<const xv::ColorImage> rgb);
+void raw_to_opencv( std::shared_ptr<const xv::ColorImage> rgb, cv::Mat& out, int scale);
 cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthImage> tof);
 cv::Mat raw_to_opencv_tof_ir( const xv::GrayScaleImage& tof_ir);
 cv::Mat raw_to_opencv_tof_ir_grey( const xv::GrayScaleImage& tof_ir);
 std::pair<cv::Mat,cv::Mat> raw_to_opencv( std::shared_ptr<const xv::FisheyeImages> stereo);
-cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthColorImage> rgbd);
+cv::Mat gray_to_opencv(xv::GrayScaleImage const& gray, int height = 400, int width = 640);
+cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthColorImage> rgbd, RgbdPlanes& planes);
 cv::Mat raw_to_opencv(std::shared_ptr<const xv::SgbmImage> sbgm_image);
 std::pair<cv::Mat,cv::Mat> raw_to_opencv(std::shared_ptr<const xv::EyetrackingImage> eyetracking);
 
@@ -110,27 +139,8 @@ void add_tags(cv::Mat& im, std::vector<xv::TagDetection> const& tags) {
 
 std::pair<cv::Mat,cv::Mat> raw_to_opencv(std::shared_ptr<const xv::FisheyeImages> stereo, std::shared_ptr<const xv::FisheyeKeyPoints<2,32>> keypoints, std::shared_ptr<const std::vector<std::pair<int, std::array<xv::Vector2d, 4>>>> tags)
 {
-    cv::Mat left;
-    cv::Mat right;
-
-    if (stereo) {
-        auto const& leftInput = stereo->images[0];
-        auto const& rightInput = stereo->images[1];
-        if( leftInput.data != nullptr ){
-            left = cv::Mat::zeros(leftInput.height, leftInput.width, CV_8UC1);
-            std::memcpy(left.data, leftInput.data.get(), static_cast<size_t>(left.rows*left.cols));
-        }
-        if( rightInput.data != nullptr ){
-            right = cv::Mat::zeros(rightInput.height, rightInput.width, CV_8UC1);
-            std::memcpy(right.data, rightInput.data.get(), static_cast<size_t>(right.rows*right.cols));
-        }
-    } else {
-        left = cv::Mat::zeros(400, 640, CV_8UC1);
-        right = cv::Mat::zeros(400, 640, CV_8UC1);
-    }
-
-    cv::cvtColor(left, left, cv::COLOR_GRAY2BGR);
-    cv::cvtColor(right, right, cv::COLOR_GRAY2BGR);
+    cv::Mat left = gray_to_opencv(stereo ? stereo->images[0] : xv::GrayScaleImage());
+    cv::Mat right = gray_to_opencv(stereo ? stereo->images[1] : xv::GrayScaleImage());
 
     if (keypoints) {
         const int size = 2;
@@ -162,23 +172,8 @@ std::array<cv::Mat,4> raw_to_opencv(std::shared_ptr<const xv::FisheyeImages> ste
 
     std::array<cv::Mat,4> images;
 
-    for (auto& im : images) {
-        im = cv::Mat::zeros(400, 640, CV_8UC1);
-    }
-
-    if (stereo) {
-        std::size_t i=0;
-        for (auto& im : stereo->images) {
-            if (im.data != nullptr && i < images.size()) {
-                std::memcpy(images[i].data, im.data.get(), static_cast<size_t>(images[i].rows*images[i].cols));
-                cv::cvtColor(images[i], images[i], cv::COLOR_GRAY2BGR);
-            }
-            ++i;
-        }
-    } else {
-        for (auto& im : images) {
-            im = cv::Mat::zeros(400, 640, CV_8UC1);
-        }
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        images[i] = gray_to_opencv(stereo && i < stereo->images.size() ? stereo->images[i] : xv::GrayScaleImage());
     }
 
     if (keypoints) {
@@ -205,303 +200,250 @@ std::array<cv::Mat,4> raw_to_opencv(std::shared_ptr<const xv::FisheyeImages> ste
 
 std::pair<cv::Mat,cv::Mat> raw_to_opencv(std::shared_ptr<const xv::EyetrackingImage> eyetracking)
 {
-    cv::Mat left;
-    cv::Mat right;
-
-    if (eyetracking) {
-        auto const& leftInput = eyetracking->images[0];
-        auto const& rightInput = eyetracking->images[1];
-        if( leftInput.data != nullptr ){
-            left = cv::Mat::zeros(leftInput.height, leftInput.width, CV_8UC1);
-            std::memcpy(left.data, leftInput.data.get(), static_cast<size_t>(left.rows*left.cols));
-        }
-        if( rightInput.data != nullptr ){
-            right = cv::Mat::zeros(rightInput.height, rightInput.width, CV_8UC1);
-            std::memcpy(right.data, rightInput.data.get(), static_cast<size_t>(right.rows*right.cols));
-        }
-    } else {
-        left = cv::Mat::zeros(400, 640, CV_8UC1);
-        right = cv::Mat::zeros(400, 640, CV_8UC1);
+    if (!eyetracking || eyetracking->images.size() < 2) {
+        return {gray_to_opencv(xv::GrayScaleImage()), gray_to_opencv(xv::GrayScaleImage())};
     }
+    return {gray_to_opencv(eyetracking->images[0]), gray_to_opencv(eyetracking->images[1])};
+}
 
-    cv::cvtColor(left, left, cv::COLOR_GRAY2BGR);
-    cv::cvtColor(right, right, cv::COLOR_GRAY2BGR);
+#endif
 
-    return {left, right};
-}
 
+#include "frame_mailbox.hpp"
+
+// Filled by the SDK callbacks, display() is woken up through s_frameSignal
+FrameSignal s_frameSignal;
+FrameMailbox<xv::ColorImage> s_rgb(&s_frameSignal);
+FrameMailbox<xv::ColorImage> s_rgb2(&s_frameSignal);
+FrameMailbox<xv::DepthImage> s_tof(&s_frameSignal);
+FrameMailbox<xv::GrayScaleImage> s_ir(&s_frameSignal);
+FrameMailbox<xv::FisheyeImages> s_stereo(&s_frameSignal);
+FrameMailbox<xv::FisheyeImages> s_stereoDewarp(&s_frameSignal);
+FrameMailbox<xv::DepthColorImage> s_depthColor(&s_frameSignal);
+FrameMailbox<xv::SgbmImage> s_ptr_sgbm(&s_frameSignal);
+FrameMailbox<xv::EyetrackingImage> s_eyetracking(&s_frameSignal);
+
+#ifdef USE_EX
+FrameMailbox<xv::FisheyeKeyPoints<2,32>> s_keypoints(&s_frameSignal);
+FrameMailbox<xv::FisheyeKeyPoints<4,32>> s_keypoints4cam(&s_frameSignal);
 #endif
 
+#ifdef USE_OPENCV_
+#include "jpeg_decode_pool.h"
 
-std::shared_ptr<const xv::ColorImage> s_rgb = nullptr;
-std::shared_ptr<const xv::ColorImage> s_rgb2 = nullptr;
-std::shared_ptr<const xv::DepthImage> s_tof = nullptr;
-std::shared_ptr<const xv::GrayScaleImage> s_ir = nullptr;
-std::shared_ptr<const xv::FisheyeImages> s_stereo = nullptr;
-std::shared_ptr<const xv::FisheyeImages> s_stereoDewarp = nullptr;
-std::shared_ptr<const xv::DepthColorImage> s_depthColor = nullptr;
-std::shared_ptr<const xv::SgbmImage> s_ptr_sgbm = nullptr;
-std::shared_ptr<const xv::EyetrackingImage> s_eyetracking = nullptr;
+// JPEG color frames are decoded by a worker pool, in order, instead of on the display thread
+FrameMailbox<cv::Mat> s_rgbJpeg(&s_frameSignal);
+std::unique_ptr<JpegDecodePool> s_jpegPool;
 
 #ifdef USE_EX
-std::shared_ptr<const xv::FisheyeKeyPoints<2,32>> s_keypoints = nullptr;
-std::shared_ptr<const xv::FisheyeKeyPoints<4,32>> s_keypoints4cam = nullptr;
-std::mutex s_mtx_tags;
-std::shared_ptr<const std::vector<std::pair<int, std::array<xv::Vector2d, 4>>>> s_tags;
-std::mutex s_mtx_rgb_tags;
-xv::GrayScaleImage s_rgb_gray;
-std::vector<xv::TagDetection> s_rgb_tags;
+typedef std::vector<std::pair<int, std::array<xv::Vector2d, 4>>> FisheyeTags;
+typedef DetectionStage<xv::FisheyeImages, FisheyeTags> FisheyeTagStage;
+typedef DetectionStage<xv::ColorImage, std::vector<xv::TagDetection>> RgbTagStage;
+
+// Tags are detected on the new frames by worker threads, not in the SDK callbacks. The
+// mailboxes hold the latest results, drawn over the next displayed images.
+FrameMailbox<FisheyeTags> s_tags;
+FrameMailbox<std::vector<xv::TagDetection>> s_rgb_tags;
+std::unique_ptr<FisheyeTagStage> s_fisheyeTagStage;
+std::unique_ptr<RgbTagStage> s_rgbTagStage;
+#endif
 #endif
 
-std::mutex s_mtx_rgb;
-std::mutex s_mtx_rgb2;
-std::mutex s_mtx_tof;
-std::mutex s_mtx_depthColor;
-std::mutex s_mtx_ir;
-std::mutex s_mtx_stereo;
-std::mutex s_mtx_sgbm;
-std::mutex s_mtx_eyetracking;
-std::mutex s_mtx_stereoDewarp;
+// Displayed streams: each one is rendered from the latest frame of its mailbox, only when the
+// mailbox sequence advanced and at most DisplayService::Options::maxFps times per second.
+// Renders run on the workers of the service, so they allocate their images (pooled) instead
+// of reusing static Mats that could still be shown.
+void addDisplayStreams(DisplayService& display) {
+    display.placeWindow("Left", 20, 20);
+    display.placeWindow("Right", 660, 20);
+    display.placeWindow("LeftDewrap", 20, 450);
+    display.placeWindow("RightDewrap", 660, 450);
+    display.placeWindow("RGB", 20, 462);
+    display.placeWindow("RGB2", 20, 962);
+    display.placeWindow("TOF", 500, 462);
+    display.placeWindow("IR", 500 + 640, 462);
+    display.placeWindow("Depth", 500, 650);
 
-void display() {
     if (enableDevMap["fisheye"]) {
-        cv::namedWindow("Left");
-        cv::moveWindow("Left", 20, 20);
-        cv::namedWindow("Right");
-        cv::moveWindow("Right", 660, 20);
+#ifdef USE_EX
+        // new keypoints are drawn over the latest images
+        display.addStream({"Left", "Right"}, [] { return s_keypoints.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto stereo = s_stereo.latest();
+            TraceScope trace("convert", "stereo", stereo ? stereo->edgeTimestampUs : 0);
+            auto imgs = raw_to_opencv(stereo, s_keypoints.latest(), s_tags.latest());
+            images[0] = imgs.first;
+            images[1] = imgs.second;
+            return true;
+        });
+        display.addStream({"Cam0", "Cam1", "Cam2", "Cam3"}, [] { return s_keypoints4cam.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto stereo = s_stereo.latest();
+            TraceScope trace("convert", "stereo", stereo ? stereo->edgeTimestampUs : 0);
+            auto imgs = raw_to_opencv(stereo, s_keypoints4cam.latest(), s_tags.latest());
+            std::copy(imgs.begin(), imgs.end(), images.begin());
+            return true;
+        });
+#else
+        display.addStream({"Left", "Right"}, [] { return s_stereo.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto stereo = s_stereo.latest();
+            TraceScope trace("convert", "stereo", stereo ? stereo->edgeTimestampUs : 0);
+            auto imgs = raw_to_opencv(stereo);
+            images[0] = imgs.first;
+            images[1] = imgs.second;
+            return true;
+        });
+#endif
         if(enableDevMap["Dewarp"])
         {
-            cv::namedWindow("LeftDewrap");
-            cv::moveWindow("LeftDewrap", 20, 450);
-            cv::namedWindow("RightDewrap");
-            cv::moveWindow("RightDewrap", 660, 450);
+            display.addStream({"LeftDewrap", "RightDewrap"}, [] { return s_stereoDewarp.sequence(); }, [](std::vector<cv::Mat>& images) {
+                auto stereo = s_stereoDewarp.latest();
+                TraceScope trace("convert", "stereo dewarp", stereo ? stereo->edgeTimestampUs : 0);
+                auto imgs = raw_to_opencv(stereo);
+                images[0] = imgs.first;
+                images[1] = imgs.second;
+                return true;
+            });
         }
     }
     if (enableDevMap["rgb"]) {
-        cv::namedWindow("RGB");
-        cv::moveWindow("RGB", 20, 462);
+        display.addStream({"RGB"}, [] { return s_rgb.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto rgb = s_rgb.latest();
+            if (!rgb || rgb->width<=0 || rgb->height<=0)
+                return false;
+            TraceScope trace("convert", "rgb", rgb->edgeTimestampUs);
+            cv::Mat img;
+            img.allocator = PooledMatAllocator::global();
+#ifdef USE_EX
+            raw_to_opencv(rgb, img, 1);
+            auto rgb_tags = s_rgb_tags.latest();
+            if (rgb_tags)
+                add_tags(img, *rgb_tags);
+#else
+            // the preview is converted at 1/4 directly
+            raw_to_opencv(rgb, img, 4);
+#endif
+            images[0] = img;
+            return true;
+        });
+        display.addStream({"RGB"}, [] { return s_rgbJpeg.sequence(); }, [](std::vector<cv::Mat>& images) {
+            cv::Mat jpeg;
+            std::uint64_t seq = 0;
+            if (!s_rgbJpeg.next(jpeg, seq))
+                return false;
+#ifdef USE_EX
+            auto rgb_tags = s_rgb_tags.latest();
+            if (rgb_tags && !jpeg.empty())
+                add_tags(jpeg, *rgb_tags);
+#endif
+            images[0] = jpeg;
+            return true;
+        });
     }
+
     if (enableDevMap["rgb2"]) {
-        cv::namedWindow("RGB2");
-        cv::moveWindow("RGB2", 20, 962);
+        display.addStream({"RGB2"}, [] { return s_rgb2.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto rgb2 = s_rgb2.latest();
+            if (!rgb2 || rgb2->width<=0 || rgb2->height<=0)
+                return false;
+            TraceScope trace("convert", "rgb2", rgb2->edgeTimestampUs);
+            cv::Mat img;
+            img.allocator = PooledMatAllocator::global();
+            raw_to_opencv(rgb2, img, 1);
+            images[0] = img;
+            return true;
+        });
     }
+
     if (enableDevMap["tof"]) {
-        cv::namedWindow("TOF");
-        cv::moveWindow("TOF", 500, 462);
-        cv::namedWindow("IR");
-        cv::moveWindow("IR", 500 + 640, 462);
-        cv::namedWindow("Depth");
-        cv::moveWindow("Depth", 500 , 650);
-    }
-    if (enableDevMap["sgbm"]) {
-        cv::namedWindow("ET-Left");
-        cv::moveWindow("ET-Left", 600, 60);
-        cv::namedWindow("ET-Right");
-        cv::moveWindow("ET-Right", 800, 60);
+        display.addStream({"TOF"}, [] { return s_tof.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto tof = s_tof.latest();
+            TraceScope trace("convert", "tof", tof ? tof->edgeTimestampUs : 0);
+            images[0] = raw_to_opencv(tof);
+            return true;
+        });
+        // planar depth and color of the last RGBD frame, one render at a time
+        std::shared_ptr<RgbdPlanes> rgbdPlanes = std::make_shared<RgbdPlanes>();
+        display.addStream({"RGBD (depth)"}, [] { return s_depthColor.sequence(); }, [rgbdPlanes](std::vector<cv::Mat>& images) {
+            auto depthColor = s_depthColor.latest();
+            if (!depthColor)
+                return false;
+            TraceScope trace("convert", "rgbd", depthColor->edgeTimestampUs);
+            images[0] = raw_to_opencv(depthColor, *rgbdPlanes);
+            return true;
+        });
+        display.addStream({"IR", "IR (grey)"}, [] { return s_ir.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto ir = s_ir.latest();
+            if (!ir)
+                return false;
+            TraceScope trace("convert", "tof IR", 0); // GrayScaleImage has no timestamp
+            images[0] = raw_to_opencv_tof_ir(*ir);
+            images[1] = raw_to_opencv_tof_ir_grey(*ir);
+            return true;
+        });
     }
-    cv::waitKey(1);
-
-    while( !s_stop ){
-        std::shared_ptr<const xv::ColorImage> rgb = nullptr;
-        std::shared_ptr<const xv::ColorImage> rgb2 = nullptr;
-        std::shared_ptr<const xv::DepthImage> tof = nullptr;
-        std::shared_ptr<const xv::GrayScaleImage> ir = nullptr;
-        std::shared_ptr<const xv::FisheyeImages> stereo = nullptr;
-        std::shared_ptr<const xv::FisheyeImages> stereoDewarp = nullptr;
-        std::shared_ptr<const xv::SgbmImage> ptr_sgbm = nullptr;
-        std::shared_ptr<const xv::EyetrackingImage> eyetracking = nullptr;
-#ifdef USE_EX
-        std::shared_ptr<const xv::FisheyeKeyPoints<2,32>> keypoints = nullptr;
-        std::shared_ptr<const xv::FisheyeKeyPoints<4,32>> keypoints4cam = nullptr;
-        std::shared_ptr<const std::vector<std::pair<int, std::array<xv::Vector2d, 4>>>> tags;
-        decltype (s_rgb_tags) rgb_tags;
-#endif
-        if (enableDevMap["fisheye"]) {
-            s_mtx_stereo.lock();
-            stereo = s_stereo;
-#ifdef USE_EX
-            keypoints = s_keypoints;
-            keypoints4cam = s_keypoints4cam;
-            s_mtx_tags.lock();
-            tags = s_tags;
-            s_mtx_tags.unlock();
-            s_mtx_rgb_tags.lock();
-            rgb_tags = s_rgb_tags;
-            s_mtx_rgb_tags.unlock();
-#endif
-            s_mtx_stereo.unlock();
-            if(enableDevMap["Dewarp"])
-            {
-                s_mtx_stereoDewarp.lock();
-                stereoDewarp = s_stereoDewarp;
-                s_mtx_stereoDewarp.unlock();
-            }
 
-#ifdef USE_EX
-            if (keypoints) {
-                auto imgs = raw_to_opencv(stereo, keypoints, tags);
-                cv::imshow("Left", imgs.first);
-                cv::imshow("Right", imgs.second);
-            }
-            if (keypoints4cam) {
-                auto imgs = raw_to_opencv(stereo, keypoints4cam, tags);
-                for (std::size_t i=0; i<imgs.size(); ++i) {
-                    cv::imshow("Cam"+std::to_string(i), imgs[i]);
-                }
-            }
-#else
-            if (stereo) {
-                auto imgs = raw_to_opencv(stereo);
-                cv::imshow("Left", imgs.first);
-                cv::imshow("Right", imgs.second);
-            }
-#endif
-            if(enableDevMap["Dewarp"])
+    if (enableDevMap["sgbm"]) {
+        display.addStream({"Depth"}, [] { return s_ptr_sgbm.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto ptr_sgbm = s_ptr_sgbm.latest();
+            if (!ptr_sgbm || ptr_sgbm->type != xv::SgbmImage::Type::Depth)
+                return false;
+            TraceScope trace("convert", "sgbm", ptr_sgbm->edgeTimestampUs);
+#ifdef USE_FILLHOLES
             {
-                if (stereoDewarp) {
-                    auto imgs = raw_to_opencv(stereoDewarp);
-                    cv::imshow("LeftDewrap", imgs.first);
-                    cv::imshow("RightDewrap", imgs.second);
-                }
+                static HoleFiller filler;
+                ptr_sgbm = std::make_shared<xv::SgbmImage>(filler.apply(*ptr_sgbm));
             }
-        }
-        if (enableDevMap["rgb"]) {
-#ifdef USE_EX
-            s_mtx_rgb_tags.lock();
-            rgb_tags = s_rgb_tags;
-            s_mtx_rgb_tags.unlock();
-#endif
-            s_mtx_rgb.lock();
-            rgb = s_rgb;
-            s_mtx_rgb.unlock();
-            if (rgb && rgb->width>0 && rgb->height>0) {
-                cv::Mat img = raw_to_opencv(rgb);
-#ifdef USE_EX
-                add_tags(img, rgb_tags);
-#else
-                cv::resize(img, img, cv::Size(), 0.25, 0.25);
 #endif
-                cv::imshow("RGB", img);
-            }
-        }
-
-        if (enableDevMap["rgb2"]) {
-            s_mtx_rgb2.lock();
-            rgb2 = s_rgb2;
-            s_mtx_rgb2.unlock();
-            if (rgb2 && rgb2->width>0 && rgb2->height>0) {
-                cv::Mat img = raw_to_opencv(rgb2);
-                cv::imshow("RGB2", img);
-            }
-        }
-
-        if (enableDevMap["tof"]) {
-            s_mtx_tof.lock();
-            tof = s_tof;
-            s_mtx_tof.unlock();
-            if (tof) {
-                cv::Mat img = raw_to_opencv(tof);
-                if (img.rows>0 && img.cols>0)
-                    cv::imshow("TOF", img);
-            }
-            s_mtx_depthColor.lock();
-            auto depthColor = s_depthColor;
-            s_mtx_depthColor.unlock();
-            if (depthColor) {
-                cv::Mat img = raw_to_opencv(depthColor);
-                if (img.rows>0 && img.cols>0)
-                    cv::imshow("RGBD (depth)", img);
-            }
-            s_mtx_ir.lock();
-            ir = s_ir;
-            s_mtx_ir.unlock();
-            if (ir) {
-                cv::Mat img = raw_to_opencv_tof_ir(*ir);
-                if (img.rows>0 && img.cols>0)
-                    cv::imshow("IR", img);
-                cv::Mat img_grey = raw_to_opencv_tof_ir_grey(*ir);
-                if (img_grey.rows>0 && img_grey.cols>0)
-                    cv::imshow("IR (grey)", img_grey);
-            }
-        }
-
-        if (enableDevMap["sgbm"]) {
-            s_mtx_sgbm.lock();
-            ptr_sgbm = s_ptr_sgbm;
-            s_mtx_sgbm.unlock();
+            cv::Mat img = raw_to_opencv(ptr_sgbm);
+            char text[256];
+            uint16_t* p16 = (uint16_t*)ptr_sgbm->data.get();
 
-
-            if(ptr_sgbm)
+            if( s_x!=-1 && ( s_x > 0 && s_x < ptr_sgbm->width && s_y > 0 && s_y < ptr_sgbm->height ) )
             {
-                if(ptr_sgbm->type == xv::SgbmImage::Type::Depth)
+                int width = ptr_sgbm->width;
+                int height = ptr_sgbm->height;
+                if(p16[s_x+s_y*width]==0)
                 {
-#ifdef USE_FILLHOLES
-                    {
-                        int hole = 1;
-                        xv::SgbmImage img = fillHoles(*ptr_sgbm.get(), [](uint16_t d){return d < d1  || d > d2; }, hole);
-                        ptr_sgbm = make_shared<xv::SgbmImage>(img);
-                    }
-#endif
-                    cv::Mat img = raw_to_opencv(ptr_sgbm);
-                    char text[256];
-                    uint16_t* p16 = (uint16_t*)ptr_sgbm->data.get();
-
-                    if( s_x!=-1 && ( s_x > 0 && s_x < ptr_sgbm->width && s_y > 0 && s_y < ptr_sgbm->height ) )
+                    if(k++%20==0)
                     {
-                        int width = ptr_sgbm->width;
-                        int height = ptr_sgbm->height;
-                        if(p16[s_x+s_y*width]==0)
-                        {
-                            if(k++%20==0)
-                            {
-                                memset(text,0,256);
-                                sprintf(text,"x:%d,y:%d depth:%d mm",s_x,s_y,p16[s_x+s_y*width]);
-                            }
-                        }
-                        else
-                        {
-                            memset(text,0,256);
-                            sprintf(text,"x:%d,y:%d depth:%d mm",s_x,s_y,p16[s_x+s_y*width]);
-                        }
-
-                        putText(img,text,cv::Point(25,height-30),cv::FONT_HERSHEY_TRIPLEX,0.5,cv::Scalar(0,0,255));
+                        memset(text,0,256);
+                        sprintf(text,"x:%d,y:%d depth:%d mm",s_x,s_y,p16[s_x+s_y*width]);
                     }
-                    imshow("Depth",img);
+                }
+                else
+                {
+                    memset(text,0,256);
+                    sprintf(text,"x:%d,y:%d depth:%d mm",s_x,s_y,p16[s_x+s_y*width]);
                 }
 
+                putText(img,text,cv::Point(25,height-30),cv::FONT_HERSHEY_TRIPLEX,0.5,cv::Scalar(0,0,255));
             }
-        }
+            images[0] = img;
+            return true;
+        });
+    }
 
-        
-        if (enableDevMap["eyetracking"]) {
-            s_mtx_eyetracking.lock();
-            eyetracking = s_eyetracking;
-            s_mtx_eyetracking.unlock();
-            if (eyetracking) {
-                auto imgs = raw_to_opencv(eyetracking);
-                cv::imshow("Left", imgs.first);
-                cv::imshow("Right", imgs.second);
-            }
-        }
-        cv::waitKey(1);
+    if (enableDevMap["eyetracking"]) {
+        display.addStream({"Left", "Right"}, [] { return s_eyetracking.sequence(); }, [](std::vector<cv::Mat>& images) {
+            auto eyetracking = s_eyetracking.latest();
+            TraceScope trace("convert", "eyetracking", eyetracking ? eyetracking->edgeTimestampUs : 0);
+            auto imgs = raw_to_opencv(eyetracking);
+            images[0] = imgs.first;
+            images[1] = imgs.second;
+            return true;
+        });
     }
 }
-#endif
 
-#include "fps_count.hpp"
+std::unique_ptr<DisplayService> s_display;
 
-std::string timeShowStr(std::int64_t edgeTimestampUs, double hostTimestamp) {
-    char s[1024];
-    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()*1e-6;
-    std::sprintf(s, " (device=%lld host=%.4f now=%.4f delay=%.4f) ", (long long)edgeTimestampUs, hostTimestamp, now, now-hostTimestamp);
-    return std::string(s);
-}
-std::string timeShowStr(double hostTimestamp) {
-    char s[1024];
-    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()*1e-6;
-    std::sprintf(s, " (host=%.4f now=%.4f delay=%.4f) ", hostTimestamp, now, now-hostTimestamp);
-    return std::string(s);
+void display() {
+    s_display->run(s_frameSignal);
 }
+#endif
+
+#include "stream_stats.hpp"
+#include "point_cloud_recorder.hpp"
+#include "depth_cloud.h"
 
 int main( int argc, char* argv[] ) try
 {
@@ -537,11 +479,20 @@ int main( int argc, char* argv[] ) try
     enableDevMap["720P"] = false;
     enableDevMap["tof_mode"] = 3;//default lablize sf
     enableDevMap["tof_point_cloud"] = false;
+    enableDevMap["tof_point_cloud_pcd"] = false;
+    enableDevMap["tof_voxel_mm"] = 20;//point cloud voxel grid, 0: every pixel
     enableDevMap["log"]=true;
     enableDevMap["ir"]=true;
     enableDevMap["RGBD"]=true;
     enableDevMap["Dewarp"] = true;
     enableDevMap["stereo_planes"] = true;
+    enableDevMap["trace"] = false;//per-stage latency spans, dumped with 't' and at exit
+#ifdef _WIN32
+    enableDevMap["headless"] = false;
+#else
+    // no window on a box without a display: the streams are composited into a mosaic
+    enableDevMap["headless"] = !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+#endif
     if (argc == 3)
     {
         std::string enableDevStr(argv[2]);
@@ -564,12 +515,15 @@ int main( int argc, char* argv[] ) try
         }
     }
 
+    if (enableDevMap["trace"]) {
+        FrameTrace::enable();
+    }
+
     auto devices = xv::getDevices(10., json);
     if(enableDevMap["log"])
     {
         xv::setLogLevel(xv::LogLevel::debug);
     }
-    std::ofstream ofs;
     if (devices.empty())
     {
         std::cout << "Timeout: no device found\n";
@@ -578,6 +532,9 @@ int main( int argc, char* argv[] ) try
 
     auto device = devices.begin()->second;
 
+    // ToF point clouds are converted and written on a background thread, one file per frame
+    std::unique_ptr<PointCloudRecorder<xv::DepthImage>> tofRecorder;
+
     enableDevMap["rgb"] &= device->colorCamera() != nullptr;
     enableDevMap["tof"] &= device->tofCamera() != nullptr;
     enableDevMap["fisheye"] &= device->fisheyeCameras() != nullptr;
@@ -605,15 +562,14 @@ int main( int argc, char* argv[] ) try
     if (enableDevMap["rgb"])
     {
         device->colorCamera()->registerCallback( [](xv::ColorImage const & rgb){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%25==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "rgb      " << timeShowStr(rgb.edgeTimestampUs, rgb.hostTimestamp)
-                            << rgb.width << "x" << rgb.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                }
+            TraceScope trace("callback", "rgb", rgb.edgeTimestampUs, rgb.hostTimestamp);
+            static StreamStats fc;
+            fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("rgb");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
             }
         });
         device->colorCamera()->setResolution(xv::ColorCamera::Resolution::RGB_1920x1080);
@@ -627,15 +583,14 @@ int main( int argc, char* argv[] ) try
     if (enableDevMap["rgb2"])
     {
         device->colorCamera()->registerCam2Callback( [](xv::ColorImage const & rgb){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%25==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "rgb 2     " << timeShowStr(rgb.edgeTimestampUs, rgb.hostTimestamp)
-                            << rgb.width << "x" << rgb.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                }
+            TraceScope trace("callback", "rgb2", rgb.edgeTimestampUs, rgb.hostTimestamp);
+            static StreamStats fc;
+            fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("rgb2");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
             }
         });
         device->colorCamera()->setCamsResolution(xv::ColorCamera::Resolution::RGB_1920x1080);
@@ -654,12 +609,12 @@ int main( int argc, char* argv[] ) try
         devPriv->setTofIrEnabled(true);
         device->tofCamera()->registerCallback([](xv::DepthImage const & tof){
             if (tof.type == xv::DepthImage::Type::IR) {
-                static FpsCount fc;
-                fc.tic();
-                static int k = 0;
-                if(k++%15==0){
-                    std::cout << "tof IR   " << timeShowStr(tof.edgeTimestampUs, tof.hostTimestamp)
-                              << tof.width << "x" << tof.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+                static StreamStats fc;
+                fc.tic(tof.edgeTimestampUs, tof.hostTimestamp);
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("tof IR");
+                if(limit.allow()){
+                    s_log.frame(id, tof.edgeTimestampUs, tof.hostTimestamp, fc.fps(), tof.width, tof.height);
                 }
             }
         });
@@ -672,45 +627,55 @@ int main( int argc, char* argv[] ) try
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
         if(enableDevMap["tof_point_cloud"])
         {
-            ofs.open("./tof_pointcloud.txt",std::ios::out);
+            bool pcd = enableDevMap["tof_point_cloud_pcd"];
+            DepthCloudBuilder::Options options;
+            options.voxelSize = enableDevMap["tof_voxel_mm"] / 1000.f;
+            // only used on the writer thread
+            std::shared_ptr<DepthCloudBuilder> builder = std::make_shared<DepthCloudBuilder>(
+                depthCameraFromCalibration(device->tofCamera()->calibration()), options);
+            if (!builder->camera().valid()) {
+                std::cout << "No ToF calibration, point clouds will be empty" << std::endl;
+            }
+            std::shared_ptr<std::vector<std::array<float, 3>>> points = std::make_shared<std::vector<std::array<float, 3>>>();
+            tofRecorder.reset(new PointCloudRecorder<xv::DepthImage>(
+                pcd ? "./tof_pointcloud_%06llu.pcd" : "./tof_pointcloud_%06llu.ply",
+                pcd ? PointCloudFormat::PcdBinaryCompressed : PointCloudFormat::PlyBinary,
+                [builder, points](xv::DepthImage const & tof, PointCloudWriter & writer){
+                    if (tof.type == xv::DepthImage::Type::Depth_32) {
+                        builder->build(reinterpret_cast<float const*>(tof.data.get()), tof.width, tof.height, *points);
+                    } else {
+                        builder->build(reinterpret_cast<std::uint16_t const*>(tof.data.get()), tof.width, tof.height, 0.001f, *points);
+                    }
+                    writer.append(*points);
+                }));
         }
 
         device->tofCamera()->registerCallback([&](xv::DepthImage const & tof){
             if (tof.type == xv::DepthImage::Type::Depth_16 || tof.type == xv::DepthImage::Type::Depth_32) {
-                static FpsCount fc;
-                fc.tic();
-                static int k = 0;
-                if(enableDevMap["tof_point_cloud"])
+                TraceScope trace("callback", "tof", tof.edgeTimestampUs, tof.hostTimestamp);
+                static StreamStats fc;
+                fc.tic(tof.edgeTimestampUs, tof.hostTimestamp);
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("tof");
+                if(tofRecorder)
                 {
-                    auto points = device->tofCamera()->depthImageToPointCloud(tof)->points;
-                    char buff[128]={0};
-                    for (auto iter = points.begin(); iter != points.end();iter++)
-                    {
-                        auto point = *iter;
-                        sprintf(buff, "x=%f ,y=%f ,z=%f\n", point[0], point[1], point[2]);
-                        ofs << buff;
-                    }
-                    ofs.flush();
+                    tofRecorder->push(tof);
                 }
-                if(k++%15==0){
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "tof      " << timeShowStr(tof.edgeTimestampUs, tof.hostTimestamp)
-                                << tof.width << "x" << tof.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                    }
+                if(enableDevMap["log"] && limit.allow())
+                {
+                    s_log.frame(id, tof.edgeTimestampUs, tof.hostTimestamp, fc.fps(), tof.width, tof.height);
                 }
             }
             else if(tof.type == xv::DepthImage::Type::IR && enableDevMap["ir"])
             {
-                static FpsCount fc;
-                fc.tic();
-                static int k = 0;
-                if(k++%15==0){
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "tof IR      " << timeShowStr(tof.edgeTimestampUs, tof.hostTimestamp)
-                                << tof.width << "x" << tof.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                    }
+                TraceScope trace("callback", "tof IR", tof.edgeTimestampUs, tof.hostTimestamp);
+                static StreamStats fc;
+                fc.tic(tof.edgeTimestampUs, tof.hostTimestamp);
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("tof IR");
+                if(enableDevMap["log"] && limit.allow())
+                {
+                    s_log.frame(id, tof.edgeTimestampUs, tof.hostTimestamp, fc.fps(), tof.width, tof.height);
                 }
             }
         });
@@ -725,39 +690,38 @@ int main( int argc, char* argv[] ) try
         } 
         device->tofCamera()->start();
         device->tofCamera()->registerColorDepthImageCallback([](const xv::DepthColorImage& depthColor){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%15==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "RGBD     " << timeShowStr(depthColor.hostTimestamp)
-                              << depthColor.width << "x" << depthColor.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                }
+            TraceScope trace("callback", "rgbd", depthColor.edgeTimestampUs, depthColor.hostTimestamp);
+            static StreamStats fc;
+            fc.tic(depthColor.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("RGBD");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.frame(id, depthColor.hostTimestamp, fc.fps(), depthColor.width, depthColor.height);
             }
         });
     }
 
     if (enableDevMap["imu"]) {
         device->imuSensor()->registerCallback([](xv::Imu const & imu){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%500==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "imu      " << timeShowStr(imu.edgeTimestampUs, imu.hostTimestamp) << "@" << std::round(fc.fps()) << "fps" << " Accel(" << imu.accel[0] << "," << imu.accel[1] << "," << imu.accel[2] << "), Gyro(" << imu.gyro[0] << "," << imu.gyro[1] << "," << imu.gyro[2] << ")" << std::endl;
-                }
+            TraceScope trace("callback", "imu", imu.edgeTimestampUs, imu.hostTimestamp);
+            static StreamStats fc;
+            fc.tic(imu.edgeTimestampUs, imu.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("imu");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.imu(id, imu.edgeTimestampUs, imu.hostTimestamp, fc.fps(), imu.gyro.data(), imu.accel.data(), imu.temperature);
             }
         });
     }
 
     if (device->eventStream()) {
         device->eventStream()->registerCallback( [](xv::Event const & event){
+            static const std::uint16_t id = s_log.stream("event");
             if(enableDevMap["log"])
             {
-                std::cout << "event      " << timeShowStr(event.edgeTimestampUs, event.hostTimestamp)
-                        << " (" << event.type << "," << event.state << ")" << std::endl;
+                s_log.event(id, event.edgeTimestampUs, event.hostTimestamp, event.type, event.state);
             }
         });
         device->eventStream()->start();
@@ -767,12 +731,14 @@ int main( int argc, char* argv[] ) try
         device->sgbmCamera()->registerCallback([](const xv::SgbmImage& sgbm_image){
             if(sgbm_image.type == xv::SgbmImage::Type::Depth)
             {
-                static int k=0;
-                if(k++%50==0){
-                    if(enableDevMap["log"])
-                    {
-                        std::cout<<"sgbm: "<<sgbm_image.width<<"*"<<sgbm_image.height<<std::endl;
-                    }
+                TraceScope trace("callback", "sgbm", sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp);
+                static StreamStats fc;
+                fc.tic(sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp);
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("sgbm");
+                if(enableDevMap["log"] && limit.allow())
+                {
+                    s_log.frame(id, sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp, fc.fps(), sgbm_image.width, sgbm_image.height);
                 }
             }
         });
@@ -784,15 +750,14 @@ int main( int argc, char* argv[] ) try
     {
         if (std::dynamic_pointer_cast<xv::DeviceEx>(device)->slam2()) {
             std::dynamic_pointer_cast<xv::DeviceEx>(device)->slam2()->registerCallback( [](const xv::Pose& pose){
-                static FpsCount fc;
-                fc.tic();
-                static int k = 0;
-                if(k++%500==0){
+                static StreamStats fc;
+                fc.tic(pose.edgeTimestampUs(), pose.hostTimestamp());
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("edge-pose");
+                if(enableDevMap["log"] && limit.allow())
+                {
                     auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "edge-pose" << timeShowStr(pose.edgeTimestampUs(), pose.hostTimestamp()) << "@" << std::round(fc.fps()) << "fps" << " (" << pose.x() << "," << pose.y() << "," << pose.z() << ") (" << pitchYawRoll[0]*180/M_PI << "," << pitchYawRoll[1]*180/M_PI << "," << pitchYawRoll[2]*180/M_PI << ")" << pose.confidence() << std::endl;
-                    }
+                    s_log.pose(id, pose.edgeTimestampUs(), pose.hostTimestamp(), fc.fps(), pose.translation().data(), pitchYawRoll.data(), pose.confidence());
                 }
             });
             std::dynamic_pointer_cast<xv::DeviceEx>(device)->slam2()->start(xv::Slam::Mode::Edge);
@@ -806,39 +771,39 @@ int main( int argc, char* argv[] ) try
     if (enableDevMap["fisheye"]) {
 #ifdef USE_EX
         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->registerKeyPointsCallback([](const xv::FisheyeKeyPoints<2,32>& keypoints){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%50==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "keypoints  "  << timeShowStr(keypoints.edgeTimestampUs, keypoints.hostTimestamp) << keypoints.descriptors[0].size << ":" << keypoints.descriptors[1].size << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                }
+            static StreamStats fc;
+            fc.tic(keypoints.edgeTimestampUs, keypoints.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("keypoints");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                const double counts[2] = {static_cast<double>(keypoints.descriptors[0].size), static_cast<double>(keypoints.descriptors[1].size)};
+                s_log.values(id, keypoints.edgeTimestampUs, keypoints.hostTimestamp, fc.fps(), "count", counts, 2);
             }
         });
 #endif
         device->fisheyeCameras()->registerCallback([](xv::FisheyeImages const & stereo){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%50==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "stereo   "  << timeShowStr(stereo.edgeTimestampUs, stereo.hostTimestamp) << stereo.images[0].width << "x" << stereo.images[0].height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                }
+            TraceScope trace("callback", "stereo", stereo.edgeTimestampUs, stereo.hostTimestamp);
+            static StreamStats fc;
+            fc.tic(stereo.edgeTimestampUs, stereo.hostTimestamp);
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("stereo");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.frame(id, stereo.edgeTimestampUs, stereo.hostTimestamp, fc.fps(), stereo.images[0].width, stereo.images[0].height);
             }
         });
         if(enableDevMap["Dewarp"])
         {
             device->fisheyeCameras()->registerAntiDistortionCallback([](xv::FisheyeImages const & stereo){
-                static FpsCount fc;
-                fc.tic();
-                static int k = 0;
-                if(k++%50==0){
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "stereo dewarp "  << timeShowStr(stereo.edgeTimestampUs, stereo.hostTimestamp) << stereo.images[0].width << "x" << stereo.images[0].height << "@" << std::round(fc.fps()) << "fps" << std::endl;
-                    }
+                TraceScope trace("callback", "stereo dewarp", stereo.edgeTimestampUs, stereo.hostTimestamp);
+                static StreamStats fc;
+                fc.tic(stereo.edgeTimestampUs, stereo.hostTimestamp);
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("stereo dewarp");
+                if(enableDevMap["log"] && limit.allow())
+                {
+                    s_log.frame(id, stereo.edgeTimestampUs, stereo.hostTimestamp, fc.fps(), stereo.images[0].width, stereo.images[0].height);
                 }
             });
         }
@@ -862,15 +827,15 @@ int main( int argc, char* argv[] ) try
 
     if (enableDevMap["slam"]) {
         device->slam()->registerCallback([](const xv::Pose& pose){
-            static FpsCount fc;
-            fc.tic();
-            static int k = 0;
-            if(k++%500==0){
+            TraceScope trace("callback", "slam", pose.edgeTimestampUs(), pose.hostTimestamp());
+            static StreamStats fc;
+            fc.tic(pose.edgeTimestampUs(), pose.hostTimestamp());
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("slam-pose");
+            if(enableDevMap["log"] && limit.allow())
+            {
                 auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                if(enableDevMap["log"])
-                {
-                    std::cout << "slam-pose" << timeShowStr(pose.edgeTimestampUs(), pose.hostTimestamp()) << "@" << std::round(fc.fps()) << "fps" << " (" << pose.x() << "," << pose.y() << "," << pose.z() << "," << pitchYawRoll[0]*180/M_PI << "," << pitchYawRoll[1]*180/M_PI << "," << pitchYawRoll[2]*180/M_PI << ")" << pose.confidence() << std::endl;
-                }
+                s_log.pose(id, pose.edgeTimestampUs(), pose.hostTimestamp(), fc.fps(), pose.translation().data(), pitchYawRoll.data(), pose.confidence());
             }
         });
         
@@ -878,12 +843,13 @@ int main( int argc, char* argv[] ) try
         {
             device->slam()->registerStereoPlanesCallback([] (std::shared_ptr<const std::vector<xv::Plane>> planes) {
                 if (!planes) return;
-                static int k = 0;
-                if(k++%30==0){
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "Stereo-planes update (#" << planes->size() << " planes" << std::endl;
-                    }
+                static LogRateLimiter limit;
+                static const std::uint16_t id = s_log.stream("stereo-planes");
+                if(enableDevMap["log"] && limit.allow())
+                {
+                    char text[64];
+                    std::snprintf(text, sizeof(text), "update (#%u planes)", static_cast<unsigned>(planes->size()));
+                    s_log.message(id, text);
                 }
             });
         }
@@ -893,15 +859,14 @@ int main( int argc, char* argv[] ) try
 
     if (enableDevMap["eyetracking"]) {
         device->eyetracking()->registerCallback([] (xv::EyetrackingImage const & eyetracking) {
-            static FpsCount fc;
+            TraceScope trace("callback", "eyetracking", eyetracking.edgeTimestampUs, eyetracking.hostTimestamp);
+            static StreamStats fc;
             fc.tic();
-            static int k=0;
-            if(k++%30==0){
-                if(enableDevMap["log"])
-                {
-                    std::cout << "eyetracking  " << eyetracking.images[0].width << "x" << eyetracking.images[0].height << "@" << std::round(fc.fps()) << "fps"
-                        << std::endl;
-                }
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("eyetracking");
+            if(enableDevMap["log"] && limit.allow())
+            {
+                s_log.frame(id, eyetracking.hostTimestamp, fc.fps(), eyetracking.images[0].width, eyetracking.images[0].height);
             }
         });
     }
@@ -921,111 +886,125 @@ int main( int argc, char* argv[] ) try
     //Display in thread to not slow down callbacks
 
     if (device->colorCamera()) {
-        device->colorCamera()->registerCallback( [&device](xv::ColorImage const & im){
+        JpegDecodePool::Options jpegOptions;
+#ifndef USE_EX
+        jpegOptions.scale = 4; // DCT-scaled decode at the preview size
+#endif
+        s_jpegPool.reset(new JpegDecodePool([](JpegDecodePool::Frame const& f) {
+            s_rgbJpeg.publish(f.image);
+        }, jpegOptions));
 #ifdef USE_EX
-
-        auto rgb = im.toRgb();
-        std::shared_ptr<std::uint8_t> data(new std::uint8_t[rgb.width*rgb.height], std::default_delete<std::uint8_t[]>());
-        for (std::size_t i=0; i < rgb.width*rgb.height; ++i) {
-            data.get()[i] = 0.299*rgb.data.get()[3*i]+0.587*rgb.data.get()[3*i+1]+0.114*rgb.data.get()[3*i+2];
-        }
-        xv::GrayScaleImage img;
-        img.width = rgb.width;
-        img.height = rgb.height;
-        img.data = data;
-        xv::AprilTagDetector rgbDetector("36h11");
-        auto t0 = std::chrono::steady_clock::now();
-        s_mtx_rgb_tags.lock();
-        s_rgb_tags = rgbDetector.detect(img);
-        s_rgb_gray = img;
-        s_mtx_rgb_tags.unlock();
-        auto t1 = std::chrono::steady_clock::now();
-        static auto tLast = t0 - std::chrono::milliseconds(500);
-        if (t0 >= tLast+std::chrono::milliseconds(500)) {
-            tLast = t0;
-            if(enableDevMap["log"])
-            {
-                std::cout << "RGB tag detection: " << s_rgb_tags.size() << " in " << std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count()*1e-3 << " ms" << std::endl;
+        RgbTagStage::Options tagOptions;
+        tagOptions.workers = 2;
+        s_rgbTagStage.reset(new RgbTagStage([]() -> RgbTagStage::Detector {
+            // one detector per worker, created once instead of for every frame
+            auto detector = std::make_shared<xv::AprilTagDetector>("36h11");
+            return [detector](xv::ColorImage const& im) {
+                auto rgb = im.toRgb();
+                std::shared_ptr<std::uint8_t> data(new std::uint8_t[rgb.width*rgb.height], std::default_delete<std::uint8_t[]>());
+                for (std::size_t i=0; i < rgb.width*rgb.height; ++i) {
+                    data.get()[i] = 0.299*rgb.data.get()[3*i]+0.587*rgb.data.get()[3*i+1]+0.114*rgb.data.get()[3*i+2];
+                }
+                xv::GrayScaleImage img;
+                img.width = rgb.width;
+                img.height = rgb.height;
+                img.data = data;
+                return detector->detect(img);
+            };
+        }, [](RgbTagStage::Detection const& d) {
+            s_rgb_tags.publish(d.result);
+            static auto tLast = std::chrono::steady_clock::now() - std::chrono::milliseconds(500);
+            auto t0 = std::chrono::steady_clock::now();
+            if (t0 >= tLast+std::chrono::milliseconds(500)) {
+                tLast = t0;
+                if(enableDevMap["log"])
+                {
+                    std::cout << "RGB tag detection: " << d.result.size() << " in " << d.latency*1e3 << " ms, "
+                              << s_rgbTagStage->skipped() << " frames skipped" << std::endl;
+                }
             }
-        }
+        }, tagOptions));
+#endif
+        device->colorCamera()->registerCallback( [&device](xv::ColorImage const & im){
+        TraceScope trace("publish", "rgb", im.edgeTimestampUs);
+#ifdef USE_EX
+        s_rgbTagStage->submit(im);
 #endif
-        s_mtx_rgb.lock();
-        s_rgb = std::make_shared<xv::ColorImage>(im);
-        s_mtx_rgb.unlock();
+        if (im.codec == xv::ColorImage::Codec::JPEG) {
+            s_jpegPool->submit(im);
+        } else {
+            s_rgb.publish(im);
+        }
         });
     }
     if(enableDevMap["rgb2"]){
         if (device->colorCamera()) {
             device->colorCamera()->registerCam2Callback( [&device](xv::ColorImage const & im){
-            s_mtx_rgb2.lock();
-            s_rgb2 = std::make_shared<xv::ColorImage>(im);
-            s_mtx_rgb2.unlock();
+            s_rgb2.publish(im);
             });
         }
     }
     if (enableDevMap["fisheye"]) {
+#ifdef USE_EX
+        auto fisheyeEx = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras());
+        s_fisheyeTagStage.reset(new FisheyeTagStage([fisheyeEx]() -> FisheyeTagStage::Detector {
+            return [fisheyeEx](xv::FisheyeImages const& stereo) { return fisheyeEx->detectTags(stereo.images[0], "36h11"); };
+        }, [](FisheyeTagStage::Detection const& d) {
+            s_tags.publish(d.result);
+        }));
+#endif
         device->fisheyeCameras()->registerCallback( [&device](xv::FisheyeImages const & stereo){
-        s_mtx_stereo.lock();
-        s_stereo = std::make_shared<xv::FisheyeImages>(stereo);
-        s_mtx_stereo.unlock();
+        TraceScope trace("publish", "stereo", stereo.edgeTimestampUs);
+        s_stereo.publish(stereo);
 #ifdef USE_EX
-        s_mtx_tags.lock();
-        auto tags = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->detectTags(stereo.images[0], "36h11");
-        s_tags = std::make_shared<std::vector<std::pair<int,std::array<xv::Vector2d,4>>>>(tags);
-        s_mtx_tags.unlock();
+        s_fisheyeTagStage->submit(stereo);
 #endif
         });
         if(enableDevMap["Dewarp"])
         {
             device->fisheyeCameras()->registerAntiDistortionCallback( [&device](xv::FisheyeImages const & stereo){
-            s_mtx_stereoDewarp.lock();
-            s_stereoDewarp = std::make_shared<xv::FisheyeImages>(stereo);
-            s_mtx_stereoDewarp.unlock();
+            s_stereoDewarp.publish(stereo);
             });
         }
 #ifdef USE_EX
         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->registerKeyPointsCallback([](const xv::FisheyeKeyPoints<2,32>& keypoints){
-        s_mtx_stereo.lock();
-        s_keypoints = std::make_shared<xv::FisheyeKeyPoints<2,32>>(keypoints);
-        s_mtx_stereo.unlock();
+        s_keypoints.publish(keypoints);
         });
         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->registerKeyPointsCallback([](const xv::FisheyeKeyPoints<4,32>& keypoints){
-        s_mtx_stereo.lock();
-        s_keypoints4cam = std::make_shared<xv::FisheyeKeyPoints<4,32>>(keypoints);
-        s_mtx_stereo.unlock();
+        s_keypoints4cam.publish(keypoints);
         });
 #endif
     }
     if (enableDevMap["tof"]) {
         device->tofCamera()->registerCallback([](xv::DepthImage const & tof){
+            TraceScope trace("publish", tof.type == xv::DepthImage::Type::IR ? "tof IR" : "tof", tof.edgeTimestampUs);
             if (tof.type == xv::DepthImage::Type::Depth_16 || tof.type == xv::DepthImage::Type::Depth_32) {
-                std::lock_guard<std::mutex> l(s_mtx_tof);
-                s_tof = std::make_shared<xv::DepthImage>(tof);
+                s_tof.publish(tof);
             } else if (tof.type ==  xv::DepthImage::Type::IR) {
-                auto ir = std::make_shared<xv::GrayScaleImage>();
-                ir->width = tof.width;
-                ir->height = tof.height;
-                ir->data = tof.data;
-                std::lock_guard<std::mutex> l(s_mtx_ir);
-                s_ir = ir;
+                xv::GrayScaleImage ir;
+                ir.width = tof.width;
+                ir.height = tof.height;
+                ir.data = tof.data;
+                s_ir.publish(std::move(ir));
             }
         });
 
         device->slam()->registerTofPlanesCallback([] (std::shared_ptr<const std::vector<xv::Plane>> planes) {
-            static FpsCount fc;
+            static StreamStats fc;
             if (!planes) return;
             fc.tic();
-            if(enableDevMap["log"])
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("ToF-planes");
+            if(enableDevMap["log"] && limit.allow())
             {
-                std::cout << "ToF-planes update (#" << planes->size() << " planes" << std::endl;
+                const double v[] = {static_cast<double>(planes->size()), fc.fps()};
+                s_log.values(id, "planes fps", v, 2);
             }
         });
 
         //std::dynamic_pointer_cast<xv::TofCameraEx>(device->tofCamera())->registerColorDepthImageCallback([](const xv::DepthColorImage& depthColor){
         device->tofCamera()->registerColorDepthImageCallback([](const xv::DepthColorImage& depthColor){
-            s_mtx_depthColor.lock();
-            s_depthColor = std::make_shared<xv::DepthColorImage>(depthColor);
-            s_mtx_depthColor.unlock();
+            s_depthColor.publish(depthColor);
         });
     }
     if(enableDevMap["sgbm"])
@@ -1033,9 +1012,7 @@ int main( int argc, char* argv[] ) try
         device->sgbmCamera()->registerCallback([](const xv::SgbmImage& sgbm_image){
             if(sgbm_image.type == xv::SgbmImage::Type::Depth)
             {
-                s_mtx_sgbm.lock();
-                s_ptr_sgbm = std::make_shared<const xv::SgbmImage>(sgbm_image);
-                s_mtx_sgbm.unlock();
+                s_ptr_sgbm.publish(sgbm_image);
             }
         });
         device->sgbmCamera()->start(global_config);
@@ -1043,10 +1020,49 @@ int main( int argc, char* argv[] ) try
 
     if (enableDevMap["eyetracking"]) {
         device->eyetracking()->registerCallback([] (xv::EyetrackingImage const & eyetracking) {
-            s_mtx_eyetracking.lock();
-            s_eyetracking = std::make_shared<xv::EyetrackingImage>(eyetracking);
-            s_mtx_eyetracking.unlock();
+            s_eyetracking.publish(eyetracking);
+        });
+    }
+
+    DisplayService::Options displayOptions;
+    displayOptions.headless = enableDevMap["headless"];
+    s_display.reset(new DisplayService(displayOptions));
+    addDisplayStreams(*s_display);
+    if (displayOptions.headless) {
+#ifdef USE_SHM
+        // the mosaic is published as a JPEG color track, see shm_client --prefix all_stream rgb
+        ShmPublisher::Options shmOptions;
+        shmOptions.prefix = "all_stream";
+        shmOptions.imageSlots = 4;
+        shmOptions.slotHeadroom = 3.; // JPEG size depends on the content of the mosaic
+        std::shared_ptr<ShmPublisher> mosaicPublisher = std::make_shared<ShmPublisher>(shmOptions);
+        std::shared_ptr<std::vector<uchar>> mosaicJpeg = std::make_shared<std::vector<uchar>>();
+        s_display->setMosaicCallback([mosaicPublisher, mosaicJpeg](cv::Mat const& mosaic) {
+            if (!cv::imencode(".jpg", mosaic, *mosaicJpeg))
+                return;
+            xv::ColorImage im;
+            im.codec = xv::ColorImage::Codec::JPEG;
+            im.width = mosaic.cols;
+            im.height = mosaic.rows;
+            im.data = std::shared_ptr<const std::uint8_t>(mosaicJpeg, mosaicJpeg->data());
+            im.dataSize = mosaicJpeg->size();
+            im.hostTimestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            im.edgeTimestampUs = static_cast<std::int64_t>(im.hostTimestamp * 1e6);
+            if (!xvrecAppend(*mosaicPublisher, im) && !mosaicPublisher->error().empty()) {
+                static bool reported = false;
+                if (!reported) {
+                    reported = true;
+                    std::cerr << "Cannot publish the mosaic: " << mosaicPublisher->error() << std::endl;
+                }
+            }
         });
+        std::cout << "Headless: mosaic published to " << shmRingName(shmOptions.prefix, XvRecTrack::Color) << std::endl;
+#else
+        s_display->setMosaicCallback([](cv::Mat const& mosaic) {
+            cv::imwrite("all_stream_mosaic.jpg", mosaic);
+        });
+        std::cout << "Headless: mosaic written to all_stream_mosaic.jpg" << std::endl;
+#endif
     }
 
     s_stop = false;
@@ -1054,29 +1070,27 @@ int main( int argc, char* argv[] ) try
 
 #else
 #ifdef USE_EX
-    s_stop = false;
-    std::thread t([&device,&tagDetectorId](){
-        while (!s_stop) {
-            auto t0 = std::chrono::steady_clock::now();
-            std::this_thread::sleep_until(t0 + std::chrono::milliseconds(25));
-            if (!tagDetectorId.empty()) {
-                auto detections = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->getTagDetections(tagDetectorId);
-                if (!detections.empty())
-                    std::cout << "Tag detections: ";
-                for (auto const& d : detections) {
-                    auto const& pose = d.second;
-                    auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                    if(enableDevMap["log"])
-                    {
-                        std::cout << "id=" << d.first
-                              << " (" << pose.x() << "," << pose.y() << "," << pose.z() << ","
-                              << pitchYawRoll[0]*180/M_PI << "," << pitchYawRoll[1]*180/M_PI << "," << pitchYawRoll[2]*180/M_PI << ") " << pose.confidence() << std::endl;
-                    }
-                }
+    // The SDK tag detector runs on its own, its latest detections are read when a new frame
+    // arrived, at most once per second, rather than every 25 ms. They are not computed on that frame.
+    int tagCallbackId = -1;
+    if (!tagDetectorId.empty()) {
+        auto fisheyeEx = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras());
+        tagCallbackId = device->fisheyeCameras()->registerCallback([fisheyeEx, tagDetectorId](xv::FisheyeImages const&) {
+            static LogRateLimiter limit;
+            static const std::uint16_t id = s_log.stream("fisheye tag");
+            if (!enableDevMap["log"] || !limit.allow())
+                return;
+            for (auto const& d : fisheyeEx->getTagDetections(tagDetectorId)) {
+                auto const& pose = d.second;
+                auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
+                char label[16];
+                std::snprintf(label, sizeof(label), "id=%d", static_cast<int>(d.first));
+                const double v[] = {pose.x(), pose.y(), pose.z(), pitchYawRoll[0]*180/M_PI, pitchYawRoll[1]*180/M_PI,
+                                    pitchYawRoll[2]*180/M_PI, pose.confidence()};
+                s_log.values(id, label, v, 7);
             }
-
-        }
-    });
+        });
+    }
 #endif
 #endif
 
@@ -1088,6 +1102,9 @@ int main( int argc, char* argv[] ) try
     if (!tagDetectorId.empty()) {
         std::cerr << "ENTER to stop tag detection" << std::endl;
         std::cin.get();
+#ifndef USE_OPENCV_
+        device->fisheyeCameras()->unregisterCallback(tagCallbackId);
+#endif
         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->stopTagDetector(tagDetectorId);
     }
     std::string getkey;
@@ -1101,6 +1118,9 @@ int main( int argc, char* argv[] ) try
         else
             std::cerr << "ENTER 'f' to switch FE to MEDIUM res" << std::endl;
 
+        if (FrameTrace::enabled())
+            std::cerr << "ENTER 't' to write the latency trace" << std::endl;
+
         if(sgbm_ctl == true){
             std::cerr << "ENTER 's' to stop SGBM to res" << std::endl;
             std::cerr << "ENTER 'r' to modify SGBM resolution" << std::endl;
@@ -1144,6 +1164,10 @@ int main( int argc, char* argv[] ) try
                 std::cout << "device->sgbmCamera()->setSgbmResolution failed"<<std::endl;
             }
         }
+        else if(getkey == "t")
+        {
+            dumpTrace();
+        }
         else if(getkey == "q")
         {
             break;
@@ -1199,11 +1223,27 @@ int main( int argc, char* argv[] ) try
 
 #ifdef USE_OPENCV_
     s_stop = true;
+    s_display->stop();
     if (t.joinable()) {
         t.join();
     }
+    std::cout << "display: " << s_display->rendered() << " renders, " << s_display->mosaics() << " mosaics" << std::endl;
+#ifdef USE_EX
+    // the cameras are stopped: wait for the detections in progress
+    s_rgbTagStage.reset();
+    s_fisheyeTagStage.reset();
+#endif
+#endif
+    tofRecorder.reset(); // writes the point clouds still queued
+    if (FrameTrace::enabled()) {
+        dumpTrace();
+    }
+#ifdef USE_OPENCV_
+    // after the first frames of each size, the converters should not allocate anymore
+    FramePool::Stats pool = FramePool::global().stats();
+    std::cout << "frame pool: " << pool.allocations << " allocations, " << pool.reuses << " reuses, "
+              << pool.cachedBytes / 1024 << " KiB cached" << std::endl;
 #endif
-    ofs.close();
     return EXIT_SUCCESS;
 }
 catch( const std::exception &e){
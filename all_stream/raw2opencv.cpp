@@ -3,6 +3,10 @@
 
 #include <cstring>
 #include "colors.h"
+#include "depth_colorizer.h"
+#include "rgbd_unpack.h"
+#include "pooled_mat_allocator.h"
+#include "yuv_to_bgr.h"
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -20,54 +24,62 @@ static double depth_min_distance_m = 0.1;
 
 static bool stretch_disparity = true;
 
-cv::Mat raw_to_opencv(std::shared_ptr<const xv::ColorImage> rgb)
+// Depth_16/IR ranges: maybe 7494,2494,1498,1249 see mode_manage.h in sony toflib
+static const DepthColorizer s_colorizer(colors, 7.5f, 2494.0f);
+
+/**
+ * Converts `rgb` into `out`, downscaled by `scale` (1, 2 or 4) in the same pass. `out` is
+ * only reallocated when the size changes, so passing the same Mat every frame reuses it.
+ */
+void raw_to_opencv(std::shared_ptr<const xv::ColorImage> rgb, cv::Mat& out, int scale)
 {
-    cv::Mat img;
+    const int width = static_cast<int>(rgb->width), height = static_cast<int>(rgb->height);
+    YuvLayout layout;
     switch (rgb->codec) {
-    case xv::ColorImage::Codec::YUV420p: {
-        img = cv::Mat::zeros(rgb->height, rgb->width, CV_8UC3);
-        auto raw = rgb->data.get();
-        auto rawImg = cv::Mat(rgb->height * 3 / 2, rgb->width, CV_8UC1, const_cast<unsigned char*>(raw));
-        cv::cvtColor(rawImg, img, cv::COLOR_YUV2BGR_I420);
-        break;
+    case xv::ColorImage::Codec::YUV420p: layout = YuvLayout::I420; break;
+    case xv::ColorImage::Codec::NV12: layout = YuvLayout::NV12; break;
+    case xv::ColorImage::Codec::YUYV: layout = YuvLayout::YUYV; break;
+    case xv::ColorImage::Codec::JPEG: {
+        // libjpeg scales while decoding (IMREAD_REDUCED_COLOR_*)
+        cv::Mat raw(1, static_cast<int>(rgb->dataSize), CV_8UC1, const_cast<unsigned char*>(rgb->data.get()));
+        const int flags = scale == 4 ? cv::IMREAD_REDUCED_COLOR_4 : (scale == 2 ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_COLOR);
+        cv::imdecode(raw, flags, &out);
+        return;
     }
-    case xv::ColorImage::Codec::YUYV: {
-        img = cv::Mat::zeros(rgb->height, rgb->width, CV_8UC3);
-        auto raw = rgb->data.get();
-        auto rawImg = cv::Mat(rgb->height, rgb->width, CV_8UC2, const_cast<unsigned char*>(raw));
-        cv::cvtColor(rawImg, img, cv::COLOR_YUV2BGR_YUYV);
-        break;
+    default:
+        out.release();
+        return;
     }
-    case xv::ColorImage::Codec::JPEG: {
-        cv::Mat raw(1, rgb->width*rgb->height, CV_8UC1, const_cast<unsigned char*>(rgb->data.get()));
-        img = cv::imdecode(raw, cv::IMREAD_COLOR);
-        break;
+    if (!rgb->data || rgb->dataSize < yuvFrameSize(layout, width, height)) {
+        out.release();
+        return;
     }
+    out.create(yuvScaledSize(height, scale), yuvScaledSize(width, scale), CV_8UC3);
+    if (!yuvToBgr(layout, rgb->data.get(), width, height, scale, out.data, out.step)) {
+        out.release();
     }
+}
+
+cv::Mat raw_to_opencv(std::shared_ptr<const xv::ColorImage> rgb)
+{
+    cv::Mat img;
+    img.allocator = PooledMatAllocator::global();
+    raw_to_opencv(rgb, img, 1);
     return img;
 }
 
 cv::Mat raw_to_opencv_tof_ir(xv::GrayScaleImage const& tof_ir) {
-    cv::Mat out;
-    out = cv::Mat::zeros(tof_ir.height, tof_ir.width, CV_8UC3);
-    float dmax = 2191/4;
-    auto tmp_d = reinterpret_cast<short const*>(tof_ir.data.get());
-    for (unsigned int i=0; i< tof_ir.height*tof_ir.width; i++) {
-        short d = tmp_d[i];
-//        unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
-//        if( u < 15 )
-//            u = 0;
-        const auto &cc = colors.at(d);
-        out.at<cv::Vec3b>( i/tof_ir.width, i%tof_ir.width ) = cv::Vec3b(cc.at(2), cc.at(1),cc.at(0) );
-        /*short u = tof->ir.get()[i];
-                cvtof.at<cv::Vec3b>( i/tof->width, i%tof->width ) = cv::Vec3s(u*255/2191,u*255/2191,u*255/2191);*/
+    cv::Mat out = pooledMat(tof_ir.height, tof_ir.width, CV_8UC3);
+    auto tmp_d = reinterpret_cast<std::int16_t const*>(tof_ir.data.get());
+    for (int r = 0; r < out.rows; r++) {
+        s_colorizer.colorizeIrRaw(tmp_d + r * tof_ir.width, tof_ir.width, out.ptr<std::uint8_t>(r));
     }
     return out;
 }
 
 cv::Mat raw_to_opencv_tof_ir_grey(xv::GrayScaleImage const& tof_ir) {
-    cv::Mat out;
-    out = cv::Mat::zeros(tof_ir.height, tof_ir.width, CV_8UC3);
+    // every pixel is written
+    cv::Mat out = pooledMat(tof_ir.height, tof_ir.width, CV_8UC3);
     float dmax = 2191/4;
     auto tmp_d = reinterpret_cast<short const*>(tof_ir.data.get());
     for (unsigned int i=0; i< tof_ir.height*tof_ir.width; i++) {
@@ -82,97 +94,75 @@ cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthImage> tof)
 {
     cv::Mat out;
     if (tof->height>0 && tof->width>0) {
-        out = cv::Mat::zeros(tof->height, tof->width, CV_8UC3);
+        const auto width = tof->width;
         if (tof->type == xv::DepthImage::Type::Depth_32) {
-            float dmax = 7.5;
+            out = pooledMat(tof->height, tof->width, CV_8UC3);
             const auto tmp_d = reinterpret_cast<float const*>(tof->data.get());
-            for (unsigned int i=0; i< tof->height*tof->width; i++) {
-                const auto &d = tmp_d[i];
-                if( d < 0.01 || d > 9.9 ) {
-                    out.at<cv::Vec3b>(i / tof->width, i % tof->width) = 0;
-                } else {
-                    unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
-                    const auto &cc = colors.at(u);
-                    out.at<cv::Vec3b>( i/tof->width, i%tof->width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
-                }
+            for (int r = 0; r < out.rows; r++) {
+                s_colorizer.colorizeDepth32(tmp_d + r * width, width, out.ptr<std::uint8_t>(r));
             }
         } else if (tof->type == xv::DepthImage::Type::Depth_16) {
-            // #define DEPTH_RANGE_20M_SF       7494  //7.494m
-            // #define DEPTH_RANGE_60M_SF       2494  //2.494m
-            // #define DEPTH_RANGE_100M_SF      1498  //1.498m
-            // #define DEPTH_RANGE_120M_SF      1249  //1.249m
-            float dmax = 2494.0; // maybe 7494,2494,1498,1249 see mode_manage.h in sony toflib
             const auto tmp_d = reinterpret_cast<int16_t const*>(tof->data.get());
-            for (unsigned int i=0; i< tof->height*tof->width; i++) {
-                const auto &d = tmp_d[i];
-                unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
-                const auto &cc = colors.at(u);
-                out.at<cv::Vec3b>( i/tof->width, i%tof->width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
+            out = pooledMat(tof->height, tof->width, CV_8UC3);
+            for (int r = 0; r < out.rows; r++) {
+                s_colorizer.colorizeDepth16(tmp_d + r * width, width, out.ptr<std::uint8_t>(r));
             }
         } else if( tof->type == xv::DepthImage::Type::IR ){
-            out = cv::Mat::zeros(tof->height, tof->width, CV_8UC3);
-            float dmax = 2494.0; // maybe 7494,2494,1498,1249 see mode_manage.h in sony toflib
+            out = pooledMat(tof->height, tof->width, CV_8UC3);
             auto tmp_d = reinterpret_cast<unsigned short const*>(tof->data.get());
-            for (unsigned int i=0; i< tof->height*tof->width; i++) {
-                unsigned short d = tmp_d[i];
-                unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
-                if( u < 15 )
-                    u = 0;
-                const auto &cc = colors.at(u);
-                out.at<cv::Vec3b>( i/tof->width, i%tof->width ) = cv::Vec3b(cc.at(2), cc.at(1),cc.at(0) );
-                /*short u = tof->ir.get()[i];
-                cvtof.at<cv::Vec3b>( i/tof->width, i%tof->width ) = cv::Vec3s(u*255/2191,u*255/2191,u*255/2191);*/
+            for (int r = 0; r < out.rows; r++) {
+                s_colorizer.colorizeIr(tmp_d + r * width, width, out.ptr<std::uint8_t>(r));
             }
+        } else {
+            out = pooledMat(tof->height, tof->width, CV_8UC3);
+            out.setTo(cv::Scalar::all(0));
         }
     }
     return out;
 }
 
 
-std::pair<cv::Mat,cv::Mat> raw_to_opencv(std::shared_ptr<const xv::FisheyeImages> stereo)
+/**
+ * 8-bit gray image to a pooled BGR Mat, black if it has no data (`height` x `width` if
+ * its size is not set either)
+ */
+cv::Mat gray_to_opencv(xv::GrayScaleImage const& gray, int height = 400, int width = 640)
 {
-    auto const& leftInput = stereo->images[0];
-    auto const& rightInput = stereo->images[1];
-    cv::Mat left = cv::Mat::zeros(leftInput.height, leftInput.width, CV_8UC1);
-    cv::Mat right = cv::Mat::zeros(rightInput.height, rightInput.width, CV_8UC1);
-
-    if( leftInput.data != nullptr ){
-        std::memcpy(left.data, leftInput.data.get(), static_cast<size_t>(left.rows*left.cols));
+    if (gray.data == nullptr || gray.width == 0 || gray.height == 0) {
+        cv::Mat out = pooledMat(gray.height ? static_cast<int>(gray.height) : height,
+                                gray.width ? static_cast<int>(gray.width) : width, CV_8UC3);
+        out.setTo(cv::Scalar::all(0));
+        return out;
     }
-    if( rightInput.data != nullptr ){
-        std::memcpy(right.data, rightInput.data.get(), static_cast<size_t>(right.rows*right.cols));
-    }
-
-    cv::cvtColor(left, left, cv::COLOR_GRAY2BGR);
-    cv::cvtColor(right, right, cv::COLOR_GRAY2BGR);
-
-    return {left, right};
+    // converted straight from the SDK buffer, no intermediate gray copy
+    const int rows = static_cast<int>(gray.height), cols = static_cast<int>(gray.width);
+    const cv::Mat in(rows, cols, CV_8UC1, const_cast<std::uint8_t*>(gray.data.get()));
+    cv::Mat out = pooledMat(rows, cols, CV_8UC3);
+    cv::cvtColor(in, out, cv::COLOR_GRAY2BGR);
+    return out;
 }
 
-cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthColorImage> rgbd)
+std::pair<cv::Mat,cv::Mat> raw_to_opencv(std::shared_ptr<const xv::FisheyeImages> stereo)
 {
-    cv::Mat out;
-    out = cv::Mat::zeros(rgbd->height, rgbd->width*2, CV_8UC3);
-    auto w = rgbd->width;
+    return {gray_to_opencv(stereo->images[0]), gray_to_opencv(stereo->images[1])};
+}
 
-    if (rgbd->height>0 && rgbd->width>0) {
-        float dmax = 7.5;
-        const auto tmp_d = reinterpret_cast<std::uint8_t const*>(rgbd->data.get()+3);
-        for (unsigned int i=0; i< rgbd->height*rgbd->width; i++) {
-            const auto &d = *reinterpret_cast<float const*>(tmp_d + i*(3+sizeof(float)));
-            if( d < 0.01 || d > 9.9 ) {
-                out.at<cv::Vec3b>(i / w, i % rgbd->width) = 0;
-            } else {
-                unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
-                const auto &cc = colors.at(u);
-                out.at<cv::Vec3b>( i/ w, i%rgbd->width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
-            }
-        }
-        const auto tmp_rgb = reinterpret_cast<std::uint8_t const*>(rgbd->data.get());
-        for (unsigned int i=0; i< rgbd->height*rgbd->width; i++) {
-            const auto rgb = reinterpret_cast<std::uint8_t const*>(tmp_rgb + i*(3+sizeof(float)));
-            out.at<cv::Vec3b>( i/ w, (i%rgbd->width) + rgbd->width) = cv::Vec3b(rgb[2], rgb[1], rgb[0]);
-        }
+/**
+ * Unpacks `rgbd` into `planes` (kept for later stages) and returns the colorized depth
+ * next to the color image.
+ */
+cv::Mat raw_to_opencv( std::shared_ptr<const xv::DepthColorImage> rgbd, RgbdPlanes& planes)
+{
+    const int width = static_cast<int>(rgbd->width), height = static_cast<int>(rgbd->height);
+    cv::Mat out = pooledMat(height, width * 2, CV_8UC3);
+    if (!planes.unpack(rgbd->data.get(), rgbd->dataSize, width, height, RgbdColorOrder::Rgb)) {
+        out.setTo(cv::Scalar::all(0));
+        return out;
+    }
+    for (int r = 0; r < height; r++) {
+        std::uint8_t* row = out.ptr<std::uint8_t>(r);
+        s_colorizer.colorizeDepth32(planes.depth.data() + r * width, width, row);
+        std::memcpy(row + 3 * width, planes.bgr.data() + 3 * r * width, 3 * width);
     }
     return out;
 }
@@ -192,18 +182,9 @@ static std::tuple<int, int, int> color(double distance, double distance_min, dou
     return std::tuple<int, int, int>(r, g, b);
 }
 
-static std::shared_ptr<unsigned char> depthImage(uint16_t *data, unsigned int width, unsigned int height, double min_distance_m, double max_distance_m, bool colorize)
+/// Writes the colorized (CV_8UC3) or gray (CV_8UC1) depth into `out`
+static void depthImage(uint16_t const *data, unsigned int width, unsigned int height, double min_distance_m, double max_distance_m, bool colorize, unsigned char *out)
 {
-    std::shared_ptr<unsigned char> out;
-    if (colorize)
-    {
-        out = std::shared_ptr<unsigned char>(new unsigned char[width * height * 3], std::default_delete<unsigned char[]>());
-    }
-    else
-    {
-        out = std::shared_ptr<unsigned char>(new unsigned char[width * height], std::default_delete<unsigned char[]>());
-    }
-
     for (unsigned int i = 0; i < width * height; i++)
     {
         double distance_mm = data[i];
@@ -212,9 +193,9 @@ static std::shared_ptr<unsigned char> depthImage(uint16_t *data, unsigned int wi
             double distance_m = distance_mm / 1000.;
 
             auto c = color(distance_m, min_distance_m, max_distance_m, min_distance_m);
-            out.get()[i * 3 + 0] = static_cast<unsigned char>(std::get<2>(c));
-            out.get()[i * 3 + 1] = static_cast<unsigned char>(std::get<1>(c));
-            out.get()[i * 3 + 2] = static_cast<unsigned char>(std::get<0>(c));
+            out[i * 3 + 0] = static_cast<unsigned char>(std::get<2>(c));
+            out[i * 3 + 1] = static_cast<unsigned char>(std::get<1>(c));
+            out[i * 3 + 2] = static_cast<unsigned char>(std::get<0>(c));
         }
         else
         {
@@ -225,15 +206,14 @@ static std::shared_ptr<unsigned char> depthImage(uint16_t *data, unsigned int wi
 
             double norm = (distance_mm - min_distance_mm) / (max_distance_mm - min_distance_mm);
             auto c = 255. * norm;
-            out.get()[i] = static_cast<unsigned char>(c);
+            out[i] = static_cast<unsigned char>(c);
         }
     }
-
-    return out;
 }
+
 cv::Mat convDepthToMat(std::shared_ptr<const xv::SgbmImage> sgbm_image,bool _colorize_depth)
 {
-    uint16_t* p16 = (uint16_t*)sgbm_image->data.get();
+    uint16_t const* p16 = reinterpret_cast<uint16_t const*>(sgbm_image->data.get());
 
     // cv::Mat mask;
     // cv::Mat im_gray_d = cv::Mat(cv::Size(sgbm_image->width, sgbm_image->height),  CV_16UC1, p16); //18
@@ -247,20 +227,12 @@ cv::Mat convDepthToMat(std::shared_ptr<const xv::SgbmImage> sgbm_image,bool _col
     min_distance_m = depth_min_distance_m;
     assert(max_distance_m > min_distance_m);
 
-    static std::shared_ptr<unsigned char> tmp;
-    tmp = depthImage(p16, sgbm_image->width, sgbm_image->height, min_distance_m, max_distance_m, !!_colorize_depth);
-    if (_colorize_depth)
-    {
-        cv::Mat im_col(cv::Size(sgbm_image->width, sgbm_image->height), CV_8UC3, tmp.get());
-        // cv::Mat roi = cv::Mat::zeros(cv::Size(sgbm_image->width, sgbm_image->height), CV_8UC3);
-        // im_col.copyTo(roi,mask);
-        return im_col;
-    }
-    else
-    {
-        cv::Mat im_col(cv::Size(sgbm_image->width, sgbm_image->height), CV_8UC1, tmp.get());
-        return im_col;
-    }
+    // a new buffer per call: the Mat returned before stays valid and two threads may convert
+    cv::Mat im_col = pooledMat(sgbm_image->height, sgbm_image->width, _colorize_depth ? CV_8UC3 : CV_8UC1);
+    depthImage(p16, sgbm_image->width, sgbm_image->height, min_distance_m, max_distance_m, !!_colorize_depth, im_col.data);
+    // cv::Mat roi = cv::Mat::zeros(cv::Size(sgbm_image->width, sgbm_image->height), CV_8UC3);
+    // im_col.copyTo(roi,mask);
+    return im_col;
 }
 
 static void stretchDisparityRange(cv::Mat &frame, int disp)
@@ -287,19 +259,20 @@ static void stretchDisparityRange(cv::Mat &frame, int disp)
 
 cv::Mat convdispToMat(std::shared_ptr<const xv::SgbmImage> sbgm_image, bool col_map)
 {
-    cv::Mat im_gray;
-
-    im_gray = cv::Mat(cv::Size(sbgm_image->width, sbgm_image->height), CV_8UC1, const_cast<uint8_t*>(sbgm_image->data.get()));
+    cv::Mat im_gray(cv::Size(sbgm_image->width, sbgm_image->height), CV_8UC1, const_cast<uint8_t*>(sbgm_image->data.get()));
 
     if (stretch_disparity)
     {
-        //for better visualization
+        //for better visualization, on a copy: the SDK buffer may be shared with other callbacks
+        cv::Mat stretched = pooledMat(im_gray.rows, im_gray.cols, CV_8UC1);
+        im_gray.copyTo(stretched);
+        im_gray = stretched;
         stretchDisparityRange(im_gray, 96);
     }
 
     if (col_map)
     {
-        cv::Mat im_col(cv::Size(sbgm_image->width, sbgm_image->height), CV_8UC3);
+        cv::Mat im_col = pooledMat(sbgm_image->height, sbgm_image->width, CV_8UC3);
         applyColorMap(im_gray, im_col, cv::COLORMAP_JET);
         return im_col;
     }
@@ -0,0 +1,144 @@
+// Measures the callback-side cost of one log record: the former std::cout line with
+// timeShowStr() and std::endl, against AsyncLog::frame() and LogRateLimiter::allow().
+// Both write to /dev/null so the terminal speed does not enter the figures. The ring holds
+// a whole round of records and is drained between the rounds, so the AsyncLog figures are
+// those of records actually enqueued, not of the drop path.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_log.h"
+#include "bench_util.hpp"
+
+namespace {
+
+// --- former implementation (all_stream.cpp), kept verbatim as the baseline ---
+
+std::string timeShowStr(std::int64_t edgeTimestampUs, double hostTimestamp) {
+    char s[1024];
+    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()*1e-6;
+    std::sprintf(s, " (device=%lld host=%.4f now=%.4f delay=%.4f) ", (long long)edgeTimestampUs, hostTimestamp, now, now-hostTimestamp);
+    return std::string(s);
+}
+
+const int kRecords = 20000;
+
+// `dropped` in %: records refused because the ring was full, 0 unless the writer fell behind
+void printRow(const char* name, double secondsPerRecord, double baselineSeconds, double dropped)
+{
+    std::printf("%-36s %12.1f %12.2f %9.2fx %9.1f%%\n", name, secondsPerRecord * 1e9, 1e-6 / secondsPerRecord,
+                baselineSeconds / secondsPerRecord, dropped);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Time per record with `threads` producers each logging kRecords frames per round
+ *
+ * The clock starts once the producers are created and waiting, and stops when the last one
+ * is done; the ring is drained (flush) outside of the timed region.
+ */
+double runAsync(AsyncLog& log, int threads)
+{
+    std::vector<std::uint16_t> ids;
+    for (int t = 0; t < threads; ++t) {
+        ids.push_back(log.stream("rgb" + std::to_string(t)));
+    }
+    double elapsed = 0;
+    long long rounds = 0;
+    for (int round = -1; elapsed < 0.5; ++round) {
+        std::atomic<int> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<Clock::time_point> end(threads);
+        std::vector<std::thread> producers;
+        for (int t = 0; t < threads; ++t) {
+            producers.emplace_back([&, t] {
+                ++ready;
+                while (!go.load()) {
+                }
+                for (int i = 0; i < kRecords; ++i) {
+                    log.frame(ids[t], i * 33333, i / 30.0, 30.0, 1920, 1080);
+                }
+                end[t] = Clock::now();
+            });
+        }
+        while (ready.load() < threads) {
+        }
+        const Clock::time_point t0 = Clock::now();
+        go = true;
+        for (auto& p : producers) {
+            p.join();
+        }
+        log.flush();
+        // the first round is a warm-up
+        if (round >= 0) {
+            Clock::time_point last = t0;
+            for (auto const& e : end) {
+                last = std::max(last, e);
+            }
+            elapsed += std::chrono::duration<double>(last - t0).count();
+            ++rounds;
+        }
+    }
+    return elapsed / (static_cast<double>(rounds) * kRecords * threads);
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-36s %12s %12s %10s %10s\n", "case", "ns/record", "Mrecord/s", "speedup", "dropped");
+
+    std::ofstream devNull("/dev/null");
+    std::streambuf* const coutBuf = std::cout.rdbuf(devNull.rdbuf());
+    const double legacy = benchRun([&] {
+        for (int i = 0; i < kRecords; ++i) {
+            std::cout << "rgb      " << timeShowStr(i * 33333, i / 30.0)
+                      << 1920 << "x" << 1080 << "@" << std::round(30.0) << "fps" << std::endl;
+        }
+    }, 0.5) / kRecords;
+    std::cout.rdbuf(coutBuf);
+    printRow("std::cout + std::endl", legacy, legacy, 0);
+
+    for (LogFormat format : {LogFormat::Text, LogFormat::JsonLines, LogFormat::Binary}) {
+        const char* formatName = format == LogFormat::Text ? "text" : format == LogFormat::JsonLines ? "json" : "binary";
+        for (int threads : {1, 4}) {
+            AsyncLog::Options options;
+            options.path = "/dev/null";
+            options.format = format;
+            // a whole round of the 4 producers fits: nothing is dropped however slow the writer
+            options.capacity = 1 << 17;
+            options.flushIntervalMs = 1;
+            AsyncLog log(options);
+            const double t = runAsync(log, threads);
+            log.flush();
+            const double total = static_cast<double>(log.written() + log.dropped());
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "AsyncLog %s, %d producer%s", formatName, threads, threads > 1 ? "s" : "");
+            printRow(name, t, legacy, 100.0 * log.dropped() / total);
+        }
+    }
+
+    // what a callback pays on every frame once the k++ % 25 counters are gone
+    LogRateLimiter limit(1.0);
+    std::atomic<int> allowed(0);
+    const double rate = benchRun([&] {
+        for (int i = 0; i < kRecords; ++i) {
+            if (limit.allow()) {
+                ++allowed;
+            }
+        }
+    }, 0.5) / kRecords;
+    printRow("LogRateLimiter::allow", rate, legacy, 0);
+    return 0;
+}
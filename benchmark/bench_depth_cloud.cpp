@@ -0,0 +1,147 @@
+// Measures the conversion of a 640x480 ToF-like depth frame (a wall, a floor and a sphere, with
+// noise) to a point cloud: the per-pixel division of save_tof_ply, DepthCloudBuilder without
+// downsampling, then with a voxel grid on one and several threads, and the time to write each
+// cloud as binary PLY. Checks the voxels against a std::map reference.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+#include "depth_cloud.h"
+#include "point_cloud_writer.h"
+#include "bench_util.hpp"
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFx = 513.336, kFy = 513.336, kCx = 322.987, kCy = 243.861;
+
+/// Depth in mm (Depth_16): wall at 3 m, floor 1.2 m below the camera, sphere of 0.4 m at 1.5 m
+std::vector<std::uint16_t> makeDepth()
+{
+    std::vector<std::uint16_t> depth(kWidth * kHeight);
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, 0.005);
+    for (int v = 0; v < kHeight; ++v) {
+        for (int u = 0; u < kWidth; ++u) {
+            const double x = (u - kCx) / kFx, y = (v - kCy) / kFy;
+            double z = 3.0;
+            if (y > 0 && 1.2 / y < z) {
+                z = 1.2 / y;
+            }
+            // ray / sphere centered at (0.3, 0.2, 1.5)
+            const double n = std::sqrt(x * x + y * y + 1);
+            const double dx = x / n, dy = y / n, dz = 1 / n;
+            const double b = dx * 0.3 + dy * 0.2 + dz * 1.5;
+            const double c = 0.3 * 0.3 + 0.2 * 0.2 + 1.5 * 1.5 - 0.4 * 0.4;
+            if (b * b - c >= 0) {
+                z = std::min(z, (b - std::sqrt(b * b - c)) * dz);
+            }
+            // ~3% holes
+            depth[v * kWidth + u] = (u * 7 + v * 13) % 31 == 0 ? 0 : static_cast<std::uint16_t>((z + noise(rng)) * 1000);
+        }
+    }
+    return depth;
+}
+
+/// appendTofPoints() of save_tof_ply: one division per coordinate
+void legacyPoints(std::vector<std::uint16_t> const& depth, std::vector<std::array<float, 3>>& points)
+{
+    points.clear();
+    for (int v = 0; v < kHeight; ++v) {
+        for (int u = 0; u < kWidth; ++u) {
+            float d = depth[v * kWidth + u] / 1000.0f;
+            if (d < 0.1 || d > 10) continue;
+            std::array<float, 3> p = {{static_cast<float>((u - kCx) * d / kFx), static_cast<float>((v - kCy) * d / kFy), d}};
+            points.push_back(p);
+        }
+    }
+}
+
+std::size_t referenceVoxels(std::vector<std::array<float, 3>> const& points, float size)
+{
+    std::map<std::tuple<long, long, long>, int> voxels;
+    for (auto const& p : points) {
+        ++voxels[std::make_tuple(static_cast<long>(std::floor(p[0] / size)), static_cast<long>(std::floor(p[1] / size)),
+                                 static_cast<long>(std::floor(p[2] / size)))];
+    }
+    return voxels.size();
+}
+
+/// Seconds to write `points` as binary PLY
+double writeSeconds(std::vector<std::array<float, 3>> const& points)
+{
+    const char* filename = "/tmp/bench_depth_cloud.ply";
+    const double t = benchRun([&] {
+        PointCloudWriter writer;
+        writer.open(filename, PointCloudFormat::PlyBinary);
+        writer.append(points);
+        writer.close();
+    }, 0.5);
+    unlink(filename);
+    return t;
+}
+
+void printRow(char const* name, double build, double legacyTotal, std::vector<std::array<float, 3>> const& points, std::size_t all)
+{
+    const double write = writeSeconds(points);
+    std::printf("%-32s %10.3f %10.3f %9.2fx %10zu %9.1fx\n", name, build * 1e3, write * 1e3,
+                legacyTotal > 0 ? legacyTotal / (build + write) : 1.0, points.size(), static_cast<double>(all) / points.size());
+}
+
+} // namespace
+
+int main()
+{
+    const std::vector<std::uint16_t> depth = makeDepth();
+    const DepthCamera camera = DepthCamera::pinhole(kWidth, kHeight, kFx, kFy, kCx, kCy);
+    const int threads = std::max(2u, std::thread::hardware_concurrency());
+
+    std::printf("%dx%d depth frame\n", kWidth, kHeight);
+    std::printf("%-32s %10s %10s %10s %10s %10s\n", "case", "build ms", "write ms", "speedup", "points", "reduction");
+
+    std::vector<std::array<float, 3>> points;
+    const double legacy = benchRun([&] { legacyPoints(depth, points); }, 1.0);
+    const std::size_t allPoints = points.size();
+    const double legacyTotal = legacy + writeSeconds(points);
+    printRow("per-pixel division", legacy, 0, points, allPoints);
+
+    DepthCloudBuilder::Options options;
+    options.voxelSize = 0;
+    options.threads = 1;
+    DepthCloudBuilder all(camera, options);
+    const double table = benchRun([&] { all.build(depth.data(), kWidth, kHeight, 0.001f, points); }, 1.0);
+    printRow("ray table, no voxel grid", table, legacyTotal, points, allPoints);
+    const std::size_t expected = referenceVoxels(points, 0.02f);
+
+    int failed = 0;
+    for (int n : {1, threads}) {
+        options.voxelSize = 0.02f;
+        options.threads = n;
+        DepthCloudBuilder builder(camera, options);
+        const double t = benchRun([&] { builder.build(depth.data(), kWidth, kHeight, 0.001f, points); }, 1.0);
+        char name[64];
+        std::snprintf(name, sizeof(name), "voxel grid 2 cm, %d thread%s", n, n > 1 ? "s" : "");
+        printRow(name, t, legacyTotal, points, allPoints);
+        if (points.size() != expected || builder.validPoints() != allPoints) {
+            std::printf("FAILED: %zu voxels instead of %zu\n", points.size(), expected);
+            failed = 1;
+        }
+    }
+
+    options.voxelSize = 0.05f;
+    options.threads = threads;
+    DepthCloudBuilder coarse(camera, options);
+    const double t = benchRun([&] { coarse.build(depth.data(), kWidth, kHeight, 0.001f, points); }, 1.0);
+    printRow("voxel grid 5 cm", t, legacyTotal, points, allPoints);
+    return failed;
+}
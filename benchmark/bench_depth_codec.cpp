@@ -0,0 +1,162 @@
+// Encodes and decodes a 640x480 SGBM-like depth frame (mm: a wall, a floor and a sphere, with
+// noise and invalid holes, plus an invalid border as the dewarped device output) with the
+// depth codec, lossless and with bounded errors over the sgbm_config range, against copying
+// the raw frame. Checks the round trips, the error bound, an odd-sized frame and that
+// truncated streams are rejected.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "depth_codec.h"
+#include "bench_util.hpp"
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFx = 513.336, kFy = 513.336, kCx = 322.987, kCy = 243.861;
+// min_distance / max_distance of the sgbm_config of the samples
+const std::uint16_t kMinDistance = 100;
+const std::uint16_t kMaxDistance = 8000;
+
+/// Depth in mm: wall at 3 m, floor 1.2 m below the camera, sphere of 0.4 m at 1.5 m
+std::vector<std::uint16_t> makeDepth(int width, int height, double noiseM)
+{
+    std::vector<std::uint16_t> depth(width * height);
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, noiseM);
+    for (int v = 0; v < height; ++v) {
+        for (int u = 0; u < width; ++u) {
+            const double x = (u - kCx) / kFx, y = (v - kCy) / kFy;
+            double z = 3.0;
+            if (y > 0 && 1.2 / y < z) {
+                z = 1.2 / y;
+            }
+            const double n = std::sqrt(x * x + y * y + 1);
+            const double dx = x / n, dy = y / n, dz = 1 / n;
+            const double b = dx * 0.3 + dy * 0.2 + dz * 1.5;
+            const double c = 0.3 * 0.3 + 0.2 * 0.2 + 1.5 * 1.5 - 0.4 * 0.4;
+            if (b * b - c >= 0) {
+                z = std::min(z, (b - std::sqrt(b * b - c)) * dz);
+            }
+            const bool hole = (u * 7 + v * 13) % 31 == 0 || u < 32 || u >= width - 32;
+            depth[v * width + u] = hole ? 0 : static_cast<std::uint16_t>((z + noise(rng)) * 1000);
+        }
+    }
+    return depth;
+}
+
+struct Result
+{
+    double encode;
+    double decode;
+    std::size_t bytes;
+    int maxError;
+    bool ok;
+};
+
+Result run(std::vector<std::uint16_t> const& depth, int width, int height, DepthEncoder::Options const& options)
+{
+    DepthEncoder encoder(options);
+    Result r;
+    r.encode = benchRun([&] { encoder.encode(depth.data(), width, height); });
+    std::vector<std::uint8_t> const stream = encoder.encode(depth.data(), width, height);
+    std::vector<std::uint16_t> decoded(depth.size());
+    r.decode = benchRun([&] { depthDecode(stream.data(), stream.size(), decoded.data(), decoded.size()); });
+    r.bytes = stream.size();
+
+    std::fill(decoded.begin(), decoded.end(), 0xffff);
+    r.ok = depthDecode(stream.data(), stream.size(), decoded.data(), decoded.size());
+    r.maxError = 0;
+    const bool bounded = options.mode == DepthCodecMode::Bounded;
+    for (std::size_t i = 0; i < depth.size(); ++i) {
+        const bool valid = !bounded || (depth[i] >= options.minDepth && depth[i] <= options.maxDepth);
+        if (!valid) {
+            r.ok = r.ok && decoded[i] == 0;
+            continue;
+        }
+        r.maxError = std::max(r.maxError, std::abs(static_cast<int>(decoded[i]) - depth[i]));
+    }
+    r.ok = r.ok && r.maxError <= (bounded ? options.maxError : 0);
+
+    // every truncation is rejected, not read past the end
+    for (std::size_t size = 0; size < stream.size(); size += 1 + size / 8) {
+        r.ok = r.ok && !depthDecode(stream.data(), size, decoded.data(), decoded.size());
+    }
+    return r;
+}
+
+void printResult(const char* name, Result const& r, double rawBytes, double copy)
+{
+    char encode[64], decode[64];
+    std::snprintf(encode, sizeof(encode), "%s encode", name);
+    std::snprintf(decode, sizeof(decode), "%s decode", name);
+    benchPrintRow(encode, r.encode, kWidth * kHeight, copy);
+    benchPrintRow(decode, r.decode, kWidth * kHeight, copy);
+    std::printf("%-36s %9zu bytes, ratio %.2f, %.0f fps encode, max error %d%s\n", "", r.bytes, rawBytes / r.bytes,
+                1 / r.encode, r.maxError, r.ok ? "" : "  FAILED");
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("predictor kernel: %s\n", depthCodecKernel());
+    const double rawBytes = kWidth * kHeight * sizeof(std::uint16_t);
+    bool ok = true;
+
+    for (double noiseM : {0.002, 0.01}) {
+        const std::vector<std::uint16_t> depth = makeDepth(kWidth, kHeight, noiseM);
+        char title[128];
+        std::snprintf(title, sizeof(title), "640x480 depth, %.0f mm noise, %.0f KB raw", noiseM * 1000, rawBytes / 1024);
+        benchPrintHeader(title);
+
+        std::vector<std::uint16_t> copy(depth.size());
+        const double copied = benchRun([&] { std::memcpy(copy.data(), depth.data(), rawBytes); });
+        benchPrintRow("memcpy (raw)", copied, kWidth * kHeight, copied);
+
+        DepthEncoder::Options lossless;
+        Result r = run(depth, kWidth, kHeight, lossless);
+        printResult("lossless", r, rawBytes, copied);
+        ok = ok && r.ok;
+
+        for (std::uint16_t maxError : {2, 8}) {
+            DepthEncoder::Options bounded;
+            bounded.mode = DepthCodecMode::Bounded;
+            bounded.minDepth = kMinDistance;
+            bounded.maxDepth = kMaxDistance;
+            bounded.maxError = maxError;
+            char name[64];
+            std::snprintf(name, sizeof(name), "bounded +-%d mm", maxError);
+            r = run(depth, kWidth, kHeight, bounded);
+            printResult(name, r, rawBytes, copied);
+            ok = ok && r.ok;
+        }
+    }
+
+    // odd sizes go through the scalar tail blocks, raw values through the 16-bit residuals
+    std::vector<std::uint16_t> odd = makeDepth(637, 3, 0.01);
+    std::mt19937 rng(3);
+    for (std::size_t i = 0; i < odd.size(); i += 5) {
+        odd[i] = static_cast<std::uint16_t>(rng());
+    }
+    DepthEncoder encoder;
+    std::vector<std::uint8_t> const& stream = encoder.encode(odd.data(), 637, 3);
+    std::vector<std::uint16_t> decoded(odd.size());
+    int width = 0, height = 0;
+    const bool same = depthDecodeInfo(stream.data(), stream.size(), &width, &height) && width == 637 && height == 3
+                      && depthDecode(stream.data(), stream.size(), decoded.data(), decoded.size()) && decoded == odd;
+    std::printf("\n637x3 frame with random samples: %s\n", same ? "identical" : "DIFFERENT");
+
+    if (!ok || !same) {
+        std::printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Compares the LUT/SIMD DepthColorizer against the former per-pixel loops of
+// raw_to_opencv(DepthImage) on synthetic ToF frames and reports Mpixel/s.
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "colors.h"
+#include "depth_colorizer.h"
+#include "bench_util.hpp"
+
+namespace {
+
+// --- former implementation, kept verbatim as the baseline ---
+
+cv::Mat legacyDepth32(float const* tmp_d, unsigned int width, unsigned int height)
+{
+    cv::Mat out = cv::Mat::zeros(height, width, CV_8UC3);
+    float dmax = 7.5;
+    for (unsigned int i=0; i< height*width; i++) {
+        const auto &d = tmp_d[i];
+        if( d < 0.01 || d > 9.9 ) {
+            out.at<cv::Vec3b>(i / width, i % width) = 0;
+        } else {
+            unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
+            const auto &cc = colors.at(u);
+            out.at<cv::Vec3b>( i/width, i%width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
+        }
+    }
+    return out;
+}
+
+cv::Mat legacyDepth16(int16_t const* tmp_d, unsigned int width, unsigned int height)
+{
+    cv::Mat out = cv::Mat::zeros(height, width, CV_8UC3);
+    float dmax = 2494.0;
+    for (unsigned int i=0; i< height*width; i++) {
+        const auto &d = tmp_d[i];
+        unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
+        const auto &cc = colors.at(u);
+        out.at<cv::Vec3b>( i/width, i%width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
+    }
+    return out;
+}
+
+cv::Mat legacyIr(unsigned short const* tmp_d, unsigned int width, unsigned int height)
+{
+    cv::Mat out = cv::Mat::zeros(height, width, CV_8UC3);
+    float dmax = 2494.0;
+    for (unsigned int i=0; i< height*width; i++) {
+        unsigned short d = tmp_d[i];
+        unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
+        if( u < 15 )
+            u = 0;
+        const auto &cc = colors.at(u);
+        out.at<cv::Vec3b>( i/width, i%width ) = cv::Vec3b(cc.at(2), cc.at(1),cc.at(0) );
+    }
+    return out;
+}
+
+// --- new implementation, same call pattern as raw2opencv.cpp ---
+
+template <class T>
+cv::Mat lutConvert(DepthColorizer const& colorizer, void (DepthColorizer::*fn)(T const*, std::size_t, std::uint8_t*) const,
+                   T const* src, int width, int height)
+{
+    cv::Mat out(height, width, CV_8UC3);
+    for (int r = 0; r < height; r++) {
+        (colorizer.*fn)(src + r * width, width, out.ptr<std::uint8_t>(r));
+    }
+    return out;
+}
+
+bool same(cv::Mat const& a, cv::Mat const& b)
+{
+    return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+void runResolution(int width, int height)
+{
+    const std::size_t n = static_cast<std::size_t>(width) * height;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> meters(0.0f, 10.5f);
+    std::uniform_int_distribution<int> raw(-100, 4000);
+
+    std::vector<float> depth32(n);
+    std::vector<std::int16_t> depth16(n);
+    std::vector<std::uint16_t> ir(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        depth32[i] = meters(rng);
+        depth16[i] = static_cast<std::int16_t>(raw(rng));
+        ir[i] = static_cast<std::uint16_t>(std::max(0, raw(rng)));
+    }
+
+    const DepthColorizer colorizer(colors);
+
+    char title[64];
+    std::snprintf(title, sizeof(title), "depth colorization %dx%d", width, height);
+    benchPrintHeader(title);
+
+    double base = benchRun([&]{ legacyDepth32(depth32.data(), width, height); });
+    benchPrintRow("Depth_32 legacy", base, n, base);
+    double fast = benchRun([&]{ lutConvert(colorizer, &DepthColorizer::colorizeDepth32, depth32.data(), width, height); });
+    benchPrintRow("Depth_32 LUT", fast, n, base);
+    bool ok32 = same(legacyDepth32(depth32.data(), width, height),
+                     lutConvert(colorizer, &DepthColorizer::colorizeDepth32, depth32.data(), width, height));
+
+    base = benchRun([&]{ legacyDepth16(depth16.data(), width, height); });
+    benchPrintRow("Depth_16 legacy", base, n, base);
+    fast = benchRun([&]{ lutConvert(colorizer, &DepthColorizer::colorizeDepth16, depth16.data(), width, height); });
+    benchPrintRow("Depth_16 LUT", fast, n, base);
+    bool ok16 = same(legacyDepth16(depth16.data(), width, height),
+                     lutConvert(colorizer, &DepthColorizer::colorizeDepth16, depth16.data(), width, height));
+
+    base = benchRun([&]{ legacyIr(ir.data(), width, height); });
+    benchPrintRow("IR legacy", base, n, base);
+    fast = benchRun([&]{ lutConvert(colorizer, &DepthColorizer::colorizeIr, ir.data(), width, height); });
+    benchPrintRow("IR LUT", fast, n, base);
+    bool okIr = same(legacyIr(ir.data(), width, height),
+                     lutConvert(colorizer, &DepthColorizer::colorizeIr, ir.data(), width, height));
+
+    std::printf("output identical: Depth_32 %s, Depth_16 %s, IR %s\n",
+                ok32 ? "yes" : "NO", ok16 ? "yes" : "NO", okIr ? "yes" : "NO");
+}
+
+} // namespace
+
+int main()
+{
+    runResolution(224, 172);   // pmd ToF
+    runResolution(640, 480);   // sony ToF VGA
+    runResolution(1280, 720);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Compares the tag detection of demo-api before and after DetectionStage with a camera
+// simulated at 30 Hz and a detector that sleeps: a thread that sleeps 25 ms and detects on
+// the last frame, against detections triggered by the frames. Reports the delay between a
+// frame and its detection, the detections run on a frame already seen and the frames never
+// detected.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "detection_stage.hpp"
+
+namespace {
+
+struct Frame
+{
+    Frame() : edgeTimestampUs(0), hostTimestamp(0), id(0) {}
+    std::int64_t edgeTimestampUs;
+    double hostTimestamp; ///< steady clock, seconds
+    std::int64_t id;
+};
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Stats
+{
+    Stats() : detections(0), duplicates(0), lastId(0), delay(0), maxDelay(0) {}
+
+    void add(Frame const& frame)
+    {
+        std::lock_guard<std::mutex> l(mtx);
+        ++detections;
+        if (frame.id <= lastId) {
+            ++duplicates;
+            return;
+        }
+        lastId = frame.id;
+        ids.push_back(frame.id);
+        const double d = now() - frame.hostTimestamp;
+        delay += d;
+        maxDelay = std::max(maxDelay, d);
+    }
+
+    std::mutex mtx;
+    int detections;
+    int duplicates;
+    std::int64_t lastId;
+    std::vector<std::int64_t> ids;
+    double delay;
+    double maxDelay;
+};
+
+/// Calls `fn` with frames at `fps` for `count` frames
+template <class F>
+void camera(double fps, int count, F fn)
+{
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 1; i <= count; ++i) {
+        std::this_thread::sleep_until(next);
+        Frame f;
+        f.id = i;
+        f.hostTimestamp = now();
+        f.edgeTimestampUs = static_cast<std::int64_t>(f.hostTimestamp * 1e6);
+        fn(f);
+        next += std::chrono::microseconds(static_cast<long>(1e6 / fps));
+    }
+}
+
+void print(char const* name, Stats const& s, int frames)
+{
+    const std::size_t detected = s.ids.size();
+    std::printf("%-36s %10.1f %10.1f %10d %10d %10zu\n", name, detected ? s.delay / detected * 1e3 : 0.,
+                s.maxDelay * 1e3, s.detections, s.duplicates, frames - detected);
+}
+
+void polling(char const* name, int frames, int detectMs)
+{
+    Stats stats;
+    std::mutex mtx;
+    Frame last;
+    std::atomic<bool> stop(false);
+    std::thread t([&] {
+        while (!stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(25));
+            Frame f;
+            {
+                std::lock_guard<std::mutex> l(mtx);
+                f = last;
+            }
+            if (f.id == 0) {
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(detectMs));
+            stats.add(f);
+        }
+    });
+    camera(30, frames, [&](Frame const& f) {
+        std::lock_guard<std::mutex> l(mtx);
+        last = f;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stop = true;
+    t.join();
+    print(name, stats, frames);
+}
+
+void staged(char const* name, int frames, int detectMs, int workers)
+{
+    typedef DetectionStage<Frame, Frame> Stage;
+    Stats stats;
+    Stage::Options options;
+    options.workers = workers;
+    {
+        Stage stage([detectMs]() -> Stage::Detector {
+            return [detectMs](Frame const& f) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(detectMs));
+                return f;
+            };
+        }, [&stats](Stage::Detection const& d) { stats.add(d.result); }, options);
+        camera(30, frames, [&stage](Frame const& f) { stage.submit(f); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    print(name, stats, frames);
+}
+
+} // namespace
+
+int main()
+{
+    const int frames = 150;
+    std::printf("%d frames at 30 Hz\n", frames);
+    std::printf("%-36s %10s %10s %10s %10s %10s\n", "case", "mean ms", "max ms", "detections", "duplicates", "missed");
+
+    polling("poll 25 ms, detect 10 ms", frames, 10);
+    staged("DetectionStage, detect 10 ms", frames, 10, 1);
+    polling("poll 25 ms, detect 50 ms", frames, 50);
+    staged("DetectionStage, detect 50 ms", frames, 50, 1);
+    staged("DetectionStage x2, detect 50 ms", frames, 50, 2);
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Compares the per-frame buffers of the all_stream converters allocated with new[] (as
+// depthImage() did, or cv::Mat::zeros) against FramePool: one display iteration converts
+// two 640x400 fisheye images, a 640x480 ToF frame, a 1280x720 RGBD view and a 1280x720
+// SGBM view, writing every byte. Then checks that 2 threads converting concurrently reach a
+// steady state without allocation.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "frame_pool.h"
+#include "bench_util.hpp"
+
+namespace {
+
+struct Frame { int width, height, channels; };
+
+const Frame kFrames[] = {{640, 400, 3}, {640, 400, 3}, {640, 480, 3}, {2560, 720, 3}, {1280, 720, 3}};
+
+std::size_t bytes(Frame const& f)
+{
+    return static_cast<std::size_t>(f.width) * f.height * f.channels;
+}
+
+// the frames of an iteration stay alive until the next one, as the images shown by the display
+typedef std::vector<std::shared_ptr<std::uint8_t>> Shown;
+
+/// new[] per frame, zeroed then written like cv::Mat::zeros + conversion
+void newFrames(Shown& shown, bool zero)
+{
+    shown.clear();
+    for (Frame const& f : kFrames) {
+        shown.push_back(std::shared_ptr<std::uint8_t>(new std::uint8_t[bytes(f)], std::default_delete<std::uint8_t[]>()));
+        if (zero) {
+            std::memset(shown.back().get(), 0, bytes(f));
+        }
+        std::memset(shown.back().get(), 0x55, bytes(f));
+    }
+}
+
+void pooledFrames(Shown& shown, FramePool& pool)
+{
+    shown.clear();
+    for (Frame const& f : kFrames) {
+        shown.push_back(pool.acquireShared(f.width, f.height, f.channels, bytes(f)));
+        std::memset(shown.back().get(), 0x55, bytes(f));
+    }
+}
+
+} // namespace
+
+int main()
+{
+    std::size_t total = 0;
+    for (Frame const& f : kFrames) {
+        total += bytes(f);
+    }
+    std::printf("%zu frames, %.1f MB per display iteration\n", sizeof(kFrames) / sizeof(kFrames[0]), total / 1e6);
+    std::printf("%-36s %12s %12s %10s\n", "case", "ms/iter", "GB/s", "speedup");
+
+    Shown shown;
+    const double zeros = benchRun([&shown] { newFrames(shown, true); });
+    std::printf("%-36s %12.3f %12.2f %9.2fx\n", "new[] + zero (Mat::zeros)", zeros * 1e3, total / zeros * 1e-9, 1.0);
+    const double plain = benchRun([&shown] { newFrames(shown, false); });
+    std::printf("%-36s %12.3f %12.2f %9.2fx\n", "new[]", plain * 1e3, total / plain * 1e-9, zeros / plain);
+
+    FramePool pool;
+    const double pooled = benchRun([&] { pooledFrames(shown, pool); });
+    std::printf("%-36s %12.3f %12.2f %9.2fx\n", "FramePool", pooled * 1e3, total / pooled * 1e-9, zeros / pooled);
+    shown.clear();
+
+    // two converting threads, each keeping its last frames alive like a display
+    FramePool shared;
+    auto worker = [&shared](int iterations) {
+        Shown shown;
+        for (int i = 0; i < iterations; ++i) {
+            pooledFrames(shown, shared);
+        }
+    };
+    auto run = [&worker](int iterations) {
+        std::thread a(worker, iterations), b(worker, iterations);
+        a.join();
+        b.join();
+    };
+    run(10);
+    const FramePool::Stats warm = shared.stats();
+    run(200);
+    const FramePool::Stats steady = shared.stats();
+    std::printf("\n2 threads: %llu allocations while warming up, %llu in the next %d iterations (%llu reuses), "
+                "%zu outstanding, %.1f MB cached\n",
+                static_cast<unsigned long long>(warm.allocations),
+                static_cast<unsigned long long>(steady.allocations - warm.allocations), 2 * 200,
+                static_cast<unsigned long long>(steady.reuses - warm.reuses), steady.outstanding, steady.cachedBytes / 1e6);
+    if (steady.allocations != warm.allocations || steady.outstanding != 0) {
+        std::printf("FAILED: allocations in steady state\n");
+        return 1;
+    }
+    return 0;
+}
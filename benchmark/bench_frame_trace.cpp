@@ -0,0 +1,136 @@
+// Cost of a FrameTrace span (TraceScope) disabled and enabled, from 1 and 4 threads, against
+// the printf of timeShowStr() it replaces for latency measurements. Then checks that a
+// snapshot taken while 4 threads record holds only complete spans and that the binary trace
+// reads back identical.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_trace.hpp"
+#include "bench_util.hpp"
+
+namespace {
+
+const int kSpans = 1000000;
+
+// former latency output of the callbacks, formatted but not written
+std::string timeShowStr(std::int64_t edgeTimestampUs, double hostTimestamp) {
+    char s[1024];
+    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()*1e-6;
+    std::sprintf(s, " (device=%lld host=%.4f now=%.4f delay=%.4f) ", (long long)edgeTimestampUs, hostTimestamp, now, now-hostTimestamp);
+    return std::string(s);
+}
+
+std::atomic<std::uint64_t> s_sink(0);
+
+void spans(int count, std::uint64_t stream)
+{
+    for (int i = 0; i < count; ++i) {
+        TraceScope trace("convert", stream ? "tof" : "rgb", static_cast<std::uint64_t>(i));
+        s_sink.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/// ns per span with `threads` threads each recording kSpans spans
+double runThreads(int threads)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back(spans, kSpans, static_cast<std::uint64_t>(t & 1));
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / kSpans * 1e9;
+}
+
+void printRow(const char* name, double ns, double baseline)
+{
+    std::printf("%-36s %12.1f %9.2fx\n", name, ns, baseline / ns);
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-36s %12s %10s\n", "case", "ns/span", "speedup");
+
+    std::size_t length = 0;
+    const double printed = benchRun([&length] {
+        for (int i = 0; i < 1000; ++i) {
+            length += timeShowStr(i * 33333, i / 30.0).size();
+        }
+    }) / 1000 * 1e9;
+    printRow("timeShowStr()", printed, printed);
+
+    FrameTrace::enable(false);
+    printRow("TraceScope, disabled", benchRun([] { spans(kSpans, 0); }) / kSpans * 1e9, printed);
+    FrameTrace::enable();
+    const double enabled = benchRun([] { spans(kSpans, 0); }) / kSpans * 1e9;
+    printRow("TraceScope, enabled", enabled, printed);
+    const double sdk = benchRun([] {
+        for (int i = 0; i < kSpans; ++i) {
+            TraceScope trace("callback", "rgb", static_cast<std::int64_t>(i), 1.0);
+        }
+    }) / kSpans * 1e9;
+    printRow("callback TraceScope (+ sdk span)", sdk, printed);
+    FrameTrace::clear();
+    // threads running concurrently: time per span of one thread
+    printRow("TraceScope, enabled, 4 threads", runThreads(4), printed);
+
+    // snapshot while recording: spans must be whole (end >= begin, known stream)
+    FrameTrace::clear();
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&stop, t] {
+            FrameTrace::nameThread(t & 1 ? "tof" : "rgb");
+            while (!stop.load()) {
+                spans(1000, static_cast<std::uint64_t>(t & 1));
+            }
+        });
+    }
+    std::size_t snapshots = 0, bad = 0, total = 0;
+    for (auto t0 = std::chrono::steady_clock::now(); std::chrono::steady_clock::now() - t0 < std::chrono::seconds(1); ++snapshots) {
+        FrameTraceSnapshot s = FrameTrace::snapshot();
+        total += s.spans.size();
+        for (auto const& span : s.spans) {
+            const std::string& stream = s.strings[span.stream];
+            bad += span.endNs < span.beginNs || (stream != "rgb" && stream != "tof") || s.strings[span.stage] != "convert";
+        }
+    }
+    stop = true;
+    for (auto& w : writers) {
+        w.join();
+    }
+    std::printf("\n%zu snapshots while 4 threads record, %.0f spans each, %zu incomplete\n", snapshots,
+                static_cast<double>(total) / snapshots, bad);
+
+    FrameTraceSnapshot s = FrameTrace::snapshot();
+    auto t0 = std::chrono::steady_clock::now();
+    const bool written = s.writeBinary("bench_frame_trace.bin");
+    const double binaryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    const bool json = s.writeChrome("bench_frame_trace.json");
+    const double jsonMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    FrameTraceSnapshot read;
+    const bool same = written && read.readBinary("bench_frame_trace.bin") && read.spans.size() == s.spans.size()
+                      && read.strings == s.strings && read.threads.size() == s.threads.size()
+                      && (s.spans.empty() || std::memcmp(read.spans.data(), s.spans.data(), s.spans.size() * sizeof(s.spans[0])) == 0);
+    std::remove("bench_frame_trace.bin");
+    std::remove("bench_frame_trace.json");
+    std::printf("%zu spans: binary %.1f ms, Chrome JSON %.1f ms, binary read back %s\n", s.spans.size(), binaryMs, jsonMs,
+                same ? "identical" : "DIFFERENT");
+    if (bad || !same || !json || length == 0) {
+        std::printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
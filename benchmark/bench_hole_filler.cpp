@@ -0,0 +1,178 @@
+// Compares HoleFiller against the former fillHoles() template of sgbm_demo on synthetic
+// SGBM depth frames (speckle and blob holes) and checks that the outputs are identical.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "hole_filler.h"
+#include "bench_util.hpp"
+
+namespace {
+
+/// Fields of xv::SgbmImage used by both implementations
+struct DepthFrame
+{
+    std::size_t width = 0, height = 0;
+    std::shared_ptr<const std::uint8_t> data;
+    unsigned int dataSize = 0;
+};
+
+// --- former implementation (study/sgbm_demo/sgbm_demo.cc), kept verbatim as the baseline ---
+
+template <class InputImage>
+InputImage fillHoles(InputImage const& inputImage, std::function<bool(uint16_t)> isHole, float holeSize=1) {
+
+    // pointer on input data (assume input data is float)
+    const auto inputImagePtr = reinterpret_cast<uint16_t const*>(inputImage.data.get());
+
+    // binary image of holes
+    cv::Mat holesBinaryImage = cv::Mat::zeros(inputImage.height, inputImage.width, CV_16UC1);
+    for (std::size_t i=0; i< inputImage.height*inputImage.width; i++) {
+        const auto &d = inputImagePtr[i];
+        if( isHole(d)) {
+            holesBinaryImage.at<uint16_t>(i / inputImage.width, i % inputImage.width) = 0;
+        } else {
+            holesBinaryImage.at<uint16_t>(i / inputImage.width, i % inputImage.width) = 65535;
+        }
+    }
+
+    // Create structuring element
+    int elementSize = (holeSize+1)/2;
+    cv::Mat element = cv::getStructuringElement(
+                cv::MORPH_ELLIPSE,
+                cv::Size(2 * elementSize + 1,
+                         2 * elementSize + 1),
+                cv::Point(elementSize, elementSize));
+    cv::Mat holesFilledBinaryImage;
+
+    // Closing to fill the holes
+    cv::morphologyEx(holesBinaryImage, holesFilledBinaryImage,
+                     cv::MORPH_CLOSE, element,
+                     cv::Point(-1, -1), 2);
+
+    cv::Mat onlyFilledHolesImage;
+    // extract only the filled holes in a binary image
+    {
+        cv::Mat tmp;
+        cv::bitwise_not(holesBinaryImage, tmp);
+        cv::bitwise_and(tmp, holesFilledBinaryImage, onlyFilledHolesImage);
+    }
+
+    auto median = [] (std::vector<uint16_t> &v)
+    {
+        size_t n = v.size() / 2;
+        std::nth_element(v.begin(), v.begin()+n, v.end());
+        return v[n];
+    };
+
+    // copy the input image to output image
+    InputImage outputImage = inputImage;
+    std::shared_ptr<std::uint8_t> data(new std::uint8_t[inputImage.dataSize], std::default_delete<std::uint8_t[]>());
+    std::memcpy(data.get(), inputImage.data.get(), inputImage.dataSize);
+
+    const auto outputImagePtr = reinterpret_cast<uint16_t*>(data.get());
+
+    for (std::size_t c=0; c< inputImage.height*inputImage.width; c++) {
+        auto i = c / inputImage.width;
+        auto j = c % inputImage.width;
+        // if it is a filled hole, compute the median to fill the depth image data
+        if( onlyFilledHolesImage.at<uint16_t>(i, j)>0 ) {
+            std::vector<uint16_t> pixels;
+            // compute the median based on non-hole input pixels
+            for (int ii=-holeSize; ii<holeSize; ++ii) {
+                if (i+ii<0 || i+ii>inputImage.height) continue;
+                for (int jj=-holeSize; jj<holeSize; ++jj) {
+                    if (j+jj<0 || j+jj>inputImage.width) continue;
+                    uint16_t v = inputImagePtr[(i+ii)*inputImage.width+(j+jj)];
+                    if (!isHole(v)) {
+                        pixels.push_back(v);
+                    }
+                }
+            }
+            if (!pixels.empty())
+                outputImagePtr[c] = median(pixels);
+        }
+    }
+    outputImage.data = data;
+
+    return outputImage;
+}
+
+/// Smooth depth (mm) with 5% single pixel holes, small blobs and out of range samples
+DepthFrame syntheticFrame(int width, int height)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::shared_ptr<std::uint16_t> buffer(new std::uint16_t[width * height], std::default_delete<std::uint16_t[]>());
+    std::uint16_t* d = buffer.get();
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            d[y * width + x] = static_cast<std::uint16_t>(800 + 3 * x + 2 * y + static_cast<int>(40 * unit(rng)));
+        }
+    }
+    for (int i = 0; i < width * height / 20; ++i) {
+        d[static_cast<int>(unit(rng) * (width * height - 1))] = 0;
+    }
+    for (int i = 0; i < width * height / 2000; ++i) {
+        const int cx = static_cast<int>(unit(rng) * (width - 4)), cy = static_cast<int>(unit(rng) * (height - 4));
+        const std::uint16_t v = unit(rng) < 0.5f ? 0 : 60000;
+        for (int y = cy; y < cy + 3; ++y) {
+            for (int x = cx; x < cx + 3; ++x) {
+                d[y * width + x] = v;
+            }
+        }
+    }
+    DepthFrame f;
+    f.width = width;
+    f.height = height;
+    f.dataSize = width * height * sizeof(std::uint16_t);
+    f.data = std::shared_ptr<const std::uint8_t>(buffer, reinterpret_cast<std::uint8_t const*>(buffer.get()));
+    return f;
+}
+
+void runResolution(int width, int height)
+{
+    const DepthFrame frame = syntheticFrame(width, height);
+    const int d1 = 200, d2 = 10000;
+    auto isHole = [](uint16_t d){ return d < d1 || d > d2; };
+    HoleFiller filler;
+    const double pixels = static_cast<double>(width) * height;
+
+    char title[96];
+    std::snprintf(title, sizeof(title), "hole filling %dx%d, holeSize 1, %d threads", width, height, cv::getNumThreads());
+    benchPrintHeader(title);
+
+    const double base = benchRun([&]{ fillHoles(frame, isHole, 1); });
+    benchPrintRow("fillHoles() template", base, pixels, base);
+    const double fast = benchRun([&]{ filler.apply(frame); });
+    benchPrintRow("HoleFiller::apply (copy + fill)", fast, pixels, base);
+
+    std::vector<std::uint16_t> work(width * height);
+    const double inPlace = benchRun([&]{
+        std::memcpy(work.data(), frame.data.get(), frame.dataSize);
+        filler.fill(work.data(), width, height);
+    });
+    benchPrintRow("HoleFiller::fill (in place)", inPlace, pixels, base);
+
+    const DepthFrame expected = fillHoles(frame, isHole, 1);
+    const DepthFrame actual = filler.apply(frame);
+    const bool same = std::memcmp(expected.data.get(), actual.data.get(), frame.dataSize) == 0;
+    std::printf("output identical: %s\n", same ? "yes" : "NO");
+}
+
+} // namespace
+
+int main()
+{
+    runResolution(640, 480);
+    runResolution(1280, 720);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Measures a consumer getting 1 kHz IMU samples: the per-sample std::function callback of
+// IMUDataInterface feeding a mutex protected std::deque, against ImuCache::push() and a
+// batch query of the same window.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "imu_cache.h"
+#include "bench_util.hpp"
+
+namespace {
+
+/// Fields of xv::Imu
+struct Imu
+{
+    std::array<double, 3> gyro{};
+    std::array<double, 3> accel{};
+    double temperature = 0;
+    std::int64_t edgeTimestampUs = 0;
+    double hostTimestamp = 0;
+};
+
+std::vector<Imu> makeSamples(int n)
+{
+    std::vector<Imu> samples(n);
+    for (int i = 0; i < n; ++i) {
+        samples[i].hostTimestamp = i * 1e-3;
+        samples[i].edgeTimestampUs = i * 1000;
+        samples[i].gyro = {{0.01 * i, 0.02, -0.03}};
+        samples[i].accel = {{0.1, 9.81, 0.2}};
+        samples[i].temperature = 40;
+    }
+    return samples;
+}
+
+// --- the callback pattern: each consumer keeps its own history behind a mutex ---
+
+class CallbackHistory
+{
+public:
+    explicit CallbackHistory(std::size_t capacity) : m_capacity(capacity)
+    {
+        m_callback = [this](Imu const& imu) {
+            std::lock_guard<std::mutex> l(m_mtx);
+            m_samples.push_back(imu);
+            if (m_samples.size() > m_capacity) {
+                m_samples.pop_front();
+            }
+        };
+    }
+
+    std::function<void(Imu const&)> const& callback() const { return m_callback; }
+
+    std::size_t range(double t0, double t1, std::vector<Imu>& out)
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        auto first = std::lower_bound(m_samples.begin(), m_samples.end(), t0,
+                                      [](Imu const& s, double t) { return s.hostTimestamp < t; });
+        auto last = std::upper_bound(first, m_samples.end(), t1,
+                                     [](double t, Imu const& s) { return t < s.hostTimestamp; });
+        out.assign(first, last);
+        return out.size();
+    }
+
+private:
+    std::size_t m_capacity;
+    std::function<void(Imu const&)> m_callback;
+    std::mutex m_mtx;
+    std::deque<Imu> m_samples;
+};
+
+} // namespace
+
+int main()
+{
+    const int count = 100000;
+    const std::vector<Imu> samples = makeSamples(count);
+
+    std::printf("%-36s %12s %12s %10s\n", "case", "ns/sample", "Msample/s", "speedup");
+
+    CallbackHistory history(4096);
+    const double pushCallback = benchRun([&] {
+        for (Imu const& s : samples) {
+            history.callback()(s);
+        }
+    }, 0.5) / count;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "std::function + mutex + deque", pushCallback * 1e9, 1e-6 / pushCallback, 1.0);
+
+    // three consumers (e.g. fusion, display, recording) each registering their own callback
+    CallbackHistory fusion(4096), display(4096), recording(4096);
+    CallbackHistory* consumers[3] = {&fusion, &display, &recording};
+    const double pushCallbacks = benchRun([&] {
+        for (Imu const& s : samples) {
+            for (CallbackHistory* c : consumers) {
+                c->callback()(s);
+            }
+        }
+    }, 0.5) / count;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "3 consumers, 3 callbacks", pushCallbacks * 1e9, 1e-6 / pushCallbacks,
+                pushCallback / pushCallbacks);
+
+    for (bool integrate : {false, true}) {
+        ImuCache::Options options;
+        options.integrateGyro = integrate;
+        ImuCache cache(options);
+        const double push = benchRun([&] {
+            for (Imu const& s : samples) {
+                cache.push(s);
+            }
+        }, 0.5) / count;
+        std::printf("%-36s %12.1f %12.2f %9.2fx\n", integrate ? "ImuCache::push, integrateGyro" : "ImuCache::push, any consumers",
+                    push * 1e9, 1e-6 / push, pushCallback / push);
+    }
+
+    // a consumer asking for the last 50 ms (50 samples) of a full history
+    std::printf("\n%-36s %12s %12s %10s\n", "case", "ns/query", "Mquery/s", "speedup");
+    const double t1 = samples.back().hostTimestamp, t0 = t1 - 0.05;
+    std::vector<Imu> out;
+    const double queryLocked = benchRun([&] {
+        for (int i = 0; i < 1000; ++i) {
+            history.range(t0, t1, out);
+        }
+    }, 0.5) / 1000;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "deque range under mutex", queryLocked * 1e9, 1e-6 / queryLocked, 1.0);
+
+    ImuCache cache;
+    for (Imu const& s : samples) {
+        cache.push(s);
+    }
+    ImuCache::Batch batch;
+    std::size_t n = 0;
+    const double query = benchRun([&] {
+        for (int i = 0; i < 1000; ++i) {
+            n = cache.range(t0, t1, batch);
+        }
+    }, 0.5) / 1000;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "ImuCache::range", query * 1e9, 1e-6 / query, queryLocked / query);
+
+    if (n != out.size()) {
+        std::printf("\nFAILED: %zu samples instead of %zu\n", n, out.size());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Measures decoded JPEG frames/s of JpegDecodePool against the worker count and the decode
+// scale, compared with the former synchronous cv::imdecode() of raw_to_opencv(ColorImage).
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "jpeg_decode_pool.h"
+#include "bench_util.hpp"
+
+namespace {
+
+/// Fields of xv::ColorImage used by both implementations
+struct JpegFrame
+{
+    std::size_t width = 0, height = 0;
+    std::shared_ptr<const std::uint8_t> data;
+    std::size_t dataSize = 0;
+    std::int64_t edgeTimestampUs = 0;
+    double hostTimestamp = 0;
+};
+
+// --- former implementation (raw_to_opencv(ColorImage), JPEG case), kept verbatim as the baseline ---
+
+cv::Mat legacyDecode(JpegFrame const* rgb)
+{
+    cv::Mat img;
+    cv::Mat raw(1, rgb->width*rgb->height, CV_8UC1, const_cast<unsigned char*>(rgb->data.get()));
+    img = cv::imdecode(raw, cv::IMREAD_COLOR);
+    return img;
+}
+
+// textured frame (gradients, shapes and noise) so the entropy decoder has real work
+std::vector<JpegFrame> makeFrames(int width, int height, int count)
+{
+    std::mt19937 rng(7);
+    std::vector<JpegFrame> frames;
+    for (int i = 0; i < count; ++i) {
+        cv::Mat img(height, width, CV_8UC3);
+        for (int y = 0; y < height; ++y) {
+            cv::Vec3b* row = img.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < width; ++x) {
+                row[x] = cv::Vec3b(static_cast<std::uint8_t>(x + i * 4), static_cast<std::uint8_t>(y), static_cast<std::uint8_t>((x ^ y) + rng() % 24));
+            }
+        }
+        for (int k = 0; k < 40; ++k) {
+            cv::circle(img, cv::Point(rng() % width, rng() % height), 10 + rng() % 80,
+                       cv::Scalar(rng() % 256, rng() % 256, rng() % 256), -1);
+        }
+        std::vector<unsigned char> jpeg;
+        cv::imencode(".jpg", img, jpeg, std::vector<int>{cv::IMWRITE_JPEG_QUALITY, 90});
+
+        // the former code reads width * height bytes: pad so the baseline stays in bounds
+        JpegFrame f;
+        f.width = width;
+        f.height = height;
+        f.dataSize = jpeg.size();
+        std::shared_ptr<std::uint8_t> data(new std::uint8_t[std::max(jpeg.size(), f.width * f.height)](), std::default_delete<std::uint8_t[]>());
+        std::memcpy(data.get(), jpeg.data(), jpeg.size());
+        f.data = data;
+        f.hostTimestamp = i / 30.0;
+        frames.push_back(f);
+    }
+    return frames;
+}
+
+} // namespace
+
+int main()
+{
+    const int width = 1920, height = 1080, count = 30, rounds = 4;
+    const std::vector<JpegFrame> frames = makeFrames(width, height, count);
+    std::size_t bytes = 0;
+    for (JpegFrame const& f : frames) {
+        bytes += f.dataSize;
+    }
+    std::printf("%d frames %dx%d, %.0f KB per frame\n", count, width, height, bytes / 1024.0 / count);
+
+    std::printf("\n%-36s %12s %12s %10s\n", "case", "ms/frame", "frames/s", "speedup");
+    const double legacy = benchRun([&] {
+        for (JpegFrame const& f : frames) {
+            legacyDecode(&f);
+        }
+    }) / count;
+    std::printf("%-36s %12.3f %12.1f %9.2fx\n", "imdecode, display thread", legacy * 1e3, 1.0 / legacy, 1.0);
+
+    const unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> workerCounts = {1, 2, 4};
+    if (hw > 4) {
+        workerCounts.push_back(static_cast<int>(hw));
+    }
+    bool ok = true;
+    for (int scale : {1, 2, 4}) {
+        for (int workers : workerCounts) {
+            JpegDecodePool::Options options;
+            options.workers = workers;
+            options.scale = scale;
+            options.maxQueued = count * rounds;
+            std::atomic<std::uint64_t> delivered(0), outOfOrder(0), bad(0);
+            std::uint64_t expected = 0;
+            JpegDecodePool pool([&](JpegDecodePool::Frame const& f) {
+                if (f.sequence != expected) {
+                    ++outOfOrder;
+                }
+                expected = f.sequence + 1;
+                if (f.image.cols != width / scale || f.image.rows != height / scale) {
+                    ++bad;
+                }
+                ++delivered;
+            }, options);
+
+            const double t = benchRun([&] {
+                for (int r = 0; r < rounds; ++r) {
+                    for (JpegFrame const& f : frames) {
+                        pool.submit(f);
+                    }
+                }
+                pool.flush();
+            }) / (count * rounds);
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "pool 1/%d, %d worker%s", scale, workers, workers > 1 ? "s" : "");
+            std::printf("%-36s %12.3f %12.1f %9.2fx\n", name, t * 1e3, 1.0 / t, legacy / t);
+            if (outOfOrder || bad || pool.dropped() || pool.failed()) {
+                std::printf("    %llu out of order, %llu wrong size, %llu dropped, %llu failed\n",
+                            (unsigned long long)outOfOrder.load(), (unsigned long long)bad.load(),
+                            (unsigned long long)pool.dropped(), (unsigned long long)pool.failed());
+                ok = false;
+            }
+        }
+    }
+    if (!ok) {
+        std::printf("\nFAILED\n");
+    }
+    return ok ? 0 : 1;
+}
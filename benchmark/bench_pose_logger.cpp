@@ -0,0 +1,135 @@
+// Measures what the SLAM pose callback pays to save a pose: the `outFile << ... << std::endl`
+// under a mutex of the study samples (a flush per pose) against PoseLogger::log(), then
+// checks that the xvrec file reloads with every pose and its CPU usage.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "pose_logger.h"
+#include "slam_log.h"
+
+namespace {
+
+/// Accessors of xv::Pose used by the writers
+class Pose
+{
+public:
+    Pose(double t, int i)
+        : m_t(t), m_edge(static_cast<std::int64_t>(t * 1e6)), m_confidence(0.9)
+    {
+        const double a = 0.001 * i;
+        m_translation = {{std::cos(a), std::sin(a), 0.01 * a}};
+        m_rotation = {{std::cos(a), -std::sin(a), 0, std::sin(a), std::cos(a), 0, 0, 0, 1}};
+    }
+    double hostTimestamp() const { return m_t; }
+    std::int64_t edgeTimestampUs() const { return m_edge; }
+    std::array<double, 3> const& translation() const { return m_translation; }
+    std::array<double, 9> const& rotation() const { return m_rotation; }
+    double confidence() const { return m_confidence; }
+    double x() const { return m_translation[0]; }
+    double y() const { return m_translation[1]; }
+    double z() const { return m_translation[2]; }
+
+private:
+    double m_t;
+    std::int64_t m_edge;
+    std::array<double, 3> m_translation;
+    std::array<double, 9> m_rotation;
+    double m_confidence;
+};
+
+struct Result
+{
+    double meanNs;
+    double maxNs;
+};
+
+/// Calls `fn` on every pose at `rate` Hz (a SLAM callback), timing each call
+template <class F>
+Result run(std::vector<Pose> const& poses, double rate, F fn)
+{
+    Result r = {0, 0};
+    auto next = std::chrono::steady_clock::now();
+    for (Pose const& pose : poses) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn(pose);
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        r.meanNs += ns;
+        r.maxNs = std::max(r.maxNs, ns);
+        if (rate > 0) {
+            next += std::chrono::microseconds(static_cast<long>(1e6 / rate));
+            std::this_thread::sleep_until(next);
+        }
+    }
+    r.meanNs /= poses.size();
+    return r;
+}
+
+} // namespace
+
+int main()
+{
+    const std::string dir = "/tmp";
+    const std::string csv = dir + "/bench_pose_logger.csv";
+    const std::string xvrec = dir + "/bench_pose_logger.xvrec";
+
+    std::vector<Pose> poses;
+    for (int i = 0; i < 5000; ++i) {
+        poses.emplace_back(1000 + i * 1e-3, i);
+    }
+
+    std::printf("%zu poses at 1 kHz, time spent in the callback\n", poses.size());
+    std::printf("%-36s %12s %12s %10s\n", "case", "mean ns", "max ns", "speedup");
+
+    std::ofstream outFile(csv);
+    std::mutex fileMutex;
+    const Result legacy = run(poses, 1000, [&](Pose const& pose) {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        outFile << pose.hostTimestamp() << "," << pose.x() << "," << pose.y() << "," << pose.z() << ","
+                << pose.confidence() << std::endl;
+    });
+    outFile.close();
+    std::printf("%-36s %12.0f %12.0f %9.2fx\n", "ofstream << ... << std::endl", legacy.meanNs, legacy.maxNs, 1.0);
+
+    PoseLogger logger;
+    if (!logger.open(xvrec, "bench")) {
+        std::fprintf(stderr, "%s\n", logger.error().c_str());
+        return 1;
+    }
+    const Result logged = run(poses, 1000, [&](Pose const& pose) { logger.log(pose); });
+    logger.close();
+    std::printf("%-36s %12.0f %12.0f %9.2fx\n", "PoseLogger::log", logged.meanNs, logged.maxNs, legacy.meanNs / logged.meanNs);
+
+    // unthrottled: the writer thread has to keep up with a burst
+    PoseLogger burst;
+    burst.open(xvrec, "bench");
+    const Result burstResult = run(poses, 0, [&](Pose const& pose) { burst.log(pose, 12.5f); });
+    burst.close();
+    std::printf("%-36s %12.0f %12.0f %9.2fx %llu dropped\n", "PoseLogger::log, burst", burstResult.meanNs, burstResult.maxNs,
+                legacy.meanNs / burstResult.meanNs, (unsigned long long)burst.dropped());
+
+    SlamTrajectory trajectory;
+    std::string error;
+    const bool loaded = slamLogLoad(xvrec, trajectory, &error);
+    unlink(csv.c_str());
+    unlink(xvrec.c_str());
+    const bool cpu = trajectory.cpuUsage.size() == trajectory.size()
+        && std::all_of(trajectory.cpuUsage.begin(), trajectory.cpuUsage.end(), [](double c) { return c == 12.5; });
+    if (!loaded || trajectory.size() != burst.written() || !cpu) {
+        std::printf("\nFAILED: %zu poses reloaded, %llu written %s\n", trajectory.size(),
+                    (unsigned long long)burst.written(), error.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Measures PoseTimeline::at() with several reader threads while a writer pushes 1 kHz poses,
+// compared with the same timeline behind a std::mutex (the readers then serialize).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pose_timeline.h"
+
+namespace {
+
+const double kRate = 1000.0;
+
+PoseTimeline::Sample makeSample(std::uint64_t i)
+{
+    const double t = i / kRate;
+    PoseTimeline::Sample s;
+    s.hostTimestamp = t;
+    s.edgeTimestampUs = static_cast<std::int64_t>(t * 1e6);
+    s.position[0] = std::sin(t);
+    s.position[1] = std::cos(t);
+    s.position[2] = 0.1 * t;
+    s.quaternion[0] = 0;
+    s.quaternion[1] = std::sin(t / 4);
+    s.quaternion[2] = 0;
+    s.quaternion[3] = std::cos(t / 4);
+    s.confidence = 1;
+    return s;
+}
+
+struct Result
+{
+    double nsPerQuery;
+    std::uint64_t queries;
+    std::uint64_t misses;
+};
+
+/// `readers` threads query random timestamps of the last `window` seconds during `seconds`
+template <class Query, class Push>
+Result run(int readers, double window, double seconds, Query query, Push push)
+{
+    std::uint64_t pushed = 0;
+    for (; pushed < 4096; ++pushed) {
+        push(makeSample(pushed));
+    }
+    std::atomic<std::uint64_t> head(pushed);
+    std::atomic<bool> stop(false);
+
+    std::thread writer([&] {
+        auto next = std::chrono::steady_clock::now();
+        std::uint64_t i = head.load();
+        while (!stop) {
+            push(makeSample(i));
+            head.store(++i);
+            next += std::chrono::microseconds(static_cast<long>(1e6 / kRate));
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    std::atomic<std::uint64_t> queries(0), misses(0);
+    std::atomic<std::int64_t> busyNs(0);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r] {
+            std::uint64_t n = 0, miss = 0, seed = 88172645463325252ull + r;
+            PoseTimeline::Sample s;
+            const auto t0 = std::chrono::steady_clock::now();
+            while (!stop) {
+                for (int k = 0; k < 256; ++k) {
+                    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+                    const double newest = (head.load(std::memory_order_relaxed) - 1) / kRate;
+                    const double t = newest - window * static_cast<double>(seed % 10000) / 10000.0;
+                    if (!query(t, s)) {
+                        ++miss;
+                    }
+                    ++n;
+                }
+            }
+            busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+            queries += n;
+            misses += miss;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    writer.join();
+
+    Result result;
+    result.queries = queries.load();
+    result.misses = misses.load();
+    // wall time per query across all readers: lower is better, scales with readers if lock free
+    result.nsPerQuery = busyNs.load() / static_cast<double>(readers) / std::max<std::uint64_t>(1, result.queries);
+    return result;
+}
+
+} // namespace
+
+int main()
+{
+    const double window = 0.5, seconds = 1.0;
+    std::printf("writer %.0f Hz, queries in the last %.1f s, capacity %d\n", kRate, window, 1024);
+    std::printf("\n%-36s %12s %12s %10s %8s\n", "case", "ns/query", "Mquery/s", "speedup", "misses");
+
+    const unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> readerCounts = {1, 2, 4};
+    if (hw > 4) {
+        readerCounts.push_back(static_cast<int>(hw));
+    }
+    for (int readers : readerCounts) {
+        PoseTimeline locked;
+        std::mutex mtx;
+        const Result baseline = run(readers, window, seconds,
+            [&](double t, PoseTimeline::Sample& s) { std::lock_guard<std::mutex> l(mtx); return locked.at(t, s); },
+            [&](PoseTimeline::Sample const& s) { std::lock_guard<std::mutex> l(mtx); locked.push(s); });
+
+        PoseTimeline timeline;
+        const Result lockFree = run(readers, window, seconds,
+            [&](double t, PoseTimeline::Sample& s) { return timeline.at(t, s); },
+            [&](PoseTimeline::Sample const& s) { timeline.push(s); });
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "std::mutex, %d reader%s", readers, readers > 1 ? "s" : "");
+        std::printf("%-36s %12.1f %12.2f %9.2fx %8llu\n", name, baseline.nsPerQuery, 1e3 / baseline.nsPerQuery, 1.0,
+                    (unsigned long long)baseline.misses);
+        std::snprintf(name, sizeof(name), "lock free, %d reader%s", readers, readers > 1 ? "s" : "");
+        std::printf("%-36s %12.1f %12.2f %9.2fx %8llu\n", name, lockFree.nsPerQuery, 1e3 / lockFree.nsPerQuery,
+                    baseline.nsPerQuery / lockFree.nsPerQuery, (unsigned long long)lockFree.misses);
+    }
+    return 0;
+}
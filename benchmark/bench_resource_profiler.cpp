@@ -0,0 +1,92 @@
+// Measures what a pose callback pays to report the CPU usage: the getrusage() call of the
+// study samples (one syscall per pose, a cumulative number) against ResourceProfiler::cpuPercent(),
+// and the cost of one ResourceProfiler::update() done by the sampling thread once per interval.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "resource_profiler.h"
+#include "bench_util.hpp"
+
+namespace {
+
+/// getCPUUsage() of study/ex3.cpp before ResourceProfiler
+double getCPUUsage() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        double user_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        double sys_time = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        double total_time = user_time + sys_time;
+        return total_time * 100;
+    }
+    return 0.0;
+}
+
+} // namespace
+
+int main()
+{
+    if (!ResourceProfiler::supported()) {
+        std::printf("ResourceProfiler is not supported on this system\n");
+        return 0;
+    }
+
+    const int calls = 10000;
+    volatile double sink = 0;
+
+    std::printf("%-36s %12s %12s %10s\n", "case", "ns/call", "Mcall/s", "speedup");
+    const double legacy = benchRun([&] {
+        for (int i = 0; i < calls; ++i) {
+            sink = sink + getCPUUsage();
+        }
+    }, 0.5) / calls;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "getrusage per pose", legacy * 1e9, 1e-6 / legacy, 1.0);
+
+    ResourceProfiler profiler;
+    const double cached = benchRun([&] {
+        for (int i = 0; i < calls; ++i) {
+            sink = sink + profiler.cpuPercent();
+        }
+    }, 0.5) / calls;
+    std::printf("%-36s %12.1f %12.2f %9.2fx\n", "ResourceProfiler::cpuPercent", cached * 1e9, 1e-6 / cached, legacy / cached);
+
+    // the sampling cost grows with the threads: a device session has about 20 of them
+    std::printf("\n%-36s %12s %12s\n", "ResourceProfiler::update", "us/update", "% of 1 core");
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int count : {1, 8, 32}) {
+        while (static_cast<int>(threads.size()) + 2 < count) { // main and profiler threads
+            threads.emplace_back([&stop] {
+                while (!stop) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            });
+        }
+        ResourceProfiler::Options options;
+        options.intervalMs = 0;
+        ResourceProfiler manual(options);
+        const double update = benchRun([&] { manual.update(); }, 0.5);
+        char name[64];
+        std::snprintf(name, sizeof(name), "%zu threads", manual.snapshot().threads.size());
+        // at the default 1 s interval
+        std::printf("%-36s %12.1f %12.3f\n", name, update * 1e6, update * 100);
+    }
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    ResourceProfiler::Options options;
+    options.intervalMs = 0;
+    ResourceProfiler manual(options);
+    manual.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    manual.update();
+    std::printf("\n%s\n", ResourceProfiler::format(manual.snapshot(), 0).c_str());
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Compares the unpacking of the interleaved RGBD buffer (3 color bytes + float depth per
+// pixel) at 640x480 and 1280x720: two per-pixel passes building the side-by-side view as
+// raw_to_opencv(DepthColorImage) did, unpackRgbd() into planar depth + BGR, and the same
+// view from the planes through DepthColorizer. When OpenCV is available the former
+// raw_to_opencv is also run verbatim. Checks the planes and the view against references.
+
+#ifdef BENCH_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "colors.h"
+#include "depth_colorizer.h"
+#include "rgbd_unpack.h"
+#include "bench_util.hpp"
+
+namespace {
+
+struct Size { int width, height; };
+
+// depth ramps with holes and out of range values, color gradients
+std::vector<std::uint8_t> makeFrame(int width, int height)
+{
+    std::vector<std::uint8_t> frame(static_cast<std::size_t>(width) * height * kRgbdPixelBytes);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> noise(-0.02f, 0.02f);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            std::uint8_t* p = &frame[(static_cast<std::size_t>(y) * width + x) * kRgbdPixelBytes];
+            p[0] = static_cast<std::uint8_t>(x * 255 / width);
+            p[1] = static_cast<std::uint8_t>(y * 255 / height);
+            p[2] = static_cast<std::uint8_t>((x + y) & 0xff);
+            float d = 0.3f + 8.f * x / width + noise(rng);
+            if ((x * 7 + y * 13) % 29 == 0) d = 0;
+            if ((x + y * 3) % 97 == 0) d = 12.f;
+            std::memcpy(p + 3, &d, sizeof(d));
+        }
+    }
+    return frame;
+}
+
+/// Two passes over the packed buffer with a per-pixel palette lookup, into a plain buffer
+void twoPassView(std::uint8_t const* data, int width, int height, std::vector<std::uint8_t>& out)
+{
+    const int w = width, cols = 2 * width;
+    std::fill(out.begin(), out.end(), 0);
+    const float dmax = 7.5;
+    for (int i = 0; i < width * height; ++i) {
+        float d;
+        std::memcpy(&d, data + 3 + i * kRgbdPixelBytes, sizeof(d));
+        std::uint8_t* o = &out[3 * ((i / w) * cols + i % w)];
+        if (d < 0.01 || d > 9.9) {
+            o[0] = o[1] = o[2] = 0;
+        } else {
+            unsigned int u = static_cast<unsigned int>(std::max(0.0f, std::min(255.0f, d * 255.0f / dmax)));
+            const auto& cc = colors.at(u);
+            o[0] = cc.at(2);
+            o[1] = cc.at(1);
+            o[2] = cc.at(0);
+        }
+    }
+    for (int i = 0; i < width * height; ++i) {
+        std::uint8_t const* rgb = data + i * kRgbdPixelBytes;
+        std::uint8_t* o = &out[3 * ((i / w) * cols + i % w + w)];
+        o[0] = rgb[2];
+        o[1] = rgb[1];
+        o[2] = rgb[0];
+    }
+}
+
+/// Planes then view, the view rows hold the colorized depth then the color
+void planarView(RgbdPlanes& planes, DepthColorizer const& colorizer, std::uint8_t const* data, std::size_t size,
+                int width, int height, std::vector<std::uint8_t>& out)
+{
+    const std::size_t stride = 6u * width;
+    planes.depth.resize(static_cast<std::size_t>(width) * height);
+    unpackRgbd(data, size, width, height, RgbdColorOrder::Rgb, planes.depth.data(), width * sizeof(float),
+               out.data() + 3 * width, stride);
+    for (int y = 0; y < height; ++y) {
+        colorizer.colorizeDepth32(planes.depth.data() + static_cast<std::size_t>(y) * width, width, out.data() + stride * y);
+    }
+}
+
+#ifdef BENCH_WITH_OPENCV
+// --- former raw_to_opencv(DepthColorImage) of all_stream, kept verbatim as the baseline ---
+cv::Mat legacyView(std::uint8_t const* data, unsigned int width, unsigned int height)
+{
+    cv::Mat out;
+    out = cv::Mat::zeros(height, width*2, CV_8UC3);
+    auto w = width;
+
+    if (height>0 && width>0) {
+        float dmax = 7.5;
+        const auto tmp_d = reinterpret_cast<std::uint8_t const*>(data+3);
+        for (unsigned int i=0; i< height*width; i++) {
+            const auto &d = *reinterpret_cast<float const*>(tmp_d + i*(3+sizeof(float)));
+            if( d < 0.01 || d > 9.9 ) {
+                out.at<cv::Vec3b>(i / w, i % width) = 0;
+            } else {
+                unsigned int u = static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
+                const auto &cc = colors.at(u);
+                out.at<cv::Vec3b>( i/ w, i%width ) = cv::Vec3b(cc.at(2), cc.at(1), cc.at(0) );
+            }
+        }
+        const auto tmp_rgb = reinterpret_cast<std::uint8_t const*>(data);
+        for (unsigned int i=0; i< height*width; i++) {
+            const auto rgb = reinterpret_cast<std::uint8_t const*>(tmp_rgb + i*(3+sizeof(float)));
+            out.at<cv::Vec3b>( i/ w, (i%width) + width) = cv::Vec3b(rgb[2], rgb[1], rgb[0]);
+        }
+    }
+    return out;
+}
+#endif
+
+bool checkPlanes(std::vector<std::uint8_t> const& frame, RgbdPlanes const& planes)
+{
+    for (std::size_t i = 0; i < planes.depth.size(); ++i) {
+        std::uint8_t const* p = &frame[i * kRgbdPixelBytes];
+        if (std::memcmp(&planes.depth[i], p + 3, sizeof(float)) != 0 || planes.bgr[3 * i] != p[2] ||
+            planes.bgr[3 * i + 1] != p[1] || planes.bgr[3 * i + 2] != p[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    const Size sizes[] = {{640, 480}, {1280, 720}};
+    const DepthColorizer colorizer(colors, 7.5f, 2494.0f);
+    bool ok = true;
+
+    std::printf("unpackRgbd kernel: %s\n", rgbdUnpackKernel());
+    for (Size const& s : sizes) {
+        const std::vector<std::uint8_t> frame = makeFrame(s.width, s.height);
+        const double pixels = static_cast<double>(s.width) * s.height;
+        char title[64];
+        std::snprintf(title, sizeof(title), "RGBD %dx%d", s.width, s.height);
+        benchPrintHeader(title);
+
+        std::vector<std::uint8_t> reference(static_cast<std::size_t>(pixels) * 6);
+        const double base = benchRun([&] { twoPassView(frame.data(), s.width, s.height, reference); });
+        benchPrintRow("two passes, per pixel (view)", base, pixels, base);
+#ifdef BENCH_WITH_OPENCV
+        cv::Mat legacy;
+        const double t0 = benchRun([&] { legacy = legacyView(frame.data(), s.width, s.height); });
+        benchPrintRow("former raw_to_opencv (view)", t0, pixels, base);
+        ok &= std::memcmp(legacy.data, reference.data(), reference.size()) == 0;
+#endif
+
+        RgbdPlanes planes;
+        const double t1 = benchRun([&] { planes.unpack(frame.data(), frame.size(), s.width, s.height); });
+        benchPrintRow("unpackRgbd (depth + BGR planes)", t1, pixels, base);
+        ok &= checkPlanes(frame, planes);
+
+        std::vector<std::uint8_t> view(reference.size());
+        const double t2 = benchRun([&] { planarView(planes, colorizer, frame.data(), frame.size(), s.width, s.height, view); });
+        benchPrintRow("unpackRgbd + DepthColorizer (view)", t2, pixels, base);
+        ok &= view == reference;
+    }
+    if (!ok) {
+        std::printf("\nFAILED: output differs from the reference\n");
+        return 1;
+    }
+    return 0;
+}
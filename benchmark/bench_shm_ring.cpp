@@ -0,0 +1,248 @@
+// Latency from publishing a frame to a reader in another process having it, shared memory
+// rings (common/shm_ring.h) against pipes (the transport of pipe_srv, one pipe per reader).
+// Frames are paced at 1 kHz, payloads of an IMU sample, a ToF frame and a fisheye pair.
+//
+// usage: bench_shm_ring [frames]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+namespace {
+
+struct Result
+{
+    double p50Us, p99Us, maxUs;
+    std::uint64_t received, lost;
+};
+
+std::int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Result summarize(std::vector<std::int64_t>& latencies, std::uint64_t lost)
+{
+    Result r = {0, 0, 0, latencies.size(), lost};
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        r.p50Us = latencies[latencies.size() / 2] * 1e-3;
+        r.p99Us = latencies[latencies.size() * 99 / 100] * 1e-3;
+        r.maxUs = latencies.back() * 1e-3;
+    }
+    return r;
+}
+
+bool readAll(int fd, void* data, std::size_t size)
+{
+    auto p = static_cast<std::uint8_t*>(data);
+    while (size) {
+        const ssize_t n = ::read(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, void const* data, std::size_t size)
+{
+    auto p = static_cast<std::uint8_t const*>(data);
+    while (size) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/// Paces `frames` calls of publish(stamp) at 1 kHz
+template <class F>
+void publishPaced(int frames, F publish)
+{
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+        publish(nowNs());
+    }
+}
+
+/// Forks `readers` processes running `reader(index, resultFd)`, waits for their ready byte
+template <class F>
+std::vector<pid_t> spawnReaders(int readers, std::vector<int>& resultFds, F reader)
+{
+    std::vector<pid_t> pids;
+    int ready[2];
+    if (::pipe(ready) != 0) {
+        std::exit(1);
+    }
+    for (int i = 0; i < readers; ++i) {
+        int result[2];
+        if (::pipe(result) != 0) {
+            std::exit(1);
+        }
+        const pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(result[0]);
+            reader(i, ready[1], result[1]);
+            std::_Exit(0);
+        }
+        ::close(result[1]);
+        resultFds.push_back(result[0]);
+        pids.push_back(pid);
+    }
+    ::close(ready[1]);
+    char c;
+    for (int i = 0; i < readers; ++i) {
+        readAll(ready[0], &c, 1);
+    }
+    ::close(ready[0]);
+    return pids;
+}
+
+Result collect(std::vector<int> const& resultFds, std::vector<pid_t> const& pids)
+{
+    Result worst = {0, 0, 0, 0, 0};
+    for (std::size_t i = 0; i < pids.size(); ++i) {
+        Result r;
+        if (readAll(resultFds[i], &r, sizeof(r))) {
+            worst.p50Us = std::max(worst.p50Us, r.p50Us);
+            worst.p99Us = std::max(worst.p99Us, r.p99Us);
+            worst.maxUs = std::max(worst.maxUs, r.maxUs);
+            worst.received += r.received;
+            worst.lost += r.lost;
+        }
+        ::close(resultFds[i]);
+        ::waitpid(pids[i], nullptr, 0);
+    }
+    return worst;
+}
+
+Result runRing(std::size_t payload, int readers, int frames)
+{
+    const std::string name = "/xvsdk_bench." + std::to_string(::getpid());
+    ShmRingWriter writer;
+    if (!writer.create(name, XvRecTrack::Fisheye, 8, payload)) {
+        std::fprintf(stderr, "%s\n", writer.error().c_str());
+        std::exit(1);
+    }
+    std::vector<int> resultFds;
+    auto pids = spawnReaders(readers, resultFds, [&](int, int readyFd, int resultFd) {
+        ShmRingReader reader;
+        reader.open(name);
+        writeAll(readyFd, "r", 1);
+        std::vector<std::int64_t> latencies;
+        latencies.reserve(frames);
+        ShmFrame f;
+        while (static_cast<int>(latencies.size()) + static_cast<int>(reader.overruns()) < frames) {
+            if (!reader.wait(200) && reader.closed()) {
+                break;
+            }
+            while (reader.next(f)) {
+                std::int64_t stamp;
+                std::memcpy(&stamp, f.record.data, sizeof(stamp));
+                if (reader.valid(f)) {
+                    latencies.push_back(nowNs() - stamp);
+                }
+            }
+        }
+        Result r = summarize(latencies, frames - latencies.size());
+        writeAll(resultFd, &r, sizeof(r));
+    });
+
+    std::vector<std::uint8_t> data(payload, 0x5a);
+    publishPaced(frames, [&](std::int64_t stamp) {
+        std::memcpy(data.data(), &stamp, sizeof(stamp));
+        XvRecWriter::Part part = {data.data(), data.size()};
+        writer.publish(0, 0, &part, 1);
+    });
+    const Result r = collect(resultFds, pids);
+    writer.close();
+    return r;
+}
+
+Result runPipes(std::size_t payload, int readers, int frames)
+{
+    std::vector<int> writeFds(readers), readFds(readers);
+    for (int i = 0; i < readers; ++i) {
+        int p[2];
+        if (::pipe(p) != 0) {
+            std::exit(1);
+        }
+        readFds[i] = p[0];
+        writeFds[i] = p[1];
+    }
+    std::vector<int> resultFds;
+    auto pids = spawnReaders(readers, resultFds, [&](int index, int readyFd, int resultFd) {
+        for (int i = 0; i < readers; ++i) {
+            ::close(writeFds[i]);
+        }
+        writeAll(readyFd, "r", 1);
+        std::vector<std::int64_t> latencies;
+        latencies.reserve(frames);
+        std::vector<std::uint8_t> frame(payload);
+        while (readAll(readFds[index], frame.data(), frame.size())) {
+            std::int64_t stamp;
+            std::memcpy(&stamp, frame.data(), sizeof(stamp));
+            latencies.push_back(nowNs() - stamp);
+        }
+        Result r = summarize(latencies, frames - latencies.size());
+        writeAll(resultFd, &r, sizeof(r));
+    });
+    for (int i = 0; i < readers; ++i) {
+        ::close(readFds[i]);
+    }
+
+    std::vector<std::uint8_t> data(payload, 0x5a);
+    publishPaced(frames, [&](std::int64_t stamp) {
+        std::memcpy(data.data(), &stamp, sizeof(stamp));
+        for (int fd : writeFds) {
+            writeAll(fd, data.data(), data.size());
+        }
+    });
+    for (int fd : writeFds) {
+        ::close(fd);
+    }
+    return collect(resultFds, pids);
+}
+
+void printRow(const char* transport, std::size_t payload, int readers, Result const& r)
+{
+    std::printf("%-6s %10zu %8d %10.1f %10.1f %10.1f %8llu\n", transport, payload, readers, r.p50Us, r.p99Us, r.maxUs,
+                static_cast<unsigned long long>(r.lost));
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int frames = argc > 1 ? std::max(100, std::atoi(argv[1])) : 2000;
+    // IMU sample, 224x172 ToF depth (float), two 640x400 fisheye images
+    const std::size_t payloads[] = {96, 224 * 172 * 4, 2 * 640 * 400};
+
+    std::printf("\npublish -> read latency across processes, %d frames at 1 kHz (worst reader)\n", frames);
+    std::printf("%-6s %10s %8s %10s %10s %10s %8s\n", "", "bytes", "readers", "p50 us", "p99 us", "max us", "lost");
+    for (std::size_t payload : payloads) {
+        for (int readers : {1, 3}) {
+            printRow("pipe", payload, readers, runPipes(payload, readers, frames));
+            printRow("shm", payload, readers, runRing(payload, readers, frames));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Measures the parse throughput of the bundled data/slam_data.txt: the std::getline +
+// std::string + atof parser that xvrec_synthetic used, slamLogParse() on the file in memory,
+// slamLogLoad() of the file (mmap + parse) and the reload of its xvrec form.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "slam_log.h"
+#include "bench_util.hpp"
+
+#ifndef XVSDK_DATA_DIR
+#define XVSDK_DATA_DIR "../data"
+#endif
+
+namespace {
+
+struct SlamSample
+{
+    double t;
+    double position[3];
+    double orientation[4];
+    double confidence;
+};
+
+/// loadSlamData() of xvrec_synthetic.cpp before slamLogParse(), reading from a stream
+std::vector<SlamSample> legacyParse(std::istream& in)
+{
+    std::vector<SlamSample> samples;
+    std::string line;
+    SlamSample s;
+    std::memset(&s, 0, sizeof(s));
+    long long secs = 0, nsecs = 0;
+    int field = 0;
+    double t0 = -1;
+    while (std::getline(in, line)) {
+        const std::size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            if (line.compare(0, 3, "---") == 0 && field == 7) {
+                const double t = secs + nsecs * 1e-9;
+                if (t0 < 0) {
+                    t0 = t;
+                }
+                s.t = t - t0;
+                if (samples.empty() || s.t > samples.back().t) {
+                    samples.push_back(s);
+                }
+                field = 0;
+            }
+            continue;
+        }
+        const std::size_t key = line.find_first_not_of(' ');
+        const std::string name = line.substr(key, colon - key);
+        const char* value = line.c_str() + colon + 1;
+        if (name == "confidence") {
+            s.confidence = std::atof(value);
+        } else if (name == "secs") {
+            secs = std::atoll(value);
+        } else if (name == "nsecs") {
+            nsecs = std::atoll(value);
+        } else if ((name == "x" || name == "y" || name == "z" || name == "w") && field < 7) {
+            if (field < 3) {
+                s.position[field] = std::atof(value);
+            } else {
+                s.orientation[field - 3] = std::atof(value);
+            }
+            ++field;
+        }
+    }
+    return samples;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const std::string path = std::string(argc > 1 ? argv[1] : XVSDK_DATA_DIR) + "/slam_data.txt";
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "cannot open %s\n", path.c_str());
+        return 1;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string text = content.str();
+    const double mb = text.size() / 1048576.;
+
+    std::printf("%s: %.2f MB\n", path.c_str(), mb);
+    std::printf("%-36s %12s %12s %10s %8s\n", "case", "ms/file", "MB/s", "speedup", "poses");
+
+    std::size_t legacyPoses = 0;
+    const double legacy = benchRun([&] {
+        std::istringstream in(text);
+        legacyPoses = legacyParse(in).size();
+    }, 1.0);
+    std::printf("%-36s %12.3f %12.1f %9.2fx %8zu\n", "getline + std::string + atof", legacy * 1e3, mb / legacy, 1.0, legacyPoses);
+
+    SlamTrajectory trajectory;
+    const double parse = benchRun([&] {
+        trajectory.clear();
+        slamLogParse(text.data(), text.size(), trajectory);
+    }, 1.0);
+    std::printf("%-36s %12.3f %12.1f %9.2fx %8zu\n", "slamLogParse (in memory)", parse * 1e3, mb / parse, legacy / parse,
+                trajectory.size());
+
+    const double load = benchRun([&] {
+        trajectory.clear();
+        slamLogLoad(path, trajectory);
+    }, 1.0);
+    std::printf("%-36s %12.3f %12.1f %9.2fx %8zu\n", "slamLogLoad (mmap + parse)", load * 1e3, mb / load, legacy / load,
+                trajectory.size());
+
+    char xvrec[] = "/tmp/bench_slam_log_XXXXXX";
+    const int fd = mkstemp(xvrec);
+    if (fd < 0) {
+        return 1;
+    }
+    close(fd);
+    std::string error;
+    if (!slamLogWriteXvRec(xvrec, trajectory, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        unlink(xvrec);
+        return 1;
+    }
+    const double reload = benchRun([&] {
+        trajectory.clear();
+        slamLogLoad(xvrec, trajectory);
+    }, 1.0);
+    std::printf("%-36s %12.3f %12s %9.2fx %8zu\n", "slamLogLoad (xvrec)", reload * 1e3, "-", legacy / reload, trajectory.size());
+    unlink(xvrec);
+
+    if (trajectory.size() != legacyPoses) {
+        std::printf("\nFAILED: %zu poses instead of %zu\n", trajectory.size(), legacyPoses);
+        return 1;
+    }
+    return 0;
+}
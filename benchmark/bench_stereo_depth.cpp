@@ -0,0 +1,103 @@
+// Throughput of the stereo depth path of study/compose_stereo (StereoSGBM created per frame
+// on BGR images, point cloud built with push_back) against StereoDepthEngine on the
+// data/left_image_0.png / right_image_0.png pair.
+//
+// usage: bench_stereo_depth [data dir]
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "stereo_depth.h"
+#include "bench_util.hpp"
+
+#ifndef XVSDK_DATA_DIR
+#define XVSDK_DATA_DIR "../data"
+#endif
+
+namespace {
+
+// intrinsics used by compose_stereo.cpp
+const double kF = 718.856, kCx = 607.1928, kCy = 185.2157, kB = 0.573;
+
+// --- former implementation (compose_stereo.cpp, without PCL), kept as the baseline ---
+
+std::size_t legacyStereo(cv::Mat const& left_img, cv::Mat const& right_img, std::vector<cv::Vec3f>& cloud)
+{
+    double f = kF, cx = kCx, cy = kCy;
+    double b = kB;
+    cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(0, 96, 9, 8 * 9 * 9, 32 * 9 * 9, 1, 63, 10, 100, 32);
+    cv::Mat disparity_sgbm, disparity;
+    sgbm->compute(left_img, right_img, disparity_sgbm);
+    disparity_sgbm.convertTo(disparity, CV_32F, 1.0 / 16.0);
+
+    cloud.clear();
+    for (int v = 0; v < left_img.rows; v++) {
+        for (int u = 0; u < left_img.cols; u++) {
+            float disp = disparity.at<float>(v, u);
+            if (disp <= 10 || disp >= 96) continue;
+            double x = (u - cx) / f;
+            double y = (v - cy) / f;
+            double depth = f * b / disp;
+            cloud.push_back(cv::Vec3f(x * depth, y * depth, depth));
+        }
+    }
+    return cloud.size();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const std::string dir = argc > 1 ? argv[1] : XVSDK_DATA_DIR;
+    cv::Mat left = cv::imread(dir + "/left_image_0.png");
+    cv::Mat right = cv::imread(dir + "/right_image_0.png");
+    if (left.empty() || right.empty()) {
+        std::fprintf(stderr, "cannot read %s/left_image_0.png, right_image_0.png\n", dir.c_str());
+        return 1;
+    }
+    const double pixels = static_cast<double>(left.total());
+    const StereoRig rectified = stereoRigRectified(left.size(), kF, kCx, kCy, kB);
+    // same images through the rectification path: identity rotation, so only the remap cost is added
+    StereoRig rig = rectified;
+    rig.rectified = false;
+
+    char title[96];
+    std::snprintf(title, sizeof(title), "stereo depth %dx%d, 96 disparities, %d threads", left.cols, left.rows, cv::getNumThreads());
+    benchPrintHeader(title);
+
+    std::vector<cv::Vec3f> cloud;
+    const double base = benchRun([&]{ legacyStereo(left, right, cloud); }, 3.0);
+    benchPrintRow("compose_stereo (BGR, per frame)", base, pixels, base);
+    const std::size_t legacyPoints = cloud.size();
+
+    StereoDepthEngine::Options options;
+    options.bands = 1;
+    StereoDepthEngine single(rectified, options);
+    double t = benchRun([&]{ single.compute(left, right); }, 3.0);
+    benchPrintRow("engine, gray, 1 band", t, pixels, base);
+
+    StereoDepthEngine banded(rectified);
+    t = benchRun([&]{ banded.compute(left, right); }, 3.0);
+    char name[64];
+    std::snprintf(name, sizeof(name), "engine, gray, %d bands", banded.bands());
+    benchPrintRow(name, t, pixels, base);
+
+    cv::Mat leftGray, rightGray;
+    cv::cvtColor(left, leftGray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(right, rightGray, cv::COLOR_BGR2GRAY);
+    t = benchRun([&]{ banded.compute(leftGray, rightGray); }, 3.0);
+    std::snprintf(name, sizeof(name), "engine, gray input, %d bands", banded.bands());
+    benchPrintRow(name, t, pixels, base);
+
+    StereoDepthEngine remapped(rig);
+    t = benchRun([&]{ remapped.compute(leftGray, rightGray); }, 3.0);
+    std::snprintf(name, sizeof(name), "engine + rectify, %d bands", remapped.bands());
+    benchPrintRow(name, t, pixels, base);
+
+    std::printf("valid points: legacy %zu (BGR matching), engine %zu (gray, 1 band) %zu (%d bands)\n",
+                legacyPoints, single.validPoints(), banded.validPoints(), banded.bands());
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+/**
+ * @brief Runs `fn` until at least `minSeconds` elapsed (after one warm-up call)
+ * @return mean seconds per call
+ */
+template <class F>
+double benchRun(F&& fn, double minSeconds = 1.0)
+{
+    fn();
+    long long n = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        fn();
+        ++n;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (elapsed < minSeconds);
+    return elapsed / n;
+}
+
+inline void benchPrintHeader(const char* title)
+{
+    std::printf("\n%s\n", title);
+    std::printf("%-36s %12s %12s %10s\n", "case", "ms/frame", "Mpixel/s", "speedup");
+}
+
+inline void benchPrintRow(const char* name, double secondsPerCall, double pixels, double baselineSeconds)
+{
+    std::printf("%-36s %12.3f %12.1f %9.2fx\n", name, secondsPerCall * 1e3,
+                pixels / secondsPerCall * 1e-6, baselineSeconds / secondsPerCall);
+}
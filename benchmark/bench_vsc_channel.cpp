@@ -0,0 +1,272 @@
+// Round trip of a demo-api menu request: the former FIFO protocol (write menu, read the
+// 16-int reply, answered by pipe_srv) against the Unix socket channel of pipe_srv.h
+// (device -> server -> controller -> server -> device), alone and with 1 kHz telemetry
+// fanned out to three controllers.
+//
+// usage: bench_vsc_channel [requests]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "pipe_srv.h"
+
+namespace {
+
+// --- former implementation (pipe_srv.h), kept as the baseline; "recv cmd" printf removed ---
+namespace legacy {
+
+#define VSC_SRV_RECV_PIPE	"./vscSrvRfifo"   // client write,
+#define VSC_SRV_SEND_PIPE	"./vscSrvWfifo"   // client read
+
+#define SRV_CMD_FLAG1	('C')
+#define SRV_CMD_FLAG2	('M')
+#define SRV_CMD_FLAG3	('D')
+
+#define IS_PIPE_SRV_CMD(cmd1, cmd2, cmd3) \
+	((cmd1==SRV_CMD_FLAG1) && (cmd2==SRV_CMD_FLAG2) && (cmd3==SRV_CMD_FLAG3))
+
+static int vsc_pipe_init(void)
+{
+	int ret;
+
+	if (access(VSC_SRV_RECV_PIPE, F_OK) != 0) {
+		ret = mkfifo(VSC_SRV_RECV_PIPE, 0666);
+		if (0 != ret) {
+			printf("mkfifo server recv pipe fail, ret: %d\n", ret);
+			return -1;
+		}
+	}
+
+	if (access(VSC_SRV_SEND_PIPE, F_OK) != 0) {
+		ret = mkfifo(VSC_SRV_SEND_PIPE, 0666);
+		if (0 != ret) {
+			printf("mkfifo server send pipe fail, ret: %d\n", ret);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int vsc_server_get_handle(int *sendfd, int *recvfd)
+{
+	int ret = 0;
+
+	ret = open(VSC_SRV_SEND_PIPE, O_WRONLY);
+	if (ret < 0) {
+		printf("open vsc cmd pipe for server fail, %d\n", ret);
+		return ret;
+	}
+	*sendfd = ret;
+
+	ret = open(VSC_SRV_RECV_PIPE, O_RDONLY);
+	if (ret < 0) {
+		printf("open vsc cmd pipe for server fail, %d\n", ret);
+		return ret;
+	}
+	*recvfd = ret;
+
+	return 0;
+}
+
+static int vsc_cmd_recv_fd = -1;
+static int vsc_cmd_send_fd = -1;
+
+static int vsc_client_pipe_init(void)
+{
+	int ret = 0;
+
+	ret = vsc_pipe_init();
+	if (ret != 0) return ret;
+
+	ret = open(VSC_SRV_SEND_PIPE, O_RDONLY);
+	if (ret < 0) {
+		printf("open vsc cmd pipe for client recv fail, %d\n", ret);
+		return ret;
+	}
+	vsc_cmd_recv_fd = ret;
+
+	ret = open(VSC_SRV_RECV_PIPE, O_WRONLY);
+	if (ret < 0) {
+		printf("open vsc cmd pipe for client send fail, %d\n", ret);
+		return ret;
+	}
+	vsc_cmd_send_fd = ret;
+	return 0;
+}
+
+static int vsc_client_pipe_request_cmd(const char *tip_info, int size)
+{
+	int cmdbuf[16] = {0};
+	int retval;
+
+	retval = write(vsc_cmd_send_fd, tip_info, size);
+	retval = read(vsc_cmd_recv_fd, cmdbuf, sizeof(cmdbuf));
+	(void)retval;
+	if (IS_PIPE_SRV_CMD(cmdbuf[0], cmdbuf[1], cmdbuf[2])) {
+		return cmdbuf[3];
+	}
+	return -1;
+}
+
+/// pipe_srv main loop, answering 1 instead of reading the console
+static void serve()
+{
+	int sendfd = -1, recvfd = -1;
+	char menu_info[4096];
+	int cmdbuf[4] = { SRV_CMD_FLAG1, SRV_CMD_FLAG2, SRV_CMD_FLAG3, 1 };
+	vsc_pipe_init();
+	vsc_server_get_handle(&sendfd, &recvfd);
+	while (read(recvfd, menu_info, sizeof(menu_info) - 2) > 0) {
+		if (write(sendfd, cmdbuf, sizeof(cmdbuf)) < 0)
+			break;
+	}
+}
+
+} // namespace legacy
+
+struct Rtt
+{
+    double p50Us, p99Us, maxUs;
+    int failed;
+};
+
+template <class F>
+Rtt measure(int requests, F request)
+{
+    std::vector<double> us;
+    us.reserve(requests);
+    int failed = 0;
+    for (int i = 0; i < requests; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        const int cmd = request();
+        us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        failed += cmd != 1;
+    }
+    std::sort(us.begin(), us.end());
+    Rtt r = {us[us.size() / 2], us[us.size() * 99 / 100], us.back(), failed};
+    return r;
+}
+
+void printRow(const char* name, Rtt const& r)
+{
+    std::printf("%-44s %10.1f %10.1f %10.1f %8d\n", name, r.p50Us, r.p99Us, r.maxUs, r.failed);
+}
+
+Rtt runFifo(std::string const& menu, int requests)
+{
+    const pid_t server = ::fork();
+    if (server == 0) {
+        legacy::serve();
+        std::_Exit(0);
+    }
+    legacy::vsc_client_pipe_init();
+    const Rtt r = measure(requests, [&] {
+        return legacy::vsc_client_pipe_request_cmd(menu.c_str(), static_cast<int>(menu.size()));
+    });
+    ::close(legacy::vsc_cmd_send_fd);
+    ::close(legacy::vsc_cmd_recv_fd);
+    ::waitpid(server, nullptr, 0);
+    ::unlink(VSC_SRV_RECV_PIPE);
+    ::unlink(VSC_SRV_SEND_PIPE);
+    return r;
+}
+
+/// Controllers answer every menu with 1 and read the telemetry
+Rtt runSocket(std::string const& menu, int requests, int controllers, bool telemetry)
+{
+    const std::string path = "./vscBench" + std::to_string(::getpid()) + ".sock";
+    const pid_t server = ::fork();
+    if (server == 0) {
+        ::signal(SIGTERM, [](int) { vsc_srv_quit = 1; });
+        vsc_server_run(path.c_str(), -1);
+        std::_Exit(0);
+    }
+    auto connectRetry = [&path](int role) {
+        int fd;
+        while ((fd = vsc_connect(path.c_str(), role)) < 0) {
+            ::usleep(1000);
+        }
+        return fd;
+    };
+
+    std::vector<pid_t> pids;
+    for (int i = 0; i < controllers; ++i) {
+        const pid_t pid = ::fork();
+        if (pid == 0) {
+            const int fd = connectRetry(VSC_ROLE_CONTROLLER);
+            struct vsc_msg_header hdr;
+            char payload[4096];
+            while (vsc_recv_msg(fd, &hdr, payload, sizeof(payload)) >= 0) {
+                if (hdr.type == VSC_MSG_MENU) {
+                    vsc_controller_send_command(fd, hdr.id, 1);
+                }
+            }
+            std::_Exit(0);
+        }
+        pids.push_back(pid);
+    }
+    vsc_cmd_fd = connectRetry(VSC_ROLE_DEVICE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // controllers connected
+
+    std::atomic<bool> stop(false);
+    std::thread pusher;
+    if (telemetry) {
+        pusher = std::thread([&stop] {
+            struct vsc_telemetry t;
+            std::memset(&t, 0, sizeof(t));
+            std::strcpy(t.stream, "imu");
+            auto next = std::chrono::steady_clock::now();
+            while (!stop) {
+                next += std::chrono::milliseconds(1);
+                std::this_thread::sleep_until(next);
+                ++t.count;
+                vsc_client_send_telemetry(&t);
+            }
+        });
+    }
+    std::uint32_t id = 0;
+    const Rtt r = measure(requests, [&] {
+        return vsc_request_cmd(vsc_cmd_fd, &vsc_cmd_send_mtx, ++id, menu.c_str(), static_cast<int>(menu.size()));
+    });
+    stop = true;
+    if (pusher.joinable()) {
+        pusher.join();
+    }
+    vsc_client_pipe_deinit();
+    ::kill(server, SIGTERM);
+    ::waitpid(server, nullptr, 0);
+    for (pid_t pid : pids) {
+        ::waitpid(pid, nullptr, 0);
+    }
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int requests = argc > 1 ? std::max(100, std::atoi(argv[1])) : 5000;
+    // about the size of the demo-api main menu
+    std::string menu;
+    while (menu.size() < 2000) {
+        menu += "  " + std::to_string(menu.size() / 40) + " : start or stop a stream of the device\n";
+    }
+
+    std::printf("\nmenu request round trip, %zu byte menu, %d requests\n", menu.size(), requests);
+    std::printf("%-44s %10s %10s %10s %8s\n", "transport", "p50 us", "p99 us", "max us", "failed");
+    printRow("FIFO, pipe_srv answers", runFifo(menu, requests));
+    printRow("socket, 1 controller answers", runSocket(menu, requests, 1, false));
+    printRow("socket, 3 controllers + 1 kHz telemetry", runSocket(menu, requests, 3, true));
+    return 0;
+}
@@ -0,0 +1,217 @@
+// Compares yuvToBgr() (convert + downscale in one pass) against a per-pixel reference and,
+// when OpenCV is available, against the former raw_to_opencv(ColorImage) path followed by
+// the cv::resize() of the all_stream preview, for every codec and scale factor.
+
+#ifdef BENCH_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "yuv_to_bgr.h"
+#include "bench_util.hpp"
+
+namespace {
+
+// smooth gradients plus noise, like a camera frame (flat random data would hide rounding)
+std::vector<std::uint8_t> makeFrame(YuvLayout layout, int width, int height)
+{
+    std::vector<std::uint8_t> frame(yuvFrameSize(layout, width, height));
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> noise(-6, 6);
+    auto luma = [&](int x, int y) { return std::max(0, std::min(255, 16 + (x * 219 / width + y * 64 / height) % 220 + noise(rng))); };
+    auto chroma = [&](int x, int y, int phase) { return std::max(0, std::min(255, 128 + static_cast<int>(100 * std::sin(0.01 * (x + phase) + 0.02 * y)) + noise(rng))); };
+
+    if (layout == YuvLayout::YUYV) {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; x += 2) {
+                std::uint8_t* p = &frame[(static_cast<std::size_t>(y) * width + x) * 2];
+                p[0] = luma(x, y);
+                p[1] = chroma(x, y, 0);
+                p[2] = luma(x + 1, y);
+                p[3] = chroma(x, y, 300);
+            }
+        }
+        return frame;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            frame[static_cast<std::size_t>(y) * width + x] = luma(x, y);
+        }
+    }
+    std::uint8_t* c = &frame[static_cast<std::size_t>(width) * height];
+    const int cw = width / 2, ch = height / 2;
+    for (int y = 0; y < ch; ++y) {
+        for (int x = 0; x < cw; ++x) {
+            const std::uint8_t u = chroma(2 * x, 2 * y, 0), v = chroma(2 * x, 2 * y, 300);
+            if (layout == YuvLayout::I420) {
+                c[y * cw + x] = u;
+                c[cw * ch + y * cw + x] = v;
+            } else {
+                c[y * width + 2 * x] = u;
+                c[y * width + 2 * x + 1] = v;
+            }
+        }
+    }
+    return frame;
+}
+
+// floating point reference: Y / U / V box-averaged over each output pixel, then BT.601
+std::vector<std::uint8_t> reference(YuvLayout layout, std::vector<std::uint8_t> const& frame, int width, int height, int scale)
+{
+    // full resolution planes, chroma replicated over the pixels it covers
+    const std::size_t pixels = static_cast<std::size_t>(width) * height;
+    std::vector<double> planes(3 * pixels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int Y, U, V;
+            if (layout == YuvLayout::YUYV) {
+                std::uint8_t const* p = &frame[(static_cast<std::size_t>(y) * width + (x & ~1)) * 2];
+                Y = p[(x & 1) * 2];
+                U = p[1];
+                V = p[3];
+            } else {
+                std::uint8_t const* c = &frame[pixels];
+                const int cw = width / 2, ch = height / 2;
+                Y = frame[static_cast<std::size_t>(y) * width + x];
+                if (layout == YuvLayout::I420) {
+                    U = c[(y / 2) * cw + x / 2];
+                    V = c[cw * ch + (y / 2) * cw + x / 2];
+                } else {
+                    U = c[(y / 2) * width + (x & ~1)];
+                    V = c[(y / 2) * width + (x & ~1) + 1];
+                }
+            }
+            const std::size_t i = static_cast<std::size_t>(y) * width + x;
+            planes[i] = Y;
+            planes[pixels + i] = U;
+            planes[2 * pixels + i] = V;
+        }
+    }
+    const int ow = width / scale, oh = height / scale;
+    std::vector<std::uint8_t> out(static_cast<std::size_t>(ow) * oh * 3);
+    for (int y = 0; y < oh; ++y) {
+        for (int x = 0; x < ow; ++x) {
+            double yuv[3] = {0, 0, 0};
+            for (int k = 0; k < 3; ++k) {
+                for (int dy = 0; dy < scale; ++dy) {
+                    for (int dx = 0; dx < scale; ++dx) {
+                        yuv[k] += planes[k * pixels + (static_cast<std::size_t>(y) * scale + dy) * width + x * scale + dx];
+                    }
+                }
+                yuv[k] /= scale * scale;
+            }
+            const double yy = 1.164383 * std::max(0.0, yuv[0] - 16), u = yuv[1] - 128, v = yuv[2] - 128;
+            const double bgr[3] = {yy + 2.017232 * u, yy - 0.391762 * u - 0.812968 * v, yy + 1.596027 * v};
+            for (int k = 0; k < 3; ++k) {
+                out[(static_cast<std::size_t>(y) * ow + x) * 3 + k] = static_cast<std::uint8_t>(std::lround(std::max(0.0, std::min(255.0, bgr[k]))));
+            }
+        }
+    }
+    return out;
+}
+
+int maxDiff(std::uint8_t const* a, std::uint8_t const* b, std::size_t n)
+{
+    int d = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        d = std::max(d, std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+    }
+    return d;
+}
+
+#ifdef BENCH_WITH_OPENCV
+// --- former implementation (raw_to_opencv(ColorImage) + preview resize), the baseline ---
+
+cv::Mat legacyConvert(YuvLayout layout, std::uint8_t const* raw, int width, int height, int scale)
+{
+    cv::Mat img;
+    if (layout == YuvLayout::YUYV) {
+        img = cv::Mat::zeros(height, width, CV_8UC3);
+        auto rawImg = cv::Mat(height, width, CV_8UC2, const_cast<unsigned char*>(raw));
+        cv::cvtColor(rawImg, img, cv::COLOR_YUV2BGR_YUYV);
+    } else {
+        img = cv::Mat::zeros(height, width, CV_8UC3);
+        auto rawImg = cv::Mat(height * 3 / 2, width, CV_8UC1, const_cast<unsigned char*>(raw));
+        cv::cvtColor(rawImg, img, layout == YuvLayout::I420 ? cv::COLOR_YUV2BGR_I420 : cv::COLOR_YUV2BGR_NV12);
+    }
+    if (scale > 1) {
+        cv::resize(img, img, cv::Size(), 1.0 / scale, 1.0 / scale);
+    }
+    return img;
+}
+#endif
+
+const char* layoutName(YuvLayout layout)
+{
+    switch (layout) {
+    case YuvLayout::I420: return "YUV420p";
+    case YuvLayout::NV12: return "NV12";
+    case YuvLayout::YUYV: return "YUYV";
+    }
+    return "?";
+}
+
+} // namespace
+
+int main()
+{
+    struct Size { int width, height; };
+    const Size sizes[] = {{1280, 720}, {1920, 1080}};
+    const YuvLayout layouts[] = {YuvLayout::I420, YuvLayout::NV12, YuvLayout::YUYV};
+    const int scales[] = {1, 2, 4};
+    bool ok = true;
+
+    std::printf("yuvToBgr kernel: %s\n", yuvToBgrKernel());
+    for (Size const& s : sizes) {
+        for (YuvLayout layout : layouts) {
+            const std::vector<std::uint8_t> frame = makeFrame(layout, s.width, s.height);
+            char title[96];
+            std::snprintf(title, sizeof(title), "%s %dx%d", layoutName(layout), s.width, s.height);
+            benchPrintHeader(title);
+
+            for (int scale : scales) {
+                const int ow = yuvScaledSize(s.width, scale), oh = yuvScaledSize(s.height, scale);
+                std::vector<std::uint8_t> out(static_cast<std::size_t>(ow) * oh * 3);
+                char name[64];
+
+                double baseline = 0;
+#ifdef BENCH_WITH_OPENCV
+                cv::Mat legacy;
+                baseline = benchRun([&] { legacy = legacyConvert(layout, frame.data(), s.width, s.height, scale); });
+                std::snprintf(name, sizeof(name), "cvtColor%s 1/%d", scale > 1 ? "+resize" : "", scale);
+                benchPrintRow(name, baseline, static_cast<double>(s.width) * s.height, baseline);
+#endif
+                const double t = benchRun([&] {
+                    yuvToBgr(layout, frame.data(), s.width, s.height, scale, out.data(), 3 * ow);
+                });
+                std::snprintf(name, sizeof(name), "yuvToBgr 1/%d", scale);
+                benchPrintRow(name, t, static_cast<double>(s.width) * s.height, baseline > 0 ? baseline : t);
+
+                // the kernels round the averaged samples to 8 bits before converting
+                const std::vector<std::uint8_t> ref = reference(layout, frame, s.width, s.height, scale);
+                const int diff = maxDiff(out.data(), ref.data(), out.size());
+                std::printf("    max difference vs reference: %d", diff);
+#ifdef BENCH_WITH_OPENCV
+                if (legacy.rows == oh && legacy.cols == ow) {
+                    std::printf(", vs former path: %d", maxDiff(out.data(), legacy.ptr<std::uint8_t>(0), out.size()));
+                }
+#endif
+                std::printf("\n");
+                if (diff > 2) {
+                    ok = false;
+                }
+            }
+        }
+    }
+    if (!ok) {
+        std::printf("\nFAILED: output differs from the reference\n");
+    }
+    return ok ? 0 : 1;
+}
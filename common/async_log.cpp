@@ -0,0 +1,423 @@
+#include "async_log.h"
+#include "frame_trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstring>
+
+namespace {
+
+const char kBinaryMagic[4] = {'X', 'L', 'O', 'G'};
+const std::uint32_t kBinaryVersion = 1;
+
+double steadyNow()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() * 1e-6;
+}
+
+void copyText(char* dst, std::size_t size, char const* src)
+{
+    if (!src) {
+        dst[0] = '\0';
+        return;
+    }
+    std::size_t n = 0;
+    while (n + 1 < size && src[n]) {
+        dst[n] = src[n];
+        ++n;
+    }
+    dst[n] = '\0';
+}
+
+LogRecord makeRecord(std::uint16_t stream, LogKind kind, std::int64_t edgeTimestampUs, double hostTimestamp, double fps, std::uint8_t flags)
+{
+    LogRecord r;
+    r.stream = stream;
+    r.kind = kind;
+    r.flags = flags;
+    r.fps = static_cast<float>(fps);
+    r.edgeTimestampUs = edgeTimestampUs;
+    r.hostTimestamp = hostTimestamp;
+    return r;
+}
+
+void append(std::string& out, char const* format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    const int n = std::vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n > 0) {
+        out.append(buf, std::min<std::size_t>(n, sizeof(buf) - 1));
+    }
+}
+
+void appendJsonString(std::string& out, char const* s)
+{
+    out += '"';
+    for (; *s; ++s) {
+        const unsigned char c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            append(out, "\\u%04x", c);
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+char const* kindName(LogKind kind)
+{
+    switch (kind) {
+    case LogKind::StreamName: return "stream";
+    case LogKind::Frame: return "frame";
+    case LogKind::Imu: return "imu";
+    case LogKind::Pose: return "pose";
+    case LogKind::Values: return "values";
+    case LogKind::Event: return "event";
+    case LogKind::Message: return "message";
+    }
+    return "?";
+}
+
+} // namespace
+
+AsyncLog::AsyncLog(Options const& options)
+    : m_options(options), m_out(stdout), m_ownsOut(false), m_head(0), m_written(0), m_dropped(0),
+      m_nextStream(0), m_stop(false), m_readPos(0)
+{
+    std::size_t n = 2;
+    while (n < m_options.capacity) {
+        n *= 2;
+    }
+    m_slots.reset(new Slot[n]);
+    m_mask = n - 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    if (!m_options.path.empty()) {
+        m_out = std::fopen(m_options.path.c_str(), m_options.format == LogFormat::Binary ? "wb" : "w");
+        if (m_out) {
+            m_ownsOut = true;
+        } else {
+            m_error = m_options.path + ": " + std::strerror(errno) + ", logging to stdout";
+            m_out = stdout;
+        }
+    }
+    if (m_options.format == LogFormat::Binary) {
+        const std::uint32_t recordSize = sizeof(LogRecord);
+        std::fwrite(kBinaryMagic, 1, 4, m_out);
+        std::fwrite(&kBinaryVersion, sizeof(kBinaryVersion), 1, m_out);
+        std::fwrite(&recordSize, sizeof(recordSize), 1, m_out);
+    }
+    m_thread = std::thread(&AsyncLog::run, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    std::fflush(m_out);
+    if (m_ownsOut) {
+        std::fclose(m_out);
+    }
+}
+
+std::uint16_t AsyncLog::stream(std::string const& name)
+{
+    const std::uint16_t id = m_nextStream.fetch_add(1);
+    LogRecord r = makeRecord(id, LogKind::StreamName, 0, 0, 0, 0);
+    copyText(r.text, sizeof(r.text), name.c_str());
+    // not on a hot path: wait for room rather than losing the name
+    while (!push(r)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return id;
+}
+
+bool AsyncLog::push(LogRecord& record)
+{
+    record.now = steadyNow();
+    std::uint64_t pos = m_head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &m_slots[pos & m_mask];
+        const std::uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        const std::int64_t diff = static_cast<std::int64_t>(seq - pos);
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the writer has not consumed this slot since the previous lap
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+    slot->record = record;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLog::frame(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+                     std::size_t width, std::size_t height, char const* label)
+{
+    LogRecord r = makeRecord(stream, LogKind::Frame, edgeTimestampUs, hostTimestamp, fps,
+                             LogRecord::kHasEdge | LogRecord::kHasHost | LogRecord::kHasFps);
+    r.frame.width = static_cast<std::uint32_t>(width);
+    r.frame.height = static_cast<std::uint32_t>(height);
+    copyText(r.frame.label, sizeof(r.frame.label), label);
+    return push(r);
+}
+
+bool AsyncLog::frame(std::uint16_t stream, double hostTimestamp, double fps, std::size_t width, std::size_t height,
+                     char const* label)
+{
+    LogRecord r = makeRecord(stream, LogKind::Frame, 0, hostTimestamp, fps, LogRecord::kHasHost | LogRecord::kHasFps);
+    r.frame.width = static_cast<std::uint32_t>(width);
+    r.frame.height = static_cast<std::uint32_t>(height);
+    copyText(r.frame.label, sizeof(r.frame.label), label);
+    return push(r);
+}
+
+bool AsyncLog::imu(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+                   double const* gyro, double const* accel, double temperature)
+{
+    LogRecord r = makeRecord(stream, LogKind::Imu, edgeTimestampUs, hostTimestamp, fps,
+                             LogRecord::kHasEdge | LogRecord::kHasHost | LogRecord::kHasFps);
+    for (int i = 0; i < 3; ++i) {
+        r.imu.gyro[i] = static_cast<float>(gyro[i]);
+        r.imu.accel[i] = static_cast<float>(accel[i]);
+    }
+    r.imu.temperature = static_cast<float>(temperature);
+    return push(r);
+}
+
+bool AsyncLog::pose(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+                    double const* position, double const* pitchYawRoll, double confidence)
+{
+    LogRecord r = makeRecord(stream, LogKind::Pose, edgeTimestampUs, hostTimestamp, fps,
+                             LogRecord::kHasEdge | LogRecord::kHasHost | LogRecord::kHasFps);
+    for (int i = 0; i < 3; ++i) {
+        r.pose.position[i] = position[i];
+        r.pose.pitchYawRoll[i] = pitchYawRoll[i] * 180.0 / 3.14159265358979323846;
+    }
+    r.pose.confidence = confidence;
+    return push(r);
+}
+
+bool AsyncLog::values(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+                      char const* label, double const* v, std::size_t count)
+{
+    LogRecord r = makeRecord(stream, LogKind::Values, edgeTimestampUs, hostTimestamp, fps,
+                             LogRecord::kHasEdge | LogRecord::kHasHost | LogRecord::kHasFps);
+    r.values.count = static_cast<std::uint8_t>(std::min<std::size_t>(count, 8));
+    std::copy(v, v + r.values.count, r.values.v);
+    copyText(r.values.label, sizeof(r.values.label), label);
+    return push(r);
+}
+
+bool AsyncLog::values(std::uint16_t stream, char const* label, double const* v, std::size_t count)
+{
+    LogRecord r = makeRecord(stream, LogKind::Values, 0, 0, 0, 0);
+    r.values.count = static_cast<std::uint8_t>(std::min<std::size_t>(count, 8));
+    std::copy(v, v + r.values.count, r.values.v);
+    copyText(r.values.label, sizeof(r.values.label), label);
+    return push(r);
+}
+
+bool AsyncLog::event(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, int type, int state)
+{
+    LogRecord r = makeRecord(stream, LogKind::Event, edgeTimestampUs, hostTimestamp, 0,
+                             LogRecord::kHasEdge | LogRecord::kHasHost);
+    r.event.type = type;
+    r.event.state = state;
+    return push(r);
+}
+
+bool AsyncLog::message(std::uint16_t stream, char const* text)
+{
+    LogRecord r = makeRecord(stream, LogKind::Message, 0, 0, 0, 0);
+    copyText(r.text, sizeof(r.text), text);
+    return push(r);
+}
+
+void AsyncLog::flush()
+{
+    const std::uint64_t target = m_head.load();
+    while (m_written.load() < target && m_thread.joinable()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool AsyncLog::pop(LogRecord& record)
+{
+    Slot& slot = m_slots[m_readPos & m_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != m_readPos + 1) {
+        return false;
+    }
+    record = slot.record;
+    slot.sequence.store(m_readPos + m_mask + 1, std::memory_order_release);
+    ++m_readPos;
+    return true;
+}
+
+void AsyncLog::run()
+{
+    std::string out;
+    LogRecord r;
+    FrameTrace::nameThread("log writer");
+    while (true) {
+        const bool stopping = m_stop.load();
+        const std::uint64_t traceBegin = FrameTrace::enabled() ? FrameTrace::ticks() : 0;
+        std::size_t n = 0;
+        while (pop(r)) {
+            write(r, out);
+            ++n;
+            if (out.size() > 64 * 1024) {
+                std::fwrite(out.data(), 1, out.size(), m_out);
+                out.clear();
+            }
+        }
+        if (!out.empty()) {
+            std::fwrite(out.data(), 1, out.size(), m_out);
+            out.clear();
+        }
+        if (n > 0) {
+            std::fflush(m_out);
+            m_written.store(m_readPos);
+            if (traceBegin) {
+                FrameTrace::recordTicks("write", "log", m_readPos, traceBegin, FrameTrace::ticks());
+            }
+        } else if (stopping) {
+            return;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_options.flushIntervalMs));
+        }
+    }
+}
+
+void AsyncLog::write(LogRecord const& r, std::string& out)
+{
+    if (r.kind == LogKind::StreamName) {
+        if (m_names.size() <= r.stream) {
+            m_names.resize(r.stream + 1);
+        }
+        m_names[r.stream] = r.text;
+    }
+    if (m_options.format == LogFormat::Binary) {
+        out.append(reinterpret_cast<char const*>(&r), sizeof(r));
+        return;
+    }
+    if (r.kind == LogKind::StreamName) {
+        return;
+    }
+    char const* name = r.stream < m_names.size() ? m_names[r.stream].c_str() : "?";
+
+    if (m_options.format == LogFormat::JsonLines) {
+        out += "{\"stream\":";
+        appendJsonString(out, name);
+        append(out, ",\"kind\":\"%s\",\"now\":%.6f", kindName(r.kind), r.now);
+        if (r.flags & LogRecord::kHasEdge) {
+            append(out, ",\"device\":%lld", static_cast<long long>(r.edgeTimestampUs));
+        }
+        if (r.flags & LogRecord::kHasHost) {
+            append(out, ",\"host\":%.6f,\"delay\":%.6f", r.hostTimestamp, r.now - r.hostTimestamp);
+        }
+        if (r.flags & LogRecord::kHasFps) {
+            append(out, ",\"fps\":%.1f", r.fps);
+        }
+        switch (r.kind) {
+        case LogKind::Frame:
+            append(out, ",\"width\":%u,\"height\":%u", r.frame.width, r.frame.height);
+            if (r.frame.label[0]) {
+                out += ",\"label\":";
+                appendJsonString(out, r.frame.label);
+            }
+            break;
+        case LogKind::Imu:
+            append(out, ",\"gyro\":[%g,%g,%g],\"accel\":[%g,%g,%g],\"temperature\":%g",
+                   r.imu.gyro[0], r.imu.gyro[1], r.imu.gyro[2], r.imu.accel[0], r.imu.accel[1], r.imu.accel[2], r.imu.temperature);
+            break;
+        case LogKind::Pose:
+            append(out, ",\"position\":[%g,%g,%g],\"pitchYawRoll\":[%g,%g,%g],\"confidence\":%g",
+                   r.pose.position[0], r.pose.position[1], r.pose.position[2],
+                   r.pose.pitchYawRoll[0], r.pose.pitchYawRoll[1], r.pose.pitchYawRoll[2], r.pose.confidence);
+            break;
+        case LogKind::Values:
+            out += ",\"label\":";
+            appendJsonString(out, r.values.label);
+            out += ",\"values\":[";
+            for (int i = 0; i < r.values.count; ++i) {
+                append(out, i ? ",%g" : "%g", r.values.v[i]);
+            }
+            out += ']';
+            break;
+        case LogKind::Event:
+            append(out, ",\"type\":%d,\"state\":%d", r.event.type, r.event.state);
+            break;
+        case LogKind::Message:
+            out += ",\"text\":";
+            appendJsonString(out, r.text);
+            break;
+        case LogKind::StreamName:
+            break;
+        }
+        out += "}\n";
+        return;
+    }
+
+    // text: same information as the former std::cout lines and timeShowStr()
+    append(out, "%-12s", name);
+    if (r.flags & LogRecord::kHasEdge) {
+        append(out, " (device=%lld host=%.4f now=%.4f delay=%.4f)", static_cast<long long>(r.edgeTimestampUs),
+               r.hostTimestamp, r.now, r.now - r.hostTimestamp);
+    } else if (r.flags & LogRecord::kHasHost) {
+        append(out, " (host=%.4f now=%.4f delay=%.4f)", r.hostTimestamp, r.now, r.now - r.hostTimestamp);
+    }
+    if ((r.flags & LogRecord::kHasFps) && r.kind != LogKind::Frame) {
+        append(out, " @%.0ffps", r.fps);
+    }
+    switch (r.kind) {
+    case LogKind::Frame:
+        append(out, " %s%s%ux%u", r.frame.label, r.frame.label[0] ? " " : "", r.frame.width, r.frame.height);
+        if (r.flags & LogRecord::kHasFps) {
+            append(out, "@%.0ffps", r.fps);
+        }
+        break;
+    case LogKind::Imu:
+        append(out, " Gyro=(%g %g %g), Accel=(%g %g %g), Temperature=%g",
+               r.imu.gyro[0], r.imu.gyro[1], r.imu.gyro[2], r.imu.accel[0], r.imu.accel[1], r.imu.accel[2], r.imu.temperature);
+        break;
+    case LogKind::Pose:
+        append(out, " p=(%g %g %g), r=(%g %g %g), Confidence=%g",
+               r.pose.position[0], r.pose.position[1], r.pose.position[2],
+               r.pose.pitchYawRoll[0], r.pose.pitchYawRoll[1], r.pose.pitchYawRoll[2], r.pose.confidence);
+        break;
+    case LogKind::Values:
+        append(out, " %s=(", r.values.label);
+        for (int i = 0; i < r.values.count; ++i) {
+            append(out, i ? " %g" : "%g", r.values.v[i]);
+        }
+        out += ')';
+        break;
+    case LogKind::Event:
+        append(out, " (%d,%d)", r.event.type, r.event.state);
+        break;
+    case LogKind::Message:
+        append(out, " %s", r.text);
+        break;
+    case LogKind::StreamName:
+        break;
+    }
+    out += '\n';
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Logging from SDK callbacks without formatting or I/O on the callback thread
+ *
+ * Callbacks enqueue fixed-size binary records (stream id, timestamps, fps and a small
+ * payload) into a lock-free multi-producer ring; a background thread formats them as text,
+ * JSON lines or raw binary and writes them out. A slow terminal therefore never blocks the
+ * SDK delivery threads: when the ring is full the record is dropped and counted.
+ *
+ * @code
+ * static AsyncLog s_log;
+ * void rgbCallback(xv::ColorImage const& rgb) {
+ *     static StreamStats fc;
+ *     static LogRateLimiter limit(1.0);
+ *     static const std::uint16_t id = s_log.stream("rgb");
+ *     fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+ *     if (limit.allow()) {
+ *         s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
+ *     }
+ * }
+ * @endcode
+ */
+
+enum class LogFormat
+{
+    Text,      ///< one line per record, like the former std::cout output
+    JsonLines, ///< one JSON object per line
+    Binary,    ///< "XLOG" header then the LogRecord structs as they are in memory
+};
+
+enum class LogKind : std::uint8_t
+{
+    StreamName, ///< text: name of stream `stream`, enqueued by AsyncLog::stream()
+    Frame,
+    Imu,
+    Pose,
+    Values,
+    Event,
+    Message,
+};
+
+/// One log entry, written by the callback thread as is
+struct LogRecord
+{
+    static const std::uint8_t kHasEdge = 1; ///< edgeTimestampUs is set
+    static const std::uint8_t kHasHost = 2; ///< hostTimestamp is set
+    static const std::uint8_t kHasFps = 4;  ///< fps is set
+
+    std::uint16_t stream;
+    LogKind kind;
+    std::uint8_t flags;
+    float fps;
+    std::int64_t edgeTimestampUs;
+    double hostTimestamp;
+    double now; ///< steady clock (s) when the record was made, the clock of hostTimestamp
+    union {
+        struct { std::uint32_t width, height; char label[24]; } frame;
+        struct { float gyro[3], accel[3], temperature; } imu;
+        struct { double position[3], pitchYawRoll[3], confidence; } pose; ///< angles in degrees
+        struct { double v[8]; std::uint8_t count; char label[15]; } values;
+        struct { std::int32_t type, state; } event;
+        char text[96];
+    };
+};
+
+static_assert(sizeof(LogRecord) == 128, "LogRecord is written as is by LogFormat::Binary");
+
+/**
+ * @brief At most one true per interval, shared by any number of threads
+ *
+ * Replaces the `static int k = 0; if (k++ % 25 == 0)` counters: the output rate no longer
+ * depends on the stream rate. Costs one clock read and, when due, one compare-exchange.
+ */
+class LogRateLimiter
+{
+public:
+    explicit LogRateLimiter(double intervalSeconds = 1.0)
+        : m_intervalNs(static_cast<std::int64_t>(intervalSeconds * 1e9)), m_next(0) {}
+
+    bool allow()
+    {
+        const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::int64_t next = m_next.load(std::memory_order_relaxed);
+        return now >= next && m_next.compare_exchange_strong(next, now + m_intervalNs, std::memory_order_relaxed);
+    }
+
+private:
+    const std::int64_t m_intervalNs;
+    std::atomic<std::int64_t> m_next;
+};
+
+class AsyncLog
+{
+public:
+    struct Options
+    {
+        Options() : format(LogFormat::Text), capacity(4096), flushIntervalMs(20) {}
+        std::string path;      ///< output file, stdout if empty
+        LogFormat format;
+        std::size_t capacity;  ///< records in the ring (rounded up to a power of two)
+        int flushIntervalMs;   ///< writer wake-up period when the ring is empty
+    };
+
+    explicit AsyncLog(Options const& options = Options());
+    /// Writes the pending records and stops the writer thread
+    ~AsyncLog();
+
+    AsyncLog(AsyncLog const&) = delete;
+    AsyncLog& operator=(AsyncLog const&) = delete;
+
+    /// Registers a stream name (up to 95 characters) and returns its id, e.g. in a static initializer
+    std::uint16_t stream(std::string const& name);
+
+    /// Enqueues `record` (its `now` is set here), false if the ring is full
+    bool push(LogRecord& record);
+
+    bool frame(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+               std::size_t width, std::size_t height, char const* label = nullptr);
+    /// Frame of a stream without device timestamp
+    bool frame(std::uint16_t stream, double hostTimestamp, double fps, std::size_t width, std::size_t height,
+               char const* label = nullptr);
+    bool imu(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+             double const* gyro, double const* accel, double temperature);
+    /// `pitchYawRoll` in radians, logged in degrees
+    bool pose(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+              double const* position, double const* pitchYawRoll, double confidence);
+    /// Up to 8 values printed as `label=(v0 v1 ...)`
+    bool values(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, double fps,
+                char const* label, double const* v, std::size_t count);
+    /// Values of a stream without timestamps (detections, keypoints, ...)
+    bool values(std::uint16_t stream, char const* label, double const* v, std::size_t count);
+    bool event(std::uint16_t stream, std::int64_t edgeTimestampUs, double hostTimestamp, int type, int state);
+    /// Free text, truncated to 95 characters
+    bool message(std::uint16_t stream, char const* text);
+
+    /// Waits until the records enqueued so far are written
+    void flush();
+
+    Options const& options() const { return m_options; }
+    std::uint64_t written() const { return m_written.load(); }
+    std::uint64_t dropped() const { return m_dropped.load(); }
+    std::string const& error() const { return m_error; }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> sequence; // == position: free, == position + 1: filled
+        LogRecord record;
+    };
+
+    bool pop(LogRecord& record);
+    void run();
+    void write(LogRecord const& r, std::string& out);
+
+    Options m_options;
+    std::unique_ptr<Slot[]> m_slots;
+    std::size_t m_mask;
+    std::FILE* m_out;
+    bool m_ownsOut;
+    std::string m_error;
+
+    alignas(64) std::atomic<std::uint64_t> m_head; // next position to claim (producers)
+    alignas(64) std::atomic<std::uint64_t> m_written; // records written out
+    std::atomic<std::uint64_t> m_dropped;
+    std::atomic<std::uint16_t> m_nextStream;
+    std::atomic<bool> m_stop;
+    // writer thread only
+    std::uint64_t m_readPos;
+    std::vector<std::string> m_names;
+    std::thread m_thread;
+};
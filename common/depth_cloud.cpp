@@ -0,0 +1,255 @@
+#include "depth_cloud.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+const std::uint64_t kEmpty = ~0ull;
+// 21 bits per axis: +-2^20 voxels, +-20 km at 2 cm
+const std::int32_t kAxisOffset = 1 << 20;
+const std::uint64_t kAxisMask = (1u << 21) - 1;
+// bands smaller than this cost more in thread start than they gain
+const int kMinBandRows = 16;
+const std::size_t kInitialSlots = 4096;
+
+inline std::uint64_t voxelIndex(float v)
+{
+    // floor() without the libm call
+    std::int32_t i = static_cast<std::int32_t>(v);
+    i -= v < static_cast<float>(i);
+    return static_cast<std::uint32_t>(i + kAxisOffset) & kAxisMask;
+}
+
+inline std::uint64_t voxelKey(float x, float y, float z, float inv)
+{
+    return voxelIndex(x * inv) | voxelIndex(y * inv) << 21 | voxelIndex(z * inv) << 42;
+}
+
+inline std::size_t slotOf(std::uint64_t key, std::size_t mask)
+{
+    // murmur3 finalizer: the three axes all reach the low bits
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return static_cast<std::size_t>(key) & mask;
+}
+
+} // namespace
+
+void DepthCloudBuilder::VoxelTable::add(std::uint64_t key, float x, float y, float z, std::uint32_t n)
+{
+    if ((used.size() + 1) * 2 > entries.size()) {
+        grow();
+    }
+    const std::size_t mask = entries.size() - 1;
+    std::size_t slot = slotOf(key, mask);
+    while (true) {
+        Entry& e = entries[slot];
+        if (e.key == key) {
+            e.sum[0] += x;
+            e.sum[1] += y;
+            e.sum[2] += z;
+            e.count += n;
+            return;
+        }
+        if (e.key == kEmpty) {
+            e.key = key;
+            e.sum[0] = x;
+            e.sum[1] = y;
+            e.sum[2] = z;
+            e.count = n;
+            used.push_back(static_cast<std::uint32_t>(slot));
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void DepthCloudBuilder::VoxelTable::grow()
+{
+    std::vector<Entry> old;
+    old.swap(entries);
+    Entry empty;
+    empty.key = kEmpty;
+    entries.assign(std::max(kInitialSlots, 2 * old.size()), empty);
+    const std::size_t mask = entries.size() - 1;
+    // same insertion order, new slots
+    for (std::uint32_t& u : used) {
+        Entry const& e = old[u];
+        std::size_t slot = slotOf(e.key, mask);
+        while (entries[slot].key != kEmpty) {
+            slot = (slot + 1) & mask;
+        }
+        entries[slot] = e;
+        u = static_cast<std::uint32_t>(slot);
+    }
+}
+
+void DepthCloudBuilder::VoxelTable::clear()
+{
+    for (std::uint32_t u : used) {
+        entries[u].key = kEmpty;
+    }
+    used.clear();
+    points.clear();
+    valid = 0;
+}
+
+DepthCloudBuilder::DepthCloudBuilder(DepthCamera const& camera, Options const& options)
+    : m_camera(camera), m_options(options), m_width(0), m_height(0), m_validPoints(0)
+{
+}
+
+void DepthCloudBuilder::setCamera(DepthCamera const& camera)
+{
+    m_camera = camera;
+    m_width = 0;
+    m_height = 0;
+}
+
+void DepthCloudBuilder::prepare(int width, int height)
+{
+    if (width == m_width && height == m_height) {
+        return;
+    }
+    m_width = width;
+    m_height = height;
+    // intrinsics of the calibrated resolution scaled to this one (pixel centers)
+    const double sx = static_cast<double>(width) / m_camera.width;
+    const double sy = static_cast<double>(height) / m_camera.height;
+    const double fx = m_camera.fx * sx;
+    const double fy = m_camera.fy * sy;
+    const double cx = (m_camera.cx + 0.5) * sx - 0.5;
+    const double cy = (m_camera.cy + 0.5) * sy - 0.5;
+    const double* k = m_camera.distortion;
+    const bool distorted = k[0] != 0 || k[1] != 0 || k[2] != 0 || k[3] != 0 || k[4] != 0;
+
+    m_rayX.resize(static_cast<std::size_t>(width) * height);
+    m_rayY.resize(m_rayX.size());
+    for (int v = 0; v < height; ++v) {
+        for (int u = 0; u < width; ++u) {
+            const double x0 = (u - cx) / fx;
+            const double y0 = (v - cy) / fy;
+            double x = x0;
+            double y = y0;
+            // fixed point iteration on the distortion model (cv::undistortPoints)
+            for (int i = 0; distorted && i < 10; ++i) {
+                const double r2 = x * x + y * y;
+                const double radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+                const double dx = 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+                const double dy = k[2] * (r2 + 2 * y * y) + 2 * k[3] * x * y;
+                x = (x0 - dx) / radial;
+                y = (y0 - dy) / radial;
+            }
+            m_rayX[static_cast<std::size_t>(v) * width + u] = static_cast<float>(x);
+            m_rayY[static_cast<std::size_t>(v) * width + u] = static_cast<float>(y);
+        }
+    }
+}
+
+template <class T>
+void DepthCloudBuilder::buildBand(T const* depth, int width, int row0, int row1, float scale, VoxelTable& table) const
+{
+    const float minDepth = m_options.minDepth;
+    const float maxDepth = m_options.maxDepth;
+    const bool voxels = m_options.voxelSize > 0;
+    const float inv = voxels ? 1.f / m_options.voxelSize : 0.f;
+    table.clear();
+    for (int v = row0; v < row1; ++v) {
+        const std::size_t row = static_cast<std::size_t>(v) * width;
+        T const* d = depth + row;
+        float const* rx = &m_rayX[row];
+        float const* ry = &m_rayY[row];
+        for (int u = 0; u < width; ++u) {
+            const float z = static_cast<float>(d[u]) * scale;
+            // also rejects NaN
+            if (!(z >= minDepth && z <= maxDepth)) {
+                continue;
+            }
+            const float x = rx[u] * z;
+            const float y = ry[u] * z;
+            ++table.valid;
+            // no shortcut for a run of pixels in the same voxel: with sensor noise the
+            // comparison mispredicts more often than it saves a lookup
+            if (voxels) {
+                table.add(voxelKey(x, y, z, inv), x, y, z, 1);
+            } else {
+                std::array<float, 3> p = {{x, y, z}};
+                table.points.push_back(p);
+            }
+        }
+    }
+}
+
+template <class T>
+bool DepthCloudBuilder::buildImpl(T const* depth, int width, int height, float scale, std::vector<std::array<float, 3>>& points)
+{
+    points.clear();
+    m_validPoints = 0;
+    if (!depth || width <= 0 || height <= 0 || !m_camera.valid()) {
+        return false;
+    }
+    prepare(width, height);
+
+    int threads = m_options.threads > 0 ? m_options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    const int bands = std::max(1, std::min(threads, height / kMinBandRows));
+    m_bands.resize(bands);
+    std::vector<std::thread> workers;
+    for (int b = 1; b < bands; ++b) {
+        workers.emplace_back([this, depth, width, height, scale, bands, b] {
+            buildBand(depth, width, height * b / bands, height * (b + 1) / bands, scale, m_bands[b]);
+        });
+    }
+    buildBand(depth, width, 0, height / bands, scale, m_bands[0]);
+    for (std::thread& t : workers) {
+        t.join();
+    }
+
+    for (VoxelTable const& band : m_bands) {
+        m_validPoints += band.valid;
+    }
+    if (m_options.voxelSize <= 0) {
+        points.reserve(m_validPoints);
+        for (VoxelTable const& band : m_bands) {
+            points.insert(points.end(), band.points.begin(), band.points.end());
+        }
+        return true;
+    }
+
+    // voxels cut by a band boundary are summed here
+    VoxelTable* voxels = &m_bands[0];
+    if (bands > 1) {
+        m_merged.clear();
+        for (VoxelTable const& band : m_bands) {
+            for (std::uint32_t u : band.used) {
+                VoxelTable::Entry const& e = band.entries[u];
+                m_merged.add(e.key, e.sum[0], e.sum[1], e.sum[2], e.count);
+            }
+        }
+        voxels = &m_merged;
+    }
+    const std::uint32_t minCount = static_cast<std::uint32_t>(std::max(1, m_options.minPointsPerVoxel));
+    points.reserve(voxels->used.size());
+    for (std::uint32_t u : voxels->used) {
+        VoxelTable::Entry const& e = voxels->entries[u];
+        if (e.count >= minCount) {
+            const float inv = 1.f / e.count;
+            std::array<float, 3> p = {{e.sum[0] * inv, e.sum[1] * inv, e.sum[2] * inv}};
+            points.push_back(p);
+        }
+    }
+    return true;
+}
+
+bool DepthCloudBuilder::build(std::uint16_t const* depth, int width, int height, float scale, std::vector<std::array<float, 3>>& points)
+{
+    return buildImpl(depth, width, height, scale, points);
+}
+
+bool DepthCloudBuilder::build(float const* depth, int width, int height, std::vector<std::array<float, 3>>& points)
+{
+    return buildImpl(depth, width, height, 1.f, points);
+}
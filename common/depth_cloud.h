@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Pinhole intrinsics of a depth image, with the optional xvsdk `pdcm` distortion
+ *
+ * The intrinsics are given for `width` x `height`. Depth images of another resolution of the
+ * same sensor (SGBM 640x480 / 1280x720) are handled by scaling them.
+ */
+struct DepthCamera
+{
+    DepthCamera() : width(0), height(0), fx(0), fy(0), cx(0), cy(0) { for (double& d : distortion) d = 0; }
+
+    static DepthCamera pinhole(int width, int height, double fx, double fy, double cx, double cy)
+    {
+        DepthCamera c;
+        c.width = width;
+        c.height = height;
+        c.fx = fx;
+        c.fy = fy;
+        c.cx = cx;
+        c.cy = cy;
+        return c;
+    }
+
+    /// Centered pinhole with a horizontal field of view (degrees), as the dewarped SGBM depth (sgbm_config::fov)
+    static DepthCamera fromFov(int width, int height, double fovDegrees)
+    {
+        const double f = 0.5 * width / std::tan(0.5 * fovDegrees * 3.14159265358979323846 / 180.);
+        return pinhole(width, height, f, f, 0.5 * (width - 1), 0.5 * (height - 1));
+    }
+
+    bool valid() const { return width > 0 && height > 0 && fx > 0 && fy > 0; }
+
+    int width;
+    int height;
+    double fx, fy, cx, cy;
+    double distortion[5]; ///< k1 k2 p1 p2 k3
+};
+
+/// Camera of the first `pdcm` model of a calibration (`tofCamera()->calibration()`), invalid if there is none
+template <class Calibration>
+DepthCamera depthCameraFromCalibration(std::vector<Calibration> const& calibrations)
+{
+    DepthCamera c;
+    if (calibrations.empty() || calibrations[0].pdcm.empty()) {
+        return c;
+    }
+    auto const& m = calibrations[0].pdcm[0];
+    c = DepthCamera::pinhole(m.w, m.h, m.fx, m.fy, m.u0, m.v0);
+    for (int k = 0; k < 5; ++k) {
+        c.distortion[k] = m.distor[k];
+    }
+    return c;
+}
+
+/**
+ * @brief Depth image to point cloud on the host, downsampled by a voxel grid
+ *
+ * The ray of every pixel (undistorted, at depth 1) is computed once per resolution, so a
+ * point costs two multiplications. Points in [minDepth, maxDepth] are accumulated in a hash
+ * grid of `voxelSize` cubes and each occupied voxel gives the centroid of its points: a
+ * 640x480 ToF frame (300k points) becomes ~5k-30k points at 2 cm, before the cloud is written
+ * or sent. The image is split into row bands processed in parallel, each with its own hash
+ * table; the tables are then merged. All buffers are kept across frames.
+ *
+ * Not thread safe: one builder per consumer thread (e.g. the PointCloudRecorder extract).
+ *
+ * @code
+ * DepthCloudBuilder builder(depthCameraFromCalibration(device->tofCamera()->calibration()));
+ * std::vector<std::array<float, 3>> points;
+ * builder.build(reinterpret_cast<float const*>(tof.data.get()), tof.width, tof.height, points); // Depth_32
+ * @endcode
+ */
+class DepthCloudBuilder
+{
+public:
+    struct Options
+    {
+        Options() : voxelSize(0.02f), minDepth(0.1f), maxDepth(10.f), minPointsPerVoxel(1), threads(0) {}
+        float voxelSize;       ///< meters, 0: no downsampling (every valid pixel)
+        float minDepth;        ///< meters
+        float maxDepth;        ///< meters
+        int minPointsPerVoxel; ///< voxels with fewer points are dropped (flying pixels)
+        int threads;           ///< row bands processed in parallel, 0: hardware concurrency
+    };
+
+    explicit DepthCloudBuilder(DepthCamera const& camera = DepthCamera(), Options const& options = Options());
+
+    void setCamera(DepthCamera const& camera);
+    DepthCamera const& camera() const { return m_camera; }
+    Options const& options() const { return m_options; }
+
+    /**
+     * @brief Depth in units of `scale` meters (ToF Depth_16, SGBM Depth: 0.001)
+     * @return false if the camera is not set, `points` is then empty
+     */
+    bool build(std::uint16_t const* depth, int width, int height, float scale, std::vector<std::array<float, 3>>& points);
+    /// Depth in meters (ToF Depth_32)
+    bool build(float const* depth, int width, int height, std::vector<std::array<float, 3>>& points);
+
+    /// Points in the depth range in the last frame, before downsampling
+    std::size_t validPoints() const { return m_validPoints; }
+
+private:
+    /// Open addressing table of the voxels of a band, cleared through the list of used slots
+    struct VoxelTable
+    {
+        struct Entry
+        {
+            std::uint64_t key;
+            float sum[3];
+            std::uint32_t count;
+        };
+
+        VoxelTable() : valid(0) {}
+        /// Adds `n` points summing to x y z
+        void add(std::uint64_t key, float x, float y, float z, std::uint32_t n);
+        void clear();
+        void grow();
+
+        std::vector<Entry> entries;
+        std::vector<std::uint32_t> used; // slots in insertion order
+        std::vector<std::array<float, 3>> points; // voxelSize 0: points of the band
+        std::size_t valid; // points in the depth range
+    };
+
+    void prepare(int width, int height);
+    template <class T>
+    bool buildImpl(T const* depth, int width, int height, float scale, std::vector<std::array<float, 3>>& points);
+    template <class T>
+    void buildBand(T const* depth, int width, int row0, int row1, float scale, VoxelTable& table) const;
+
+    DepthCamera m_camera;
+    Options m_options;
+    int m_width;
+    int m_height;
+    std::vector<float> m_rayX; // per pixel, x / z of the ray
+    std::vector<float> m_rayY;
+    std::vector<VoxelTable> m_bands;
+    VoxelTable m_merged;
+    std::size_t m_validPoints;
+};
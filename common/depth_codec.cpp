@@ -0,0 +1,488 @@
+#include "depth_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTH_CODEC_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DEPTH_CODEC_NEON
+#endif
+
+namespace {
+
+const int kBlock = 16;
+const int kMaxRun = 128;
+const std::uint8_t kRun = 0x80;
+
+/// Median edge detector: min(a, b) if c >= max(a, b), max(a, b) if c <= min(a, b), else a + b - c
+inline std::uint16_t med(std::uint16_t a, std::uint16_t b, std::uint16_t c)
+{
+    // branchless: the decoder runs it once per sample on noisy data
+    const int d = a - b;
+    const int lo = b + (d & (d >> 31)), hi = a - (d & (d >> 31));
+    const int hc = hi - c;
+    const int t = hc & ~(hc >> 31);
+    const int m = t - (hi - lo);
+    return static_cast<std::uint16_t>(hi + (m & (m >> 31)));
+}
+
+inline std::uint16_t zigzag(std::uint16_t v, std::uint16_t prediction)
+{
+    const std::uint16_t r = static_cast<std::uint16_t>(v - prediction);
+    return static_cast<std::uint16_t>((r << 1) ^ (0u - (r >> 15)));
+}
+
+inline std::uint16_t unzigzag(std::uint16_t z, std::uint16_t prediction)
+{
+    return static_cast<std::uint16_t>(prediction + ((z >> 1) ^ (0u - (z & 1))));
+}
+
+/**
+ * @brief Residuals of the block at `x` of a row (any x, samples past `width` are zero residuals)
+ * @param cur, up: hole-filled current and previous rows
+ * @param valid: 0xffff for the valid samples of the row, 0 for the holes (zero residual)
+ * @return OR of the residuals
+ */
+std::uint16_t residualsScalar(std::uint16_t const* cur, std::uint16_t const* up, std::uint16_t const* valid, int x, int width,
+                              std::uint16_t* z)
+{
+    std::uint16_t bits = 0;
+    for (int i = 0; i < kBlock; ++i) {
+        const int xx = x + i;
+        if (xx >= width) {
+            z[i] = 0;
+            continue;
+        }
+        // the first sample of a row is predicted from the one above
+        const std::uint16_t p = xx > 0 ? med(cur[xx - 1], up[xx], up[xx - 1]) : up[0];
+        z[i] = zigzag(cur[xx], p) & valid[xx];
+        bits |= z[i];
+    }
+    return bits;
+}
+
+#if defined(DEPTH_CODEC_SSE2)
+/// Whole block at x > 0, same result as residualsScalar()
+inline std::uint16_t residuals(std::uint16_t const* cur, std::uint16_t const* up, std::uint16_t const* valid, int x, std::uint16_t* z)
+{
+    __m128i bits = _mm_setzero_si128();
+    for (int k = 0; k < kBlock; k += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(cur + x + k - 1));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(up + x + k));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(up + x + k - 1));
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(cur + x + k));
+        // unsigned min / max / min of SSE2 through saturated subtractions
+        const __m128i d = _mm_subs_epu16(a, b);
+        const __m128i lo = _mm_sub_epi16(a, d), hi = _mm_add_epi16(b, d);
+        const __m128i t = _mm_subs_epu16(hi, c);
+        const __m128i p = _mm_add_epi16(lo, _mm_sub_epi16(t, _mm_subs_epu16(t, _mm_sub_epi16(hi, lo))));
+        const __m128i r = _mm_sub_epi16(v, p);
+        const __m128i zz = _mm_and_si128(_mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15)),
+                                         _mm_loadu_si128(reinterpret_cast<__m128i const*>(valid + x + k)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(z + k), zz);
+        bits = _mm_or_si128(bits, zz);
+    }
+    bits = _mm_or_si128(bits, _mm_srli_si128(bits, 8));
+    bits = _mm_or_si128(bits, _mm_srli_si128(bits, 4));
+    bits = _mm_or_si128(bits, _mm_srli_si128(bits, 2));
+    return static_cast<std::uint16_t>(_mm_cvtsi128_si32(bits));
+}
+#elif defined(DEPTH_CODEC_NEON)
+inline std::uint16_t residuals(std::uint16_t const* cur, std::uint16_t const* up, std::uint16_t const* valid, int x, std::uint16_t* z)
+{
+    uint16x8_t bits = vdupq_n_u16(0);
+    for (int k = 0; k < kBlock; k += 8) {
+        const uint16x8_t a = vld1q_u16(cur + x + k - 1);
+        const uint16x8_t b = vld1q_u16(up + x + k);
+        const uint16x8_t c = vld1q_u16(up + x + k - 1);
+        const uint16x8_t v = vld1q_u16(cur + x + k);
+        const uint16x8_t lo = vminq_u16(a, b), hi = vmaxq_u16(a, b);
+        const uint16x8_t p = vaddq_u16(lo, vminq_u16(vqsubq_u16(hi, c), vsubq_u16(hi, lo)));
+        const uint16x8_t r = vsubq_u16(v, p);
+        const uint16x8_t zz = vandq_u16(veorq_u16(vshlq_n_u16(r, 1), vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(r), 15))),
+                                        vld1q_u16(valid + x + k));
+        vst1q_u16(z + k, zz);
+        bits = vorrq_u16(bits, zz);
+    }
+    uint16x4_t half = vorr_u16(vget_low_u16(bits), vget_high_u16(bits));
+    return static_cast<std::uint16_t>(vget_lane_u16(half, 0) | vget_lane_u16(half, 1) | vget_lane_u16(half, 2) | vget_lane_u16(half, 3));
+}
+#else
+inline std::uint16_t residuals(std::uint16_t const* cur, std::uint16_t const* up, std::uint16_t const* valid, int x, std::uint16_t* z)
+{
+    return residualsScalar(cur, up, valid, x, x + kBlock, z);
+}
+#endif
+
+inline int bitWidth(std::uint32_t v)
+{
+    int w = 0;
+    if (v >> 8) {
+        w = 8;
+        v >>= 8;
+    }
+    while (v) {
+        ++w;
+        v >>= 1;
+    }
+    return w;
+}
+
+/// 16 values of `w` bits, LSB first: 2 * w bytes
+void pack(std::uint16_t const* z, int w, std::uint8_t* out)
+{
+    std::uint64_t acc = 0;
+    int n = 0;
+    for (int i = 0; i < kBlock; ++i) {
+        acc |= static_cast<std::uint64_t>(z[i]) << n;
+        n += w;
+        if (n >= 32) {
+            const std::uint32_t word = static_cast<std::uint32_t>(acc);
+            std::memcpy(out, &word, 4);
+            out += 4;
+            acc >>= 32;
+            n -= 32;
+        }
+    }
+    if (n > 0) { // 16 bits left when w is odd
+        out[0] = static_cast<std::uint8_t>(acc);
+        out[1] = static_cast<std::uint8_t>(acc >> 8);
+    }
+}
+
+/// Reads 16 values of `w` bits, at least 2 * w + 8 bytes readable at `in`
+inline void unpack(std::uint8_t const* in, int w, std::uint16_t* z)
+{
+    const std::uint64_t mask = (1u << w) - 1;
+    for (int i = 0; i < kBlock; ++i) {
+        const int bit = i * w;
+        std::uint64_t v;
+        std::memcpy(&v, in + (bit >> 3), 8);
+        z[i] = static_cast<std::uint16_t>((v >> (bit & 7)) & mask);
+    }
+}
+
+/// unpack() of the last blocks of a stream, through a padded copy
+void unpackTail(std::uint8_t const* in, int w, std::uint16_t* z)
+{
+    std::uint8_t buf[2 * kBlock + 8] = {};
+    std::memcpy(buf, in, 2 * w);
+    unpack(buf, w, z);
+}
+
+void putVarint(std::vector<std::uint8_t>& out, std::uint32_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+bool getVarint(std::uint8_t const*& p, std::uint8_t const* end, std::uint32_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 35 && p != end; shift += 7) {
+        const std::uint8_t b = *p++;
+        v |= static_cast<std::uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Reads the hole mask: alternating runs of valid and invalid samples, valid first
+struct MaskReader
+{
+    MaskReader(std::uint8_t const* begin, std::uint8_t const* end) : p(begin), end(end), left(0), valid(false) {}
+
+    /// Bit i of `holes` set if sample i of the next `count` (<= 32) is a hole, false at the end of the mask
+    bool take(int count, std::uint32_t& holes)
+    {
+        holes = 0;
+        if (left >= static_cast<std::uint32_t>(count)) {
+            holes = valid ? 0 : (count == 32 ? 0xffffffffu : ((1u << count) - 1));
+            left -= count;
+            return true;
+        }
+        for (int i = 0; i < count;) {
+            if (left == 0) {
+                if (!getVarint(p, end, left)) {
+                    return false;
+                }
+                valid = !valid;
+                continue;
+            }
+            const int n = static_cast<int>(std::min<std::uint32_t>(left, count - i));
+            if (!valid) {
+                holes |= (n == 32 ? 0xffffffffu : ((1u << n) - 1)) << i;
+            }
+            left -= n;
+            i += n;
+        }
+        return true;
+    }
+
+    std::uint8_t const* p;
+    std::uint8_t const* end;
+    std::uint32_t left;
+    bool valid;
+};
+
+} // namespace
+
+std::size_t depthEncodeBound(int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        return sizeof(DepthCodecHeader);
+    }
+    const std::size_t samples = static_cast<std::size_t>(width) * height;
+    const std::size_t blocks = static_cast<std::size_t>((width + kBlock - 1) / kBlock) * height;
+    // the mask is at most one byte per run (and a leading empty run)
+    return sizeof(DepthCodecHeader) + samples + 1 + blocks * (1 + 2 * kBlock);
+}
+
+DepthEncoder::DepthEncoder(Options const& options)
+    : m_options(options), m_step(1)
+{
+    if (m_options.mode != DepthCodecMode::Bounded) {
+        return;
+    }
+    // quantized values must stay below 65536
+    m_options.maxDepth = std::min<std::uint16_t>(m_options.maxDepth, 65534);
+    m_options.maxError = std::min<std::uint16_t>(m_options.maxError, 32767);
+    m_step = static_cast<std::uint16_t>(2 * m_options.maxError + 1);
+    m_quantize.resize(65536);
+    for (std::uint32_t v = 0; v < 65536; ++v) {
+        const bool valid = v >= m_options.minDepth && v <= m_options.maxDepth;
+        m_quantize[v] = valid ? static_cast<std::uint16_t>((v - m_options.minDepth + m_options.maxError) / m_step + 1) : 0;
+    }
+}
+
+std::vector<std::uint8_t> const& DepthEncoder::encode(std::uint16_t const* src, int width, int height)
+{
+    m_stream.clear();
+    if (width <= 0 || height <= 0) {
+        return m_stream;
+    }
+    const std::size_t w = static_cast<std::size_t>(width);
+    const bool bounded = m_options.mode == DepthCodecMode::Bounded;
+    if (m_zero.size() < w) {
+        m_zero.assign(w, 0);
+        m_rows.resize(2 * w);
+        m_valid.resize(w);
+    }
+    m_mask.clear();
+    m_blocks.resize(depthEncodeBound(width, height));
+
+    std::uint8_t* out = m_blocks.data();
+    int run = 0;
+    bool maskValid = true;
+    std::uint32_t maskRun = 0;
+    std::uint16_t const* up = m_zero.data();
+    std::uint16_t z[kBlock];
+    for (int y = 0; y < height; ++y) {
+        // holes take the value on their left (the one above at the start of a row), so the
+        // samples around them are predicted from valid depths and their residuals are zero
+        std::uint16_t const* row = src + y * w;
+        std::uint16_t* cur = &m_rows[(y & 1) * w];
+        std::uint16_t filled = up[0];
+        for (std::size_t x = 0; x < w; ++x) {
+            const std::uint16_t v = bounded ? m_quantize[row[x]] : row[x];
+            const bool valid = v != 0;
+            if (valid != maskValid) {
+                putVarint(m_mask, maskRun);
+                maskRun = 0;
+                maskValid = valid;
+            }
+            ++maskRun;
+            filled = valid ? v : filled;
+            cur[x] = filled;
+            m_valid[x] = valid ? 0xffff : 0;
+        }
+
+        for (int x = 0; x < width; x += kBlock) {
+            const std::uint16_t bits = x > 0 && x + kBlock <= width ? residuals(cur, up, m_valid.data(), x, z)
+                                                                   : residualsScalar(cur, up, m_valid.data(), x, width, z);
+            if (bits == 0) {
+                if (++run == kMaxRun) {
+                    *out++ = static_cast<std::uint8_t>(kRun | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                *out++ = static_cast<std::uint8_t>(kRun | (run - 1));
+                run = 0;
+            }
+            const int bw = bitWidth(bits);
+            *out++ = static_cast<std::uint8_t>(bw);
+            pack(z, bw, out);
+            out += 2 * bw;
+        }
+        up = cur;
+    }
+    if (run > 0) {
+        *out++ = static_cast<std::uint8_t>(kRun | (run - 1));
+    }
+    putVarint(m_mask, maskRun);
+
+    DepthCodecHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = kDepthCodecMagic;
+    header.version = kDepthCodecVersion;
+    header.mode = static_cast<std::uint16_t>(m_options.mode);
+    header.width = static_cast<std::uint32_t>(width);
+    header.height = static_cast<std::uint32_t>(height);
+    if (bounded) {
+        header.minDepth = m_options.minDepth;
+        header.maxDepth = m_options.maxDepth;
+        header.step = m_step;
+    }
+    header.maskSize = static_cast<std::uint32_t>(m_mask.size());
+
+    const std::size_t blocks = out - m_blocks.data();
+    m_stream.resize(sizeof(header) + m_mask.size() + blocks);
+    std::memcpy(m_stream.data(), &header, sizeof(header));
+    std::memcpy(m_stream.data() + sizeof(header), m_mask.data(), m_mask.size());
+    std::memcpy(m_stream.data() + sizeof(header) + m_mask.size(), m_blocks.data(), blocks);
+    return m_stream;
+}
+
+bool depthDecodeInfo(std::uint8_t const* data, std::size_t size, int* width, int* height)
+{
+    DepthCodecHeader header;
+    if (!data || size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != kDepthCodecMagic || header.version != kDepthCodecVersion
+        || header.width == 0 || header.height == 0 || header.width > 65535 || header.height > 65535) {
+        return false;
+    }
+    if (width) {
+        *width = static_cast<int>(header.width);
+    }
+    if (height) {
+        *height = static_cast<int>(header.height);
+    }
+    return true;
+}
+
+bool depthDecode(std::uint8_t const* data, std::size_t size, std::uint16_t* dst, std::size_t dstCount)
+{
+    int width = 0, height = 0;
+    if (!depthDecodeInfo(data, size, &width, &height)) {
+        return false;
+    }
+    DepthCodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const bool bounded = header.mode == static_cast<std::uint16_t>(DepthCodecMode::Bounded);
+    if ((!bounded && header.mode != static_cast<std::uint16_t>(DepthCodecMode::Lossless)) || (bounded && header.step == 0)
+        || header.maskSize > size - sizeof(header)) {
+        return false;
+    }
+    const std::size_t w = static_cast<std::size_t>(width);
+    if (!dst || dstCount < w * height) {
+        return false;
+    }
+
+    std::uint8_t const* mask = data + sizeof(header);
+    std::uint8_t const* p = mask + header.maskSize;
+    std::uint8_t const* end = data + size;
+    MaskReader holes(mask, p);
+    int run = 0;
+    std::uint16_t z[kBlock];
+    // decodes the hole-filled image, the holes are cleared at the end
+    for (int y = 0; y < height; ++y) {
+        std::uint16_t* cur = dst + y * w;
+        std::uint16_t const* up = y > 0 ? cur - w : nullptr;
+        for (int x = 0; x < width; x += kBlock) {
+            if (run > 0) {
+                --run;
+                std::memset(z, 0, sizeof(z));
+            } else {
+                if (p == end) {
+                    return false;
+                }
+                const std::uint8_t b = *p++;
+                if (b & kRun) {
+                    run = b & ~kRun;
+                    std::memset(z, 0, sizeof(z));
+                } else if (b > kBlock || end - p < 2 * b) {
+                    return false;
+                } else {
+                    if (end - p >= 2 * b + 8) {
+                        unpack(p, b, z);
+                    } else {
+                        unpackTail(p, b, z);
+                    }
+                    p += 2 * b;
+                }
+            }
+            const int n = std::min(kBlock, width - x);
+            std::uint32_t holeBits = 0;
+            if (!holes.take(n, holeBits)) {
+                return false;
+            }
+            int i = 0;
+            if (x == 0) {
+                const std::uint16_t p0 = up ? up[0] : 0;
+                cur[0] = holeBits & 1 ? p0 : unzigzag(z[0], p0);
+                i = 1;
+            }
+            if (!up) {
+                for (; i < n; ++i) {
+                    cur[x + i] = holeBits >> i & 1 ? cur[x + i - 1] : unzigzag(z[i], cur[x + i - 1]);
+                }
+            } else if (holeBits == 0) {
+                for (; i < n; ++i) {
+                    const int xx = x + i;
+                    cur[xx] = unzigzag(z[i], med(cur[xx - 1], up[xx], up[xx - 1]));
+                }
+            } else {
+                for (; i < n; ++i) {
+                    const int xx = x + i;
+                    cur[xx] = holeBits >> i & 1 ? cur[xx - 1] : unzigzag(z[i], med(cur[xx - 1], up[xx], up[xx - 1]));
+                }
+            }
+        }
+    }
+
+    // clears the holes, dequantizes the valid samples
+    std::uint8_t const* runs = mask;
+    bool valid = false;
+    const std::size_t count = w * height;
+    for (std::size_t i = 0; i < count;) {
+        std::uint32_t length;
+        if (!getVarint(runs, mask + header.maskSize, length) || length > count - i) {
+            return false;
+        }
+        valid = !valid;
+        if (!valid) {
+            std::fill(dst + i, dst + i + length, 0);
+        } else if (bounded) {
+            for (std::size_t j = i; j < i + length; ++j) {
+                const std::uint32_t q = dst[j];
+                dst[j] = q ? static_cast<std::uint16_t>(std::min<std::uint32_t>(header.minDepth + (q - 1) * header.step, header.maxDepth)) : 0;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+const char* depthCodecKernel()
+{
+#if defined(DEPTH_CODEC_SSE2)
+    return "SSE2";
+#elif defined(DEPTH_CODEC_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Compression of 16-bit depth images: SGBM depth (mm) and ToF Depth_16 / IR
+ *
+ * Every sample is predicted from its left, upper and upper-left neighbours with the median
+ * edge detector of LOCO-I (JPEG-LS), the residual is zigzag folded and the residuals are
+ * bit-packed by blocks of 16 samples at the width of the largest one. Runs of all-zero
+ * blocks (flat areas) are run-length coded. Holes (0, invalid depth) are coded apart in a
+ * run-length mask and take the value of their left neighbour for the prediction, so
+ * scattered invalid pixels do not widen the blocks around them: a frame costs about the
+ * noise of its valid pixels. The prediction uses SSE2 / NEON when available; the scalar
+ * fallback gives the same stream.
+ *
+ * Two modes:
+ *  - Lossless: decoded samples are bit-exact (any 16-bit image, signed Depth_16 included);
+ *  - Bounded: samples outside [minDepth, maxDepth] become 0 (invalid), the others are
+ *    quantized with a step of 2 * maxError + 1 and decode within maxError of the original.
+ *    For SGBM use the min_distance / max_distance of the sgbm_config it was started with.
+ *
+ * Stream:
+ *  - DepthCodecHeader;
+ *  - hole mask, `maskSize` bytes: lengths (LEB128) of alternating runs of valid and invalid
+ *    samples over the whole image, starting with valid (possibly empty);
+ *  - for each row ceil(width / 16) blocks, each introduced by one byte: 1..16 is the bit
+ *    width of the 16 residuals that follow (2 * width bytes, LSB first), 0x80 | (n - 1) a
+ *    run of n blocks of zero residuals (runs may span rows). Holes and samples past the end
+ *    of a row are coded as zero residuals.
+ */
+
+enum class DepthCodecMode : std::uint16_t
+{
+    Lossless = 0,
+    Bounded = 1,
+};
+
+static const std::uint32_t kDepthCodecMagic = 0x54504458; // "XDPT"
+static const std::uint16_t kDepthCodecVersion = 1;
+
+struct DepthCodecHeader
+{
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t mode; // DepthCodecMode
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint16_t minDepth; // Bounded: value of quantized sample 1
+    std::uint16_t maxDepth; // Bounded: decoded samples are clamped to it
+    std::uint16_t step;     // Bounded: quantization step
+    std::uint16_t reserved;
+    std::uint32_t maskSize; // bytes of the hole mask following the header
+};
+
+/// Largest stream of a `width` x `height` image
+std::size_t depthEncodeBound(int width, int height);
+
+/**
+ * @brief Encodes the frames of one stream, keeps its buffers between frames
+ *
+ * Not thread safe: use one encoder per stream (or per thread).
+ */
+class DepthEncoder
+{
+public:
+    struct Options
+    {
+        Options() : mode(DepthCodecMode::Lossless), minDepth(0), maxDepth(65534), maxError(0) {}
+        DepthCodecMode mode;
+        std::uint16_t minDepth; ///< Bounded: smaller samples are invalid (0)
+        std::uint16_t maxDepth; ///< Bounded: larger samples are invalid (0), at most 65534
+        std::uint16_t maxError; ///< Bounded: largest error of a valid sample
+    };
+
+    explicit DepthEncoder(Options const& options = Options());
+
+    /**
+     * @brief Encodes `width` x `height` contiguous samples
+     * @return the stream, valid until the next call; empty for an empty image
+     */
+    std::vector<std::uint8_t> const& encode(std::uint16_t const* src, int width, int height);
+
+    Options const& options() const { return m_options; }
+
+private:
+    Options m_options;
+    std::uint16_t m_step;
+    std::vector<std::uint16_t> m_quantize; // Bounded: sample -> quantized value, 0 invalid
+    std::vector<std::uint16_t> m_rows;     // hole-filled current and previous rows
+    std::vector<std::uint16_t> m_valid;    // 0xffff for the valid samples of the current row
+    std::vector<std::uint16_t> m_zero;     // row above the first one
+    std::vector<std::uint8_t> m_mask;
+    std::vector<std::uint8_t> m_blocks;
+    std::vector<std::uint8_t> m_stream;
+};
+
+/// Reads the size of an encoded image, false if `data` is not a depth codec stream
+bool depthDecodeInfo(std::uint8_t const* data, std::size_t size, int* width, int* height);
+
+/**
+ * @brief Decodes a stream into `dst` (width * height contiguous samples)
+ * @param dstCount: samples available at `dst`
+ * @return false (`dst` partly written) on a truncated or corrupted stream
+ */
+bool depthDecode(std::uint8_t const* data, std::size_t size, std::uint16_t* dst, std::size_t dstCount);
+
+/// Predictor kernel compiled in: "SSE2", "NEON" or "scalar"
+const char* depthCodecKernel();
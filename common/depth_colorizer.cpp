@@ -0,0 +1,221 @@
+#include "depth_colorizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTH_COLORIZER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DEPTH_COLORIZER_NEON
+#endif
+
+namespace {
+
+// indices are computed in blocks so the SIMD part and the table lookups stay in L1
+const std::size_t kBlock = 256;
+
+inline std::uint32_t packBgr(std::vector<unsigned char> const& rgb)
+{
+    return static_cast<std::uint32_t>(rgb.at(2))
+         | static_cast<std::uint32_t>(rgb.at(1)) << 8
+         | static_cast<std::uint32_t>(rgb.at(0)) << 16;
+}
+
+inline unsigned int quantize(float d, float dmax)
+{
+    // same expression as the former per-pixel loops so the tables are bit-exact
+    return static_cast<unsigned int>( std::max(0.0f, std::min(255.0f,  d * 255.0f / dmax )));
+}
+
+/**
+ * Writes `count` BGR pixels from packed table entries. Every pixel but the last one
+ * is stored with a 4-byte write whose spare byte is overwritten by the next pixel.
+ */
+template <class Index>
+inline void scatter(std::uint32_t const* lut, Index const* idx, std::size_t count, std::uint8_t* bgr, bool lastBlock)
+{
+    std::size_t n = lastBlock ? count - 1 : count;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::memcpy(bgr + 3 * i, &lut[idx[i]], 4);
+    }
+    if (lastBlock) {
+        std::memcpy(bgr + 3 * n, &lut[idx[n]], 3);
+    }
+}
+
+// clamps signed 16-bit samples to [0, hi]
+inline void clampIndices16(std::int16_t const* src, std::size_t count, std::int16_t hi, std::uint16_t* idx)
+{
+    std::size_t i = 0;
+#if defined(DEPTH_COLORIZER_SSE2)
+    const __m128i vlo = _mm_setzero_si128();
+    const __m128i vhi = _mm_set1_epi16(hi);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        v = _mm_min_epi16(_mm_max_epi16(v, vlo), vhi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(idx + i), v);
+    }
+#elif defined(DEPTH_COLORIZER_NEON)
+    const int16x8_t vlo = vdupq_n_s16(0);
+    const int16x8_t vhi = vdupq_n_s16(hi);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        v = vminq_s16(vmaxq_s16(v, vlo), vhi);
+        vst1q_u16(idx + i, vreinterpretq_u16_s16(v));
+    }
+#endif
+    for (; i < count; ++i) {
+        idx[i] = static_cast<std::uint16_t>(std::min<int>(std::max<int>(src[i], 0), hi));
+    }
+}
+
+// clamps unsigned 16-bit samples to [0, hi]
+inline void clampIndicesU16(std::uint16_t const* src, std::size_t count, std::uint16_t hi, std::uint16_t* idx)
+{
+    std::size_t i = 0;
+#if defined(DEPTH_COLORIZER_SSE2)
+    // SSE2 has no unsigned 16-bit min: min(v, hi) = v - sat(v - hi)
+    const __m128i vhi = _mm_set1_epi16(static_cast<short>(hi));
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        v = _mm_sub_epi16(v, _mm_subs_epu16(v, vhi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(idx + i), v);
+    }
+#elif defined(DEPTH_COLORIZER_NEON)
+    const uint16x8_t vhi = vdupq_n_u16(hi);
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u16(idx + i, vminq_u16(vld1q_u16(src + i), vhi));
+    }
+#endif
+    for (; i < count; ++i) {
+        idx[i] = std::min(src[i], hi);
+    }
+}
+
+} // namespace
+
+DepthColorizer::DepthColorizer(std::vector<std::vector<unsigned char>> const& palette, float depth32MaxM, float depth16Max)
+    : m_depth32Max(depth32MaxM)
+{
+    std::memset(&m_lut8, 0, sizeof(m_lut8));
+    for (std::size_t u = 0; u < 256; ++u) {
+        m_lut8.v[u] = packBgr(palette.at(u));
+    }
+    m_lut8.v[kInvalid] = 0;
+
+    // the 16-bit tables must reach past depth16Max so that clamping the index to the
+    // last entry keeps the saturated color; 4096 entries for the default range
+    m_lut16Size = 4096;
+    while (m_lut16Size <= depth16Max && m_lut16Size < 32768) {
+        m_lut16Size *= 2;
+    }
+
+    const std::size_t align = 64 / sizeof(std::uint32_t);
+    m_storage.assign(2 * m_lut16Size + align, 0);
+    auto base = reinterpret_cast<std::uintptr_t>(m_storage.data());
+    auto offset = ((64 - base % 64) % 64) / sizeof(std::uint32_t);
+    m_lutDepth16 = m_storage.data() + offset;
+    m_lutIr = m_lutDepth16 + m_lut16Size;
+
+    for (int d = 0; d < m_lut16Size; ++d) {
+        unsigned int u = quantize(static_cast<float>(d), depth16Max);
+        m_lutDepth16[d] = m_lut8.v[u];
+        if( u < 15 )
+            u = 0;
+        m_lutIr[d] = m_lut8.v[u];
+    }
+}
+
+void DepthColorizer::colorizeDepth32(float const* src, std::size_t count, std::uint8_t* bgr) const
+{
+    // the valid range used to be tested in double precision, find the matching float bounds
+    float lo = 0.01f;
+    if (static_cast<double>(lo) < 0.01) lo = std::nextafter(lo, 1.0f);
+    float hi = 9.9f;
+    if (static_cast<double>(hi) > 9.9) hi = std::nextafter(hi, 0.0f);
+    const float dmax = m_depth32Max;
+
+    std::int32_t idx[kBlock];
+    for (std::size_t b = 0; b < count; b += kBlock) {
+        const std::size_t n = std::min(kBlock, count - b);
+        float const* s = src + b;
+        std::size_t i = 0;
+#if defined(DEPTH_COLORIZER_SSE2)
+        const __m128 vlo = _mm_set1_ps(lo);
+        const __m128 vhi = _mm_set1_ps(hi);
+        const __m128 v255 = _mm_set1_ps(255.0f);
+        const __m128 vmax = _mm_set1_ps(dmax);
+        const __m128 vzero = _mm_setzero_ps();
+        const __m128i vinvalid = _mm_set1_epi32(kInvalid);
+        for (; i + 4 <= n; i += 4) {
+            __m128 d = _mm_loadu_ps(s + i);
+            // NaN fails both comparisons and is treated as invalid
+            __m128i valid = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(d, vlo), _mm_cmple_ps(d, vhi)));
+            __m128 q = _mm_div_ps(_mm_mul_ps(d, v255), vmax);
+            q = _mm_max_ps(vzero, _mm_min_ps(v255, q));
+            __m128i u = _mm_cvttps_epi32(q);
+            u = _mm_or_si128(_mm_and_si128(valid, u), _mm_andnot_si128(valid, vinvalid));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(idx + i), u);
+        }
+#elif defined(DEPTH_COLORIZER_NEON)
+        const float32x4_t vlo = vdupq_n_f32(lo);
+        const float32x4_t vhi = vdupq_n_f32(hi);
+        const float32x4_t v255 = vdupq_n_f32(255.0f);
+        const float32x4_t vzero = vdupq_n_f32(0.0f);
+        const int32x4_t vinvalid = vdupq_n_s32(kInvalid);
+        for (; i + 4 <= n; i += 4) {
+            float32x4_t d = vld1q_f32(s + i);
+            uint32x4_t valid = vandq_u32(vcgeq_f32(d, vlo), vcleq_f32(d, vhi));
+            float32x4_t q = vmulq_f32(d, v255);
+#if defined(__aarch64__)
+            q = vdivq_f32(q, vdupq_n_f32(dmax));
+#else
+            float tmp[4];
+            vst1q_f32(tmp, q);
+            for (int k = 0; k < 4; ++k) tmp[k] /= dmax;
+            q = vld1q_f32(tmp);
+#endif
+            q = vmaxq_f32(vzero, vminq_f32(v255, q));
+            vst1q_s32(idx + i, vbslq_s32(valid, vcvtq_s32_f32(q), vinvalid));
+        }
+#endif
+        for (; i < n; ++i) {
+            const float d = s[i];
+            idx[i] = ( d < 0.01 || d > 9.9 || d != d ) ? kInvalid : static_cast<std::int32_t>(quantize(d, dmax));
+        }
+        scatter(m_lut8.v, idx, n, bgr + 3 * b, b + n == count);
+    }
+}
+
+void DepthColorizer::colorizeDepth16(std::int16_t const* src, std::size_t count, std::uint8_t* bgr) const
+{
+    std::uint16_t idx[kBlock];
+    for (std::size_t b = 0; b < count; b += kBlock) {
+        const std::size_t n = std::min(kBlock, count - b);
+        clampIndices16(src + b, n, static_cast<std::int16_t>(m_lut16Size - 1), idx);
+        scatter(m_lutDepth16, idx, n, bgr + 3 * b, b + n == count);
+    }
+}
+
+void DepthColorizer::colorizeIr(std::uint16_t const* src, std::size_t count, std::uint8_t* bgr) const
+{
+    std::uint16_t idx[kBlock];
+    for (std::size_t b = 0; b < count; b += kBlock) {
+        const std::size_t n = std::min(kBlock, count - b);
+        clampIndicesU16(src + b, n, static_cast<std::uint16_t>(m_lut16Size - 1), idx);
+        scatter(m_lutIr, idx, n, bgr + 3 * b, b + n == count);
+    }
+}
+
+void DepthColorizer::colorizeIrRaw(std::int16_t const* src, std::size_t count, std::uint8_t* bgr) const
+{
+    std::uint16_t idx[kBlock];
+    for (std::size_t b = 0; b < count; b += kBlock) {
+        const std::size_t n = std::min(kBlock, count - b);
+        clampIndices16(src + b, n, 255, idx);
+        scatter(m_lut8.v, idx, n, bgr + 3 * b, b + n == count);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief LUT based colorization of ToF depth / IR rows into packed BGR
+ *
+ * The palette (RGB triplets, e.g. `colors` from colors.h) is flattened once into
+ * 64-byte aligned tables of packed BGRx words:
+ *  - a 256(+1) entry table indexed by the quantized 8-bit value, used for Depth_32
+ *    (the extra entry is black for invalid depths) and for raw IR values;
+ *  - two tables indexed directly by the 16-bit sample (4096 entries for the default
+ *    range), so Depth_16 and IR rows need no float math at all.
+ *
+ * Row kernels compute LUT indices with SSE2 / NEON when available and fall back to
+ * scalar code otherwise. For finite samples the output is bit-exact with the former
+ * per-pixel loops of raw_to_opencv(DepthImage); NaN depths are drawn black.
+ */
+class DepthColorizer
+{
+public:
+    /**
+     * @param palette: 256 RGB triplets
+     * @param depth32MaxM: Depth_32 value (m) mapped to the last palette entry
+     * @param depth16Max: Depth_16/IR value mapped to the last palette entry
+     *                    (maybe 7494,2494,1498,1249 see mode_manage.h in sony toflib)
+     */
+    explicit DepthColorizer(std::vector<std::vector<unsigned char>> const& palette,
+                            float depth32MaxM = 7.5f, float depth16Max = 2494.0f);
+
+    DepthColorizer(DepthColorizer const&) = delete;
+    DepthColorizer& operator=(DepthColorizer const&) = delete;
+
+    /// Depth_32 (meters), values outside [0.01, 9.9] are black
+    void colorizeDepth32(float const* src, std::size_t count, std::uint8_t* bgr) const;
+    /// Depth_16 (signed, sensor units), negative values get the first palette entry
+    void colorizeDepth16(std::int16_t const* src, std::size_t count, std::uint8_t* bgr) const;
+    /// IR amplitude, quantized values below 15 get the first palette entry
+    void colorizeIr(std::uint16_t const* src, std::size_t count, std::uint8_t* bgr) const;
+    /// Raw IR used directly as palette index (clamped to [0, 255])
+    void colorizeIrRaw(std::int16_t const* src, std::size_t count, std::uint8_t* bgr) const;
+
+private:
+    static const int kInvalid = 256;
+
+    struct alignas(64) Lut256 { std::uint32_t v[260]; };
+
+    Lut256 m_lut8;
+    std::vector<std::uint32_t> m_storage;
+    std::uint32_t* m_lutDepth16;
+    std::uint32_t* m_lutIr;
+    int m_lut16Size;
+    float m_depth32Max;
+};
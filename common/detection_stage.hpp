@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Runs a detector (AprilTag, QR code ...) on the frames of a stream, from worker threads
+ *
+ * Replaces the threads that sleep 25 ms and detect on the last frame, whether or not a new
+ * frame arrived. submit() is called from the SDK frame callback: it stores the frame (the
+ * SDK frames only hold `std::shared_ptr` to the pixels) and wakes an idle worker, it never
+ * waits for a detection. There is at most one frame waiting: when every worker is busy a
+ * new frame replaces the waiting one, which is counted in skipped(). The latency is thus
+ * bounded by one detection, whatever the frame rate.
+ *
+ * Each worker calls the factory once, from its own thread, so a detector that is not thread
+ * safe (xv::AprilTagDetector) gets one instance per worker. Results carry the timestamps of
+ * the frame they were computed on, so they can be fused with the pose of the device at that
+ * time (PoseTimeline::poseAt) rather than with the latest pose. They are delivered in frame
+ * order: a result finished after the one of a newer frame is discarded (see late()).
+ *
+ * `Frame` needs `hostTimestamp` and `edgeTimestampUs` members (xv::FisheyeImages,
+ * xv::ColorImage, xv::GrayScaleImage ...).
+ *
+ * @code
+ * DetectionStage<xv::FisheyeImages, std::vector<xv::TagPose>> stage(
+ *     [calibration] {
+ *         auto detector = std::make_shared<xv::AprilTagDetector>(calibration);
+ *         return [detector](xv::FisheyeImages const& images) { return detector->detect(images, 0.16); };
+ *     },
+ *     [](DetectionStage<xv::FisheyeImages, std::vector<xv::TagPose>>::Detection const& d) { ... });
+ * fisheyes->registerCallback([&stage](xv::FisheyeImages const& images) { stage.submit(images); });
+ * @endcode
+ */
+template <class Frame, class Result>
+class DetectionStage
+{
+public:
+    struct Options
+    {
+        Options() : workers(1) {}
+        int workers; ///< detection threads
+    };
+
+    struct Detection
+    {
+        std::uint64_t sequence;       ///< index of the frame among the submitted ones (from 1)
+        std::int64_t edgeTimestampUs; ///< of the frame
+        double hostTimestamp;         ///< of the frame
+        double latency;               ///< seconds from submit() to the end of the detection
+        Result result;
+    };
+
+    typedef std::function<Result(Frame const&)> Detector;
+    typedef std::function<Detector()> DetectorFactory;
+    typedef std::function<void(Detection const&)> Callback;
+
+    DetectionStage(DetectorFactory factory, Callback callback, Options const& options = Options())
+        : m_factory(std::move(factory)), m_callback(std::move(callback)), m_options(options),
+          m_frameSequence(0), m_pending(false), m_stop(false), m_lastDelivered(0), m_submitted(0), m_skipped(0),
+          m_processed(0), m_late(0)
+    {
+        const int workers = m_options.workers > 0 ? m_options.workers : 1;
+        for (int i = 0; i < workers; ++i) {
+            m_workers.emplace_back(&DetectionStage::run, this);
+        }
+    }
+
+    /// Stops the workers after their current detection, the waiting frame is discarded
+    ~DetectionStage()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mtx);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& t : m_workers) {
+            t.join();
+        }
+    }
+
+    DetectionStage(DetectionStage const&) = delete;
+    DetectionStage& operator=(DetectionStage const&) = delete;
+
+    /// Frame callback side: hands `frame` to an idle worker or replaces the waiting frame
+    void submit(Frame const& frame)
+    {
+        bool replaced;
+        {
+            std::lock_guard<std::mutex> l(m_mtx);
+            replaced = m_pending;
+            m_frame = frame;
+            m_frameSequence = ++m_submitted;
+            m_frameSubmitted = std::chrono::steady_clock::now();
+            m_pending = true;
+        }
+        if (replaced) {
+            m_skipped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m_cv.notify_one();
+        }
+    }
+
+    Options const& options() const { return m_options; }
+    std::uint64_t submitted() const
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        return m_submitted;
+    }
+    /// Frames replaced before a worker took them
+    std::uint64_t skipped() const { return m_skipped.load(); }
+    /// Detections delivered to the callback
+    std::uint64_t processed() const { return m_processed.load(); }
+    /// Detections discarded because the one of a newer frame was delivered first
+    std::uint64_t late() const { return m_late.load(); }
+
+private:
+    void run()
+    {
+        Detector detect = m_factory();
+        std::unique_lock<std::mutex> l(m_mtx);
+        while (true) {
+            m_cv.wait(l, [this] { return m_stop || m_pending; });
+            if (m_stop) {
+                return;
+            }
+            Frame frame = std::move(m_frame);
+            m_frame = Frame();
+            m_pending = false;
+            Detection d;
+            d.sequence = m_frameSequence;
+            const auto submitted = m_frameSubmitted;
+            l.unlock();
+
+            d.edgeTimestampUs = frame.edgeTimestampUs;
+            d.hostTimestamp = frame.hostTimestamp;
+            d.result = detect(frame);
+            d.latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - submitted).count();
+            // release the pixels before waiting for the next frame
+            frame = Frame();
+            deliver(d);
+
+            l.lock();
+        }
+    }
+
+    void deliver(Detection const& d)
+    {
+        std::lock_guard<std::mutex> l(m_deliverMtx);
+        if (d.sequence < m_lastDelivered) {
+            m_late.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_lastDelivered = d.sequence;
+        m_callback(d);
+        m_processed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    DetectorFactory m_factory;
+    Callback m_callback;
+    Options m_options;
+
+    // the frame waiting for a worker
+    mutable std::mutex m_mtx;
+    std::condition_variable m_cv;
+    Frame m_frame;
+    std::uint64_t m_frameSequence;
+    std::chrono::steady_clock::time_point m_frameSubmitted;
+    bool m_pending;
+    bool m_stop;
+
+    std::mutex m_deliverMtx;
+    std::uint64_t m_lastDelivered;
+
+    std::uint64_t m_submitted;
+    std::atomic<std::uint64_t> m_skipped;
+    std::atomic<std::uint64_t> m_processed;
+    std::atomic<std::uint64_t> m_late;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,306 @@
+#include "display_service.h"
+#include "frame_trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+const std::chrono::milliseconds kMaxWait(30); // keeps the windows responsive
+
+std::chrono::steady_clock::duration interval(double fps)
+{
+    if (fps <= 0.) {
+        return std::chrono::steady_clock::duration::zero();
+    }
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1. / fps));
+}
+
+// BGR 8 bits, as the tiles of the mosaic
+void toBgr(cv::Mat const& image, cv::Mat& bgr)
+{
+    cv::Mat src = image;
+    if (src.depth() != CV_8U) {
+        cv::normalize(image, src, 0, 255, cv::NORM_MINMAX, CV_8U);
+    }
+    switch (src.channels()) {
+    case 1: cv::cvtColor(src, bgr, cv::COLOR_GRAY2BGR); break;
+    case 4: cv::cvtColor(src, bgr, cv::COLOR_BGRA2BGR); break;
+    default: bgr = src; break;
+    }
+}
+
+} // namespace
+
+DisplayService::DisplayService(Options const& options)
+    : m_options(options), m_signal(nullptr), m_stop(false), m_quit(false), m_rendered(0), m_mosaics(0)
+{
+}
+
+DisplayService::~DisplayService()
+{
+    stopWorkers();
+}
+
+void DisplayService::addStream(std::vector<std::string> const& windows, Sequence sequence, Render render, double maxFps)
+{
+    Stream s;
+    for (std::string const& name : windows) {
+        s.windows.push_back(window(name));
+    }
+    s.sequence = sequence;
+    s.render = render;
+    s.minInterval = interval(maxFps > 0. ? maxFps : m_options.maxFps);
+    s.shownSequence = 0;
+    s.busy = false;
+    m_streams.push_back(s);
+}
+
+void DisplayService::placeWindow(std::string const& name, int x, int y)
+{
+    m_windows[window(name)].position = cv::Point(x, y);
+}
+
+void DisplayService::setMosaicCallback(MosaicCallback callback)
+{
+    m_mosaicCallback = callback;
+}
+
+void DisplayService::run(FrameSignal& signal)
+{
+    FrameTrace::nameThread("display");
+    m_signal = &signal;
+    m_quit = false;
+    for (int i = 0; i < m_options.workers; ++i) {
+        m_workers.emplace_back(&DisplayService::work, this);
+    }
+
+    std::uint64_t generation = 0;
+    while (!m_stop.load()) {
+        const Clock::duration wait = schedule(Clock::now());
+        // sleep until a callback published a frame or a worker finished a render
+        signal.waitFor(generation, wait);
+
+        std::vector<Result> results;
+        {
+            std::lock_guard<std::mutex> l(m_mtx);
+            results.swap(m_results);
+        }
+        for (Result& r : results) {
+            apply(r);
+        }
+        if (m_options.headless) {
+            composeMosaic(Clock::now());
+        } else {
+            show();
+        }
+    }
+    stopWorkers();
+}
+
+void DisplayService::stop()
+{
+    m_stop = true;
+}
+
+std::size_t DisplayService::window(std::string const& name)
+{
+    auto it = m_windowIndex.find(name);
+    if (it != m_windowIndex.end()) {
+        return it->second;
+    }
+    Window w;
+    w.name = name;
+    w.position = cv::Point(-1, -1);
+    w.created = false;
+    w.dirty = false;
+    m_windows.push_back(w);
+    m_windowIndex[name] = m_windows.size() - 1;
+    return m_windows.size() - 1;
+}
+
+DisplayService::Clock::duration DisplayService::schedule(Clock::time_point now)
+{
+    Clock::duration next = kMaxWait;
+    std::size_t queued = 0;
+    for (std::size_t i = 0; i < m_streams.size(); ++i) {
+        Stream& s = m_streams[i];
+        if (s.busy) {
+            continue;
+        }
+        const std::uint64_t sequence = s.sequence();
+        if (sequence == 0 || sequence == s.shownSequence) {
+            continue;
+        }
+        const Clock::time_point due = s.lastRender + s.minInterval;
+        if (now < due) {
+            // capped: wake up when it is due even if nothing else happens
+            next = std::min(next, due - now);
+            continue;
+        }
+        s.shownSequence = sequence;
+        s.lastRender = now;
+        if (m_workers.empty()) {
+            Result r = render(i);
+            apply(r);
+            continue;
+        }
+        s.busy = true;
+        std::lock_guard<std::mutex> l(m_mtx);
+        m_jobs.push_back(i);
+        ++queued;
+    }
+    if (queued > 0) {
+        m_cv.notify_all();
+    }
+    return next;
+}
+
+DisplayService::Result DisplayService::render(std::size_t stream)
+{
+    Result r;
+    r.stream = stream;
+    r.ok = false;
+    r.images.resize(m_streams[stream].windows.size());
+    try {
+        r.ok = m_streams[stream].render(r.images);
+    } catch (std::exception const& e) {
+        std::cerr << "DisplayService: render failed: " << e.what() << std::endl;
+    }
+    ++m_rendered;
+    return r;
+}
+
+void DisplayService::apply(Result& result)
+{
+    Stream& s = m_streams[result.stream];
+    s.busy = false;
+    if (!result.ok) {
+        return;
+    }
+    for (std::size_t i = 0; i < s.windows.size() && i < result.images.size(); ++i) {
+        if (result.images[i].empty()) {
+            continue;
+        }
+        Window& w = m_windows[s.windows[i]];
+        w.image = result.images[i];
+        w.dirty = true;
+    }
+}
+
+void DisplayService::show()
+{
+    for (std::size_t i = 0; i < m_windows.size(); ++i) {
+        Window& w = m_windows[i];
+        if (!w.dirty) {
+            continue;
+        }
+        if (!w.created) {
+            cv::namedWindow(w.name);
+            if (w.position.x >= 0) {
+                cv::moveWindow(w.name, w.position.x, w.position.y);
+            }
+            w.created = true;
+        }
+        {
+            // trace names must outlive the spans: the window is given by its index, as the frame id
+            TraceScope trace("show", "display", i);
+            cv::imshow(w.name, w.image);
+        }
+        // imshow keeps its own copy: the buffer can go back to the pool
+        w.image.release();
+        w.dirty = false;
+    }
+    cv::waitKey(1);
+}
+
+void DisplayService::composeMosaic(Clock::time_point now)
+{
+    bool dirty = false;
+    int count = 0;
+    for (Window const& w : m_windows) {
+        dirty = dirty || w.dirty;
+        count += w.image.empty() ? 0 : 1;
+    }
+    if (!dirty || count == 0) {
+        return;
+    }
+    if (m_lastMosaic != Clock::time_point() && now < m_lastMosaic + interval(m_options.mosaicFps)) {
+        return;
+    }
+
+    TraceScope trace("mosaic", "display", m_mosaics.load());
+    const int columns = m_options.columns > 0 ? std::min(m_options.columns, count)
+                                              : static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const int rows = (count + columns - 1) / columns;
+    const int tw = m_options.tileWidth, th = m_options.tileHeight;
+    m_mosaic.create(rows * th, columns * tw, CV_8UC3);
+    m_mosaic.setTo(cv::Scalar::all(0));
+
+    cv::Mat bgr;
+    int tile = 0;
+    for (Window& w : m_windows) {
+        w.dirty = false;
+        if (w.image.empty()) {
+            continue;
+        }
+        toBgr(w.image, bgr);
+        // letterboxed in its tile, aspect ratio kept
+        const double scale = std::min(static_cast<double>(tw) / bgr.cols, static_cast<double>(th) / bgr.rows);
+        const int width = std::max(1, static_cast<int>(bgr.cols * scale));
+        const int height = std::max(1, static_cast<int>(bgr.rows * scale));
+        const cv::Point origin((tile % columns) * tw + (tw - width) / 2, (tile / columns) * th + (th - height) / 2);
+        cv::Mat roi = m_mosaic(cv::Rect(origin.x, origin.y, width, height));
+        cv::resize(bgr, roi, roi.size(), 0, 0, cv::INTER_AREA);
+        cv::putText(m_mosaic, w.name, cv::Point((tile % columns) * tw + 6, (tile / columns) * th + 16),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(0, 255, 0));
+        ++tile;
+    }
+    m_lastMosaic = now;
+    ++m_mosaics;
+    if (m_mosaicCallback) {
+        m_mosaicCallback(m_mosaic);
+    }
+}
+
+void DisplayService::work()
+{
+    FrameTrace::nameThread("display worker");
+    while (true) {
+        std::size_t stream;
+        {
+            std::unique_lock<std::mutex> l(m_mtx);
+            m_cv.wait(l, [this] { return m_quit || !m_jobs.empty(); });
+            if (m_quit) {
+                return;
+            }
+            stream = m_jobs.front();
+            m_jobs.pop_front();
+        }
+        Result r = render(stream);
+        {
+            std::lock_guard<std::mutex> l(m_mtx);
+            m_results.push_back(std::move(r));
+        }
+        m_signal->notify();
+    }
+}
+
+void DisplayService::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        m_quit = true;
+        m_jobs.clear();
+    }
+    m_cv.notify_all();
+    for (std::thread& t : m_workers) {
+        t.join();
+    }
+    m_workers.clear();
+    m_results.clear();
+    for (Stream& s : m_streams) {
+        s.busy = false;
+    }
+}
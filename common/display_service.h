@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_mailbox.hpp"
+
+/**
+ * @brief Shows the latest frame of each stream, converted on worker threads, in windows or in a mosaic
+ *
+ * Each stream gives a sequence number (usually FrameMailbox::sequence()) and a render
+ * function producing one image per window of the stream. A stream is rendered only when
+ * its sequence changed since the last render, at most `maxFps` times per second and never
+ * twice at the same time; renders of different streams run in parallel on the workers.
+ *
+ * run() is the display loop. With windows, a window is created the first time it has an
+ * image (streams that never deliver do not open anything) and only the windows with a new
+ * image are redrawn. Headless, no window is created: the images are letterboxed into the
+ * tiles of a BGR mosaic, given to the mosaic callback at most `mosaicFps` times per second
+ * (e.g. to encode and publish it for remote inspection).
+ *
+ * @code
+ * DisplayService service;
+ * service.addStream({"TOF"}, [] { return s_tof.sequence(); }, [](std::vector<cv::Mat>& images) {
+ *     images[0] = raw_to_opencv(s_tof.latest());
+ *     return true;
+ * });
+ * std::thread t([&] { service.run(s_frameSignal); });
+ * // ...
+ * service.stop();
+ * t.join();
+ * @endcode
+ */
+class DisplayService
+{
+public:
+    struct Options
+    {
+        Options() : headless(false), workers(2), maxFps(30.), tileWidth(480), tileHeight(300), columns(0), mosaicFps(5.) {}
+        bool headless;  ///< composite a mosaic instead of opening windows
+        int workers;    ///< rendering threads, 0: render on the display thread
+        double maxFps;  ///< default refresh cap of the streams, 0: none
+        int tileWidth;  ///< mosaic tile of a window
+        int tileHeight;
+        int columns;    ///< mosaic columns, 0: about square
+        double mosaicFps; ///< mosaic callback cap, 0: every change
+    };
+
+    /// Latest sequence number of the stream, 0 while it has nothing
+    typedef std::function<std::uint64_t()> Sequence;
+    /// Fills the images of the windows of the stream (empty images are not shown), false: nothing to show
+    typedef std::function<bool(std::vector<cv::Mat>&)> Render;
+    /// Receives the mosaic on the display thread, valid until the callback returns
+    typedef std::function<void(cv::Mat const&)> MosaicCallback;
+
+    explicit DisplayService(Options const& options = Options());
+    /// Stops the workers
+    ~DisplayService();
+
+    DisplayService(DisplayService const&) = delete;
+    DisplayService& operator=(DisplayService const&) = delete;
+
+    /**
+     * @brief Adds a stream, before run()
+     * @param windows: window names, several streams may share a window
+     * @param maxFps: refresh cap of this stream, 0: Options::maxFps
+     */
+    void addStream(std::vector<std::string> const& windows, Sequence sequence, Render render, double maxFps = 0.);
+    /// Position of a window when it gets created, before run()
+    void placeWindow(std::string const& name, int x, int y);
+    void setMosaicCallback(MosaicCallback callback);
+
+    /**
+     * @brief Display loop, returns after stop()
+     * @param signal: notified by the mailboxes of the streams; the workers notify it too
+     */
+    void run(FrameSignal& signal);
+    void stop();
+
+    Options const& options() const { return m_options; }
+    std::uint64_t rendered() const { return m_rendered.load(); }
+    std::uint64_t mosaics() const { return m_mosaics.load(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stream
+    {
+        std::vector<std::size_t> windows; // indices in m_windows
+        Sequence sequence;
+        Render render;
+        Clock::duration minInterval;
+        // display thread only
+        std::uint64_t shownSequence;
+        Clock::time_point lastRender;
+        bool busy;
+    };
+
+    struct Window
+    {
+        std::string name;
+        cv::Point position; // x < 0: not placed
+        cv::Mat image;
+        bool created;
+        bool dirty;
+    };
+
+    struct Result
+    {
+        std::size_t stream;
+        bool ok;
+        std::vector<cv::Mat> images;
+    };
+
+    std::size_t window(std::string const& name);
+    /// Queues the streams due for a render, returns how long until the next one may be due
+    Clock::duration schedule(Clock::time_point now);
+    Result render(std::size_t stream);
+    void apply(Result& result);
+    void show();
+    void composeMosaic(Clock::time_point now);
+    void work();
+    void stopWorkers();
+
+    Options m_options;
+    std::vector<Stream> m_streams;
+    std::vector<Window> m_windows;
+    std::map<std::string, std::size_t> m_windowIndex;
+    MosaicCallback m_mosaicCallback;
+    cv::Mat m_mosaic;
+    Clock::time_point m_lastMosaic;
+
+    FrameSignal* m_signal;
+    std::atomic<bool> m_stop;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::deque<std::size_t> m_jobs;
+    std::vector<Result> m_results;
+    bool m_quit;
+    std::vector<std::thread> m_workers;
+
+    std::atomic<std::uint64_t> m_rendered;
+    std::atomic<std::uint64_t> m_mosaics;
+};
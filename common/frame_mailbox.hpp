@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Wakes consumer threads when one of several mailboxes received a frame
+ *
+ * One signal is usually shared by all the mailboxes a display thread looks at.
+ * notify() only takes the mutex when somebody is actually waiting, so SDK
+ * callbacks stay lock free while the consumer is busy.
+ */
+class FrameSignal
+{
+public:
+    FrameSignal() : m_generation(0), m_waiters(0) {}
+
+    FrameSignal(FrameSignal const&) = delete;
+    FrameSignal& operator=(FrameSignal const&) = delete;
+
+    void notify()
+    {
+        m_generation.fetch_add(1);
+        if (m_waiters.load() > 0) {
+            std::lock_guard<std::mutex> l(m_mtx);
+            m_cv.notify_all();
+        }
+    }
+
+    /**
+     * @brief Waits until notify() was called since `generation` was last updated, or until timeout
+     * @param generation: in/out, last generation seen by the caller (start with 0)
+     * @return true if new data was signaled
+     */
+    template <class Rep, class Period>
+    bool waitFor(std::uint64_t& generation, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        std::uint64_t g = m_generation.load();
+        if (g == generation) {
+            m_waiters.fetch_add(1);
+            std::unique_lock<std::mutex> l(m_mtx);
+            m_cv.wait_for(l, timeout, [&]{ return m_generation.load() != generation; });
+            m_waiters.fetch_sub(1);
+            g = m_generation.load();
+        }
+        bool signaled = g != generation;
+        generation = g;
+        return signaled;
+    }
+
+private:
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::atomic<std::uint64_t> m_generation;
+    std::atomic<int> m_waiters;
+};
+
+/**
+ * @brief Single producer / multi consumer "latest frame" mailbox
+ *
+ * Replaces the `s_mtx_xxx.lock(); s_xxx = std::make_shared<xv::X>(frame);` pattern.
+ * The frame structs of the SDK only hold `std::shared_ptr` to the pixel buffers, so a
+ * slot keeps the buffers alive without copying pixels, and publishing does not allocate.
+ *
+ * With the default 3 slots this is a lock-free triple buffer: the producer writes into a
+ * slot that is neither the published one nor being read, then publishes it with a single
+ * atomic store. Consumers pin the published slot with a reader count while they copy the
+ * frame header out. If every slot is pinned (more consumers than Slots - 2) the frame is
+ * dropped instead of blocking the callback, see dropped().
+ */
+template <class T, std::size_t Slots = 3>
+class FrameMailbox
+{
+    static_assert(Slots >= 2 && Slots <= 255, "FrameMailbox needs between 2 and 255 slots");
+
+public:
+    explicit FrameMailbox(FrameSignal* signal = nullptr)
+        : m_signal(signal), m_latest(0), m_dropped(0), m_seq(0), m_published(Slots) {}
+
+    FrameMailbox(FrameMailbox const&) = delete;
+    FrameMailbox& operator=(FrameMailbox const&) = delete;
+
+    /// Producer side (SDK callback). Returns false if the frame had to be dropped.
+    bool publish(T const& frame)
+    {
+        Slot* s = claim();
+        if (!s) {
+            return false;
+        }
+        s->value = frame;
+        commit(s);
+        return true;
+    }
+
+    bool publish(T&& frame)
+    {
+        Slot* s = claim();
+        if (!s) {
+            return false;
+        }
+        s->value = std::move(frame);
+        commit(s);
+        return true;
+    }
+
+    /**
+     * @brief Copies the latest frame header if it is newer than `seq`
+     * @param seq: in/out, sequence number of the last frame seen by this consumer (start with 0)
+     */
+    bool next(T& out, std::uint64_t& seq) const
+    {
+        while (true) {
+            std::uint64_t latest = m_latest.load(std::memory_order_acquire);
+            std::uint64_t latestSeq = latest >> 8;
+            if (latestSeq == 0 || latestSeq == seq) {
+                return false;
+            }
+            Slot& s = m_slots[latest & 0xff];
+            std::uint32_t state = s.state.fetch_add(1, std::memory_order_acquire);
+            // the producer recycled this slot after we loaded m_latest: reload
+            if ((state & kWriting) || s.seq.load(std::memory_order_relaxed) != latestSeq) {
+                s.state.fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+            out = s.value;
+            s.state.fetch_sub(1, std::memory_order_release);
+            seq = latestSeq;
+            return true;
+        }
+    }
+
+    /// Same as next(), returns nullptr when there is no newer frame
+    std::shared_ptr<const T> next(std::uint64_t& seq) const
+    {
+        const std::uint64_t latestSeq = sequence();
+        if (latestSeq == 0 || latestSeq == seq) {
+            return nullptr;
+        }
+        std::shared_ptr<T> p = std::make_shared<T>();
+        if (!next(*p, seq)) {
+            return nullptr;
+        }
+        return p;
+    }
+
+    /// Latest frame regardless of whether it was seen already, nullptr if nothing was published
+    std::shared_ptr<const T> latest() const
+    {
+        std::uint64_t seq = 0;
+        return next(seq);
+    }
+
+    /// Sequence number of the last published frame (0: none)
+    std::uint64_t sequence() const { return m_latest.load(std::memory_order_acquire) >> 8; }
+
+    /// Frames dropped because all slots were being read
+    std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static const std::uint32_t kWriting = 1u << 31;
+
+    struct alignas(64) Slot
+    {
+        Slot() : state(0), seq(0) {}
+        std::atomic<std::uint32_t> state; // reader count | kWriting
+        std::atomic<std::uint64_t> seq;
+        T value;
+    };
+
+    Slot* claim()
+    {
+        for (std::size_t i = 0; i < Slots; ++i) {
+            if (i == m_published) {
+                continue;
+            }
+            std::uint32_t expected = 0;
+            if (m_slots[i].state.compare_exchange_strong(expected, kWriting, std::memory_order_acquire)) {
+                return &m_slots[i];
+            }
+        }
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    void commit(Slot* s)
+    {
+        std::uint64_t seq = ++m_seq;
+        s->seq.store(seq, std::memory_order_relaxed);
+        s->state.fetch_and(~kWriting, std::memory_order_release);
+        m_published = static_cast<std::size_t>(s - m_slots);
+        m_latest.store(seq << 8 | m_published, std::memory_order_release);
+        if (m_signal) {
+            m_signal->notify();
+        }
+    }
+
+    mutable Slot m_slots[Slots];
+    FrameSignal* m_signal;
+    alignas(64) std::atomic<std::uint64_t> m_latest; // seq << 8 | slot
+    std::atomic<std::uint64_t> m_dropped;
+    // producer only
+    std::uint64_t m_seq;
+    std::size_t m_published;
+};
+
+/**
+ * @brief Bounded single producer / single consumer frame queue
+ *
+ * For consumers that need every frame (recording, processing) rather than the latest
+ * one. The producer never blocks: when the ring is full the new frame is dropped and
+ * counted, so a slow consumer cannot back-pressure the SDK callbacks.
+ */
+template <class T>
+class FrameRing
+{
+public:
+    /**
+     * @param capacity: number of frames kept (rounded up to a power of two)
+     */
+    explicit FrameRing(std::size_t capacity, FrameSignal* signal = nullptr)
+        : m_signal(signal), m_head(0), m_tail(0), m_dropped(0)
+    {
+        std::size_t n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+        m_buffer.resize(n);
+        m_mask = n - 1;
+    }
+
+    FrameRing(FrameRing const&) = delete;
+    FrameRing& operator=(FrameRing const&) = delete;
+
+    /// Producer side. Returns false (and counts a drop) when the ring is full.
+    bool push(T const& frame)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_buffer[head & m_mask] = frame;
+        m_head.store(head + 1, std::memory_order_release);
+        if (m_signal) {
+            m_signal->notify();
+        }
+        return true;
+    }
+
+    /// Consumer side. Moves the oldest frame out, returns false when empty.
+    bool pop(T& out)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        T& slot = m_buffer[tail & m_mask];
+        out = std::move(slot);
+        slot = T(); // release the pixel buffers now, not when the slot is reused
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+    std::size_t capacity() const { return m_mask + 1; }
+    std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<T> m_buffer;
+    std::size_t m_mask;
+    FrameSignal* m_signal;
+    alignas(64) std::atomic<std::size_t> m_head;
+    alignas(64) std::atomic<std::size_t> m_tail;
+    std::atomic<std::uint64_t> m_dropped;
+};
@@ -0,0 +1,127 @@
+#include "frame_pool.h"
+
+#include <cstdlib>
+#include <new>
+#include <tuple>
+
+namespace {
+
+const std::size_t kAlignment = 64;
+
+} // namespace
+
+// placed in the 64 bytes before the data
+struct FramePool::Header
+{
+    Key key;
+    void* block; // as returned by malloc
+};
+
+bool FramePool::Key::operator<(Key const& o) const
+{
+    return std::tie(width, height, type, bytes) < std::tie(o.width, o.height, o.type, o.bytes);
+}
+
+FramePool::FramePool(std::size_t maxPerKey) : m_maxPerKey(maxPerKey)
+{
+}
+
+FramePool::~FramePool()
+{
+    trim();
+}
+
+void* FramePool::acquire(int width, int height, int type, std::size_t bytes)
+{
+    static_assert(sizeof(Header) <= kAlignment, "the header must fit before the data");
+    const Key key = {width, height, type, bytes};
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        auto it = m_free.find(key);
+        if (it != m_free.end() && !it->second.empty()) {
+            Header* header = it->second.back();
+            it->second.pop_back();
+            ++m_stats.reuses;
+            ++m_stats.outstanding;
+            --m_stats.cached;
+            m_stats.cachedBytes -= bytes;
+            return reinterpret_cast<std::uint8_t*>(header) + kAlignment;
+        }
+    }
+
+    // room for the alignment and the header
+    void* block = std::malloc(bytes + 2 * kAlignment);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    std::uintptr_t data = (reinterpret_cast<std::uintptr_t>(block) + 2 * kAlignment) & ~(kAlignment - 1);
+    Header* header = reinterpret_cast<Header*>(data - kAlignment);
+    header->key = key;
+    header->block = block;
+
+    std::lock_guard<std::mutex> l(m_mtx);
+    ++m_stats.allocations;
+    ++m_stats.outstanding;
+    return reinterpret_cast<void*>(data);
+}
+
+void FramePool::release(void* data)
+{
+    if (!data) {
+        return;
+    }
+    Header* header = reinterpret_cast<Header*>(static_cast<std::uint8_t*>(data) - kAlignment);
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        --m_stats.outstanding;
+        std::vector<Header*>& cached = m_free[header->key];
+        if (cached.size() < m_maxPerKey) {
+            cached.push_back(header);
+            ++m_stats.cached;
+            m_stats.cachedBytes += header->key.bytes;
+            return;
+        }
+        ++m_stats.frees;
+    }
+    freeBlock(header);
+}
+
+std::shared_ptr<std::uint8_t> FramePool::acquireShared(int width, int height, int type, std::size_t bytes)
+{
+    return std::shared_ptr<std::uint8_t>(static_cast<std::uint8_t*>(acquire(width, height, type, bytes)),
+                                         [this](std::uint8_t* data) { release(data); });
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    std::lock_guard<std::mutex> l(m_mtx);
+    return m_stats;
+}
+
+void FramePool::trim()
+{
+    std::map<Key, std::vector<Header*>> cached;
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        cached.swap(m_free);
+        m_stats.frees += m_stats.cached;
+        m_stats.cached = 0;
+        m_stats.cachedBytes = 0;
+    }
+    for (auto& entry : cached) {
+        for (Header* header : entry.second) {
+            freeBlock(header);
+        }
+    }
+}
+
+FramePool& FramePool::global()
+{
+    static FramePool* pool = new FramePool();
+    return *pool;
+}
+
+void FramePool::freeBlock(Header* header)
+{
+    std::free(header->block);
+}
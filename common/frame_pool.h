@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Recycles the frame-sized buffers of the host-side converters
+ *
+ * A preview converts every frame into a new image of the same few sizes; allocating them
+ * each time costs a malloc (an mmap above the malloc threshold, with its page faults on
+ * first touch) and a free per frame. The pool keeps released buffers per key (width,
+ * height, type, bytes) and hands them out again, so once every size has been seen there is
+ * no allocation left: stats() counts them.
+ *
+ * Buffers are 64-byte aligned. Each one carries its key in a header placed before the data,
+ * so release() only needs the pointer. The pool is thread safe; the lock is only held to
+ * push or pop a pointer.
+ *
+ * @code
+ * std::shared_ptr<std::uint8_t> buffer = FramePool::global().acquireShared(w, h, CV_8UC3, w * h * 3);
+ * // ... the buffer returns to the pool when the last copy of `buffer` is destroyed
+ * @endcode
+ */
+class FramePool
+{
+public:
+    struct Stats
+    {
+        Stats() : allocations(0), reuses(0), frees(0), outstanding(0), cached(0), cachedBytes(0) {}
+        std::uint64_t allocations; ///< buffers obtained from the system
+        std::uint64_t reuses;      ///< acquire() served from the pool
+        std::uint64_t frees;       ///< buffers given back to the system (key full, trim())
+        std::size_t outstanding;   ///< buffers acquired and not released yet
+        std::size_t cached;        ///< buffers waiting in the pool
+        std::size_t cachedBytes;
+    };
+
+    /// @param maxPerKey: released buffers kept per key, the others are freed
+    explicit FramePool(std::size_t maxPerKey = 4);
+    /// Frees the cached buffers; buffers still acquired must not be released afterwards
+    ~FramePool();
+
+    FramePool(FramePool const&) = delete;
+    FramePool& operator=(FramePool const&) = delete;
+
+    /**
+     * @brief Buffer of `bytes` bytes for a `width` x `height` frame
+     * @param type: any tag telling formats of the same size apart (e.g. CV_8UC3)
+     * @return uninitialized data, never null (std::bad_alloc)
+     */
+    void* acquire(int width, int height, int type, std::size_t bytes);
+    /// Gives back a buffer of acquire(), null is ignored
+    void release(void* data);
+    /// acquire() as a shared_ptr releasing the buffer with its last copy
+    std::shared_ptr<std::uint8_t> acquireShared(int width, int height, int type, std::size_t bytes);
+
+    Stats stats() const;
+    /// Frees the cached buffers (e.g. after a resolution change)
+    void trim();
+
+    /// Pool of the process, never destroyed so buffers may be released during exit
+    static FramePool& global();
+
+private:
+    struct Key
+    {
+        int width;
+        int height;
+        int type;
+        std::size_t bytes;
+        bool operator<(Key const& o) const;
+    };
+    struct Header;
+
+    void freeBlock(Header* header);
+
+    std::size_t m_maxPerKey;
+    mutable std::mutex m_mtx;
+    std::map<Key, std::vector<Header*>> m_free;
+    Stats m_stats;
+};
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FRAME_TRACE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define FRAME_TRACE_TSC 1
+#else
+#define FRAME_TRACE_TSC 0
+#endif
+
+/**
+ * @brief Per-stage latency spans of the frames, from SDK delivery to the consumers
+ *
+ * Each thread records its spans into its own ring (kSpansPerThread entries, the oldest are
+ * overwritten): a span is two reads of FrameTrace::ticks() and a store, without lock or
+ * allocation, and costs one relaxed load while tracing is disabled. A span is tagged with the stream, the
+ * stage and the frame id (the edge timestamp of the frame, so the spans of one frame line up
+ * across threads). Stage and stream names must be string literals, only the pointers are kept.
+ *
+ * snapshot() copies the rings on demand, from any thread, while they keep recording; the
+ * result is written as Chrome trace-event JSON (chrome://tracing, Perfetto) or as a compact
+ * binary file that can be read back and converted later.
+ *
+ * Timestamps are steady_clock nanoseconds, the clock of the SDK host timestamps: the
+ * "sdk" span of TraceScope(stage, stream, frame, hostTimestamp) is the delay between the
+ * SDK receiving the frame and the callback.
+ *
+ * @code
+ * FrameTrace::enable();
+ * device->colorCamera()->registerCallback([](xv::ColorImage const& rgb) {
+ *     TraceScope trace("callback", "rgb", rgb.edgeTimestampUs, rgb.hostTimestamp);
+ *     s_rgb.publish(rgb);
+ * });
+ * // ...
+ * FrameTrace::snapshot().writeChrome("trace.json");
+ * @endcode
+ */
+
+/// Spans copied out of the thread rings, with their names interned
+struct FrameTraceSnapshot
+{
+    struct Thread
+    {
+        std::uint32_t id;
+        std::string name;
+    };
+
+    struct Span
+    {
+        std::uint32_t thread;
+        std::uint16_t stage;  ///< index in strings
+        std::uint16_t stream; ///< index in strings
+        std::uint64_t frame;
+        std::int64_t beginNs;
+        std::int64_t endNs;
+    };
+
+    std::vector<std::string> strings;
+    std::vector<Thread> threads;
+    std::vector<Span> spans;
+
+    /// Trace-event JSON: one complete event per span, the frame id in its args
+    bool writeChrome(std::string const& path) const
+    {
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+        bool first = true;
+        for (Thread const& t : threads) {
+            std::fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                         first ? "" : ",\n", t.id, jsonSafe(t.name).c_str());
+            first = false;
+        }
+        for (Span const& s : spans) {
+            std::fprintf(f, "%s{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"frame\":%llu}}",
+                         first ? "" : ",\n", jsonSafe(strings[s.stage]).c_str(), jsonSafe(strings[s.stream]).c_str(), s.thread,
+                         s.beginNs * 1e-3, (s.endNs - s.beginNs) * 1e-3, static_cast<unsigned long long>(s.frame));
+            first = false;
+        }
+        std::fputs("\n]}\n", f);
+        return std::fclose(f) == 0;
+    }
+
+    /**
+     * @brief "XTRC", u32 version, u32 string count, strings (u16 size + bytes), u32 thread count,
+     * threads (u32 id, u16 name size + bytes), u64 span count, then the Span structs as they are in memory
+     */
+    bool writeBinary(std::string const& path) const
+    {
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        std::fwrite(magic(), 1, 4, f);
+        const std::uint32_t version = kVersion;
+        std::fwrite(&version, sizeof(version), 1, f);
+        const std::uint32_t stringCount = static_cast<std::uint32_t>(strings.size());
+        std::fwrite(&stringCount, sizeof(stringCount), 1, f);
+        for (std::string const& s : strings) {
+            writeString(f, s);
+        }
+        const std::uint32_t threadCount = static_cast<std::uint32_t>(threads.size());
+        std::fwrite(&threadCount, sizeof(threadCount), 1, f);
+        for (Thread const& t : threads) {
+            std::fwrite(&t.id, sizeof(t.id), 1, f);
+            writeString(f, t.name);
+        }
+        const std::uint64_t spanCount = spans.size();
+        std::fwrite(&spanCount, sizeof(spanCount), 1, f);
+        if (!spans.empty()) {
+            std::fwrite(spans.data(), sizeof(Span), spans.size(), f);
+        }
+        return std::fclose(f) == 0;
+    }
+
+    /// Reads a file of writeBinary(), false if it is not one
+    bool readBinary(std::string const& path)
+    {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) {
+            return false;
+        }
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> closer(f, &std::fclose);
+        char header[4];
+        std::uint32_t version = 0, stringCount = 0, threadCount = 0;
+        std::uint64_t spanCount = 0;
+        if (std::fread(header, 1, 4, f) != 4 || std::memcmp(header, magic(), 4) != 0
+            || std::fread(&version, sizeof(version), 1, f) != 1 || version != kVersion
+            || std::fread(&stringCount, sizeof(stringCount), 1, f) != 1) {
+            return false;
+        }
+        strings.resize(stringCount);
+        for (std::string& s : strings) {
+            if (!readString(f, s)) {
+                return false;
+            }
+        }
+        if (std::fread(&threadCount, sizeof(threadCount), 1, f) != 1) {
+            return false;
+        }
+        threads.resize(threadCount);
+        for (Thread& t : threads) {
+            if (std::fread(&t.id, sizeof(t.id), 1, f) != 1 || !readString(f, t.name)) {
+                return false;
+            }
+        }
+        if (std::fread(&spanCount, sizeof(spanCount), 1, f) != 1) {
+            return false;
+        }
+        spans.resize(spanCount);
+        if (spanCount && std::fread(spans.data(), sizeof(Span), spans.size(), f) != spans.size()) {
+            return false;
+        }
+        for (Span const& s : spans) {
+            if (s.stage >= strings.size() || s.stream >= strings.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static const char* magic() { return "XTRC"; }
+    static const std::uint32_t kVersion = 1;
+
+    static void writeString(std::FILE* f, std::string const& s)
+    {
+        const std::uint16_t size = static_cast<std::uint16_t>(std::min<std::size_t>(s.size(), 0xffff));
+        std::fwrite(&size, sizeof(size), 1, f);
+        std::fwrite(s.data(), 1, size, f);
+    }
+
+    static bool readString(std::FILE* f, std::string& s)
+    {
+        std::uint16_t size = 0;
+        if (std::fread(&size, sizeof(size), 1, f) != 1) {
+            return false;
+        }
+        s.resize(size);
+        return size == 0 || std::fread(&s[0], 1, size, f) == size;
+    }
+
+    static std::string jsonSafe(std::string const& s)
+    {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+        }
+        return out;
+    }
+};
+
+static_assert(sizeof(FrameTraceSnapshot::Span) == 32, "FrameTraceSnapshot::Span is written as is by writeBinary()");
+
+class FrameTrace
+{
+public:
+    static const std::size_t kSpansPerThread = 1 << 14; // power of two
+
+    static void enable(bool on = true) { state().enabled.store(on, std::memory_order_relaxed); }
+    static bool enabled() { return state().enabled.load(std::memory_order_relaxed); }
+
+    /// steady_clock nanoseconds
+    static std::int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Clock of the spans of TraceScope, converted to now() by snapshot()
+     *
+     * The TSC on x86 (invariant and synchronized across cores on the CPUs we run on), a read
+     * of which costs half of steady_clock::now(); now() elsewhere.
+     */
+    static std::uint64_t ticks()
+    {
+#if FRAME_TRACE_TSC
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(now());
+#endif
+    }
+
+    /// Records a span of the calling thread in now() nanoseconds, whether tracing is enabled or not
+    static void record(const char* stage, const char* stream, std::uint64_t frame, std::int64_t beginNs, std::int64_t endNs)
+    {
+        push(stage, stream, frame, beginNs, endNs, false);
+    }
+
+    /// Same as record(), in ticks()
+    static void recordTicks(const char* stage, const char* stream, std::uint64_t frame, std::uint64_t begin, std::uint64_t end)
+    {
+        push(stage, stream, frame, static_cast<std::int64_t>(begin), static_cast<std::int64_t>(end), true);
+    }
+
+    /// Names the calling thread in the traces (a literal, or a string that outlives the traces)
+    static void nameThread(const char* name) { buffer().name.store(name); }
+
+    /**
+     * @brief Copies the spans recorded so far by every thread
+     *
+     * The threads keep recording meanwhile; spans overwritten during the copy are left out.
+     */
+    static FrameTraceSnapshot snapshot()
+    {
+        FrameTraceSnapshot out;
+        std::map<const char*, std::uint16_t> ids;
+        auto intern = [&](const char* s) -> std::uint16_t {
+            auto it = ids.find(s);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            const std::uint16_t id = static_cast<std::uint16_t>(out.strings.size());
+            out.strings.push_back(s ? s : "");
+            ids[s] = id;
+            return id;
+        };
+
+        // ticks() to now(), measured since the first use of the trace
+        State& st = state();
+        const std::uint64_t tick1 = ticks();
+        const std::int64_t ns1 = now();
+        const double nsPerTick = tick1 > st.tick0 ? static_cast<double>(ns1 - st.ns0) / static_cast<double>(tick1 - st.tick0) : 1.;
+        auto toNs = [&st, nsPerTick](std::int64_t t) {
+            return st.ns0 + static_cast<std::int64_t>(static_cast<double>(static_cast<std::uint64_t>(t) - st.tick0) * nsPerTick);
+        };
+
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        {
+            std::lock_guard<std::mutex> l(st.mtx);
+            buffers = st.buffers;
+        }
+        std::vector<Entry> copy;
+        for (auto const& b : buffers) {
+            const char* name = b->name.load();
+            out.threads.push_back({b->id, name ? name : "thread " + std::to_string(b->id)});
+
+            const std::uint64_t end = b->count.load(std::memory_order_acquire);
+            const std::uint64_t begin = end > kSpansPerThread ? end - kSpansPerThread : 0;
+            copy.resize(end - begin);
+            for (std::uint64_t i = begin; i < end; ++i) {
+                copy[i - begin] = b->entries[i & (kSpansPerThread - 1)];
+            }
+            // entries the thread wrote over while they were copied, including the one in progress
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const std::uint64_t after = b->count.load(std::memory_order_relaxed) + 1;
+            const std::uint64_t valid = after > kSpansPerThread ? after - kSpansPerThread : 0;
+            for (std::uint64_t i = std::max(begin, valid); i < end; ++i) {
+                Entry const& e = copy[i - begin];
+                FrameTraceSnapshot::Span s;
+                s.thread = b->id;
+                s.stage = intern(e.stage);
+                s.stream = intern(e.stream);
+                s.frame = e.frame;
+                s.beginNs = e.ticks ? toNs(e.begin) : e.begin;
+                s.endNs = e.ticks ? toNs(e.end) : e.end;
+                out.spans.push_back(s);
+            }
+        }
+        return out;
+    }
+
+    /// Forgets the spans recorded so far (not thread safe against snapshot())
+    static void clear()
+    {
+        std::lock_guard<std::mutex> l(state().mtx);
+        for (auto const& b : state().buffers) {
+            b->count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        const char* stage;
+        const char* stream;
+        std::uint64_t frame;
+        std::int64_t begin;
+        std::int64_t end;
+        bool ticks; // begin / end in ticks(), else in now()
+    };
+
+    struct Buffer
+    {
+        Buffer() : count(0), entries(new Entry[kSpansPerThread]), id(0), name(nullptr) {}
+        std::atomic<std::uint64_t> count; // written by the owner thread only
+        std::unique_ptr<Entry[]> entries;
+        std::uint32_t id;
+        std::atomic<const char*> name;
+    };
+
+    struct State
+    {
+        State() : enabled(false), tick0(ticks()), ns0(now()) {}
+        std::atomic<bool> enabled;
+        const std::uint64_t tick0; // origin of the ticks() conversion
+        const std::int64_t ns0;
+        std::mutex mtx;
+        // kept after their thread exited, so its spans remain in the traces
+        std::vector<std::shared_ptr<Buffer>> buffers;
+    };
+
+    static void push(const char* stage, const char* stream, std::uint64_t frame, std::int64_t begin, std::int64_t end, bool ticks)
+    {
+        Buffer& b = buffer();
+        const std::uint64_t n = b.count.load(std::memory_order_relaxed);
+        Entry& e = b.entries[n & (kSpansPerThread - 1)];
+        e.stage = stage;
+        e.stream = stream;
+        e.frame = frame;
+        e.begin = begin;
+        e.end = end;
+        e.ticks = ticks;
+        b.count.store(n + 1, std::memory_order_release);
+    }
+
+    static State& state()
+    {
+        static State* s = new State(); // never destroyed, threads may record during exit
+        return *s;
+    }
+
+    static Buffer& buffer()
+    {
+        static thread_local Buffer* b = nullptr;
+        if (!b) {
+            std::shared_ptr<Buffer> created = std::make_shared<Buffer>();
+            std::lock_guard<std::mutex> l(state().mtx);
+            created->id = static_cast<std::uint32_t>(state().buffers.size() + 1);
+            state().buffers.push_back(created);
+            b = created.get();
+        }
+        return *b;
+    }
+};
+
+/**
+ * @brief Records the span of its scope when tracing is enabled
+ *
+ * The constructor taking the host timestamp of the frame also records the "sdk" span, from
+ * that timestamp to the construction: use it first thing in an SDK callback.
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char* stage, const char* stream, std::uint64_t frame)
+        : m_stage(stage), m_stream(stream), m_frame(frame), m_begin(FrameTrace::enabled() ? FrameTrace::ticks() : 0)
+    {
+    }
+
+    TraceScope(const char* stage, const char* stream, std::int64_t edgeTimestampUs, double hostTimestamp)
+        : TraceScope(stage, stream, static_cast<std::uint64_t>(edgeTimestampUs))
+    {
+        if (m_begin && hostTimestamp > 0) {
+            FrameTrace::record("sdk", stream, m_frame, static_cast<std::int64_t>(hostTimestamp * 1e9), FrameTrace::now());
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_begin) {
+            FrameTrace::recordTicks(m_stage, m_stream, m_frame, m_begin, FrameTrace::ticks());
+        }
+    }
+
+    TraceScope(TraceScope const&) = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+
+private:
+    const char* m_stage;
+    const char* m_stream;
+    std::uint64_t m_frame;
+    std::uint64_t m_begin; // 0: disabled
+};
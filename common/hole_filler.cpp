@@ -0,0 +1,87 @@
+#include "hole_filler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// rows per parallel task
+const int kTileRows = 32;
+
+} // namespace
+
+HoleFiller::HoleFiller(Options const& options) : m_options(options), m_bufferSamples(0)
+{
+    m_options.holeSize = std::max(1, std::min(m_options.holeSize, kMaxHoleSize));
+    const int elementSize = (m_options.holeSize + 1) / 2;
+    m_kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * elementSize + 1, 2 * elementSize + 1),
+                                         cv::Point(elementSize, elementSize));
+}
+
+std::size_t HoleFiller::fill(std::uint16_t* depth, int width, int height, int stride)
+{
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    m_valid.create(height, width, CV_8UC1);
+    const std::uint16_t lo = m_options.minValid;
+    const std::uint16_t hi = m_options.maxValid;
+    const int tiles = (height + kTileRows - 1) / kTileRows;
+
+    cv::parallel_for_(cv::Range(0, tiles), [&](cv::Range const& range) {
+        for (int y = range.start * kTileRows; y < std::min(height, range.end * kTileRows); ++y) {
+            std::uint16_t const* d = depth + static_cast<std::ptrdiff_t>(y) * stride;
+            std::uint8_t* m = m_valid.ptr<std::uint8_t>(y);
+            for (int x = 0; x < width; ++x) {
+                m[x] = (d[x] >= lo && d[x] <= hi) ? 255 : 0;
+            }
+        }
+    });
+
+    cv::morphologyEx(m_valid, m_closed, cv::MORPH_CLOSE, m_kernel, cv::Point(-1, -1), 2);
+
+    // holes closed by the morphology get the median of the valid samples of their window;
+    // only valid samples are read, and those are never written, so this works in place
+    const int h = m_options.holeSize;
+    std::vector<std::size_t> filled(tiles, 0);
+    cv::parallel_for_(cv::Range(0, tiles), [&](cv::Range const& range) {
+        std::uint16_t window[4 * kMaxHoleSize * kMaxHoleSize];
+        for (int tile = range.start; tile < range.end; ++tile) {
+            std::size_t count = 0;
+            for (int y = tile * kTileRows; y < std::min(height, (tile + 1) * kTileRows); ++y) {
+                std::uint8_t const* valid = m_valid.ptr<std::uint8_t>(y);
+                std::uint8_t const* closed = m_closed.ptr<std::uint8_t>(y);
+                std::uint16_t* out = depth + static_cast<std::ptrdiff_t>(y) * stride;
+                const int y0 = std::max(0, y - h), y1 = std::min(height, y + h);
+                for (int x = 0; x < width; ++x) {
+                    if (valid[x] || !closed[x]) {
+                        continue;
+                    }
+                    const int x0 = std::max(0, x - h), x1 = std::min(width, x + h);
+                    int n = 0;
+                    for (int yy = y0; yy < y1; ++yy) {
+                        std::uint8_t const* v = m_valid.ptr<std::uint8_t>(yy);
+                        std::uint16_t const* d = depth + static_cast<std::ptrdiff_t>(yy) * stride;
+                        for (int xx = x0; xx < x1; ++xx) {
+                            if (v[xx]) {
+                                window[n++] = d[xx];
+                            }
+                        }
+                    }
+                    if (n > 0) {
+                        std::nth_element(window, window + n / 2, window + n);
+                        out[x] = window[n / 2];
+                        ++count;
+                    }
+                }
+            }
+            filled[tile] = count;
+        }
+    });
+
+    std::size_t total = 0;
+    for (std::size_t n : filled) {
+        total += n;
+    }
+    return total;
+}
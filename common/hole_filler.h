@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Fills small holes of 16-bit depth images (SgbmImage, DepthImage Depth_16)
+ *
+ * Same result as the former `fillHoles()` template of sgbm_demo: holes are the samples
+ * outside [minValid, maxValid]; those closed by a morphological closing (ellipse of
+ * holeSize, 2 iterations) get the median of the valid samples of the 2*holeSize window
+ * above-left of them.
+ *
+ * Unlike the template it works on 8-bit masks, runs the mask and fill passes on row tiles
+ * in parallel, computes the medians in a fixed stack array (the window has at most
+ * 4 * holeSize^2 samples) and fills in place: every buffer is reused across frames.
+ */
+class HoleFiller
+{
+public:
+    struct Options
+    {
+        Options() : minValid(200), maxValid(10000), holeSize(1) {}
+        std::uint16_t minValid; ///< smaller samples are holes
+        std::uint16_t maxValid; ///< larger samples are holes
+        int holeSize;           ///< size of the biggest holes to fill (px), 1..kMaxHoleSize
+    };
+
+    static const int kMaxHoleSize = 8;
+
+    explicit HoleFiller(Options const& options = Options());
+
+    HoleFiller(HoleFiller const&) = delete;
+    HoleFiller& operator=(HoleFiller const&) = delete;
+
+    Options const& options() const { return m_options; }
+
+    /// Fills `depth` (rows of `stride` samples) in place, returns the number of filled samples
+    std::size_t fill(std::uint16_t* depth, int width, int height, int stride);
+    std::size_t fill(std::uint16_t* depth, int width, int height) { return fill(depth, width, height, width); }
+
+    /**
+     * @brief Copy of `image` with its holes filled (SgbmImage, DepthImage with 16-bit data)
+     *
+     * The copy lives in a buffer owned by the filler, reused for the next frame once the
+     * returned image has been released (otherwise a new one is allocated).
+     */
+    template <class Image>
+    Image apply(Image const& image)
+    {
+        const std::size_t samples = static_cast<std::size_t>(image.width) * image.height;
+        if (!image.data || image.dataSize < samples * sizeof(std::uint16_t)) {
+            return image;
+        }
+        if (!m_buffer || m_buffer.use_count() > 1 || m_bufferSamples < samples) {
+            m_buffer.reset(new std::uint16_t[samples], std::default_delete<std::uint16_t[]>());
+            m_bufferSamples = samples;
+        }
+        std::memcpy(m_buffer.get(), image.data.get(), samples * sizeof(std::uint16_t));
+        fill(m_buffer.get(), static_cast<int>(image.width), static_cast<int>(image.height));
+
+        Image out = image;
+        out.data = std::shared_ptr<const std::uint8_t>(m_buffer, reinterpret_cast<std::uint8_t const*>(m_buffer.get()));
+        out.dataSize = static_cast<decltype(out.dataSize)>(samples * sizeof(std::uint16_t));
+        return out;
+    }
+
+private:
+    Options m_options;
+    cv::Mat m_kernel;
+    cv::Mat m_valid;  ///< 255: valid sample
+    cv::Mat m_closed; ///< closing of m_valid
+    std::shared_ptr<std::uint16_t> m_buffer;
+    std::size_t m_bufferSamples;
+};
@@ -0,0 +1,254 @@
+#include "imu_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+std::uint64_t roundUpPow2(std::size_t n)
+{
+    std::uint64_t p = 2;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+/// q = q * rotation of `gyro` (rad/s) during `dt` seconds, [qx, qy, qz, qw]
+void integrate(double* q, double const* gyro, double dt)
+{
+    const double angle = std::sqrt(gyro[0] * gyro[0] + gyro[1] * gyro[1] + gyro[2] * gyro[2]) * dt;
+    if (angle <= 0) {
+        return;
+    }
+    const double s = std::sin(angle / 2) * dt / angle;
+    const double d[4] = {gyro[0] * s, gyro[1] * s, gyro[2] * s, std::cos(angle / 2)};
+    const double r[4] = {
+        q[3] * d[0] + q[0] * d[3] + q[1] * d[2] - q[2] * d[1],
+        q[3] * d[1] - q[0] * d[2] + q[1] * d[3] + q[2] * d[0],
+        q[3] * d[2] + q[0] * d[1] - q[1] * d[0] + q[2] * d[3],
+        q[3] * d[3] - q[0] * d[0] - q[1] * d[1] - q[2] * d[2],
+    };
+    const double norm = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+    for (int i = 0; i < 4; ++i) {
+        q[i] = r[i] / norm;
+    }
+}
+
+} // namespace
+
+ImuCache::Sample ImuCache::Batch::sample(std::size_t i) const
+{
+    Sample s;
+    s.hostTimestamp = hostTimestamp[i];
+    s.edgeTimestampUs = edgeTimestampUs[i];
+    for (int k = 0; k < 3; ++k) {
+        s.gyro[k] = gyro[k][i];
+        s.accel[k] = accel[k][i];
+    }
+    s.temperature = temperature[i];
+    for (int k = 0; k < 4; ++k) {
+        s.orientation[k] = orientation[k][i];
+    }
+    return s;
+}
+
+ImuCache::ImuCache(Options const& options)
+    : m_options(options), m_count(0), m_previousTime(0)
+{
+    const std::uint64_t capacity = roundUpPow2(std::max<std::size_t>(m_options.capacity, 2));
+    m_options.capacity = static_cast<std::size_t>(capacity);
+    m_mask = capacity - 1;
+    m_sequence.reset(new std::atomic<std::uint64_t>[capacity]);
+    for (int c = 0; c < Columns; ++c) {
+        m_columns[c].reset(new std::atomic<double>[capacity]);
+    }
+    m_edgeTimestampUs.reset(new std::atomic<std::int64_t>[capacity]);
+    for (std::uint64_t i = 0; i < capacity; ++i) {
+        m_sequence[i].store(0, std::memory_order_relaxed);
+        for (int c = 0; c < Columns; ++c) {
+            m_columns[c][i].store(0, std::memory_order_relaxed);
+        }
+        m_edgeTimestampUs[i].store(0, std::memory_order_relaxed);
+    }
+    m_orientation[0] = m_orientation[1] = m_orientation[2] = 0;
+    m_orientation[3] = 1;
+}
+
+void ImuCache::push(Sample const& sample)
+{
+    const std::uint64_t index = m_count.load(std::memory_order_relaxed);
+    const std::uint64_t slot = index & m_mask;
+
+    if (m_options.integrateGyro) {
+        // the device clock when available, the host one has the USB jitter
+        const double time = sample.edgeTimestampUs > 0 ? sample.edgeTimestampUs * 1e-6 : sample.hostTimestamp;
+        const double dt = index > 0 ? time - m_previousTime : 0;
+        if (dt > 0 && dt < 0.1) { // a larger gap is a restart of the stream, not motion
+            integrate(m_orientation, sample.gyro, dt);
+        }
+        m_previousTime = time;
+    }
+
+    m_sequence[slot].store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_columns[Host][slot].store(sample.hostTimestamp, std::memory_order_relaxed);
+    for (int i = 0; i < 3; ++i) {
+        m_columns[GyroX + i][slot].store(sample.gyro[i], std::memory_order_relaxed);
+        m_columns[AccelX + i][slot].store(sample.accel[i], std::memory_order_relaxed);
+    }
+    m_columns[Temperature][slot].store(sample.temperature, std::memory_order_relaxed);
+    for (int i = 0; i < 4; ++i) {
+        m_columns[QX + i][slot].store(m_orientation[i], std::memory_order_relaxed);
+    }
+    m_edgeTimestampUs[slot].store(sample.edgeTimestampUs, std::memory_order_relaxed);
+    m_sequence[slot].store(2 * index + 2, std::memory_order_release);
+    m_count.store(index + 1, std::memory_order_release);
+}
+
+namespace {
+
+/// Relaxed loads of `n` values starting at `src`
+template <class T>
+void load(std::atomic<T> const* src, std::size_t n, T* dst)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = src[i].load(std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+void ImuCache::copy(std::uint64_t first, std::uint64_t last, Batch& batch) const
+{
+    const std::size_t n = static_cast<std::size_t>(last - first);
+    std::vector<double>* columns[Columns] = {
+        &batch.hostTimestamp, &batch.gyro[0], &batch.gyro[1], &batch.gyro[2],
+        &batch.accel[0], &batch.accel[1], &batch.accel[2], &batch.temperature,
+        &batch.orientation[0], &batch.orientation[1], &batch.orientation[2], &batch.orientation[3],
+    };
+    // at most two spans: up to the end of the ring, then from its start
+    const std::size_t begin = static_cast<std::size_t>(first & m_mask);
+    const std::size_t head = std::min(n, m_options.capacity - begin);
+    for (int c = 0; c < Columns; ++c) {
+        std::vector<double>& out = *columns[c];
+        out.resize(n);
+        load(m_columns[c].get() + begin, head, out.data());
+        load(m_columns[c].get(), n - head, out.data() + head);
+    }
+    batch.edgeTimestampUs.resize(n);
+    load(m_edgeTimestampUs.get() + begin, head, batch.edgeTimestampUs.data());
+    load(m_edgeTimestampUs.get(), n - head, batch.edgeTimestampUs.data() + head);
+}
+
+namespace {
+
+/// Oldest index that the writer is not overwriting once it has pushed `count` samples
+std::uint64_t oldestValid(std::uint64_t count, std::uint64_t capacity)
+{
+    return count >= capacity ? count - capacity + 1 : 0;
+}
+
+template <class T>
+void dropFront(std::vector<T>& v, std::size_t n)
+{
+    v.erase(v.begin(), v.begin() + std::min(n, v.size()));
+}
+
+/// Removes the first `n` samples of `batch`
+void dropFront(ImuCache::Batch& batch, std::size_t n)
+{
+    dropFront(batch.hostTimestamp, n);
+    dropFront(batch.edgeTimestampUs, n);
+    for (int k = 0; k < 3; ++k) {
+        dropFront(batch.gyro[k], n);
+        dropFront(batch.accel[k], n);
+    }
+    dropFront(batch.temperature, n);
+    for (int k = 0; k < 4; ++k) {
+        dropFront(batch.orientation[k], n);
+    }
+}
+
+} // namespace
+
+void ImuCache::copyValid(std::uint64_t first, std::uint64_t last, Batch& batch) const
+{
+    // the slots up to `last` were complete when count() was read (acquire)
+    copy(first, last, batch);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the writer overwrites the oldest slots first: the overwritten samples are a prefix
+    std::uint64_t valid = first;
+    while (valid < last && m_sequence[valid & m_mask].load(std::memory_order_relaxed) != 2 * valid + 2) {
+        ++valid;
+    }
+    if (valid > first) {
+        dropFront(batch, static_cast<std::size_t>(valid - first));
+    }
+}
+
+bool ImuCache::latest(Sample& sample) const
+{
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const std::uint64_t n = count();
+        if (n == 0) {
+            return false;
+        }
+        const std::uint64_t slot = (n - 1) & m_mask;
+        const std::uint64_t expected = 2 * (n - 1) + 2;
+        if (m_sequence[slot].load(std::memory_order_acquire) != expected) {
+            continue;
+        }
+        sample.hostTimestamp = m_columns[Host][slot].load(std::memory_order_relaxed);
+        sample.edgeTimestampUs = m_edgeTimestampUs[slot].load(std::memory_order_relaxed);
+        for (int i = 0; i < 3; ++i) {
+            sample.gyro[i] = m_columns[GyroX + i][slot].load(std::memory_order_relaxed);
+            sample.accel[i] = m_columns[AccelX + i][slot].load(std::memory_order_relaxed);
+        }
+        sample.temperature = m_columns[Temperature][slot].load(std::memory_order_relaxed);
+        for (int i = 0; i < 4; ++i) {
+            sample.orientation[i] = m_columns[QX + i][slot].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence[slot].load(std::memory_order_relaxed) == expected) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t ImuCache::range(double t0, double t1, Batch& batch) const
+{
+    const std::uint64_t n = count();
+    const std::uint64_t oldest = oldestValid(n, m_options.capacity);
+    // first index with hostTimestamp >= t0, then first one > t1
+    std::uint64_t lo = oldest, hi = n;
+    while (lo < hi) {
+        const std::uint64_t mid = lo + (hi - lo) / 2;
+        if (timestamp(mid) < t0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const std::uint64_t first = lo;
+    hi = n;
+    while (lo < hi) {
+        const std::uint64_t mid = lo + (hi - lo) / 2;
+        if (timestamp(mid) <= t1) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    copyValid(first, lo, batch);
+    return batch.size();
+}
+
+std::size_t ImuCache::batch(std::size_t n, Batch& batch) const
+{
+    const std::uint64_t count = this->count();
+    const std::uint64_t first = std::max(oldestValid(count, m_options.capacity), count - std::min<std::uint64_t>(count, n));
+    copyValid(first, count, batch);
+    return batch.size();
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Recent IMU samples, queried by time range or count instead of one callback per sample
+ *
+ * Fed by `imuSensor()->registerCallback()` (a single writer thread). The samples are kept in
+ * a ring stored column by column (structure of arrays), so a query copies each field as one
+ * or two contiguous spans. Readers never lock and never block the writer: as in PoseTimeline
+ * each slot is a sequence lock and every field an atomic (relaxed loads and stores, plain
+ * moves on x86 and ARM). The sequences are checked again after the copy, and samples the
+ * writer overwrote meanwhile (the reader was overtaken by a whole ring) are dropped from the
+ * result.
+ *
+ * With `integrateGyro` the writer also integrates the gyroscope into an orientation, relative
+ * to the first sample, returned with every sample.
+ *
+ * @code
+ * static ImuCache s_imu;
+ * device->imuSensor()->registerCallback([](xv::Imu const& imu) { s_imu.push(imu); });
+ * ...
+ * ImuCache::Batch batch; // reuse it: queries do not allocate once it is large enough
+ * s_imu.range(t - 0.05, t, batch);
+ * @endcode
+ */
+class ImuCache
+{
+public:
+    struct Options
+    {
+        Options() : capacity(4096), integrateGyro(false) {}
+        std::size_t capacity; ///< ring size (rounded up to a power of two), 4096 is ~4 s at 1 kHz
+        bool integrateGyro;   ///< also keep the integrated orientation
+    };
+
+    struct Sample
+    {
+        double hostTimestamp;
+        std::int64_t edgeTimestampUs;
+        double gyro[3];        ///< rad/s
+        double accel[3];       ///< m/s2
+        double temperature;
+        double orientation[4]; ///< integrated gyro [qx, qy, qz, qw], identity without integrateGyro
+    };
+
+    /// Samples of a query, oldest first, one vector per field
+    struct Batch
+    {
+        std::size_t size() const { return hostTimestamp.size(); }
+        Sample sample(std::size_t i) const;
+
+        std::vector<double> hostTimestamp;
+        std::vector<std::int64_t> edgeTimestampUs;
+        std::vector<double> gyro[3];
+        std::vector<double> accel[3];
+        std::vector<double> temperature;
+        std::vector<double> orientation[4];
+    };
+
+    explicit ImuCache(Options const& options = Options());
+
+    ImuCache(ImuCache const&) = delete;
+    ImuCache& operator=(ImuCache const&) = delete;
+
+    /// Appends a sample, from one thread only
+    void push(Sample const& sample);
+
+    /// Appends an xv::Imu
+    template <class Imu>
+    void push(Imu const& imu)
+    {
+        Sample s;
+        s.hostTimestamp = imu.hostTimestamp;
+        s.edgeTimestampUs = imu.edgeTimestampUs;
+        for (int i = 0; i < 3; ++i) {
+            s.gyro[i] = imu.gyro[i];
+            s.accel[i] = imu.accel[i];
+        }
+        s.temperature = imu.temperature;
+        push(s);
+    }
+
+    /// Newest sample, false if there is none yet
+    bool latest(Sample& sample) const;
+    /// Samples with `t0 <= hostTimestamp <= t1`, returns their count
+    std::size_t range(double t0, double t1, Batch& batch) const;
+    /// The newest `n` samples (fewer if not available), returns their count
+    std::size_t batch(std::size_t n, Batch& batch) const;
+
+    Options const& options() const { return m_options; }
+    /// Samples pushed so far (the last `capacity - 1` ones can be queried)
+    std::uint64_t count() const { return m_count.load(std::memory_order_acquire); }
+
+private:
+    enum Column { Host, GyroX, GyroY, GyroZ, AccelX, AccelY, AccelZ, Temperature, QX, QY, QZ, QW, Columns };
+
+    void copy(std::uint64_t first, std::uint64_t last, Batch& batch) const;
+    /// Copies [first, last) into `batch` without the samples overwritten meanwhile
+    void copyValid(std::uint64_t first, std::uint64_t last, Batch& batch) const;
+    double timestamp(std::uint64_t index) const { return m_columns[Host][index & m_mask].load(std::memory_order_relaxed); }
+
+    Options m_options;
+    std::uint64_t m_mask;
+    // every field is an atomic so that a reader racing with the writer is not a data race,
+    // the sequence of the slot tells whether what it read is consistent
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_sequence; ///< 2 * index + 2 when sample `index` is complete
+    std::unique_ptr<std::atomic<double>[]> m_columns[Columns];
+    std::unique_ptr<std::atomic<std::int64_t>[]> m_edgeTimestampUs;
+    std::atomic<std::uint64_t> m_count;
+    // writer only
+    double m_orientation[4];
+    double m_previousTime;
+};
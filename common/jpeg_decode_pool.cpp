@@ -0,0 +1,143 @@
+#include "jpeg_decode_pool.h"
+#include "frame_trace.hpp"
+
+#include <algorithm>
+
+JpegDecodePool::JpegDecodePool(Callback callback, Options const& options)
+    : m_options(options), m_callback(std::move(callback)), m_nextSequence(0), m_stop(false),
+      m_nextDelivery(0), m_submitted(0), m_dropped(0), m_failed(0)
+{
+    m_options.workers = std::max(1, m_options.workers);
+    m_options.maxQueued = std::max<std::size_t>(1, m_options.maxQueued);
+    switch (m_options.scale) {
+    case 2: m_imreadFlags = cv::IMREAD_REDUCED_COLOR_2; break;
+    case 4: m_imreadFlags = cv::IMREAD_REDUCED_COLOR_4; break;
+    case 8: m_imreadFlags = cv::IMREAD_REDUCED_COLOR_8; break;
+    default:
+        m_options.scale = 1;
+        m_imreadFlags = cv::IMREAD_COLOR;
+        break;
+    }
+    for (int i = 0; i < m_options.workers; ++i) {
+        m_workers.emplace_back(&JpegDecodePool::run, this);
+    }
+}
+
+JpegDecodePool::~JpegDecodePool()
+{
+    {
+        std::lock_guard<std::mutex> l(m_queueMtx);
+        m_stop = true;
+        m_queue.clear();
+    }
+    m_queueCv.notify_all();
+    for (auto& t : m_workers) {
+        t.join();
+    }
+}
+
+bool JpegDecodePool::submit(std::shared_ptr<const std::uint8_t> const& data, std::size_t size,
+                            std::int64_t edgeTimestampUs, double hostTimestamp)
+{
+    {
+        std::lock_guard<std::mutex> l(m_queueMtx);
+        if (m_queue.size() >= m_options.maxQueued) {
+            m_dropped.fetch_add(1);
+            return false;
+        }
+        Job job;
+        job.sequence = m_nextSequence++;
+        job.data = data;
+        job.size = size;
+        job.edgeTimestampUs = edgeTimestampUs;
+        job.hostTimestamp = hostTimestamp;
+        m_queue.push_back(std::move(job));
+    }
+    m_submitted.fetch_add(1);
+    m_queueCv.notify_one();
+    return true;
+}
+
+void JpegDecodePool::flush()
+{
+    std::uint64_t target;
+    {
+        std::lock_guard<std::mutex> l(m_queueMtx);
+        target = m_nextSequence;
+    }
+    std::unique_lock<std::mutex> l(m_deliverMtx);
+    m_deliveredCv.wait(l, [&]{ return m_nextDelivery >= target; });
+}
+
+void JpegDecodePool::run()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> l(m_queueMtx);
+            m_queueCv.wait(l, [this]{ return m_stop || !m_queue.empty(); });
+            if (m_stop) {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        Frame frame;
+        frame.sequence = job.sequence;
+        frame.edgeTimestampUs = job.edgeTimestampUs;
+        frame.hostTimestamp = job.hostTimestamp;
+        if (job.data && job.size > 0) {
+            frame.image = acquireBuffer();
+            cv::UMatData* before = frame.image.u;
+            try {
+                // the input is the compressed size, never width * height
+                const cv::Mat raw(1, static_cast<int>(job.size), CV_8UC1, const_cast<std::uint8_t*>(job.data.get()));
+                TraceScope trace("decode", "jpeg", static_cast<std::uint64_t>(job.edgeTimestampUs));
+                cv::imdecode(raw, m_imreadFlags, &frame.image);
+            } catch (cv::Exception const&) {
+                frame.image.release();
+            }
+            // a new allocation (first use or size change) joins the pool
+            if (!frame.image.empty() && frame.image.u != before) {
+                std::lock_guard<std::mutex> l(m_bufferMtx);
+                auto it = std::find_if(m_buffers.begin(), m_buffers.end(), [&](cv::Mat const& m) { return m.u == before; });
+                if (before && it != m_buffers.end()) {
+                    *it = frame.image;
+                } else if (m_buffers.size() < m_options.maxBuffers) {
+                    m_buffers.push_back(frame.image);
+                }
+            }
+        }
+        if (frame.image.empty()) {
+            m_failed.fetch_add(1);
+        }
+        job.data.reset();
+        deliver(std::move(frame));
+    }
+}
+
+cv::Mat JpegDecodePool::acquireBuffer()
+{
+    std::lock_guard<std::mutex> l(m_bufferMtx);
+    for (cv::Mat const& m : m_buffers) {
+        // only referenced by the pool: nobody is decoding into it or still using the image
+        if (m.u && m.u->refcount == 1) {
+            return m;
+        }
+    }
+    return cv::Mat();
+}
+
+void JpegDecodePool::deliver(Frame&& frame)
+{
+    std::lock_guard<std::mutex> l(m_deliverMtx);
+    const std::uint64_t sequence = frame.sequence;
+    m_ready.insert(std::make_pair(sequence, std::move(frame)));
+    while (!m_ready.empty() && m_ready.begin()->first == m_nextDelivery) {
+        m_callback(m_ready.begin()->second);
+        m_ready.erase(m_ready.begin());
+        ++m_nextDelivery;
+    }
+    m_deliveredCv.notify_all();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Decodes JPEG frames (ColorImage::Codec::JPEG) on worker threads, delivered in order
+ *
+ * submit() only queues the compressed buffer (a shared_ptr, nothing is copied), so the SDK
+ * callback returns immediately. Frames are decoded in parallel and handed to the callback
+ * one at a time, in submission order, from the worker that completes the sequence.
+ *
+ * With `scale` 2, 4 or 8 libjpeg decodes the DCT at reduced resolution
+ * (IMREAD_REDUCED_COLOR_*), much cheaper than decoding the full frame and resizing it.
+ *
+ * Decoded images come from a pool of buffers: a buffer is reused once every copy of the
+ * cv::Mat given to the callback has been released, so keeping the latest frame (e.g. in a
+ * FrameMailbox<cv::Mat>) does not allocate per frame.
+ */
+class JpegDecodePool
+{
+public:
+    struct Options
+    {
+        Options() : workers(2), scale(1), maxQueued(4), maxBuffers(16) {}
+        int workers;           ///< decoding threads
+        int scale;             ///< 1, 2, 4 or 8: output size is 1/scale of the frame
+        std::size_t maxQueued; ///< frames waiting for a worker, new frames are dropped beyond
+        std::size_t maxBuffers; ///< pooled output buffers
+    };
+
+    struct Frame
+    {
+        std::uint64_t sequence; ///< submission index (dropped frames have none)
+        std::int64_t edgeTimestampUs;
+        double hostTimestamp;
+        cv::Mat image; ///< BGR, empty if the data could not be decoded
+    };
+
+    typedef std::function<void(Frame const&)> Callback;
+
+    explicit JpegDecodePool(Callback callback, Options const& options = Options());
+    /// Stops the workers, frames still queued are discarded
+    ~JpegDecodePool();
+
+    JpegDecodePool(JpegDecodePool const&) = delete;
+    JpegDecodePool& operator=(JpegDecodePool const&) = delete;
+
+    /**
+     * @brief Queues `size` bytes of compressed data (kept alive until decoded)
+     * @return false if the frame was dropped because maxQueued frames are waiting
+     */
+    bool submit(std::shared_ptr<const std::uint8_t> const& data, std::size_t size,
+                std::int64_t edgeTimestampUs, double hostTimestamp);
+
+    /// Queues an xv::ColorImage with Codec::JPEG, using its dataSize
+    template <class Image>
+    bool submit(Image const& image)
+    {
+        return submit(image.data, image.dataSize, image.edgeTimestampUs, image.hostTimestamp);
+    }
+
+    /// Waits until every submitted frame was delivered
+    void flush();
+
+    Options const& options() const { return m_options; }
+    std::uint64_t submitted() const { return m_submitted.load(); }
+    std::uint64_t dropped() const { return m_dropped.load(); }
+    std::uint64_t failed() const { return m_failed.load(); }
+
+private:
+    struct Job
+    {
+        std::uint64_t sequence;
+        std::shared_ptr<const std::uint8_t> data;
+        std::size_t size;
+        std::int64_t edgeTimestampUs;
+        double hostTimestamp;
+    };
+
+    void run();
+    cv::Mat acquireBuffer();
+    void deliver(Frame&& frame);
+
+    Options m_options;
+    Callback m_callback;
+    int m_imreadFlags;
+
+    std::mutex m_queueMtx;
+    std::condition_variable m_queueCv;
+    std::deque<Job> m_queue;
+    std::uint64_t m_nextSequence;
+    bool m_stop;
+
+    std::mutex m_bufferMtx;
+    std::vector<cv::Mat> m_buffers;
+
+    // frames decoded ahead of the next one to deliver
+    std::mutex m_deliverMtx;
+    std::condition_variable m_deliveredCv;
+    std::map<std::uint64_t, Frame> m_ready;
+    std::uint64_t m_nextDelivery;
+
+    std::atomic<std::uint64_t> m_submitted;
+    std::atomic<std::uint64_t> m_dropped;
+    std::atomic<std::uint64_t> m_failed;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "frame_mailbox.hpp"
+#include "frame_trace.hpp"
+#include "point_cloud_writer.h"
+
+/**
+ * @brief Writes one point cloud file per frame on a background thread
+ *
+ * push() is meant to be called from the SDK callback: it only moves the frame (which
+ * shares its data buffer) into a bounded FrameRing and returns. Conversion to points and
+ * file I/O run on the writer thread; if it falls behind, frames are dropped and counted
+ * rather than stalling the callback.
+ *
+ * @code
+ * PointCloudRecorder<xv::DepthImage> recorder("tof_%06llu.ply", PointCloudFormat::PlyBinary,
+ *     [&](xv::DepthImage const& tof, PointCloudWriter& w){ w.append(device->tofCamera()->depthImageToPointCloud(tof)->points); });
+ * device->tofCamera()->registerCallback([&](xv::DepthImage const& tof){ recorder.push(tof); });
+ * @endcode
+ */
+template <class Frame>
+class PointCloudRecorder
+{
+public:
+    using Extract = std::function<void(Frame const&, PointCloudWriter&)>;
+
+    /**
+     * @param filePattern: printf pattern taking the frame index as unsigned long long, e.g. "tof_%06llu.pcd"
+     * @param extract: appends the points of a frame to the writer, called on the writer thread
+     * @param queueSize: frames waiting to be written before new ones are dropped
+     */
+    PointCloudRecorder(std::string const& filePattern, PointCloudFormat format, Extract extract, std::size_t queueSize = 8)
+        : m_pattern(filePattern), m_format(format), m_extract(extract), m_queue(queueSize, &m_signal),
+          m_stop(false), m_written(0), m_failed(0)
+    {
+        m_thread = std::thread(&PointCloudRecorder::run, this);
+    }
+
+    /// Writes the frames still queued, then stops the writer thread
+    ~PointCloudRecorder()
+    {
+        m_stop = true;
+        m_signal.notify();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    PointCloudRecorder(PointCloudRecorder const&) = delete;
+    PointCloudRecorder& operator=(PointCloudRecorder const&) = delete;
+
+    /// Producer side, never blocks. Returns false if the frame was dropped.
+    bool push(Frame const& frame) { return m_queue.push(frame); }
+
+    std::uint64_t written() const { return m_written.load(); }
+    std::uint64_t failed() const { return m_failed.load(); }
+    std::uint64_t dropped() const { return m_queue.dropped(); }
+
+private:
+    void run()
+    {
+        FrameTrace::nameThread("point cloud writer");
+        PointCloudWriter writer;
+        Frame frame;
+        std::uint64_t generation = 0;
+        unsigned long long index = 0;
+        while (true) {
+            const bool stopping = m_stop.load();
+            while (m_queue.pop(frame)) {
+                TraceScope trace("write", "point cloud", static_cast<std::uint64_t>(frame.edgeTimestampUs));
+                char filename[512];
+                std::snprintf(filename, sizeof(filename), m_pattern.c_str(), index++);
+                bool ok = writer.open(filename, m_format);
+                if (ok) {
+                    m_extract(frame, writer);
+                    ok = writer.close();
+                }
+                if (ok) {
+                    ++m_written;
+                } else {
+                    ++m_failed;
+                }
+                frame = Frame();
+            }
+            if (stopping) {
+                break;
+            }
+            m_signal.waitFor(generation, std::chrono::milliseconds(100));
+        }
+    }
+
+    std::string m_pattern;
+    PointCloudFormat m_format;
+    Extract m_extract;
+    FrameSignal m_signal;
+    FrameRing<Frame> m_queue;
+    std::atomic<bool> m_stop;
+    std::atomic<std::uint64_t> m_written;
+    std::atomic<std::uint64_t> m_failed;
+    std::thread m_thread;
+};
@@ -0,0 +1,309 @@
+#include "point_cloud_writer.h"
+
+#include <algorithm>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "PointCloudWriter writes the host float representation and only supports little endian hosts"
+#endif
+
+namespace {
+
+const std::size_t kBufferSize = 1 << 18;
+// room for the point count, patched in close()
+const int kCountWidth = 12;
+
+// --- LZF (same stream format as liblzf, which PCL uses for binary_compressed) ---
+
+const unsigned int kLzfHashLog = 14;
+const std::size_t kLzfMaxLiteral = 1 << 5;
+const std::size_t kLzfMaxOffset = 1 << 13;
+const std::size_t kLzfMaxRef = (1 << 8) + (1 << 3);
+
+inline unsigned int lzfHash(std::uint8_t const* p)
+{
+    std::uint32_t v = (std::uint32_t(p[0]) << 16) | (std::uint32_t(p[1]) << 8) | p[2];
+    return (v * 2654435761u) >> (32 - kLzfHashLog);
+}
+
+} // namespace
+
+std::size_t lzfCompress(void const* in, std::size_t inSize, void* out, std::size_t outSize)
+{
+    if (inSize == 0) {
+        return 0;
+    }
+    auto ip = static_cast<std::uint8_t const*>(in);
+    auto const inEnd = ip + inSize;
+    auto op = static_cast<std::uint8_t*>(out);
+    auto const outBegin = op;
+    auto const outEnd = op + outSize;
+
+    std::vector<std::uint8_t const*> table(std::size_t(1) << kLzfHashLog, nullptr);
+
+    // position of the control byte of the literal run being built
+    std::uint8_t* literalCtrl = op++;
+    std::size_t literal = 0;
+    if (op > outEnd) {
+        return 0;
+    }
+
+    while (ip + 2 < inEnd) {
+        const unsigned int h = lzfHash(ip);
+        std::uint8_t const* ref = table[h];
+        table[h] = ip;
+        std::size_t off;
+        if (ref && (off = static_cast<std::size_t>(ip - ref - 1)) < kLzfMaxOffset
+            && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+            std::size_t maxLen = static_cast<std::size_t>(inEnd - ip);
+            if (maxLen > kLzfMaxRef) {
+                maxLen = kLzfMaxRef;
+            }
+            std::size_t len = 3;
+            while (len < maxLen && ref[len] == ip[len]) {
+                ++len;
+            }
+            // close the pending literal run
+            if (literal == 0) {
+                --op; // no literal, drop the reserved control byte
+            } else {
+                *literalCtrl = static_cast<std::uint8_t>(literal - 1);
+            }
+            if (op + 3 + 1 > outEnd) {
+                return 0;
+            }
+            len -= 2;
+            if (len < 7) {
+                *op++ = static_cast<std::uint8_t>((off >> 8) + (len << 5));
+            } else {
+                *op++ = static_cast<std::uint8_t>((off >> 8) + (7 << 5));
+                *op++ = static_cast<std::uint8_t>(len - 7);
+            }
+            *op++ = static_cast<std::uint8_t>(off);
+            ip += len + 2;
+            literalCtrl = op++;
+            literal = 0;
+            // keep the table useful inside the match
+            if (ip + 2 < inEnd) {
+                table[lzfHash(ip - 1)] = ip - 1;
+            }
+            continue;
+        }
+        if (op >= outEnd) {
+            return 0;
+        }
+        *op++ = *ip++;
+        if (++literal == kLzfMaxLiteral) {
+            *literalCtrl = static_cast<std::uint8_t>(literal - 1);
+            literalCtrl = op++;
+            literal = 0;
+        }
+    }
+    while (ip < inEnd) {
+        if (op >= outEnd) {
+            return 0;
+        }
+        *op++ = *ip++;
+        if (++literal == kLzfMaxLiteral) {
+            *literalCtrl = static_cast<std::uint8_t>(literal - 1);
+            literalCtrl = op++;
+            literal = 0;
+        }
+    }
+    if (literal == 0) {
+        --op;
+    } else {
+        *literalCtrl = static_cast<std::uint8_t>(literal - 1);
+    }
+    if (op > outEnd) {
+        return 0;
+    }
+    return static_cast<std::size_t>(op - outBegin);
+}
+
+std::size_t lzfDecompress(void const* in, std::size_t inSize, void* out, std::size_t outSize)
+{
+    auto ip = static_cast<std::uint8_t const*>(in);
+    auto const inEnd = ip + inSize;
+    auto op = static_cast<std::uint8_t*>(out);
+    auto const outBegin = op;
+    auto const outEnd = op + outSize;
+
+    while (ip < inEnd) {
+        std::size_t ctrl = *ip++;
+        if (ctrl < kLzfMaxLiteral) {
+            ++ctrl;
+            if (op + ctrl > outEnd || ip + ctrl > inEnd) {
+                return 0;
+            }
+            std::memcpy(op, ip, ctrl);
+            op += ctrl;
+            ip += ctrl;
+        } else {
+            std::size_t len = ctrl >> 5;
+            if (len == 7) {
+                if (ip >= inEnd) {
+                    return 0;
+                }
+                len += *ip++;
+            }
+            if (ip >= inEnd) {
+                return 0;
+            }
+            const std::size_t off = ((ctrl & 0x1f) << 8) + *ip++ + 1;
+            len += 2;
+            if (op + len > outEnd || off > static_cast<std::size_t>(op - outBegin)) {
+                return 0;
+            }
+            std::uint8_t const* ref = op - off;
+            // overlapping copy, byte by byte
+            for (std::size_t i = 0; i < len; ++i) {
+                op[i] = ref[i];
+            }
+            op += len;
+        }
+    }
+    return static_cast<std::size_t>(op - outBegin);
+}
+
+PointCloudWriter::PointCloudWriter()
+    : m_file(nullptr), m_format(PointCloudFormat::PlyBinary), m_count(0), m_countOffsetsSize(0),
+      m_error(false), m_buffer(kBufferSize), m_used(0)
+{
+}
+
+PointCloudWriter::~PointCloudWriter()
+{
+    if (m_file) {
+        close();
+    }
+}
+
+bool PointCloudWriter::open(std::string const& filename, PointCloudFormat format)
+{
+    if (m_file) {
+        close();
+    }
+    m_file = std::fopen(filename.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+    m_format = format;
+    m_count = 0;
+    m_countOffsetsSize = 0;
+    m_error = false;
+    m_used = 0;
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+
+    auto countField = [this](char const* prefix) {
+        std::fputs(prefix, m_file);
+        m_countOffsets[m_countOffsetsSize++] = std::ftell(m_file);
+        std::fprintf(m_file, "%-*d\n", kCountWidth, 0);
+    };
+
+    if (format == PointCloudFormat::PlyBinary) {
+        std::fputs("ply\nformat binary_little_endian 1.0\n", m_file);
+        countField("element vertex ");
+        std::fputs("property float x\nproperty float y\nproperty float z\nend_header\n", m_file);
+    } else {
+        std::fputs("# .PCD v0.7 - Point Cloud Data file format\n"
+                   "VERSION 0.7\n"
+                   "FIELDS x y z\n"
+                   "SIZE 4 4 4\n"
+                   "TYPE F F F\n"
+                   "COUNT 1 1 1\n", m_file);
+        countField("WIDTH ");
+        std::fputs("HEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\n", m_file);
+        countField("POINTS ");
+        std::fputs(format == PointCloudFormat::PcdBinary ? "DATA binary\n" : "DATA binary_compressed\n", m_file);
+    }
+    return !std::ferror(m_file);
+}
+
+void PointCloudWriter::append(float const* xyz, std::size_t count)
+{
+    if (m_format == PointCloudFormat::PcdBinaryCompressed) {
+        for (std::size_t i = 0; i < count; ++i) {
+            append(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+        }
+        return;
+    }
+    std::size_t bytes = count * 3 * sizeof(float);
+    auto src = reinterpret_cast<char const*>(xyz);
+    while (bytes > 0) {
+        if (m_used == m_buffer.size()) {
+            flush();
+        }
+        std::size_t n = std::min(bytes, m_buffer.size() - m_used);
+        std::memcpy(&m_buffer[m_used], src, n);
+        m_used += n;
+        src += n;
+        bytes -= n;
+    }
+    m_count += count;
+}
+
+void PointCloudWriter::append(std::vector<std::array<float, 3>> const& points)
+{
+    static_assert(sizeof(std::array<float, 3>) == 3 * sizeof(float), "unexpected std::array padding");
+    if (!points.empty()) {
+        append(points.front().data(), points.size());
+    }
+}
+
+void PointCloudWriter::flush()
+{
+    if (m_used > 0 && m_file) {
+        if (std::fwrite(m_buffer.data(), 1, m_used, m_file) != m_used) {
+            m_error = true;
+        }
+    }
+    m_used = 0;
+}
+
+bool PointCloudWriter::close()
+{
+    if (!m_file) {
+        return false;
+    }
+    if (m_format == PointCloudFormat::PcdBinaryCompressed) {
+        // x...x y...y z...z, compressed as one block
+        const std::size_t fieldBytes = m_count * sizeof(float);
+        std::vector<char> soa(3 * fieldBytes);
+        if (m_count > 0) {
+            std::memcpy(&soa[0], m_x.data(), fieldBytes);
+            std::memcpy(&soa[fieldBytes], m_y.data(), fieldBytes);
+            std::memcpy(&soa[2 * fieldBytes], m_z.data(), fieldBytes);
+        }
+        std::vector<char> compressed(soa.size() + soa.size() / 16 + 64);
+        std::uint32_t sizes[2];
+        sizes[0] = static_cast<std::uint32_t>(lzfCompress(soa.data(), soa.size(), compressed.data(), compressed.size()));
+        sizes[1] = static_cast<std::uint32_t>(soa.size());
+        if (sizes[0] == 0 && !soa.empty()) {
+            m_error = true;
+        }
+        std::fwrite(sizes, sizeof(sizes), 1, m_file);
+        if (std::fwrite(compressed.data(), 1, sizes[0], m_file) != sizes[0]) {
+            m_error = true;
+        }
+        m_x = std::vector<float>();
+        m_y = std::vector<float>();
+        m_z = std::vector<float>();
+    } else {
+        flush();
+    }
+
+    for (int i = 0; i < m_countOffsetsSize; ++i) {
+        std::fseek(m_file, m_countOffsets[i], SEEK_SET);
+        std::fprintf(m_file, "%-*llu", kCountWidth, static_cast<unsigned long long>(m_count));
+    }
+    if (std::ferror(m_file)) {
+        m_error = true;
+    }
+    if (std::fclose(m_file) != 0) {
+        m_error = true;
+    }
+    m_file = nullptr;
+    return !m_error;
+}
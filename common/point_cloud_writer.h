@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class PointCloudFormat
+{
+    PlyBinary,          ///< PLY, binary_little_endian, float x y z
+    PcdBinary,          ///< PCD v0.7, DATA binary
+    PcdBinaryCompressed ///< PCD v0.7, DATA binary_compressed (LZF, as written by PCL)
+};
+
+/**
+ * @brief Single pass binary PLY / PCD writer
+ *
+ * Points are appended as they are produced, the point count in the header is written as
+ * a fixed width placeholder and patched in close(), so the data never has to be scanned
+ * twice. Writes go through an internal buffer, there is no per-point stream formatting.
+ * PcdBinaryCompressed needs the whole cloud to compress the fields, points are kept in
+ * memory until close() in that case.
+ */
+class PointCloudWriter
+{
+public:
+    PointCloudWriter();
+    ~PointCloudWriter();
+
+    PointCloudWriter(PointCloudWriter const&) = delete;
+    PointCloudWriter& operator=(PointCloudWriter const&) = delete;
+
+    /// Opens `filename` and writes the header. Returns false if the file can't be created.
+    bool open(std::string const& filename, PointCloudFormat format);
+    bool isOpen() const { return m_file != nullptr; }
+
+    void append(float x, float y, float z)
+    {
+        if (m_format == PointCloudFormat::PcdBinaryCompressed) {
+            m_x.push_back(x);
+            m_y.push_back(y);
+            m_z.push_back(z);
+        } else {
+            if (m_used + 3 * sizeof(float) > m_buffer.size()) {
+                flush();
+            }
+            float p[3] = {x, y, z};
+            std::memcpy(&m_buffer[m_used], p, sizeof(p));
+            m_used += sizeof(p);
+        }
+        ++m_count;
+    }
+
+    /// Appends `count` xyz triplets
+    void append(float const* xyz, std::size_t count);
+    void append(std::vector<std::array<float, 3>> const& points);
+
+    /// Patches the header with the final point count and closes the file. Returns false on I/O error.
+    bool close();
+
+    /// Number of points appended since open()
+    std::size_t count() const { return m_count; }
+
+private:
+    void flush();
+
+    std::FILE* m_file;
+    PointCloudFormat m_format;
+    std::size_t m_count;
+    long m_countOffsets[2];
+    int m_countOffsetsSize;
+    bool m_error;
+    std::vector<char> m_buffer;
+    std::size_t m_used;
+    // PcdBinaryCompressed: fields are stored one after the other
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_z;
+};
+
+/**
+ * @brief LZF compression as used by PCD binary_compressed (liblzf compatible stream)
+ * @return compressed size, or 0 if the output does not fit in `outSize`
+ */
+std::size_t lzfCompress(void const* in, std::size_t inSize, void* out, std::size_t outSize);
+
+/// @return decompressed size, or 0 on corrupted input / too small output
+std::size_t lzfDecompress(void const* in, std::size_t inSize, void* out, std::size_t outSize);
@@ -0,0 +1,66 @@
+#include "pooled_mat_allocator.h"
+
+// same as the StdMatAllocator of OpenCV, with the pool instead of fastMalloc / fastFree
+cv::UMatData* PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                           AccessFlag, cv::UMatUsageFlags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+    // key: the last dimension as width, the others as height
+    const int width = dims > 0 ? sizes[dims - 1] : 1;
+    int height = 1;
+    for (int i = 0; i + 1 < dims; ++i) {
+        height *= sizes[i];
+    }
+
+    uchar* data = data0 ? static_cast<uchar*>(data0) : static_cast<uchar*>(m_pool.acquire(width, height, type, total));
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool PooledMatAllocator::allocate(cv::UMatData* u, AccessFlag, cv::UMatUsageFlags) const
+{
+    return u != nullptr;
+}
+
+void PooledMatAllocator::deallocate(cv::UMatData* u) const
+{
+    if (!u) {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        m_pool.release(u->origdata);
+        u->origdata = 0;
+    }
+    delete u;
+}
+
+PooledMatAllocator* PooledMatAllocator::global()
+{
+    static PooledMatAllocator* allocator = new PooledMatAllocator();
+    return allocator;
+}
+
+cv::Mat pooledMat(int rows, int cols, int type)
+{
+    cv::Mat m;
+    m.allocator = PooledMatAllocator::global();
+    m.create(rows, cols, type);
+    return m;
+}
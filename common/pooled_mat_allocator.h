@@ -0,0 +1,46 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.h"
+
+/**
+ * @brief cv::MatAllocator taking the pixels of the Mats from a FramePool
+ *
+ * A Mat created with this allocator holds a pool buffer; the buffer goes back to the pool
+ * when the last Mat sharing it is released, wherever that happens (display thread,
+ * FrameMailbox, another converter). OpenCV functions writing into such a Mat (cvtColor,
+ * imdecode, applyColorMap ...) reuse it when the size matches, or reallocate it from the
+ * pool otherwise.
+ *
+ * @code
+ * cv::Mat out = pooledMat(height, width, CV_8UC3);
+ * @endcode
+ */
+class PooledMatAllocator : public cv::MatAllocator
+{
+public:
+#if CV_VERSION_MAJOR >= 4
+    typedef cv::AccessFlag AccessFlag;
+#else
+    typedef int AccessFlag;
+#endif
+
+    explicit PooledMatAllocator(FramePool& pool = FramePool::global()) : m_pool(pool) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    FramePool& pool() const { return m_pool; }
+
+    /// Allocator of FramePool::global(), never destroyed so Mats may be released during exit
+    static PooledMatAllocator* global();
+
+private:
+    FramePool& m_pool;
+};
+
+/// Uninitialized `rows` x `cols` Mat of PooledMatAllocator::global()
+cv::Mat pooledMat(int rows, int cols, int type);
@@ -0,0 +1,150 @@
+#include "pose_logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+PoseLogger::PoseLogger()
+    : m_open(false), m_ringRecords(0), m_accepting(false), m_logging(false), m_count(0), m_written(0), m_dropped(0), m_stop(false)
+{
+}
+
+PoseLogger::~PoseLogger()
+{
+    close();
+}
+
+std::string PoseLogger::error() const
+{
+    std::lock_guard<std::mutex> l(m_errorMtx);
+    return m_error;
+}
+
+void PoseLogger::setError(std::string const& e)
+{
+    std::lock_guard<std::mutex> l(m_errorMtx);
+    if (m_error.empty()) {
+        m_error = e;
+    }
+}
+
+bool PoseLogger::open(std::string const& filename, std::string const& description, Options const& options)
+{
+    if (m_open) {
+        close();
+    }
+    m_options = options;
+    m_options.blockRecords = std::max<std::size_t>(1, m_options.blockRecords);
+    m_options.flushIntervalMs = std::max(1, m_options.flushIntervalMs);
+    {
+        std::lock_guard<std::mutex> l(m_errorMtx);
+        m_error.clear();
+    }
+    m_filename = filename;
+    // the writer thread is not the SLAM callback, it may wait for the disk
+    XvRecWriter::Options writerOptions;
+    writerOptions.waitWhenBehind = true;
+    if (!m_writer.open(filename, description, writerOptions)) {
+        setError(m_writer.error());
+        return false;
+    }
+    m_open = true;
+
+    // touch the blocks now, not in the first callbacks
+    m_ringRecords = 2 * m_options.blockRecords;
+    m_ring.reset(new PoseLogRecord[m_ringRecords]());
+    m_count = 0;
+    m_written = 0;
+    m_dropped = 0;
+    m_stop = false;
+    m_accepting = true;
+    m_thread = std::thread(&PoseLogger::run, this);
+    return true;
+}
+
+bool PoseLogger::log(PoseLogRecord const& record)
+{
+    // seq_cst with m_accepting: either close() sees m_logging, or this call sees the logger closed
+    m_logging.store(true);
+    const std::uint64_t index = m_count.load(std::memory_order_relaxed);
+    if (!m_accepting.load()
+        || index - m_written.load(std::memory_order_acquire) >= m_ringRecords) {
+        m_logging.store(false, std::memory_order_release);
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::memcpy(&m_ring[index % m_ringRecords], &record, sizeof(record));
+    m_count.store(index + 1, std::memory_order_release);
+    m_logging.store(false, std::memory_order_release);
+    return true;
+}
+
+bool PoseLogger::appendPending()
+{
+    const std::uint64_t count = m_count.load(std::memory_order_acquire);
+    std::uint64_t written = m_written.load(std::memory_order_relaxed);
+    while (written < count) {
+        PoseLogRecord const& r = m_ring[static_cast<std::size_t>(written % m_ringRecords)];
+        const XvRecWriter::Part parts[2] = {{&r.pose, sizeof(r.pose)}, {&r.cpuUsage, sizeof(r.cpuUsage)}};
+        if (!m_writer.append(XvRecTrack::Pose, r.edgeTimestampUs, r.hostTimestamp, parts, 2)) {
+            setError(m_writer.error().empty() ? "pose dropped by the xvrec writer" : m_writer.error());
+            return false;
+        }
+        // the slot can be reused by log()
+        m_written.store(++written, std::memory_order_release);
+    }
+    return true;
+}
+
+void PoseLogger::run()
+{
+    std::unique_lock<std::mutex> l(m_stopMtx);
+    while (true) {
+        const bool stopping = m_stopCv.wait_for(l, std::chrono::milliseconds(m_options.flushIntervalMs), [this] { return m_stop; });
+        l.unlock();
+        const bool ok = appendPending();
+        l.lock();
+        if (stopping || !ok) {
+            // after a write error log() drops everything once the blocks are full
+            return;
+        }
+    }
+}
+
+bool PoseLogger::close()
+{
+    if (!m_open) {
+        return false;
+    }
+    m_accepting = false;
+    // a record being copied is published before the last write
+    while (m_logging.load()) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> l(m_stopMtx);
+        m_stop = true;
+    }
+    m_stopCv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    bool ok = error().empty();
+    if (!m_writer.close() && ok) {
+        setError(m_writer.error());
+        ok = false;
+    }
+    m_open = false;
+    return ok;
+}
+
+std::string PoseLogger::summary() const
+{
+    std::ostringstream s;
+    s << written() << " poses saved to " << m_filename;
+    if (dropped() > 0) {
+        s << " (" << dropped() << " dropped)";
+    }
+    return s.str();
+}
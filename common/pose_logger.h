@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "xvrec.h"
+
+struct PoseLogRecord
+{
+    double hostTimestamp;
+    std::int64_t edgeTimestampUs;
+    XvRecPosePayload pose;
+    float cpuUsage; // CPU usage of the process when the pose was logged, % of one core, NaN if unknown
+};
+
+/**
+ * @brief Appends poses to the Pose track of an xvrec file from the SLAM callback without touching the disk
+ *
+ * log() copies the record into one of two preallocated blocks and publishes it with an
+ * atomic store: no lock, no allocation, no syscall. A writer thread moves the published
+ * records to an XvRecWriter every `flushIntervalMs` (the pose payload followed by the CPU
+ * usage), while log() keeps filling the other block. The file is read back by `slam_log`
+ * and played by `replay`; a file cut by a crash loses about the last second of poses (the
+ * open chunk). If the writer falls two blocks behind records are dropped and counted
+ * instead of blocking SLAM.
+ *
+ * log() must be called from one thread at a time (the SDK pose callback).
+ *
+ * @code
+ * static PoseLogger s_poseLog;
+ * s_poseLog.open("slam_data.xvrec");
+ * device->slam()->registerCallback([](xv::Pose const& pose) { s_poseLog.log(pose); });
+ * @endcode
+ */
+class PoseLogger
+{
+public:
+    struct Options
+    {
+        Options() : blockRecords(4096), flushIntervalMs(100) {}
+        std::size_t blockRecords; ///< records per block, 4096 is ~4 s at 1 kHz (544 KB)
+        int flushIntervalMs;      ///< period of the moves to the xvrec writer
+    };
+
+    PoseLogger();
+    ~PoseLogger();
+
+    PoseLogger(PoseLogger const&) = delete;
+    PoseLogger& operator=(PoseLogger const&) = delete;
+
+    /// Creates `filename` and starts the writer thread. Returns false on error, see error().
+    bool open(std::string const& filename, std::string const& description = "", Options const& options = Options());
+
+    /// Appends a record, false if it was dropped (writer behind or logger closed)
+    bool log(PoseLogRecord const& record);
+
+    /// Appends an xv::Pose, with the CPU usage of the process if known (ResourceProfiler::cpuPercent)
+    template <class Pose>
+    bool log(Pose const& pose, float cpuUsage = std::numeric_limits<float>::quiet_NaN())
+    {
+        PoseLogRecord r;
+        r.hostTimestamp = pose.hostTimestamp();
+        r.edgeTimestampUs = pose.edgeTimestampUs();
+        for (int i = 0; i < 3; ++i) {
+            r.pose.translation[i] = pose.translation()[i];
+        }
+        for (int i = 0; i < 9; ++i) {
+            r.pose.rotation[i] = pose.rotation()[i];
+        }
+        r.pose.confidence = pose.confidence();
+        r.cpuUsage = cpuUsage;
+        return log(r);
+    }
+
+    /// Writes the pending records and closes the file. Waits for a log() in progress.
+    bool close();
+
+    bool isOpen() const { return m_open; }
+    std::string error() const;
+
+    std::uint64_t records() const { return m_count.load(); }
+    std::uint64_t dropped() const { return m_dropped.load(); }
+    std::uint64_t written() const { return m_written.load(); }
+
+    /// "<n> poses saved to <file>", with the dropped ones if any, to print after close()
+    std::string summary() const;
+
+private:
+    void run();
+    bool appendPending();
+    void setError(std::string const& e);
+
+    XvRecWriter m_writer;
+    bool m_open;
+    std::string m_filename;
+    Options m_options;
+    std::size_t m_ringRecords; // two blocks
+    std::unique_ptr<PoseLogRecord[]> m_ring;
+    std::atomic<bool> m_accepting;
+    std::atomic<bool> m_logging; // log() in progress, close() waits for it
+    std::atomic<std::uint64_t> m_count;   // records published by log()
+    std::atomic<std::uint64_t> m_written; // records moved to m_writer by the writer thread
+    std::atomic<std::uint64_t> m_dropped;
+
+    std::mutex m_stopMtx;
+    std::condition_variable m_stopCv;
+    bool m_stop;
+    std::thread m_thread;
+
+    mutable std::mutex m_errorMtx;
+    std::string m_error;
+};
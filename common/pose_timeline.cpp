@@ -0,0 +1,181 @@
+#include "pose_timeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+std::uint64_t roundUpPow2(std::size_t n)
+{
+    std::uint64_t p = 2;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+/// Pose at `u` between `a` (0) and `b` (1), `u` > 1 extrapolates at the velocity from a to b
+void interpolate(PoseTimeline::Sample const& a, PoseTimeline::Sample const& b, double u, PoseTimeline::Sample& out)
+{
+    out.hostTimestamp = a.hostTimestamp + (b.hostTimestamp - a.hostTimestamp) * u;
+    out.edgeTimestampUs = a.edgeTimestampUs + static_cast<std::int64_t>(std::llround((b.edgeTimestampUs - a.edgeTimestampUs) * u));
+    for (int i = 0; i < 3; ++i) {
+        out.position[i] = a.position[i] + (b.position[i] - a.position[i]) * u;
+    }
+    out.confidence = u <= 1 ? a.confidence + (b.confidence - a.confidence) * u : b.confidence;
+
+    // SLERP along the shortest arc, the same formula extrapolates the rotation for u > 1
+    double bq[4];
+    double dot = 0;
+    for (int i = 0; i < 4; ++i) {
+        dot += a.quaternion[i] * b.quaternion[i];
+    }
+    const double sign = dot < 0 ? -1 : 1;
+    for (int i = 0; i < 4; ++i) {
+        bq[i] = sign * b.quaternion[i];
+    }
+    dot = std::min(1.0, dot * sign);
+    double wa = 1 - u, wb = u;
+    if (dot < 0.9995) {
+        const double theta = std::acos(dot);
+        const double s = std::sin(theta);
+        wa = std::sin((1 - u) * theta) / s;
+        wb = std::sin(u * theta) / s;
+    }
+    double norm = 0;
+    for (int i = 0; i < 4; ++i) {
+        out.quaternion[i] = wa * a.quaternion[i] + wb * bq[i];
+        norm += out.quaternion[i] * out.quaternion[i];
+    }
+    norm = std::sqrt(norm);
+    for (int i = 0; i < 4; ++i) {
+        out.quaternion[i] /= norm;
+    }
+}
+
+} // namespace
+
+PoseTimeline::PoseTimeline(Options const& options)
+    : m_options(options), m_count(0), m_rejected(0), m_newest(0)
+{
+    const std::uint64_t capacity = roundUpPow2(m_options.capacity);
+    m_options.capacity = static_cast<std::size_t>(capacity);
+    m_mask = capacity - 1;
+    m_slots.reset(new Slot[capacity]);
+    for (std::uint64_t i = 0; i < capacity; ++i) {
+        m_slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool PoseTimeline::push(Sample const& sample)
+{
+    const std::uint64_t index = m_count.load(std::memory_order_relaxed);
+    if (index > 0 && !(sample.hostTimestamp > m_newest)) {
+        m_rejected.fetch_add(1);
+        return false;
+    }
+    m_newest = sample.hostTimestamp;
+
+    Slot& slot = m_slots[index & m_mask];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.values[0].store(sample.hostTimestamp, std::memory_order_relaxed);
+    for (int i = 0; i < 3; ++i) {
+        slot.values[1 + i].store(sample.position[i], std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 4; ++i) {
+        slot.values[4 + i].store(sample.quaternion[i], std::memory_order_relaxed);
+    }
+    slot.values[8].store(sample.confidence, std::memory_order_relaxed);
+    slot.edgeTimestampUs.store(sample.edgeTimestampUs, std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    m_count.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+bool PoseTimeline::read(std::uint64_t index, Sample& sample) const
+{
+    Slot const& slot = m_slots[index & m_mask];
+    const std::uint64_t expected = 2 * index + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != expected) {
+        return false; // overwritten by a newer pose
+    }
+    sample.hostTimestamp = slot.values[0].load(std::memory_order_relaxed);
+    for (int i = 0; i < 3; ++i) {
+        sample.position[i] = slot.values[1 + i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 4; ++i) {
+        sample.quaternion[i] = slot.values[4 + i].load(std::memory_order_relaxed);
+    }
+    sample.confidence = slot.values[8].load(std::memory_order_relaxed);
+    sample.edgeTimestampUs = slot.edgeTimestampUs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == expected;
+}
+
+bool PoseTimeline::latest(Sample& sample) const
+{
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const std::uint64_t n = count();
+        if (n == 0) {
+            return false;
+        }
+        if (read(n - 1, sample)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PoseTimeline::at(double hostTimestamp, Sample& sample) const
+{
+    // a read only fails when the writer wrapped around meanwhile, start again from the new head
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const std::uint64_t n = count();
+        if (n == 0) {
+            return false;
+        }
+        Sample newest;
+        if (!read(n - 1, newest)) {
+            continue;
+        }
+        if (hostTimestamp >= newest.hostTimestamp) {
+            if (hostTimestamp - newest.hostTimestamp > m_options.maxExtrapolation) {
+                return false;
+            }
+            Sample previous;
+            if (n >= 2 && read(n - 2, previous)) {
+                interpolate(previous, newest, (hostTimestamp - previous.hostTimestamp) / (newest.hostTimestamp - previous.hostTimestamp), sample);
+            } else {
+                sample = newest;
+                sample.hostTimestamp = hostTimestamp;
+            }
+            return true;
+        }
+
+        // first index after hostTimestamp, overwritten slots count as older
+        const std::uint64_t oldest = n > m_options.capacity ? n - m_options.capacity : 0;
+        std::uint64_t lo = oldest, hi = n - 1;
+        Sample after = newest;
+        while (lo < hi) {
+            const std::uint64_t mid = lo + (hi - lo) / 2;
+            Sample s;
+            if (read(mid, s) && s.hostTimestamp > hostTimestamp) {
+                hi = mid;
+                after = s;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        if (hi == oldest) {
+            return false; // before the history
+        }
+        Sample before;
+        if (!read(hi - 1, before)) {
+            return false; // overwritten: before the history as well
+        }
+        interpolate(before, after, (hostTimestamp - before.hostTimestamp) / (after.hostTimestamp - before.hostTimestamp), sample);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief History of the SLAM poses, queried at any host timestamp without calling the SDK
+ *
+ * Fed by `slam()->registerCallback()`, replaces the threads polling `getPose()` or
+ * `getPoseAt()`: any number of threads (tag fusion, point cloud transforms, display) ask
+ * for the pose at the timestamp of their own data.
+ *
+ * Poses are kept in a fixed-capacity ring written by a single thread (the SDK callback).
+ * Readers never lock: each slot is a sequence lock, a reader that raced with the writer
+ * simply reads the slot again. Between two samples the position is interpolated linearly
+ * and the rotation with SLERP; after the newest sample both are extrapolated at constant
+ * velocity for at most `maxExtrapolation` seconds.
+ *
+ * @code
+ * static PoseTimeline s_poses;
+ * device->slam()->registerCallback([](xv::Pose const& pose) { s_poses.push(pose); });
+ * ...
+ * xv::Pose pose;
+ * if (s_poses.poseAt(images.hostTimestamp, pose)) { ... }
+ * @endcode
+ */
+class PoseTimeline
+{
+public:
+    struct Options
+    {
+        Options() : capacity(1024), maxExtrapolation(0.1) {}
+        std::size_t capacity;    ///< poses kept (rounded up to a power of two), 1024 is ~1 s at 1 kHz
+        double maxExtrapolation; ///< seconds a query may be ahead of the newest pose
+    };
+
+    struct Sample
+    {
+        double hostTimestamp;
+        std::int64_t edgeTimestampUs;
+        double position[3];
+        double quaternion[4]; ///< [qx, qy, qz, qw] as xv::Pose::quaternion()
+        double confidence;
+    };
+
+    explicit PoseTimeline(Options const& options = Options());
+
+    PoseTimeline(PoseTimeline const&) = delete;
+    PoseTimeline& operator=(PoseTimeline const&) = delete;
+
+    /**
+     * @brief Appends a pose, from one thread only
+     * @return false if its timestamp is not after the newest one (the pose is ignored)
+     */
+    bool push(Sample const& sample);
+
+    /// Appends an xv::Pose
+    template <class Pose>
+    bool push(Pose const& pose)
+    {
+        Sample s;
+        s.hostTimestamp = pose.hostTimestamp();
+        s.edgeTimestampUs = pose.edgeTimestampUs();
+        auto const& t = pose.translation();
+        auto const q = pose.quaternion();
+        for (int i = 0; i < 3; ++i) {
+            s.position[i] = t[i];
+        }
+        for (int i = 0; i < 4; ++i) {
+            s.quaternion[i] = q[i];
+        }
+        s.confidence = pose.confidence();
+        return push(s);
+    }
+
+    /**
+     * @brief Pose at `hostTimestamp`, thread safe
+     * @return false if `hostTimestamp` is older than the history or too far after the newest pose
+     */
+    bool at(double hostTimestamp, Sample& sample) const;
+
+    /// at() into an xv::Pose
+    template <class Pose>
+    bool poseAt(double hostTimestamp, Pose& pose) const
+    {
+        Sample s;
+        if (!at(hostTimestamp, s)) {
+            return false;
+        }
+        pose.setTranslation({{s.position[0], s.position[1], s.position[2]}});
+        pose.setQuaternion({{s.quaternion[0], s.quaternion[1], s.quaternion[2], s.quaternion[3]}});
+        pose.setHostTimestamp(s.hostTimestamp);
+        pose.setEdgeTimestampUs(s.edgeTimestampUs);
+        pose.setConfidence(s.confidence);
+        return true;
+    }
+
+    /// Newest pose, false if there is none yet
+    bool latest(Sample& sample) const;
+
+    Options const& options() const { return m_options; }
+    /// Poses pushed so far (the last `capacity` ones are kept)
+    std::uint64_t count() const { return m_count.load(std::memory_order_acquire); }
+    /// Poses ignored by push() because their timestamp went backwards
+    std::uint64_t rejected() const { return m_rejected.load(); }
+
+private:
+    // every field is an atomic so that a reader racing with the writer is not a data race,
+    // the sequence tells whether what it read is consistent
+    struct Slot
+    {
+        std::atomic<std::uint64_t> sequence; ///< 2 * index + 2 when sample `index` is complete
+        std::atomic<double> values[9];       ///< host timestamp, position, quaternion, confidence
+        std::atomic<std::int64_t> edgeTimestampUs;
+    };
+
+    bool read(std::uint64_t index, Sample& sample) const;
+
+    Options m_options;
+    std::unique_ptr<Slot[]> m_slots;
+    std::uint64_t m_mask;
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::uint64_t> m_rejected;
+    double m_newest; // writer only
+};
@@ -0,0 +1,219 @@
+#include "replay_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "xvrec_xv.h"
+
+namespace {
+
+// gap between the end of the recording and its next loop
+const double kLoopGap = 1e-3;
+
+template <class T>
+void setTimestamps(T& data, double host, std::int64_t edge)
+{
+    data.hostTimestamp = host;
+    data.edgeTimestampUs = edge;
+}
+
+void setTimestamps(xv::Pose& pose, double host, std::int64_t edge)
+{
+    pose.setHostTimestamp(host);
+    pose.setEdgeTimestampUs(edge);
+}
+
+template <class T>
+std::shared_ptr<ReplayStream<T>> streamIf(XvRecReader const& reader, XvRecTrack track)
+{
+    return reader.recordCount(track) > 0 ? std::make_shared<ReplayStream<T>>() : nullptr;
+}
+
+} // namespace
+
+ReplayDevice::ReplayDevice()
+    : m_firstHost(0), m_lastHost(0), m_firstEdge(0), m_lastEdge(0), m_stop(false), m_finished(false),
+      m_delivered(0), m_maxLagUs(0), m_totalLagUs(0)
+{
+}
+
+ReplayDevice::~ReplayDevice()
+{
+    stop();
+}
+
+bool ReplayDevice::open(std::string const& filename, Options const& options)
+{
+    stop();
+    m_options = options;
+    if (!m_reader.open(filename)) {
+        m_error = m_reader.error();
+        return false;
+    }
+    m_imu = streamIf<xv::Imu>(m_reader, XvRecTrack::Imu);
+    m_fisheye = streamIf<xv::FisheyeImages>(m_reader, XvRecTrack::Fisheye);
+    m_tof = streamIf<xv::DepthImage>(m_reader, XvRecTrack::Depth);
+    m_color = streamIf<xv::ColorImage>(m_reader, XvRecTrack::Color);
+    m_sgbm = streamIf<xv::SgbmImage>(m_reader, XvRecTrack::Sgbm);
+    m_slam = streamIf<xv::Pose>(m_reader, XvRecTrack::Pose);
+
+    m_firstHost = std::numeric_limits<double>::max();
+    m_lastHost = std::numeric_limits<double>::lowest();
+    m_firstEdge = std::numeric_limits<std::int64_t>::max();
+    m_lastEdge = std::numeric_limits<std::int64_t>::min();
+    bool empty = true;
+    for (int t = 1; t < kXvRecTrackCount; ++t) {
+        const XvRecTrack track = static_cast<XvRecTrack>(t);
+        const std::size_t n = m_reader.recordCount(track);
+        if (n == 0) {
+            continue;
+        }
+        empty = false;
+        const XvRecRecord first = m_reader.record(track, 0);
+        const XvRecRecord last = m_reader.record(track, n - 1);
+        m_firstHost = std::min(m_firstHost, first.hostTimestamp);
+        m_lastHost = std::max(m_lastHost, last.hostTimestamp);
+        m_firstEdge = std::min(m_firstEdge, first.edgeTimestampUs);
+        m_lastEdge = std::max(m_lastEdge, last.edgeTimestampUs);
+    }
+    if (empty) {
+        m_error = filename + ": empty recording";
+        m_firstHost = m_lastHost = 0;
+        m_firstEdge = m_lastEdge = 0;
+        return false;
+    }
+    m_error.clear();
+    return true;
+}
+
+std::string ReplayDevice::id() const
+{
+    return m_reader.header().description;
+}
+
+bool ReplayDevice::play()
+{
+    stop();
+    if (!m_reader.mapping()) {
+        return false;
+    }
+    m_stop = false;
+    m_finished = false;
+    m_delivered = 0;
+    m_maxLagUs = 0;
+    m_totalLagUs = 0;
+    m_thread = std::thread(&ReplayDevice::run, this);
+    return true;
+}
+
+void ReplayDevice::stop()
+{
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        m_stop = true;
+        m_cv.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void ReplayDevice::wait()
+{
+    std::unique_lock<std::mutex> l(m_mtx);
+    m_cv.wait(l, [this]{ return m_finished.load() || m_stop.load(); });
+}
+
+double ReplayDevice::meanLagMs() const
+{
+    const std::uint64_t n = m_delivered.load();
+    return n ? m_totalLagUs.load() * 1e-3 / n : 0.;
+}
+
+template <class T>
+void ReplayDevice::deliver(std::shared_ptr<ReplayStream<T>> const& stream, XvRecRecord const& record, double host, std::int64_t edge)
+{
+    if (!stream || !stream->started()) {
+        return;
+    }
+    T data;
+    if (xvrecDecode(record, m_reader.mapping(), data)) {
+        setTimestamps(data, host, edge);
+        stream->dispatch(data);
+    }
+}
+
+void ReplayDevice::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    const double speed = m_options.speed;
+    const Clock::time_point t0 = Clock::now();
+    const double t0Seconds = std::chrono::duration<double>(t0.time_since_epoch()).count();
+    const double loopHost = duration() + kLoopGap;
+    const std::int64_t loopEdge = m_lastEdge - m_firstEdge + static_cast<std::int64_t>(kLoopGap * 1e6);
+
+    std::size_t cursor[kXvRecTrackCount] = {};
+    int loop = 0;
+    while (true) {
+        // next record of all tracks in host time order
+        int next = 0;
+        double nextHost = std::numeric_limits<double>::max();
+        for (int t = 1; t < kXvRecTrackCount; ++t) {
+            const XvRecTrack track = static_cast<XvRecTrack>(t);
+            if (cursor[t] < m_reader.recordCount(track)) {
+                const double h = m_reader.record(track, cursor[t]).hostTimestamp;
+                if (h < nextHost) {
+                    nextHost = h;
+                    next = t;
+                }
+            }
+        }
+        if (next == 0) {
+            if (!m_options.loop) {
+                break;
+            }
+            std::fill(cursor, cursor + kXvRecTrackCount, 0);
+            ++loop;
+            continue;
+        }
+
+        const XvRecTrack track = static_cast<XvRecTrack>(next);
+        const XvRecRecord record = m_reader.record(track, cursor[next]++);
+        // seconds since the start of the replay on the recording timeline
+        const double elapsed = record.hostTimestamp - m_firstHost + loop * loopHost;
+        if (speed > 0) {
+            const Clock::time_point due = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(elapsed / speed));
+            std::unique_lock<std::mutex> l(m_mtx);
+            if (m_cv.wait_until(l, due, [this]{ return m_stop.load(); })) {
+                break;
+            }
+            const std::int64_t lagUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due).count();
+            m_totalLagUs += lagUs;
+            if (lagUs > m_maxLagUs.load()) {
+                m_maxLagUs = lagUs;
+            }
+        } else if (m_stop.load()) {
+            break;
+        }
+
+        double host = record.hostTimestamp + loop * loopHost;
+        if (m_options.rebaseHostTimestamps) {
+            host = t0Seconds + (speed > 0 ? elapsed / speed : std::chrono::duration<double>(Clock::now() - t0).count());
+        }
+        const std::int64_t edge = record.edgeTimestampUs + loop * loopEdge;
+
+        switch (track) {
+        case XvRecTrack::Imu: deliver(m_imu, record, host, edge); break;
+        case XvRecTrack::Fisheye: deliver(m_fisheye, record, host, edge); break;
+        case XvRecTrack::Depth: deliver(m_tof, record, host, edge); break;
+        case XvRecTrack::Color: deliver(m_color, record, host, edge); break;
+        case XvRecTrack::Sgbm: deliver(m_sgbm, record, host, edge); break;
+        case XvRecTrack::Pose: deliver(m_slam, record, host, edge); break;
+        }
+        ++m_delivered;
+    }
+    std::lock_guard<std::mutex> l(m_mtx);
+    m_finished = true;
+    m_cv.notify_all();
+}
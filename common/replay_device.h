@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <xv-sdk.h>
+
+#include "xvrec.h"
+
+/**
+ * @brief One stream of a ReplayDevice, same calls as the xv stream it stands for
+ *
+ * Callbacks only receive data between start() and stop(). The callback list is copy on
+ * write, so callbacks may (un)register callbacks and dispatch() never blocks on a lock
+ * held by another callback.
+ */
+template <class T>
+class ReplayStream
+{
+public:
+    ReplayStream() : m_callbacks(std::make_shared<Callbacks>()), m_nextId(0), m_started(false) {}
+
+    int registerCallback(std::function<void(T const&)> callback)
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        auto callbacks = std::make_shared<Callbacks>(*m_callbacks);
+        callbacks->emplace_back(m_nextId, std::move(callback));
+        m_callbacks = callbacks;
+        return m_nextId++;
+    }
+
+    bool unregisterCallback(int id)
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        auto callbacks = std::make_shared<Callbacks>(*m_callbacks);
+        for (auto it = callbacks->begin(); it != callbacks->end(); ++it) {
+            if (it->first == id) {
+                callbacks->erase(it);
+                m_callbacks = callbacks;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool start() { m_started = true; return true; }
+    /// Configured starts (e.g. SgbmCamera::start(sgbm_config)), the configuration is ignored
+    template <class Config>
+    bool start(Config const&) { return start(); }
+    bool stop() { m_started = false; return true; }
+    bool started() const { return m_started.load(); }
+
+    /// Player thread: calls the callbacks if the stream is started
+    void dispatch(T const& data)
+    {
+        if (!m_started.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::shared_ptr<const Callbacks> callbacks;
+        {
+            std::lock_guard<std::mutex> l(m_mtx);
+            callbacks = m_callbacks;
+        }
+        for (auto const& c : *callbacks) {
+            c.second(data);
+        }
+    }
+
+private:
+    typedef std::vector<std::pair<int, std::function<void(T const&)>>> Callbacks;
+
+    std::mutex m_mtx;
+    std::shared_ptr<const Callbacks> m_callbacks;
+    int m_nextId;
+    std::atomic<bool> m_started;
+};
+
+/**
+ * @brief Plays an xvrec recording through the stream surfaces of xv::Device
+ *
+ * colorCamera(), tofCamera(), fisheyeCameras(), sgbmCamera(), slam() and imuSensor() return
+ * streams with the xvsdk registerCallback / start / stop calls (nullptr when the recording
+ * has no such track), so sample code written against those calls runs unchanged when the
+ * device type is a template parameter or `auto`.
+ *
+ * The records of all tracks are delivered in host timestamp order from one player thread,
+ * paced by their original timing divided by `speed` (0: as fast as possible). Frames carry
+ * their original edge and host timestamps, image data is shared with the file mapping.
+ *
+ * @code
+ * ReplayDevice device;
+ * device.open("record.xvrec");
+ * device.fisheyeCameras()->registerCallback([](xv::FisheyeImages const& fe){ ... });
+ * device.fisheyeCameras()->start();
+ * device.play();
+ * device.wait();
+ * @endcode
+ */
+class ReplayDevice
+{
+public:
+    struct Options
+    {
+        Options() : speed(1.), loop(false), rebaseHostTimestamps(false) {}
+        double speed;              ///< 1: real time, 2: twice as fast, 0: as fast as possible
+        bool loop;                 ///< restart at the end, timestamps keep increasing
+        bool rebaseHostTimestamps; ///< shift host timestamps onto the local steady clock (latency measurements)
+    };
+
+    ReplayDevice();
+    ~ReplayDevice();
+
+    ReplayDevice(ReplayDevice const&) = delete;
+    ReplayDevice& operator=(ReplayDevice const&) = delete;
+
+    bool open(std::string const& filename, Options const& options = Options());
+    std::string const& error() const { return m_error; }
+    /// Description stored in the recording
+    std::string id() const;
+
+    std::shared_ptr<ReplayStream<xv::Imu>> imuSensor() { return m_imu; }
+    std::shared_ptr<ReplayStream<xv::FisheyeImages>> fisheyeCameras() { return m_fisheye; }
+    std::shared_ptr<ReplayStream<xv::DepthImage>> tofCamera() { return m_tof; }
+    std::shared_ptr<ReplayStream<xv::ColorImage>> colorCamera() { return m_color; }
+    std::shared_ptr<ReplayStream<xv::SgbmImage>> sgbmCamera() { return m_sgbm; }
+    std::shared_ptr<ReplayStream<xv::Pose>> slam() { return m_slam; }
+
+    /// Starts the player thread (streams still need their own start())
+    bool play();
+    /// Stops the player thread
+    void stop();
+    /// Waits until the recording was played (forever when looping)
+    void wait();
+    bool finished() const { return m_finished.load(); }
+
+    /// Recording duration in seconds (host clock)
+    double duration() const { return m_lastHost - m_firstHost; }
+    std::uint64_t delivered() const { return m_delivered.load(); }
+    /// How late records were delivered compared to their schedule (paced replay only)
+    double maxLagMs() const { return m_maxLagUs.load() * 1e-3; }
+    double meanLagMs() const;
+
+private:
+    template <class T>
+    void deliver(std::shared_ptr<ReplayStream<T>> const& stream, XvRecRecord const& record, double host, std::int64_t edge);
+    void run();
+
+    XvRecReader m_reader;
+    Options m_options;
+    std::string m_error;
+    double m_firstHost, m_lastHost;
+    std::int64_t m_firstEdge, m_lastEdge;
+
+    std::shared_ptr<ReplayStream<xv::Imu>> m_imu;
+    std::shared_ptr<ReplayStream<xv::FisheyeImages>> m_fisheye;
+    std::shared_ptr<ReplayStream<xv::DepthImage>> m_tof;
+    std::shared_ptr<ReplayStream<xv::ColorImage>> m_color;
+    std::shared_ptr<ReplayStream<xv::SgbmImage>> m_sgbm;
+    std::shared_ptr<ReplayStream<xv::Pose>> m_slam;
+
+    std::thread m_thread;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    // read without m_mtx by the playback thread at full speed, set under m_mtx to wake it up
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_finished;
+    std::atomic<std::uint64_t> m_delivered;
+    std::atomic<std::int64_t> m_maxLagUs;
+    std::atomic<std::int64_t> m_totalLagUs;
+};
@@ -0,0 +1,302 @@
+#include "resource_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+double steadyNow()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(__linux__)
+
+/// Whole content of a small /proc file, empty if it cannot be read (e.g. the thread exited)
+std::string readProcFile(const char* path)
+{
+    std::string content;
+    FILE* f = std::fopen(path, "r");
+    if (!f) {
+        return content;
+    }
+    char buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        content.append(buffer, n);
+    }
+    std::fclose(f);
+    return content;
+}
+
+/**
+ * Parses a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat line (see proc(5)).
+ * The name (field 2) is between parentheses and may contain spaces, the numbered fields
+ * are counted from the last ')'. Returns false if the line is truncated.
+ */
+bool parseStat(std::string const& stat, std::string& name, std::uint64_t values[5], std::uint64_t& rssPages)
+{
+    const std::size_t open = stat.find('(');
+    const std::size_t close = stat.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+        return false;
+    }
+    name = stat.substr(open + 1, close - open - 1);
+
+    // field 3 (state) is the first after ") "
+    const char* p = stat.c_str() + close + 1;
+    enum { MinorFaults = 10, MajorFaults = 12, UserTicks = 14, SystemTicks = 15, Rss = 24 };
+    int field = 2;
+    while (*p && field < Rss) {
+        while (*p == ' ') {
+            ++p;
+        }
+        if (!*p) {
+            break;
+        }
+        ++field;
+        char* end;
+        const std::uint64_t value = std::strtoull(p, &end, 10);
+        switch (field) {
+        case MinorFaults: values[0] = value; break;
+        case MajorFaults: values[1] = value; break;
+        case UserTicks: values[2] = value; break;
+        case SystemTicks: values[3] = value; break;
+        case Rss: rssPages = value; break;
+        default: break;
+        }
+        p = end;
+        while (*p && *p != ' ') { // non numeric fields (state)
+            ++p;
+        }
+    }
+    return field == Rss;
+}
+
+/// Value of a "key:\tvalue" line of a /proc status file, 0 if missing
+std::uint64_t statusValue(std::string const& status, const char* key)
+{
+    const std::size_t at = status.find(key);
+    if (at == std::string::npos) {
+        return 0;
+    }
+    return std::strtoull(status.c_str() + at + std::strlen(key), nullptr, 10);
+}
+
+#endif
+
+double rate(std::uint64_t current, std::uint64_t previous, double seconds)
+{
+    // a reused tid may start below the counters of the previous thread
+    return current >= previous ? (current - previous) / seconds : 0;
+}
+
+} // namespace
+
+ResourceProfiler::ResourceProfiler(Options const& options, Callback callback)
+    : m_options(options), m_callback(std::move(callback)), m_lastTime(0), m_cpuPercent(0), m_rssBytes(0),
+      m_stop(false)
+{
+    if (supported() && m_options.intervalMs > 0) {
+        m_thread = std::thread(&ResourceProfiler::run, this);
+    }
+}
+
+ResourceProfiler::~ResourceProfiler()
+{
+    {
+        std::lock_guard<std::mutex> l(m_stopMtx);
+        m_stop = true;
+    }
+    m_stopCv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool ResourceProfiler::supported()
+{
+#if defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ResourceProfiler::nameCurrentThread(std::string const& name)
+{
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#else
+    (void)name;
+#endif
+}
+
+void ResourceProfiler::run()
+{
+    nameCurrentThread("profiler");
+    update();
+    std::unique_lock<std::mutex> l(m_stopMtx);
+    while (!m_stopCv.wait_for(l, std::chrono::milliseconds(m_options.intervalMs), [this] { return m_stop; })) {
+        l.unlock();
+        update();
+        if (m_callback) {
+            m_callback(snapshot());
+        }
+        l.lock();
+    }
+}
+
+void ResourceProfiler::update()
+{
+#if defined(__linux__)
+    std::lock_guard<std::mutex> l(m_updateMtx);
+    static const double ticksPerSecond = static_cast<double>(sysconf(_SC_CLK_TCK));
+    static const std::uint64_t pageSize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+
+    const double now = steadyNow();
+    const double seconds = now - m_lastTime;
+    const bool first = m_lastTime == 0;
+
+    Snapshot snapshot;
+    snapshot.timestamp = now;
+    snapshot.interval = seconds;
+
+    // process: faults and ticks include the threads that already exited
+    Counters process;
+    std::uint64_t values[5] = {0, 0, 0, 0, 0};
+    std::uint64_t rssPages = 0;
+    if (!parseStat(readProcFile("/proc/self/stat"), process.name, values, rssPages)) {
+        return;
+    }
+    process.minorFaults = values[0];
+    process.majorFaults = values[1];
+    process.userTicks = values[2];
+    process.systemTicks = values[3];
+    snapshot.rssBytes = rssPages * pageSize;
+    snapshot.userPercent = rate(process.userTicks, m_lastProcess.userTicks, seconds) / ticksPerSecond * 100;
+    snapshot.systemPercent = rate(process.systemTicks, m_lastProcess.systemTicks, seconds) / ticksPerSecond * 100;
+    snapshot.cpuPercent = snapshot.userPercent + snapshot.systemPercent;
+    snapshot.minorFaultsPerSec = rate(process.minorFaults, m_lastProcess.minorFaults, seconds);
+    snapshot.majorFaultsPerSec = rate(process.majorFaults, m_lastProcess.majorFaults, seconds);
+
+    // threads
+    std::map<int, Counters> threads;
+    if (DIR* dir = opendir("/proc/self/task")) {
+        char path[64];
+        while (dirent* entry = readdir(dir)) {
+            const int tid = std::atoi(entry->d_name);
+            if (tid <= 0) {
+                continue;
+            }
+            Counters c;
+            std::snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+            if (!parseStat(readProcFile(path), c.name, values, rssPages)) {
+                continue; // exited meanwhile
+            }
+            c.minorFaults = values[0];
+            c.majorFaults = values[1];
+            c.userTicks = values[2];
+            c.systemTicks = values[3];
+            std::snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+            const std::string status = readProcFile(path);
+            c.voluntarySwitches = statusValue(status, "\nvoluntary_ctxt_switches:");
+            c.involuntarySwitches = statusValue(status, "\nnonvoluntary_ctxt_switches:");
+
+            // a thread born during the interval is compared with zero counters
+            auto previous = m_lastThreads.find(tid);
+            const Counters last = previous != m_lastThreads.end() ? previous->second : Counters();
+            ThreadUsage usage;
+            usage.tid = tid;
+            usage.name = c.name;
+            usage.userPercent = rate(c.userTicks, last.userTicks, seconds) / ticksPerSecond * 100;
+            usage.systemPercent = rate(c.systemTicks, last.systemTicks, seconds) / ticksPerSecond * 100;
+            usage.cpuPercent = usage.userPercent + usage.systemPercent;
+            usage.voluntarySwitchesPerSec = rate(c.voluntarySwitches, last.voluntarySwitches, seconds);
+            usage.involuntarySwitchesPerSec = rate(c.involuntarySwitches, last.involuntarySwitches, seconds);
+            usage.minorFaultsPerSec = rate(c.minorFaults, last.minorFaults, seconds);
+            usage.majorFaultsPerSec = rate(c.majorFaults, last.majorFaults, seconds);
+            snapshot.voluntarySwitchesPerSec += usage.voluntarySwitchesPerSec;
+            snapshot.involuntarySwitchesPerSec += usage.involuntarySwitchesPerSec;
+            snapshot.threads.push_back(usage);
+            threads[tid] = c;
+        }
+        closedir(dir);
+    }
+    std::sort(snapshot.threads.begin(), snapshot.threads.end(),
+              [](ThreadUsage const& a, ThreadUsage const& b) { return a.cpuPercent > b.cpuPercent; });
+
+    // the exited threads are dropped here
+    m_lastThreads.swap(threads);
+    m_lastProcess = process;
+    m_lastTime = now;
+    if (first) {
+        return; // no interval yet, the rates would be averages since the start of the process
+    }
+
+    m_cpuPercent.store(snapshot.cpuPercent, std::memory_order_relaxed);
+    m_rssBytes.store(snapshot.rssBytes, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> s(m_snapshotMtx);
+    m_snapshot = std::move(snapshot);
+#endif
+}
+
+ResourceProfiler::Snapshot ResourceProfiler::snapshot() const
+{
+    std::lock_guard<std::mutex> l(m_snapshotMtx);
+    return m_snapshot;
+}
+
+std::string ResourceProfiler::format(Snapshot const& snapshot, double minCpuPercent)
+{
+    std::ostringstream out;
+    char line[256];
+    std::snprintf(line, sizeof(line), "cpu %.1f%% (user %.1f%%, sys %.1f%%) rss %.1f MB ctx/s %.0f+%.0f faults/s %.0f+%.0f threads %zu",
+                  snapshot.cpuPercent, snapshot.userPercent, snapshot.systemPercent, snapshot.rssBytes / 1048576.0,
+                  snapshot.voluntarySwitchesPerSec, snapshot.involuntarySwitchesPerSec, snapshot.minorFaultsPerSec,
+                  snapshot.majorFaultsPerSec, snapshot.threads.size());
+    out << line;
+    for (ThreadUsage const& t : snapshot.threads) {
+        if (t.cpuPercent < minCpuPercent) {
+            break; // sorted
+        }
+        std::snprintf(line, sizeof(line), "\n  %-15s %6d cpu %5.1f%% ctx/s %.0f+%.0f faults/s %.0f+%.0f",
+                      t.name.c_str(), t.tid, t.cpuPercent, t.voluntarySwitchesPerSec, t.involuntarySwitchesPerSec,
+                      t.minorFaultsPerSec, t.majorFaultsPerSec);
+        out << line;
+    }
+    return out.str();
+}
+
+void ResourceProfiler::writeCsvHeader(std::ostream& out)
+{
+    out << "timestamp,tid,name,cpu_percent,user_percent,system_percent,rss_bytes,"
+           "voluntary_switches_per_s,involuntary_switches_per_s,minor_faults_per_s,major_faults_per_s\n";
+}
+
+void ResourceProfiler::writeCsv(std::ostream& out, Snapshot const& snapshot)
+{
+    char line[256];
+    std::snprintf(line, sizeof(line), "%.6f,0,process,%.2f,%.2f,%.2f,%llu,%.1f,%.1f,%.1f,%.1f\n", snapshot.timestamp,
+                  snapshot.cpuPercent, snapshot.userPercent, snapshot.systemPercent,
+                  static_cast<unsigned long long>(snapshot.rssBytes), snapshot.voluntarySwitchesPerSec,
+                  snapshot.involuntarySwitchesPerSec, snapshot.minorFaultsPerSec, snapshot.majorFaultsPerSec);
+    out << line;
+    for (ThreadUsage const& t : snapshot.threads) {
+        // the RSS is shared by the threads, left empty
+        std::snprintf(line, sizeof(line), "%.6f,%d,%s,%.2f,%.2f,%.2f,,%.1f,%.1f,%.1f,%.1f\n", snapshot.timestamp, t.tid,
+                      t.name.c_str(), t.cpuPercent, t.userPercent, t.systemPercent, t.voluntarySwitchesPerSec,
+                      t.involuntarySwitchesPerSec, t.minorFaultsPerSec, t.majorFaultsPerSec);
+        out << line;
+    }
+}
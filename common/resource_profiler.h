@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief CPU, memory, context switch and page fault rates of the process and of each of its threads
+ *
+ * A background thread reads /proc/self/stat and /proc/self/task/<tid>/{stat,status} every
+ * `intervalMs` and turns the counters into rates over the last interval, so callbacks
+ * only read the latest figures (cpuPercent() is one atomic load, no syscall).
+ *
+ * Threads are identified by their name (/proc comm): the SDK names its delivery threads,
+ * name yours with nameCurrentThread() to tell them apart in the reports.
+ *
+ * Linux only: elsewhere supported() is false and the snapshots stay empty.
+ */
+class ResourceProfiler
+{
+public:
+    struct Options
+    {
+        Options() : intervalMs(1000) {}
+        int intervalMs; ///< sampling period, 0: no thread, call update() yourself
+    };
+
+    struct ThreadUsage
+    {
+        int tid;
+        std::string name;
+        double cpuPercent;                 ///< user + system, 100 is one full core
+        double userPercent;
+        double systemPercent;
+        double voluntarySwitchesPerSec;    ///< the thread blocked (I/O, lock, wait)
+        double involuntarySwitchesPerSec;  ///< the thread was preempted
+        double minorFaultsPerSec;
+        double majorFaultsPerSec;
+    };
+
+    struct Snapshot
+    {
+        double timestamp = 0;       ///< steady clock seconds, the clock of xv hostTimestamp
+        double interval = 0;        ///< seconds covered by the rates
+        double cpuPercent = 0;
+        double userPercent = 0;
+        double systemPercent = 0;
+        std::uint64_t rssBytes = 0;
+        double voluntarySwitchesPerSec = 0;   ///< sum over the live threads
+        double involuntarySwitchesPerSec = 0;
+        double minorFaultsPerSec = 0;
+        double majorFaultsPerSec = 0;
+        std::vector<ThreadUsage> threads;     ///< by decreasing cpuPercent
+    };
+
+    typedef std::function<void(Snapshot const&)> Callback;
+
+    /// `callback` is called from the profiler thread after every sample
+    explicit ResourceProfiler(Options const& options = Options(), Callback callback = nullptr);
+    ~ResourceProfiler();
+
+    ResourceProfiler(ResourceProfiler const&) = delete;
+    ResourceProfiler& operator=(ResourceProfiler const&) = delete;
+
+    static bool supported();
+    /// Names the calling thread (15 characters at most are kept)
+    static void nameCurrentThread(std::string const& name);
+
+    /// Takes a sample now, rates are over the time since the previous one
+    void update();
+
+    /// Latest sample (empty before the second one)
+    Snapshot snapshot() const;
+    /// Process CPU% of the latest sample, cheap enough for any callback
+    double cpuPercent() const { return m_cpuPercent.load(std::memory_order_relaxed); }
+    std::uint64_t rssBytes() const { return m_rssBytes.load(std::memory_order_relaxed); }
+
+    /// One line for the process then one per thread using at least `minCpuPercent`
+    static std::string format(Snapshot const& snapshot, double minCpuPercent = 1.0);
+    static void writeCsvHeader(std::ostream& out);
+    /// One row for the process (tid 0) and one per thread
+    static void writeCsv(std::ostream& out, Snapshot const& snapshot);
+
+private:
+    struct Counters
+    {
+        std::string name;
+        std::uint64_t userTicks = 0, systemTicks = 0;
+        std::uint64_t minorFaults = 0, majorFaults = 0;
+        std::uint64_t voluntarySwitches = 0, involuntarySwitches = 0;
+    };
+
+    void run();
+
+    Options m_options;
+    Callback m_callback;
+
+    // previous sample, used by update() only
+    std::mutex m_updateMtx;
+    double m_lastTime;
+    Counters m_lastProcess;
+    std::map<int, Counters> m_lastThreads;
+
+    mutable std::mutex m_snapshotMtx;
+    Snapshot m_snapshot;
+    std::atomic<double> m_cpuPercent;
+    std::atomic<std::uint64_t> m_rssBytes;
+
+    std::mutex m_stopMtx;
+    std::condition_variable m_stopCv;
+    bool m_stop;
+    std::thread m_thread;
+};
@@ -0,0 +1,172 @@
+#include "rgbd_unpack.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// The SSSE3 kernel is compiled whatever the -m flags of the build (the samples are built for
+// the baseline x86-64) and only called when the CPU has SSSE3, see hasSimd().
+#include <tmmintrin.h>
+#define RGBD_UNPACK_SSSE3
+#define RGBD_UNPACK_TARGET __attribute__((target("ssse3")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RGBD_UNPACK_NEON
+#endif
+
+namespace {
+
+#if defined(RGBD_UNPACK_SSSE3) || defined(RGBD_UNPACK_NEON)
+/*
+ * 8 pixels (56 bytes) are read with loads at byte 0, 12, 28 and 40, none past the last
+ * pixel. Each output register ORs the shuffles of the loads holding its bytes; -1 gives a
+ * zero byte for both pshufb and tbl.
+ */
+alignas(16) const std::int8_t kDepthMasks[2][16] = {
+    {3, 4, 5, 6, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1}, // pixels 0 1 from load 0 (4 5 from 28)
+    {-1, -1, -1, -1, -1, -1, -1, -1, 5, 6, 7, 8, 12, 13, 14, 15}, // pixels 2 3 from load 12 (6 7 from 40)
+};
+
+// per color order: 16 bytes from loads 0, 12, 28, then 8 bytes from loads 28, 40
+alignas(16) const std::int8_t kColorMasks[2][5][16] = {
+    { // Rgb
+        {2, 1, 0, 9, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+        {-1, -1, -1, -1, -1, -1, 4, 3, 2, 11, 10, 9, -1, -1, -1, -1},
+        {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 1, 0, 9},
+        {8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+        {-1, -1, 4, 3, 2, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1, -1},
+    },
+    { // Bgr
+        {0, 1, 2, 7, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+        {-1, -1, -1, -1, -1, -1, 2, 3, 4, 9, 10, 11, -1, -1, -1, -1},
+        {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 7},
+        {8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+        {-1, -1, 2, 3, 4, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1},
+    },
+};
+#endif
+
+#if defined(RGBD_UNPACK_SSSE3)
+RGBD_UNPACK_TARGET inline __m128i mask(std::int8_t const* m)
+{
+    return _mm_load_si128(reinterpret_cast<__m128i const*>(m));
+}
+
+RGBD_UNPACK_TARGET int unpackRow8(std::uint8_t const* src, int width, int order, float* depth, std::uint8_t* bgr)
+{
+    const __m128i d0 = mask(kDepthMasks[0]), d1 = mask(kDepthMasks[1]);
+    const __m128i c0 = mask(kColorMasks[order][0]), c1 = mask(kColorMasks[order][1]), c2 = mask(kColorMasks[order][2]);
+    const __m128i c3 = mask(kColorMasks[order][3]), c4 = mask(kColorMasks[order][4]);
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        std::uint8_t const* p = src + kRgbdPixelBytes * i;
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 12));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 28));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 40));
+        if (depth) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(depth + i), _mm_or_si128(_mm_shuffle_epi8(a, d0), _mm_shuffle_epi8(b, d1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(depth + i + 4), _mm_or_si128(_mm_shuffle_epi8(c, d0), _mm_shuffle_epi8(d, d1)));
+        }
+        if (bgr) {
+            const __m128i lo = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, c0), _mm_shuffle_epi8(b, c1)), _mm_shuffle_epi8(c, c2));
+            const __m128i hi = _mm_or_si128(_mm_shuffle_epi8(c, c3), _mm_shuffle_epi8(d, c4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bgr + 3 * i), lo);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(bgr + 3 * i + 16), hi);
+        }
+    }
+    return i;
+}
+#elif defined(RGBD_UNPACK_NEON)
+inline uint8x16_t mask(std::int8_t const* m)
+{
+    return vreinterpretq_u8_s8(vld1q_s8(m));
+}
+
+int unpackRow8(std::uint8_t const* src, int width, int order, float* depth, std::uint8_t* bgr)
+{
+    const uint8x16_t d0 = mask(kDepthMasks[0]), d1 = mask(kDepthMasks[1]);
+    const uint8x16_t c0 = mask(kColorMasks[order][0]), c1 = mask(kColorMasks[order][1]), c2 = mask(kColorMasks[order][2]);
+    const uint8x16_t c3 = mask(kColorMasks[order][3]), c4 = mask(kColorMasks[order][4]);
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        std::uint8_t const* p = src + kRgbdPixelBytes * i;
+        const uint8x16_t a = vld1q_u8(p);
+        const uint8x16_t b = vld1q_u8(p + 12);
+        const uint8x16_t c = vld1q_u8(p + 28);
+        const uint8x16_t d = vld1q_u8(p + 40);
+        if (depth) {
+            vst1q_u8(reinterpret_cast<std::uint8_t*>(depth + i), vorrq_u8(vqtbl1q_u8(a, d0), vqtbl1q_u8(b, d1)));
+            vst1q_u8(reinterpret_cast<std::uint8_t*>(depth + i + 4), vorrq_u8(vqtbl1q_u8(c, d0), vqtbl1q_u8(d, d1)));
+        }
+        if (bgr) {
+            const uint8x16_t lo = vorrq_u8(vorrq_u8(vqtbl1q_u8(a, c0), vqtbl1q_u8(b, c1)), vqtbl1q_u8(c, c2));
+            const uint8x16_t hi = vorrq_u8(vqtbl1q_u8(c, c3), vqtbl1q_u8(d, c4));
+            vst1q_u8(bgr + 3 * i, lo);
+            vst1_u8(bgr + 3 * i + 16, vget_low_u8(hi));
+        }
+    }
+    return i;
+}
+#else
+int unpackRow8(std::uint8_t const*, int, int, float*, std::uint8_t*)
+{
+    return 0;
+}
+#endif
+
+/// Whether unpackRow8 may be called on this CPU
+bool hasSimd()
+{
+#if defined(RGBD_UNPACK_SSSE3) && !defined(__SSSE3__)
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    return ssse3;
+#else
+    return true;
+#endif
+}
+
+void unpackRow(std::uint8_t const* src, int width, RgbdColorOrder order, bool simd, float* depth, std::uint8_t* bgr)
+{
+    int i = simd ? unpackRow8(src, width, order == RgbdColorOrder::Rgb ? 0 : 1, depth, bgr) : 0;
+    const int r = order == RgbdColorOrder::Rgb ? 2 : 0;
+    for (; i < width; ++i) {
+        std::uint8_t const* p = src + kRgbdPixelBytes * i;
+        if (depth) {
+            std::memcpy(depth + i, p + 3, sizeof(float));
+        }
+        if (bgr) {
+            bgr[3 * i] = p[r];
+            bgr[3 * i + 1] = p[1];
+            bgr[3 * i + 2] = p[2 - r];
+        }
+    }
+}
+
+} // namespace
+
+bool unpackRgbd(std::uint8_t const* src, std::size_t srcSize, int width, int height, RgbdColorOrder order,
+                float* depth, std::size_t depthStride, std::uint8_t* bgr, std::size_t bgrStride)
+{
+    const std::size_t rowBytes = static_cast<std::size_t>(width) * kRgbdPixelBytes;
+    if (!src || width <= 0 || height <= 0 || srcSize < rowBytes * height) {
+        return false;
+    }
+    const bool simd = hasSimd();
+    for (int y = 0; y < height; ++y) {
+        unpackRow(src + rowBytes * y, width, order, simd,
+                  depth ? reinterpret_cast<float*>(reinterpret_cast<std::uint8_t*>(depth) + depthStride * y) : nullptr,
+                  bgr ? bgr + bgrStride * y : nullptr);
+    }
+    return true;
+}
+
+const char* rgbdUnpackKernel()
+{
+#if defined(RGBD_UNPACK_SSSE3)
+    return hasSimd() ? "SSSE3" : "scalar";
+#elif defined(RGBD_UNPACK_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Splitting of the interleaved xv::DepthColorImage buffer into planar depth and BGR
+ *
+ * The RGBD stream packs, for every pixel, 3 color bytes followed by the depth in meters as
+ * a float, so the floats sit at odd addresses (7-byte stride). unpackRgbd() reads the
+ * buffer once and writes both planes: with SSSE3 / NEON (aarch64) 8 pixels are gathered
+ * from four unaligned 16-byte loads by byte shuffles, the scalar fallback uses memcpy for
+ * the unaligned floats. Both give the same bytes.
+ *
+ * The planes can then be used without touching the packed buffer again: the depth plane
+ * by DepthCloudBuilder or DepthColorizer::colorizeDepth32, the BGR plane by a cv::Mat
+ * header or a recorder. The functions keep no state and may be called from several threads.
+ */
+
+/// Bytes per pixel of xv::DepthColorImage: 3 color bytes then a float depth
+const std::size_t kRgbdPixelBytes = 7;
+
+/// Order of the 3 color bytes in the packed buffer
+enum class RgbdColorOrder
+{
+    Rgb, ///< swapped to BGR (all_stream)
+    Bgr, ///< copied as is (rgbd_stream)
+};
+
+/**
+ * @brief Unpacks a `width` x `height` RGBD frame
+ * @param src: packed frame, at least width * height * kRgbdPixelBytes bytes
+ * @param depth: rows of `width` floats (meters), `depthStride` bytes apart, nullptr to skip
+ * @param bgr: rows of 3 * `width` bytes, `bgrStride` bytes apart, nullptr to skip
+ * @return false (and nothing written) if `src` is null or too small
+ */
+bool unpackRgbd(std::uint8_t const* src, std::size_t srcSize, int width, int height, RgbdColorOrder order,
+                float* depth, std::size_t depthStride, std::uint8_t* bgr, std::size_t bgrStride);
+
+/// Kernel used on this CPU: "SSSE3", "NEON" or "scalar"
+const char* rgbdUnpackKernel();
+
+/**
+ * @brief Planar copy of an RGBD frame, the buffers are kept across frames
+ *
+ * @code
+ * RgbdPlanes planes;
+ * planes.unpack(rgbd.data.get(), rgbd.dataSize, rgbd.width, rgbd.height);
+ * cloudBuilder.build(planes.depth.data(), planes.width, planes.height, points);
+ * @endcode
+ */
+struct RgbdPlanes
+{
+    RgbdPlanes() : width(0), height(0) {}
+
+    bool unpack(std::uint8_t const* src, std::size_t srcSize, int w, int h, RgbdColorOrder order = RgbdColorOrder::Rgb)
+    {
+        if (!src || w <= 0 || h <= 0) {
+            return false;
+        }
+        depth.resize(static_cast<std::size_t>(w) * h);
+        bgr.resize(depth.size() * 3);
+        if (!unpackRgbd(src, srcSize, w, h, order, depth.data(), w * sizeof(float), bgr.data(), w * 3u)) {
+            width = height = 0;
+            return false;
+        }
+        width = w;
+        height = h;
+        return true;
+    }
+
+    int width;
+    int height;
+    std::vector<float> depth;       ///< meters, width * height
+    std::vector<std::uint8_t> bgr;  ///< width * height * 3
+};
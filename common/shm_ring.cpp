@@ -0,0 +1,387 @@
+#include "shm_ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(ShmRingHeader) <= kShmRingHeaderSize, "ShmRingHeader layout");
+static_assert(sizeof(ShmRingSlot) == 32, "ShmRingSlot layout");
+
+namespace {
+
+const std::size_t kSlotAlign = 64;
+const std::size_t kMinSlotSize = 256;
+
+inline std::size_t alignUp(std::size_t v, std::size_t a)
+{
+    return (v + a - 1) / a * a;
+}
+
+// shared (not FUTEX_PRIVATE) futexes: the word is mapped by several processes
+void futexWait(std::atomic<std::uint32_t>* word, std::uint32_t expected, int timeoutMs)
+{
+    timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<std::uint32_t>* word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+} // namespace
+
+std::string shmRingName(std::string const& prefix, XvRecTrack track)
+{
+    return "/" + prefix + "." + xvrecTrackName(track);
+}
+
+ShmRingWriter::ShmRingWriter() : m_header(nullptr), m_slots(nullptr), m_size(0)
+{
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    close();
+}
+
+bool ShmRingWriter::create(std::string const& name, XvRecTrack track, std::uint32_t slotCount, std::size_t slotSize,
+                          unsigned mode)
+{
+    close();
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos || slotCount == 0) {
+        m_error = "invalid ring " + name;
+        return false;
+    }
+    // a segment left by a publisher that died: its readers keep their mapping, new ones get ours
+    ::shm_unlink(name.c_str());
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, static_cast<mode_t>(mode & 0777));
+    if (fd < 0) {
+        m_error = "shm_open " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    ::fchmod(fd, static_cast<mode_t>(mode & 0777)); // the mode asked for, whatever the umask
+    const std::size_t stride = alignUp(sizeof(ShmRingSlot) + slotSize, kSlotAlign);
+    const std::size_t size = kShmRingHeaderSize + stride * slotCount;
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        m_error = "ftruncate " + name + ": " + std::strerror(errno);
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        m_error = "mmap " + name + ": " + std::strerror(errno);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+
+    // the segment is zero filled: head, futex, waiters, closed and the slot sequences start at 0
+    m_header = static_cast<ShmRingHeader*>(p);
+    m_header->version = kShmRingVersion;
+    m_header->track = static_cast<std::uint16_t>(track);
+    m_header->slotCount = slotCount;
+    m_header->slotSize = stride - sizeof(ShmRingSlot);
+    m_header->slotStride = stride;
+    m_header->publisherPid = ::getpid();
+    m_header->magic.store(kShmRingMagic, std::memory_order_release);
+
+    m_slots = static_cast<std::uint8_t*>(p) + kShmRingHeaderSize;
+    m_size = size;
+    m_name = name;
+    m_error.clear();
+    return true;
+}
+
+void ShmRingWriter::close()
+{
+    if (!m_header) {
+        return;
+    }
+    m_header->closed.store(1);
+    m_header->futex.fetch_add(1);
+    futexWakeAll(&m_header->futex);
+    ::munmap(m_header, m_size);
+    ::shm_unlink(m_name.c_str());
+    m_header = nullptr;
+    m_slots = nullptr;
+    m_size = 0;
+}
+
+bool ShmRingWriter::publish(std::int64_t edgeTimestampUs, double hostTimestamp, XvRecWriter::Part const* parts, std::size_t partCount)
+{
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < partCount; ++i) {
+        size += parts[i].size;
+    }
+    if (!m_header || size > m_header->slotSize) {
+        return false;
+    }
+    const std::uint64_t n = m_header->head.load(std::memory_order_relaxed);
+    auto slot = reinterpret_cast<ShmRingSlot*>(m_slots + (n % m_header->slotCount) * m_header->slotStride);
+
+    slot->sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::uint8_t* out = reinterpret_cast<std::uint8_t*>(slot + 1);
+    for (std::size_t i = 0; i < partCount; ++i) {
+        if (parts[i].size) {
+            std::memcpy(out, parts[i].data, parts[i].size);
+            out += parts[i].size;
+        }
+    }
+    slot->edgeTimestampUs = edgeTimestampUs;
+    slot->hostTimestamp = hostTimestamp;
+    slot->size = static_cast<std::uint32_t>(size);
+    slot->sequence.store(2 * n + 2, std::memory_order_release);
+
+    m_header->head.store(n + 1, std::memory_order_release);
+    m_header->futex.store(static_cast<std::uint32_t>(n + 1));
+    if (m_header->waiters.load()) {
+        futexWakeAll(&m_header->futex);
+    }
+    return true;
+}
+
+ShmRingReader::ShmRingReader() : m_header(nullptr), m_slots(nullptr), m_next(0), m_overruns(0)
+{
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+bool ShmRingReader::open(std::string const& name)
+{
+    close();
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        m_error = "shm_open " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < kShmRingHeaderSize) {
+        m_error = name + ": not a ring (or not initialized yet)";
+        ::close(fd);
+        return false;
+    }
+    // header read-write (wait() registers there), slots read-only
+    void* h = ::mmap(nullptr, kShmRingHeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        m_error = "mmap " + name + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    auto header = static_cast<ShmRingHeader*>(h);
+    if (header->magic.load(std::memory_order_acquire) != kShmRingMagic || header->version != kShmRingVersion
+            || header->slotCount == 0 || header->slotStride < sizeof(ShmRingSlot) + header->slotSize
+            || kShmRingHeaderSize + header->slotStride * header->slotCount > static_cast<std::size_t>(st.st_size)) {
+        m_error = name + ": not a ring (or not initialized yet)";
+        ::munmap(h, kShmRingHeaderSize);
+        ::close(fd);
+        return false;
+    }
+    const std::size_t slotsSize = header->slotStride * header->slotCount;
+    void* s = ::mmap(nullptr, slotsSize, PROT_READ, MAP_SHARED, fd, kShmRingHeaderSize);
+    ::close(fd);
+    if (s == MAP_FAILED) {
+        m_error = "mmap " + name + ": " + std::strerror(errno);
+        ::munmap(h, kShmRingHeaderSize);
+        return false;
+    }
+
+    m_mapping = std::shared_ptr<const void>(s, [h, slotsSize](void const* q) {
+        ::munmap(const_cast<void*>(q), slotsSize);
+        ::munmap(h, kShmRingHeaderSize);
+    });
+    m_header = header;
+    m_slots = static_cast<std::uint8_t const*>(s);
+    m_next = header->head.load(std::memory_order_acquire);
+    m_overruns = 0;
+    m_error.clear();
+    return true;
+}
+
+void ShmRingReader::close()
+{
+    m_mapping.reset();
+    m_header = nullptr;
+    m_slots = nullptr;
+}
+
+bool ShmRingReader::read(std::uint64_t n, ShmFrame& frame)
+{
+    auto slot = reinterpret_cast<ShmRingSlot const*>(m_slots + (n % m_header->slotCount) * m_header->slotStride);
+    const std::uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * n + 2) {
+        return false;
+    }
+    frame.record.track = static_cast<XvRecTrack>(m_header->track);
+    frame.record.edgeTimestampUs = slot->edgeTimestampUs;
+    frame.record.hostTimestamp = slot->hostTimestamp;
+    frame.record.data = reinterpret_cast<std::uint8_t const*>(slot + 1);
+    frame.record.size = slot->size;
+    frame.sequence = n;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == sequence && frame.record.size <= m_header->slotSize;
+}
+
+bool ShmRingReader::next(ShmFrame& frame)
+{
+    if (!m_header) {
+        return false;
+    }
+    const std::uint64_t head = m_header->head.load(std::memory_order_acquire);
+    if (head - m_next > m_header->slotCount) {
+        m_overruns += head - m_header->slotCount - m_next;
+        m_next = head - m_header->slotCount;
+    }
+    while (m_next < head) {
+        // a failed read means the writer lapped us while reading
+        if (read(m_next++, frame)) {
+            return true;
+        }
+        ++m_overruns;
+    }
+    return false;
+}
+
+bool ShmRingReader::latest(ShmFrame& frame)
+{
+    if (!m_header) {
+        return false;
+    }
+    for (;;) {
+        const std::uint64_t head = m_header->head.load(std::memory_order_acquire);
+        if (head == m_next) {
+            return false;
+        }
+        if (read(head - 1, frame)) {
+            m_next = head;
+            return true;
+        }
+    }
+}
+
+bool ShmRingReader::valid(ShmFrame const& frame) const
+{
+    if (!m_header) {
+        return false;
+    }
+    auto slot = reinterpret_cast<ShmRingSlot const*>(m_slots + (frame.sequence % m_header->slotCount) * m_header->slotStride);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == 2 * frame.sequence + 2;
+}
+
+std::uint64_t ShmRingReader::pending() const
+{
+    if (!m_header) {
+        return 0;
+    }
+    const std::uint64_t head = m_header->head.load(std::memory_order_acquire);
+    return std::min<std::uint64_t>(head - m_next, m_header->slotCount);
+}
+
+bool ShmRingReader::wait(int timeoutMs)
+{
+    if (!m_header) {
+        return false;
+    }
+    if (pending()) {
+        return true;
+    }
+    if (closed()) {
+        return false;
+    }
+    m_header->waiters.fetch_add(1);
+    // the publisher stores futex before it reads waiters, we do the opposite: one of us sees the other
+    const std::uint32_t expected = m_header->futex.load();
+    if (expected == static_cast<std::uint32_t>(m_next)) {
+        futexWait(&m_header->futex, expected, timeoutMs);
+    }
+    m_header->waiters.fetch_sub(1);
+    return pending() > 0;
+}
+
+bool ShmRingReader::closed() const
+{
+    if (!m_header) {
+        return true;
+    }
+    return m_header->closed.load() || (::kill(static_cast<pid_t>(m_header->publisherPid), 0) != 0 && errno == ESRCH);
+}
+
+ShmPublisher::ShmPublisher(Options const& options) : m_options(options)
+{
+    for (int i = 0; i < kXvRecTrackCount; ++i) {
+        m_failed[i] = false;
+        m_published[i] = 0;
+        m_dropped[i] = 0;
+    }
+}
+
+ShmPublisher::~ShmPublisher()
+{
+    close();
+}
+
+bool ShmPublisher::append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp, Part const* parts, std::size_t partCount)
+{
+    const int i = static_cast<int>(track);
+    if (i <= 0 || i >= kXvRecTrackCount) {
+        return false;
+    }
+    ShmRingWriter& ring = m_rings[i];
+    if (!ring.isOpen() && !m_failed[i].load(std::memory_order_relaxed)) {
+        std::size_t size = 0;
+        for (std::size_t p = 0; p < partCount; ++p) {
+            size += parts[p].size;
+        }
+        // compressed depth varies with the scene (an empty first frame is tiny): slots fit the raw frame
+        if ((track == XvRecTrack::Depth || track == XvRecTrack::Sgbm) && partCount > 0 && parts[0].size == sizeof(XvRecImagePayload)) {
+            XvRecImagePayload const* head = static_cast<XvRecImagePayload const*>(parts[0].data);
+            if (head->type & kXvRecDepthCodec) {
+                size = std::max(size, sizeof(XvRecImagePayload) + static_cast<std::size_t>(head->width) * head->height * sizeof(std::uint16_t));
+            }
+        }
+        const bool small = track == XvRecTrack::Imu || track == XvRecTrack::Pose;
+        const std::size_t slotSize = std::max(kMinSlotSize, static_cast<std::size_t>(size * std::max(1., m_options.slotHeadroom)));
+        if (!ring.create(shmRingName(m_options.prefix, track), track, small ? m_options.smallSlots : m_options.imageSlots, slotSize, m_options.mode)) {
+            std::lock_guard<std::mutex> l(m_errorMtx);
+            m_error = ring.error();
+            m_failed[i] = true;
+        }
+    }
+    if (!ring.publish(edgeTimestampUs, hostTimestamp, parts, partCount)) {
+        m_dropped[i].fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_published[i].fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void ShmPublisher::close()
+{
+    for (auto& ring : m_rings) {
+        ring.close();
+    }
+}
+
+std::string ShmPublisher::error() const
+{
+    std::lock_guard<std::mutex> l(m_errorMtx);
+    return m_error;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "xvrec.h"
+
+/**
+ * @brief Device streams published to local processes through POSIX shared memory
+ *
+ * Every track has its own segment, `/<prefix>.<track name>` (e.g. /xvsdk.fisheye):
+ *
+ *     [ShmRingHeader, padded to 4096][slot 0][slot 1]...[slot slotCount - 1]
+ *
+ * A slot is a ShmRingSlot followed by up to `slotSize` payload bytes, laid out as in an
+ * xvrec file (see xvrec_xv.h), so xvrecAppend() publishes SDK types and xvrecDecode()
+ * rebuilds them on the reader side without copying the pixels.
+ *
+ * There is one writer per segment and any number of readers. The writer never takes a
+ * lock and never waits for readers: record n goes to slot n % slotCount, guarded by a
+ * per-slot sequence (seqlock). Readers keep their own cursor, detect overruns (records
+ * overwritten before they were read) and map the slots read-only.
+ */
+
+static const std::uint32_t kShmRingMagic = 0x4d485358; // "XSHM"
+static const std::uint32_t kShmRingVersion = 1;
+static const std::size_t kShmRingHeaderSize = 4096;
+
+struct ShmRingHeader
+{
+    std::atomic<std::uint32_t> magic; // written last by the publisher
+    std::uint32_t version;
+    std::uint16_t track;
+    std::uint16_t reserved;
+    std::uint32_t slotCount;
+    std::uint64_t slotSize;   // payload capacity of a slot
+    std::uint64_t slotStride; // ShmRingSlot + payload, 64-byte aligned
+    std::int64_t publisherPid;
+
+    alignas(64) std::atomic<std::uint64_t> head; // number of published records
+    std::atomic<std::uint32_t> futex;            // low 32 bits of head, readers wait on it
+    std::atomic<std::uint32_t> waiters;          // readers in wait()
+    std::atomic<std::uint32_t> closed;           // set by the publisher on close
+};
+
+struct ShmRingSlot
+{
+    std::atomic<std::uint64_t> sequence; // 2n + 1 while record n is written, 2n + 2 once published
+    std::int64_t edgeTimestampUs;
+    double hostTimestamp;
+    std::uint32_t size;
+    std::uint32_t reserved;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared memory rings need lock-free atomics");
+
+/// Segment name of `track`: "/<prefix>.<xvrecTrackName(track)>"
+std::string shmRingName(std::string const& prefix, XvRecTrack track);
+
+/**
+ * @brief Creates a ring segment and publishes records into it (one thread)
+ */
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    ShmRingWriter(ShmRingWriter const&) = delete;
+    ShmRingWriter& operator=(ShmRingWriter const&) = delete;
+
+    /**
+     * @brief Creates (or replaces) segment `name`. Returns false on error, see error().
+     * @param mode: permissions of the segment. Readers map the header read-write, so they need
+     *        read and write access: 0600 only lets the user of the publisher read the rings,
+     *        0660 its group as well.
+     */
+    bool create(std::string const& name, XvRecTrack track, std::uint32_t slotCount, std::size_t slotSize,
+                unsigned mode = 0600);
+    /// Marks the ring closed, wakes the readers and removes the segment name
+    void close();
+
+    /// Publishes the concatenation of `parts`, false if it does not fit in a slot
+    bool publish(std::int64_t edgeTimestampUs, double hostTimestamp, XvRecWriter::Part const* parts, std::size_t partCount);
+
+    bool isOpen() const { return m_header != nullptr; }
+    std::string const& name() const { return m_name; }
+    std::string const& error() const { return m_error; }
+    std::size_t slotSize() const { return m_header ? m_header->slotSize : 0; }
+    std::uint64_t published() const { return m_header ? m_header->head.load(std::memory_order_relaxed) : 0; }
+
+private:
+    ShmRingHeader* m_header;
+    std::uint8_t* m_slots;
+    std::size_t m_size;
+    std::string m_name;
+    std::string m_error;
+};
+
+/// One record of a ring, `record.data` points into the shared mapping
+struct ShmFrame
+{
+    XvRecRecord record;
+    std::uint64_t sequence; ///< index of the record in the stream
+};
+
+/**
+ * @brief Maps a ring segment and reads its records without copying them
+ *
+ * A frame returned by next() / latest() may be overwritten by the writer while it is used
+ * (the writer does not wait): check valid() after having consumed the data, a false result
+ * means it was torn and must be discarded.
+ *
+ * @code
+ * ShmRingReader reader;
+ * reader.open(shmRingName("xvsdk", XvRecTrack::Fisheye));
+ * ShmFrame f;
+ * while (reader.wait(100)) {
+ *     while (reader.next(f)) {
+ *         xv::FisheyeImages fe;
+ *         if (xvrecDecode(f.record, reader.mapping(), fe)) { ...; }
+ *         if (!reader.valid(f)) { ... discard the result ... }
+ *     }
+ * }
+ * @endcode
+ */
+class ShmRingReader
+{
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    ShmRingReader(ShmRingReader const&) = delete;
+    ShmRingReader& operator=(ShmRingReader const&) = delete;
+
+    /// Maps segment `name`, reading starts at the next published record
+    bool open(std::string const& name);
+    void close();
+
+    bool isOpen() const { return m_header != nullptr; }
+    std::string const& error() const { return m_error; }
+    XvRecTrack track() const { return static_cast<XvRecTrack>(m_header->track); }
+    std::uint32_t slotCount() const { return m_header->slotCount; }
+    std::size_t slotSize() const { return m_header->slotSize; }
+
+    /// Next unread record, false if none (or if it was overwritten while being read)
+    bool next(ShmFrame& frame);
+    /// Most recent record, skipping the unread ones (not counted as overruns)
+    bool latest(ShmFrame& frame);
+    /// false when the writer started overwriting `frame` since it was returned
+    bool valid(ShmFrame const& frame) const;
+
+    /// Waits up to `timeoutMs` for an unread record, false on timeout or when the ring is closed
+    bool wait(int timeoutMs);
+    /// Unread records in the ring
+    std::uint64_t pending() const;
+    /// Records lost because the writer lapped this reader
+    std::uint64_t overruns() const { return m_overruns; }
+    /// The publisher closed the ring or died: open() again to follow a new publisher
+    bool closed() const;
+
+    /// Keeps the segment mapped while payloads are referenced (e.g. by decoded xv images)
+    std::shared_ptr<const void> mapping() const { return m_mapping; }
+
+private:
+    bool read(std::uint64_t n, ShmFrame& frame);
+
+    std::shared_ptr<const void> m_mapping;
+    ShmRingHeader* m_header;
+    std::uint8_t const* m_slots;
+    std::uint64_t m_next;
+    std::uint64_t m_overruns;
+    std::string m_error;
+};
+
+/**
+ * @brief Publishes the device streams, one ring per track
+ *
+ * append() has the signature of XvRecWriter::append(), so the xvrecAppend() overloads of
+ * xvrec_xv.h publish the SDK types. The ring of a track is created by its first record,
+ * with slots of `slotHeadroom` times that record size (the raw frame size for depth
+ * compressed with the depth codec); larger records are dropped and counted. Records of one track must be appended from one thread at a time (SDK
+ * callbacks of a stream are), different tracks do not share any state.
+ */
+class ShmPublisher
+{
+public:
+    typedef XvRecWriter::Part Part;
+
+    struct Options
+    {
+        Options() : prefix("xvsdk"), imageSlots(8), smallSlots(1024), slotHeadroom(1.5), mode(0600) {}
+        std::string prefix;       ///< segment names are /<prefix>.<track>
+        std::uint32_t imageSlots; ///< slots of the image tracks
+        std::uint32_t smallSlots; ///< slots of Imu / Pose
+        double slotHeadroom;      ///< slot size / first record size (compressed images vary)
+        unsigned mode;            ///< permissions of the segments, see ShmRingWriter::create()
+    };
+
+    explicit ShmPublisher(Options const& options = Options());
+    ~ShmPublisher();
+
+    ShmPublisher(ShmPublisher const&) = delete;
+    ShmPublisher& operator=(ShmPublisher const&) = delete;
+
+    bool append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp, Part const* parts, std::size_t partCount);
+
+    bool append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp,
+                void const* head, std::size_t headSize, void const* body = nullptr, std::size_t bodySize = 0)
+    {
+        Part parts[2] = {{head, headSize}, {body, bodySize}};
+        return append(track, edgeTimestampUs, hostTimestamp, parts, 2);
+    }
+
+    /// Closes every ring, call once the callbacks are unregistered
+    void close();
+
+    Options const& options() const { return m_options; }
+    std::uint64_t published(XvRecTrack track) const { return m_published[static_cast<int>(track)].load(); }
+    std::uint64_t dropped(XvRecTrack track) const { return m_dropped[static_cast<int>(track)].load(); }
+    std::string error() const;
+
+private:
+    Options m_options;
+    ShmRingWriter m_rings[kXvRecTrackCount];
+    std::atomic<bool> m_failed[kXvRecTrackCount];
+    std::atomic<std::uint64_t> m_published[kXvRecTrackCount];
+    std::atomic<std::uint64_t> m_dropped[kXvRecTrackCount];
+    mutable std::mutex m_errorMtx; // failure path only
+    std::string m_error;
+};
@@ -0,0 +1,489 @@
+#include "slam_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "xvrec.h"
+
+namespace {
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+const double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * Decimal number at `p` ("-0.0012", "7.5e-05"), within one ulp of strtod for the 17-19
+ * significant digits of the dumps. Returns false if there is no digit.
+ */
+bool parseNumber(char const* p, char const* end, double& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    std::uint64_t mantissa = 0;
+    int digits = 0;   // significant digits in `mantissa`
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); ++p) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            ++p;
+        }
+        int e = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            e = std::min(e * 10 + (*p - '0'), 10000);
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+    double v = static_cast<double>(mantissa);
+    if (exponent >= 0) {
+        v *= exponent <= 22 ? kPow10[exponent] : std::pow(10., exponent);
+    } else {
+        v /= -exponent <= 22 ? kPow10[-exponent] : std::pow(10., -exponent);
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
+bool parseInteger(char const* p, char const* end, std::int64_t& value)
+{
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        ++p;
+    }
+    if (p == end || !isDigit(*p)) {
+        return false;
+    }
+    std::int64_t v = 0;
+    for (; p < end && isDigit(*p); ++p) {
+        v = v * 10 + (*p - '0');
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
+inline bool keyIs(char const* key, std::size_t size, const char* name)
+{
+    return std::memcmp(key, name, size) == 0;
+}
+
+/// Row major rotation matrix of the quaternion [x, y, z, w]
+void quaternionToMatrix(double const* q, double* r)
+{
+    const double x = q[0], y = q[1], z = q[2], w = q[3];
+    r[0] = 1 - 2 * (y * y + z * z); r[1] = 2 * (x * y - z * w);     r[2] = 2 * (x * z + y * w);
+    r[3] = 2 * (x * y + z * w);     r[4] = 1 - 2 * (x * x + z * z); r[5] = 2 * (y * z - x * w);
+    r[6] = 2 * (x * z - y * w);     r[7] = 2 * (y * z + x * w);     r[8] = 1 - 2 * (x * x + y * y);
+}
+
+/// Quaternion [x, y, z, w] of a row major rotation matrix, with w >= 0
+void matrixToQuaternion(double const* r, double* q)
+{
+    // largest of w, x, y, z first for the precision
+    const double trace = r[0] + r[4] + r[8];
+    if (trace > 0) {
+        const double s = std::sqrt(trace + 1) * 2;
+        q[0] = (r[7] - r[5]) / s;
+        q[1] = (r[2] - r[6]) / s;
+        q[2] = (r[3] - r[1]) / s;
+        q[3] = s / 4;
+    } else if (r[0] > r[4] && r[0] > r[8]) {
+        const double s = std::sqrt(1 + r[0] - r[4] - r[8]) * 2;
+        q[0] = s / 4;
+        q[1] = (r[1] + r[3]) / s;
+        q[2] = (r[2] + r[6]) / s;
+        q[3] = (r[7] - r[5]) / s;
+    } else if (r[4] > r[8]) {
+        const double s = std::sqrt(1 + r[4] - r[0] - r[8]) * 2;
+        q[0] = (r[1] + r[3]) / s;
+        q[1] = s / 4;
+        q[2] = (r[5] + r[7]) / s;
+        q[3] = (r[2] - r[6]) / s;
+    } else {
+        const double s = std::sqrt(1 + r[8] - r[0] - r[4]) * 2;
+        q[0] = (r[2] + r[6]) / s;
+        q[1] = (r[5] + r[7]) / s;
+        q[2] = s / 4;
+        q[3] = (r[3] - r[1]) / s;
+    }
+    if (q[3] < 0) {
+        for (int i = 0; i < 4; ++i) {
+            q[i] = -q[i];
+        }
+    }
+}
+
+void append(SlamTrajectory& trajectory, double timestamp, XvRecPosePayload const& p)
+{
+    double q[4];
+    matrixToQuaternion(p.rotation, q);
+    trajectory.timestamp.push_back(timestamp);
+    for (int k = 0; k < 3; ++k) {
+        trajectory.position[k].push_back(p.translation[k]);
+    }
+    for (int k = 0; k < 4; ++k) {
+        trajectory.orientation[k].push_back(q[k]);
+    }
+    trajectory.confidence.push_back(p.confidence);
+}
+
+bool loadXvRec(std::string const& filename, SlamTrajectory& trajectory, std::string* error)
+{
+    XvRecReader reader;
+    if (!reader.open(filename)) {
+        if (error) {
+            *error = reader.error();
+        }
+        return false;
+    }
+    const std::size_t n = reader.recordCount(XvRecTrack::Pose);
+    trajectory.reserve(trajectory.size() + n);
+    // the CPU usage column is kept only if a record has it (PoseLogger files)
+    const std::size_t cpuColumn = trajectory.cpuUsage.size();
+    bool cpu = false;
+    trajectory.cpuUsage.resize(trajectory.size(), std::numeric_limits<double>::quiet_NaN());
+    for (std::size_t i = 0; i < n; ++i) {
+        const XvRecRecord r = reader.record(XvRecTrack::Pose, i);
+        if (r.size < sizeof(XvRecPosePayload)) {
+            continue;
+        }
+        XvRecPosePayload p;
+        std::memcpy(&p, r.data, sizeof(p));
+        append(trajectory, r.hostTimestamp, p);
+        float cpuUsage = std::numeric_limits<float>::quiet_NaN();
+        if (r.size >= sizeof(p) + sizeof(cpuUsage)) {
+            std::memcpy(&cpuUsage, r.data + sizeof(p), sizeof(cpuUsage));
+            cpu = true;
+        }
+        trajectory.cpuUsage.push_back(cpuUsage);
+    }
+    if (!cpu) {
+        trajectory.cpuUsage.resize(cpuColumn);
+    }
+    return true;
+}
+
+} // namespace
+
+void SlamTrajectory::clear()
+{
+    timestamp.clear();
+    for (auto& c : position) {
+        c.clear();
+    }
+    for (auto& c : orientation) {
+        c.clear();
+    }
+    confidence.clear();
+    cpuUsage.clear();
+}
+
+void SlamTrajectory::reserve(std::size_t n)
+{
+    timestamp.reserve(n);
+    for (auto& c : position) {
+        c.reserve(n);
+    }
+    for (auto& c : orientation) {
+        c.reserve(n);
+    }
+    confidence.reserve(n);
+    cpuUsage.reserve(n);
+}
+
+void slamLogParse(char const* data, std::size_t size, SlamTrajectory& trajectory, std::size_t* skipped)
+{
+    // fields seen in the current record
+    enum
+    {
+        Confidence = 1 << 0,
+        Secs = 1 << 1,
+        Nsecs = 1 << 2,
+        Position = 1 << 3,    // 3 bits, x y z
+        Orientation = 1 << 6, // 4 bits, x y z w
+        Complete = (1 << 10) - 1,
+    };
+    enum Section { None, InPosition, InOrientation };
+
+    unsigned seen = 0;
+    Section section = None;
+    double confidence = 0, position[3] = {0, 0, 0}, orientation[4] = {0, 0, 0, 1};
+    std::int64_t secs = 0, nsecs = 0;
+    std::size_t incomplete = 0;
+
+    auto endRecord = [&] {
+        if (seen == Complete) {
+            trajectory.timestamp.push_back(secs + nsecs * 1e-9);
+            for (int k = 0; k < 3; ++k) {
+                trajectory.position[k].push_back(position[k]);
+            }
+            for (int k = 0; k < 4; ++k) {
+                trajectory.orientation[k].push_back(orientation[k]);
+            }
+            trajectory.confidence.push_back(confidence);
+        } else if (seen != 0) {
+            ++incomplete;
+        }
+        seen = 0;
+        section = None;
+    };
+
+    // ~390 bytes per record in the dumps, a guess is enough to avoid most reallocations
+    trajectory.reserve(trajectory.size() + size / 384 + 1);
+
+    char const* p = data;
+    char const* const end = data + size;
+    while (p < end) {
+        char const* eol = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        if (!eol) {
+            eol = end;
+        }
+        char const* key = p;
+        while (key < eol && (*key == ' ' || *key == '\t')) {
+            ++key;
+        }
+        char const* colon = static_cast<char const*>(std::memchr(key, ':', eol - key));
+        if (!colon) {
+            if (eol - key >= 3 && key[0] == '-' && key[1] == '-' && key[2] == '-') {
+                endRecord();
+            }
+        } else {
+            const std::size_t length = colon - key;
+            char const* value = colon + 1;
+            while (value < eol && *value == ' ') {
+                ++value;
+            }
+            double d;
+            switch (length) {
+            case 1: {
+                const int axis = key[0] == 'x' ? 0 : key[0] == 'y' ? 1 : key[0] == 'z' ? 2 : key[0] == 'w' ? 3 : -1;
+                if (axis < 0 || !parseNumber(value, eol, d)) {
+                    break;
+                }
+                if (section == InPosition && axis < 3) {
+                    position[axis] = d;
+                    seen |= Position << axis;
+                } else if (section == InOrientation) {
+                    orientation[axis] = d;
+                    seen |= Orientation << axis;
+                }
+                break;
+            }
+            case 4:
+                if (keyIs(key, length, "secs") && parseInteger(value, eol, secs)) {
+                    seen |= Secs;
+                }
+                break;
+            case 5:
+                if (keyIs(key, length, "nsecs") && parseInteger(value, eol, nsecs)) {
+                    seen |= Nsecs;
+                }
+                break;
+            case 8:
+                if (keyIs(key, length, "position")) {
+                    section = InPosition;
+                }
+                break;
+            case 10:
+                if (keyIs(key, length, "confidence")) {
+                    if (seen != 0) {
+                        endRecord(); // no "---" before this record
+                    }
+                    if (parseNumber(value, eol, confidence)) {
+                        seen |= Confidence;
+                    }
+                }
+                break;
+            case 11:
+                if (keyIs(key, length, "orientation")) {
+                    section = InOrientation;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        p = eol + 1;
+    }
+    endRecord();
+    if (skipped) {
+        *skipped = incomplete;
+    }
+}
+
+bool slamLogLoad(std::string const& filename, SlamTrajectory& trajectory, std::string* error)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (error) {
+            *error = "cannot open " + filename + ": " + std::strerror(errno);
+        }
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        if (error) {
+            *error = "cannot stat " + filename + ": " + std::strerror(errno);
+        }
+        return false;
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        if (error) {
+            *error = std::string("mmap failed: ") + std::strerror(errno);
+        }
+        return false;
+    }
+    std::unique_ptr<void, std::function<void(void*)>> unmap(mapping, [size](void* q) { ::munmap(q, size); });
+
+    std::uint32_t magic = 0;
+    std::memcpy(&magic, mapping, std::min(size, sizeof(magic)));
+    if (magic == kXvRecMagic) {
+        unmap.reset();
+        return loadXvRec(filename, trajectory, error);
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    slamLogParse(static_cast<char const*>(mapping), size, trajectory);
+    return true;
+}
+
+bool slamLogWriteXvRec(std::string const& filename, SlamTrajectory const& trajectory, std::string* error)
+{
+    XvRecWriter writer;
+    XvRecWriter::Options options;
+    options.waitWhenBehind = true;
+    if (!writer.open(filename, "slam trajectory", options)) {
+        if (error) {
+            *error = writer.error();
+        }
+        return false;
+    }
+    const bool cpu = !trajectory.cpuUsage.empty() && trajectory.cpuUsage.size() == trajectory.size();
+    double previous = -1;
+    for (std::size_t i = 0; i < trajectory.size(); ++i) {
+        const double t = trajectory.timestamp[i];
+        if (t <= previous) {
+            continue; // xvrec tracks are in time order
+        }
+        previous = t;
+        XvRecPosePayload p;
+        double q[4];
+        for (int k = 0; k < 3; ++k) {
+            p.translation[k] = trajectory.position[k][i];
+        }
+        for (int k = 0; k < 4; ++k) {
+            q[k] = trajectory.orientation[k][i];
+        }
+        quaternionToMatrix(q, p.rotation);
+        p.confidence = trajectory.confidence[i];
+        const float cpuUsage = cpu ? static_cast<float>(trajectory.cpuUsage[i]) : 0.f;
+        writer.append(XvRecTrack::Pose, static_cast<std::int64_t>(std::llround(t * 1e6)), t, &p, sizeof(p),
+                      cpu ? &cpuUsage : nullptr, cpu ? sizeof(cpuUsage) : 0);
+    }
+    if (!writer.close()) {
+        if (error) {
+            *error = writer.error();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool slamLogExport(std::string const& filename, SlamTrajectory const& t, SlamLogFormat format, std::string* error)
+{
+    FILE* f = std::fopen(filename.c_str(), "w");
+    if (!f) {
+        if (error) {
+            *error = "cannot create " + filename + ": " + std::strerror(errno);
+        }
+        return false;
+    }
+    const bool cpu = !t.cpuUsage.empty() && t.cpuUsage.size() == t.size();
+    if (format == SlamLogFormat::Csv) {
+        std::fprintf(f, cpu ? "timestamp,x,y,z,qx,qy,qz,qw,confidence,cpu_usage\n" : "timestamp,x,y,z,qx,qy,qz,qw,confidence\n");
+    }
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        const double q[4] = {t.orientation[0][i], t.orientation[1][i], t.orientation[2][i], t.orientation[3][i]};
+        switch (format) {
+        case SlamLogFormat::Csv:
+            std::fprintf(f, "%.9f,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%g", t.timestamp[i],
+                         t.position[0][i], t.position[1][i], t.position[2][i], q[0], q[1], q[2], q[3], t.confidence[i]);
+            if (cpu && !std::isnan(t.cpuUsage[i])) {
+                std::fprintf(f, ",%.1f\n", t.cpuUsage[i]);
+            } else {
+                std::fprintf(f, cpu ? ",\n" : "\n");
+            }
+            break;
+        case SlamLogFormat::Tum:
+            std::fprintf(f, "%.9f %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n", t.timestamp[i],
+                         t.position[0][i], t.position[1][i], t.position[2][i], q[0], q[1], q[2], q[3]);
+            break;
+        case SlamLogFormat::Kitti: {
+            double r[9];
+            quaternionToMatrix(q, r);
+            std::fprintf(f, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                         r[0], r[1], r[2], t.position[0][i], r[3], r[4], r[5], t.position[1][i],
+                         r[6], r[7], r[8], t.position[2][i]);
+            break;
+        }
+        }
+    }
+    if (std::fclose(f) != 0) {
+        if (error) {
+            *error = "write failed: " + std::string(std::strerror(errno));
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief SLAM trajectory stored column by column (one vector per field)
+ *
+ * Loaded from the ROS style pose dumps of data/slam_data.txt (`rostopic echo` of a
+ * PoseStamped with its confidence: "confidence:", "secs:", "nsecs:", "x:" ... records
+ * separated by "---") or from the Pose track of an xvrec file (record, PoseLogger).
+ */
+struct SlamTrajectory
+{
+    std::size_t size() const { return timestamp.size(); }
+    void clear();
+    void reserve(std::size_t n);
+
+    std::vector<double> timestamp;      ///< header.stamp, seconds
+    std::vector<double> position[3];
+    std::vector<double> orientation[4]; ///< quaternion [x, y, z, w]
+    std::vector<double> confidence;
+    /// CPU usage of the process (% of one core) per pose, NaN if unknown. Only filled by
+    /// xvrec files written by PoseLogger, empty otherwise.
+    std::vector<double> cpuUsage;
+};
+
+/**
+ * @brief Parses a ROS style pose dump held in memory
+ *
+ * Single pass over the buffer, no allocation besides the growth of the columns and no
+ * null terminator needed (the buffer may be a file mapping). Records missing a field are
+ * skipped and counted in `skipped`. Poses are appended to `trajectory`.
+ */
+void slamLogParse(char const* data, std::size_t size, SlamTrajectory& trajectory, std::size_t* skipped = nullptr);
+
+/**
+ * @brief Loads a trajectory from a pose dump or an xvrec file (memory mapped)
+ *
+ * The format is detected from the content. Orientations read from xvrec files are rebuilt
+ * from the stored rotation matrix (same rotation, w >= 0).
+ * Returns false and fills `error` on failure.
+ */
+bool slamLogLoad(std::string const& filename, SlamTrajectory& trajectory, std::string* error = nullptr);
+
+/**
+ * @brief Writes `trajectory` as the Pose track of an xvrec file
+ *
+ * This is the binary form of the dump: the same records as `record` writes, indexed by time,
+ * reloaded by slamLogLoad() through a mapping instead of parsing the text again, and playable
+ * by `replay`. The CPU usage column, when filled, follows each pose as in PoseLogger files.
+ * Poses whose timestamp does not increase are skipped.
+ */
+bool slamLogWriteXvRec(std::string const& filename, SlamTrajectory const& trajectory, std::string* error = nullptr);
+
+enum class SlamLogFormat
+{
+    Csv,   ///< timestamp,x,y,z,qx,qy,qz,qw,confidence[,cpu_usage] with a header line
+    Tum,   ///< TUM RGB-D benchmark: "timestamp tx ty tz qx qy qz qw"
+    Kitti, ///< KITTI odometry: the 3x4 [R|t] matrix row by row, no timestamp
+};
+
+/// Writes `trajectory` as text in `format`, returns false and fills `error` on failure
+bool slamLogExport(std::string const& filename, SlamTrajectory const& trajectory, SlamLogFormat format,
+                   std::string* error = nullptr);
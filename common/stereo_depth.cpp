@@ -0,0 +1,254 @@
+#include "stereo_depth.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// bands smaller than this cost more in margins than they gain in parallelism
+const int kMinBandRows = 32;
+
+/// Projects a ray of the camera frame into the raw image
+void project(StereoRig::Camera const& cam, double x, double y, double z, float& u, float& v)
+{
+    if (cam.unified) {
+        const double d = std::sqrt(x * x + y * y + z * z);
+        const double w = z + cam.xi * d;
+        if (w <= 1e-9) {
+            u = v = -1.f;
+            return;
+        }
+        u = static_cast<float>(cam.fx * x / w + cam.u0);
+        v = static_cast<float>(cam.fy * y / w + cam.v0);
+        return;
+    }
+    if (z <= 1e-9) {
+        u = v = -1.f;
+        return;
+    }
+    const double a = x / z, b = y / z;
+    const double k1 = cam.distortion[0], k2 = cam.distortion[1], p1 = cam.distortion[2], p2 = cam.distortion[3], k3 = cam.distortion[4];
+    const double r2 = a * a + b * b;
+    const double radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    const double xd = a * radial + 2 * p1 * a * b + p2 * (r2 + 2 * a * a);
+    const double yd = b * radial + p1 * (r2 + 2 * b * b) + 2 * p2 * a * b;
+    u = static_cast<float>(cam.fx * xd + cam.u0);
+    v = static_cast<float>(cam.fy * yd + cam.v0);
+}
+
+cv::Mat cameraMatrix(StereoRig::Camera const& cam)
+{
+    cv::Mat k = cv::Mat::zeros(3, 3, CV_64F);
+    k.at<double>(0, 0) = cam.fx;
+    k.at<double>(1, 1) = cam.fy;
+    k.at<double>(0, 2) = cam.u0;
+    k.at<double>(1, 2) = cam.v0;
+    k.at<double>(2, 2) = 1;
+    return k;
+}
+
+} // namespace
+
+StereoRig stereoRigRectified(cv::Size size, double f, double cx, double cy, double baseline)
+{
+    StereoRig rig;
+    rig.size = size;
+    rig.rectified = true;
+    for (auto& cam : rig.camera) {
+        cam.fx = cam.fy = f;
+        cam.u0 = cx;
+        cam.v0 = cy;
+    }
+    rig.T[0] = -baseline;
+    return rig;
+}
+
+StereoDepthEngine::StereoDepthEngine(StereoRig const& rig, Options const& options)
+    : m_options(options), m_size(rig.size), m_rectify(!rig.rectified), m_f(0), m_cx(0), m_cy(0), m_baseline(0)
+{
+    if (m_rectify) {
+        buildMaps(rig);
+    } else {
+        m_f = rig.camera[0].fx;
+        m_cx = rig.camera[0].u0;
+        m_cy = rig.camera[0].v0;
+        m_baseline = std::fabs(rig.T[0]);
+    }
+    m_xScale.resize(m_size.width);
+    for (int u = 0; u < m_size.width; ++u) {
+        m_xScale[u] = static_cast<float>((u - m_cx) / m_f);
+    }
+
+    int bands = options.bands > 0 ? options.bands : std::max(1, cv::getNumThreads());
+    bands = std::max(1, std::min(bands, m_size.height / kMinBandRows));
+    const int rows = (m_size.height + bands - 1) / bands;
+    const int margin = options.bandMargin + options.blockSize / 2;
+    for (int y0 = 0; y0 < m_size.height; y0 += rows) {
+        Band b;
+        b.y0 = y0;
+        b.y1 = std::min(y0 + rows, m_size.height);
+        b.m0 = std::max(0, b.y0 - margin);
+        b.m1 = std::min(m_size.height, b.y1 + margin);
+        const int channels = 1;
+        b.sgbm = cv::StereoSGBM::create(0, options.numDisparities, options.blockSize,
+                                        8 * channels * options.blockSize * options.blockSize,
+                                        32 * channels * options.blockSize * options.blockSize,
+                                        options.disp12MaxDiff, options.preFilterCap, options.uniquenessRatio,
+                                        options.speckleWindowSize, options.speckleRange, options.mode);
+        if (m_rectify) {
+            b.rectLeft.create(b.m1 - b.m0, m_size.width, CV_8UC1);
+            b.rectRight.create(b.m1 - b.m0, m_size.width, CV_8UC1);
+        }
+        b.disparity16.create(b.m1 - b.m0, m_size.width, CV_16SC1);
+        b.valid = 0;
+        m_bands.push_back(b);
+    }
+
+    if (m_rectify) {
+        m_rectLeft.create(m_size, CV_8UC1);
+    }
+    m_disparity.create(m_size, CV_32FC1);
+    m_depth.create(m_size, CV_32FC1);
+    if (options.pointCloud) {
+        m_points.create(m_size, CV_32FC3);
+    }
+}
+
+void StereoDepthEngine::buildMaps(StereoRig const& rig)
+{
+    // rectifying rotations and the common pinhole from OpenCV; the lens models are applied
+    // below so UCM fisheyes work too (the distortion given to stereoRectify is zero)
+    cv::Mat k[2] = {cameraMatrix(rig.camera[0]), cameraMatrix(rig.camera[1])};
+    cv::Mat noDistortion = cv::Mat::zeros(1, 5, CV_64F);
+    cv::Mat r(3, 3, CV_64F), t(3, 1, CV_64F);
+    for (int i = 0; i < 9; ++i) {
+        r.at<double>(i / 3, i % 3) = rig.R[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        t.at<double>(i, 0) = rig.T[i];
+    }
+    cv::Mat rect[2], proj[2], q;
+    cv::stereoRectify(k[0], noDistortion, k[1], noDistortion, rig.size, r, t, rect[0], rect[1], proj[0], proj[1], q,
+                      cv::CALIB_ZERO_DISPARITY, 0, rig.size);
+    m_f = proj[0].at<double>(0, 0);
+    m_cx = proj[0].at<double>(0, 2);
+    m_cy = proj[0].at<double>(1, 2);
+    m_baseline = std::fabs(proj[1].at<double>(0, 3) / proj[1].at<double>(0, 0));
+
+    cv::Mat mapX(rig.size, CV_32FC1), mapY(rig.size, CV_32FC1);
+    for (int i = 0; i < 2; ++i) {
+        cv::Mat const& ri = rect[i];
+        const double fx = proj[i].at<double>(0, 0), fy = proj[i].at<double>(1, 1);
+        const double cx = proj[i].at<double>(0, 2), cy = proj[i].at<double>(1, 2);
+        double rt[9]; // ri transposed: rectified ray -> camera ray
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                rt[a * 3 + b] = ri.at<double>(b, a);
+            }
+        }
+        for (int v = 0; v < rig.size.height; ++v) {
+            float* mx = mapX.ptr<float>(v);
+            float* my = mapY.ptr<float>(v);
+            const double yn = (v - cy) / fy;
+            for (int u = 0; u < rig.size.width; ++u) {
+                const double xn = (u - cx) / fx;
+                const double x = rt[0] * xn + rt[1] * yn + rt[2];
+                const double y = rt[3] * xn + rt[4] * yn + rt[5];
+                const double z = rt[6] * xn + rt[7] * yn + rt[8];
+                project(rig.camera[i], x, y, z, mx[u], my[u]);
+            }
+        }
+        // fixed point maps: remap takes the integer + interpolation table path
+        cv::convertMaps(mapX, mapY, m_map1[i], m_map2[i], CV_16SC2);
+    }
+}
+
+bool StereoDepthEngine::compute(cv::Mat const& left, cv::Mat const& right)
+{
+    if (left.size() != m_size || right.size() != m_size || left.type() != right.type()) {
+        return false;
+    }
+    if (left.type() == CV_8UC3) {
+        cv::cvtColor(left, m_grayLeft, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(right, m_grayRight, cv::COLOR_BGR2GRAY);
+    } else if (left.type() == CV_8UC1) {
+        m_grayLeft = left;
+        m_grayRight = right;
+    } else {
+        return false;
+    }
+    if (!m_rectify) {
+        m_rectLeft = m_grayLeft;
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(m_bands.size())), [this](cv::Range const& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            processBand(m_bands[i]);
+        }
+    });
+    return true;
+}
+
+void StereoDepthEngine::processBand(Band& b)
+{
+    if (m_rectify) {
+        for (int i = 0; i < 2; ++i) {
+            cv::remap(i == 0 ? m_grayLeft : m_grayRight, i == 0 ? b.rectLeft : b.rectRight,
+                      m_map1[i].rowRange(b.m0, b.m1), m_map2[i].rowRange(b.m0, b.m1),
+                      cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+        }
+        cv::Mat rows = m_rectLeft.rowRange(b.y0, b.y1);
+        b.rectLeft.rowRange(b.y0 - b.m0, b.y1 - b.m0).copyTo(rows);
+    } else {
+        b.rectLeft = m_grayLeft.rowRange(b.m0, b.m1);
+        b.rectRight = m_grayRight.rowRange(b.m0, b.m1);
+    }
+
+    b.sgbm->compute(b.rectLeft, b.rectRight, b.disparity16);
+
+    // one pass: fixed point disparity -> disparity, depth and points of the band's own rows
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float fb = static_cast<float>(m_f * m_baseline);
+    const float minDisparity16 = m_options.minDisparity * 16.f;
+    const float maxDisparity16 = m_options.maxDisparity * 16.f;
+    const int width = m_size.width;
+    const bool points = m_options.pointCloud;
+    std::size_t valid = 0;
+    for (int v = b.y0; v < b.y1; ++v) {
+        std::int16_t const* d16 = b.disparity16.ptr<std::int16_t>(v - b.m0);
+        float* disparity = m_disparity.ptr<float>(v);
+        float* depth = m_depth.ptr<float>(v);
+        float* xyz = points ? m_points.ptr<float>(v) : nullptr;
+        const float yScale = static_cast<float>((v - m_cy) / m_f);
+        for (int u = 0; u < width; ++u) {
+            if (d16[u] > minDisparity16 && d16[u] < maxDisparity16) {
+                const float d = d16[u] * (1.f / 16.f);
+                const float z = fb / d;
+                disparity[u] = d;
+                depth[u] = z;
+                if (points) {
+                    xyz[3 * u] = m_xScale[u] * z;
+                    xyz[3 * u + 1] = yScale * z;
+                    xyz[3 * u + 2] = z;
+                }
+                ++valid;
+            } else {
+                disparity[u] = 0.f;
+                depth[u] = 0.f;
+                if (points) {
+                    xyz[3 * u] = xyz[3 * u + 1] = xyz[3 * u + 2] = nan;
+                }
+            }
+        }
+    }
+    b.valid = valid;
+}
+
+std::size_t StereoDepthEngine::validPoints() const
+{
+    std::size_t n = 0;
+    for (auto const& b : m_bands) {
+        n += b.valid;
+    }
+    return n;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Intrinsics and extrinsics of a stereo pair
+ *
+ * Each camera is either a unified camera model (xvsdk `ucm`, fisheye) or a pinhole with
+ * polynomial distortion (xvsdk `pdcm`, k1 k2 p1 p2 k3). `R`, `T` map points of the left
+ * camera into the right one (OpenCV stereoRectify convention).
+ */
+struct StereoRig
+{
+    struct Camera
+    {
+        Camera() : unified(false), fx(0), fy(0), u0(0), v0(0), xi(0) { for (double& d : distortion) d = 0; }
+        bool unified; ///< true: UCM (xi used), false: pinhole + distortion
+        double fx, fy, u0, v0;
+        double xi;
+        double distortion[5];
+    };
+
+    StereoRig() : rectified(false) { for (double& r : R) r = 0; R[0] = R[4] = R[8] = 1; for (double& t : T) t = 0; }
+
+    cv::Size size;
+    Camera camera[2];
+    double R[9]; ///< row major
+    double T[3]; ///< meters
+    bool rectified; ///< images are already rectified, only camera[0] and T[0] are used
+};
+
+/// Rig for already rectified images (e.g. the data/ samples): focal, principal point, baseline (m)
+StereoRig stereoRigRectified(cv::Size size, double f, double cx, double cy, double baseline);
+
+/**
+ * @brief Rig from the two fisheye calibrations of the device
+ *
+ * Works with `xv::Calibration` (`fisheyeCameras()->calibration()`) and `xv::CalibrationEx`
+ * (`FisheyeCamerasEx::calibrationEx()`): the UCM model is used when present, PDCM otherwise.
+ * The calibration poses map camera coordinates into the device (IMU) frame.
+ */
+template <class Calibration>
+StereoRig stereoRigFromCalibration(std::vector<Calibration> const& calibrations)
+{
+    StereoRig rig;
+    if (calibrations.size() < 2) {
+        return rig;
+    }
+    for (int i = 0; i < 2; ++i) {
+        Calibration const& c = calibrations[i];
+        StereoRig::Camera& cam = rig.camera[i];
+        if (!c.ucm.empty()) {
+            auto const& m = c.ucm[0];
+            cam.unified = true;
+            cam.fx = m.fx; cam.fy = m.fy; cam.u0 = m.u0; cam.v0 = m.v0; cam.xi = m.xi;
+            rig.size = cv::Size(m.w, m.h);
+        } else if (!c.pdcm.empty()) {
+            auto const& m = c.pdcm[0];
+            cam.fx = m.fx; cam.fy = m.fy; cam.u0 = m.u0; cam.v0 = m.v0;
+            for (int k = 0; k < 5; ++k) {
+                cam.distortion[k] = m.distor[k];
+            }
+            rig.size = cv::Size(m.w, m.h);
+        }
+    }
+    // X_right = Rr^T (Rl X_left + tl - tr)
+    auto const& rl = calibrations[0].pose.rotation();
+    auto const& rr = calibrations[1].pose.rotation();
+    auto const& tl = calibrations[0].pose.translation();
+    auto const& tr = calibrations[1].pose.translation();
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            double s = 0;
+            for (int k = 0; k < 3; ++k) {
+                s += rr[k * 3 + r] * rl[k * 3 + c];
+            }
+            rig.R[r * 3 + c] = s;
+        }
+        double s = 0;
+        for (int k = 0; k < 3; ++k) {
+            s += rr[k * 3 + r] * (tl[k] - tr[k]);
+        }
+        rig.T[r] = s;
+    }
+    return rig;
+}
+
+/**
+ * @brief Host side stereo depth: rectification, SGBM, disparity -> depth -> point cloud
+ *
+ * Everything that depends only on the rig is done once in the constructor: the rectifying
+ * remap tables (fixed point, for the fast cv::remap path) and the reprojection constants.
+ * compute() splits the image into row bands (overlapping by a margin so the SGBM paths and
+ * the block window see their neighbours) and runs remap, SGBM, depth and point cloud of
+ * each band in parallel, each band with its own matcher. All outputs are preallocated and
+ * reused: the returned references stay valid and keep their buffers across frames.
+ *
+ * @code
+ * StereoDepthEngine engine(stereoRigFromCalibration(device->fisheyeCameras()->calibration()));
+ * device->fisheyeCameras()->registerCallback([&](xv::FisheyeImages const& fe){
+ *     if (engine.computeFisheye(fe)) use(engine.depth(), engine.pointCloud());
+ * });
+ * @endcode
+ */
+class StereoDepthEngine
+{
+public:
+    struct Options
+    {
+        Options()
+            : numDisparities(96), blockSize(9), uniquenessRatio(10), speckleWindowSize(100), speckleRange(32),
+              disp12MaxDiff(1), preFilterCap(63), mode(cv::StereoSGBM::MODE_SGBM), minDisparity(10.f),
+              maxDisparity(96.f), bands(0), bandMargin(16), pointCloud(true)
+        {
+        }
+        int numDisparities;   ///< multiple of 16
+        int blockSize;        ///< odd
+        int uniquenessRatio;
+        int speckleWindowSize;
+        int speckleRange;
+        int disp12MaxDiff;
+        int preFilterCap;
+        int mode;             ///< cv::StereoSGBM::MODE_*
+        float minDisparity;   ///< disparities <= this (px) are invalid (too far / noise)
+        float maxDisparity;   ///< disparities >= this (px) are invalid (too close)
+        int bands;            ///< row bands processed in parallel, 0: cv::getNumThreads()
+        int bandMargin;       ///< extra rows matched above / below each band
+        bool pointCloud;      ///< also fill pointCloud()
+    };
+
+    explicit StereoDepthEngine(StereoRig const& rig, Options const& options = Options());
+
+    StereoDepthEngine(StereoDepthEngine const&) = delete;
+    StereoDepthEngine& operator=(StereoDepthEngine const&) = delete;
+
+    /// 8-bit gray or BGR images of rig.size, not modified. Returns false on size mismatch.
+    bool compute(cv::Mat const& left, cv::Mat const& right);
+
+    /// xv::FisheyeImages (raw or from registerAntiDistortionCallback), images are not copied
+    template <class FisheyeImages>
+    bool computeFisheye(FisheyeImages const& fe)
+    {
+        if (fe.images.size() < 2 || !fe.images[0].data || !fe.images[1].data) {
+            return false;
+        }
+        auto const& l = fe.images[0];
+        auto const& r = fe.images[1];
+        cv::Mat left(static_cast<int>(l.height), static_cast<int>(l.width), CV_8UC1, const_cast<unsigned char*>(l.data.get()));
+        cv::Mat right(static_cast<int>(r.height), static_cast<int>(r.width), CV_8UC1, const_cast<unsigned char*>(r.data.get()));
+        return compute(left, right);
+    }
+
+    cv::Size size() const { return m_size; }
+    int bands() const { return static_cast<int>(m_bands.size()); }
+
+    /// Rectified left image (CV_8UC1)
+    cv::Mat const& rectifiedLeft() const { return m_rectLeft; }
+    /// Disparity in pixels (CV_32FC1), 0 where invalid
+    cv::Mat const& disparity() const { return m_disparity; }
+    /// Depth along the optical axis of the rectified left camera in meters (CV_32FC1), 0 where invalid
+    cv::Mat const& depth() const { return m_depth; }
+    /// Organized point cloud (CV_32FC3, x y z in meters, rectified left camera), NaN where invalid
+    cv::Mat const& pointCloud() const { return m_points; }
+    /// Valid points of the last compute()
+    std::size_t validPoints() const;
+
+    /// Rectified intrinsics (left) and baseline
+    double focal() const { return m_f; }
+    double cx() const { return m_cx; }
+    double cy() const { return m_cy; }
+    double baseline() const { return m_baseline; }
+
+private:
+    struct Band
+    {
+        int y0, y1;          ///< output rows [y0, y1)
+        int m0, m1;          ///< matched rows [m0, m1) including the margins
+        cv::Ptr<cv::StereoSGBM> sgbm;
+        cv::Mat rectLeft, rectRight; ///< rows [m0, m1) of the rectified images
+        cv::Mat disparity16; ///< CV_16S, fixed point 1/16
+        std::size_t valid;
+    };
+
+    void buildMaps(StereoRig const& rig);
+    void processBand(Band& band);
+
+    Options m_options;
+    cv::Size m_size;
+    bool m_rectify;
+    cv::Mat m_map1[2], m_map2[2]; ///< CV_16SC2 + CV_16UC1 per camera
+    double m_f, m_cx, m_cy, m_baseline;
+    std::vector<float> m_xScale; ///< (u - cx) / f per column
+
+    std::vector<Band> m_bands;
+    cv::Mat m_grayLeft, m_grayRight; ///< converted inputs, or headers on gray inputs
+    cv::Mat m_rectLeft;
+    cv::Mat m_disparity, m_depth, m_points;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Rate / jitter / latency / drop statistics of a data stream (replaces FpsCount and FrequencyCounter)
+ *
+ * Call tic() from the stream callback (one writer thread), read the results from any
+ * thread without locking. tic() is O(1) amortized and never allocates: arrival times are
+ * kept in a fixed ring covering the last `windowSeconds`.
+ *
+ *  - fps(): frames in the window / window span
+ *  - jitterMs(): smoothed deviation of the inter-arrival time (RFC 3550 style)
+ *  - latencyMs(p): percentile of host arrival time - frame `hostTimestamp`, from a
+ *    log-linear histogram that is halved every 65536 samples so it follows recent data
+ *  - dropped(): frames missing in the sequence, detected as gaps in the device
+ *    (`edgeTimestampUs`) or host timeline longer than 1.5 times the usual period
+ */
+class StreamStats
+{
+public:
+    explicit StreamStats(double windowSeconds = 1.1)
+        : m_windowNs(static_cast<std::int64_t>(windowSeconds * 1e9))
+    {
+        reset();
+    }
+
+    StreamStats(StreamStats const&) = delete;
+    StreamStats& operator=(StreamStats const&) = delete;
+
+    /// New frame without timestamps, only the arrival time is used
+    void tic()
+    {
+        const std::int64_t now = nowNs();
+        arrival(now);
+        sequence(now / 1000);
+    }
+
+    /// New frame with its host timestamp (s, xv host clock), also measures the latency
+    void tic(double hostTimestamp)
+    {
+        const std::int64_t now = nowNs();
+        arrival(now);
+        latency(now, hostTimestamp);
+        sequence(now / 1000);
+    }
+
+    /// New frame with its device and host timestamps, drops are detected on the device clock
+    void tic(std::int64_t edgeTimestampUs, double hostTimestamp)
+    {
+        const std::int64_t now = nowNs();
+        arrival(now);
+        latency(now, hostTimestamp);
+        sequence(edgeTimestampUs > 0 ? edgeTimestampUs : now / 1000);
+    }
+
+    /// Frames per second over the window
+    double fps() const { return m_fps.load(std::memory_order_relaxed); }
+    /// Number of tic() since the last reset
+    unsigned long long count() const { return m_count.load(std::memory_order_relaxed); }
+    /// Smoothed inter-arrival jitter (ms)
+    double jitterMs() const { return m_jitterUs.load(std::memory_order_relaxed) * 1e-3; }
+    /// Frames detected as missing since the last reset
+    unsigned long long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Latency percentile (ms)
+     * @param percentile: in [0,100], e.g. 50 or 99
+     * @return -1 if no frame was received with a host timestamp
+     */
+    double latencyMs(double percentile) const
+    {
+        std::uint64_t counts[kBuckets];
+        std::uint64_t total = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            counts[b] = m_histogram[b].load(std::memory_order_relaxed);
+            total += counts[b];
+        }
+        if (total == 0) {
+            return -1;
+        }
+        const double rank = percentile / 100.0 * static_cast<double>(total);
+        std::uint64_t cumulated = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            cumulated += counts[b];
+            if (static_cast<double>(cumulated) >= rank && counts[b] > 0) {
+                return bucketMidUs(b) * 1e-3;
+            }
+        }
+        return bucketMidUs(kBuckets - 1) * 1e-3;
+    }
+
+    /// One line summary for logs, e.g. "30fps jitter=0.41ms latency p50=12.1ms p99=20.3ms dropped=0"
+    std::string summary() const
+    {
+        char s[160];
+        double p50 = latencyMs(50);
+        if (p50 < 0) {
+            std::snprintf(s, sizeof(s), "%.0ffps jitter=%.2fms dropped=%llu", fps(), jitterMs(), dropped());
+        } else {
+            std::snprintf(s, sizeof(s), "%.0ffps jitter=%.2fms latency p50=%.2fms p99=%.2fms dropped=%llu",
+                          fps(), jitterMs(), p50, latencyMs(99), dropped());
+        }
+        return std::string(s);
+    }
+
+    /// Not thread safe with respect to tic()
+    void reset()
+    {
+        m_head = 0;
+        m_tail = 0;
+        m_lastArrivalNs = 0;
+        m_lastSeqUs = 0;
+        m_periodUs = 0;
+        m_periodSamples = 0;
+        m_latencySamples = 0;
+        m_fps.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_jitterUs.store(0, std::memory_order_relaxed);
+        m_dropped.store(0, std::memory_order_relaxed);
+        for (auto& h : m_histogram) {
+            h.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static const std::size_t kRing = 2048; // > 1.1s of a 1kHz IMU
+    // latency buckets: 8 per power of two, 0us to ~4min
+    static const int kSubBuckets = 8;
+    static const int kBuckets = 26 * kSubBuckets;
+    static const std::uint64_t kHistogramDecay = 65536;
+
+    static std::int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int bucketOf(std::uint64_t us)
+    {
+        if (us < kSubBuckets) {
+            return static_cast<int>(us);
+        }
+        int exponent = 63 - clz64(us); // >= 3
+        int sub = static_cast<int>((us >> (exponent - 3)) & (kSubBuckets - 1));
+        int b = (exponent - 2) * kSubBuckets + sub;
+        return b < kBuckets ? b : kBuckets - 1;
+    }
+
+    static double bucketMidUs(int b)
+    {
+        if (b < kSubBuckets) {
+            return b;
+        }
+        int exponent = b / kSubBuckets + 2;
+        int sub = b % kSubBuckets;
+        double low = std::ldexp(static_cast<double>(kSubBuckets + sub), exponent - 3);
+        return low + std::ldexp(0.5, exponent - 3);
+    }
+
+    static int clz64(std::uint64_t v)
+    {
+#if defined(__GNUC__)
+        return __builtin_clzll(v);
+#else
+        int n = 0;
+        for (std::uint64_t bit = 1ull << 63; !(v & bit); bit >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    void arrival(std::int64_t now)
+    {
+        m_ring[m_head % kRing] = now;
+        ++m_head;
+        if (m_head - m_tail > kRing) {
+            m_tail = m_head - kRing;
+        }
+        while (now - m_ring[m_tail % kRing] > m_windowNs) {
+            ++m_tail;
+        }
+        const std::size_t size = m_head - m_tail;
+        const std::int64_t span = now - m_ring[m_tail % kRing];
+        m_fps.store(size > 2 && span > 0 ? 1e9 * static_cast<double>(size - 1) / span : 0.0, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        if (m_lastArrivalNs != 0 && m_periodUs > 0) {
+            double d = std::fabs((now - m_lastArrivalNs) * 1e-3 - m_periodUs);
+            double j = m_jitterUs.load(std::memory_order_relaxed);
+            m_jitterUs.store(j + (d - j) / 16.0, std::memory_order_relaxed);
+        }
+        m_lastArrivalNs = now;
+    }
+
+    void latency(std::int64_t now, double hostTimestamp)
+    {
+        double us = now * 1e-3 - hostTimestamp * 1e6;
+        m_histogram[bucketOf(us > 0 ? static_cast<std::uint64_t>(us) : 0)].fetch_add(1, std::memory_order_relaxed);
+        if (++m_latencySamples % kHistogramDecay == 0) {
+            for (auto& h : m_histogram) {
+                h.store(h.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void sequence(std::int64_t us)
+    {
+        if (m_lastSeqUs != 0 && us > m_lastSeqUs) {
+            const double dt = static_cast<double>(us - m_lastSeqUs);
+            if (m_periodSamples >= 8 && dt > 1.5 * m_periodUs) {
+                m_dropped.fetch_add(static_cast<unsigned long long>(std::lround(dt / m_periodUs)) - 1, std::memory_order_relaxed);
+            } else {
+                // slow EWMA of the nominal period, gaps are kept out of it
+                m_periodUs = m_periodSamples == 0 ? dt : m_periodUs + (dt - m_periodUs) / 32.0;
+                ++m_periodSamples;
+            }
+        }
+        m_lastSeqUs = us;
+    }
+
+    // writer only
+    const std::int64_t m_windowNs;
+    std::int64_t m_ring[kRing];
+    std::size_t m_head;
+    std::size_t m_tail;
+    std::int64_t m_lastArrivalNs;
+    std::int64_t m_lastSeqUs;
+    double m_periodUs;
+    unsigned int m_periodSamples;
+    std::uint64_t m_latencySamples;
+
+    // read from any thread
+    std::atomic<double> m_fps;
+    std::atomic<unsigned long long> m_count;
+    std::atomic<double> m_jitterUs;
+    std::atomic<unsigned long long> m_dropped;
+    std::atomic<std::uint64_t> m_histogram[kBuckets];
+};
@@ -0,0 +1,493 @@
+#include "xvrec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "xvrec files are little endian"
+#endif
+
+static_assert(sizeof(XvRecChunkHeader) == 64, "XvRecChunkHeader layout");
+static_assert(sizeof(XvRecIndexEntry) == 32, "XvRecIndexEntry layout");
+static_assert(sizeof(XvRecChunkInfo) == 32, "XvRecChunkInfo layout");
+static_assert(sizeof(XvRecFileHeader) <= kXvRecAlign, "XvRecFileHeader layout");
+
+namespace {
+
+inline std::size_t alignUp(std::size_t v, std::size_t a)
+{
+    return (v + a - 1) / a * a;
+}
+
+// chunks of slow tracks are sealed after this long so an interrupted recording loses little
+const double kMaxChunkDuration = 1.0;
+// sealed buffers kept for reuse
+const std::size_t kMaxFreeBuffers = 8;
+
+} // namespace
+
+const char* xvrecTrackName(XvRecTrack track)
+{
+    switch (track) {
+    case XvRecTrack::Imu: return "imu";
+    case XvRecTrack::Fisheye: return "fisheye";
+    case XvRecTrack::Depth: return "tof";
+    case XvRecTrack::Color: return "rgb";
+    case XvRecTrack::Sgbm: return "sgbm";
+    case XvRecTrack::Pose: return "slam";
+    }
+    return "unknown";
+}
+
+struct XvRecWriter::AlignedBuffer
+{
+    explicit AlignedBuffer(std::size_t cap) : data(nullptr), capacity(cap), size(0)
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, kXvRecAlign, capacity) != 0) {
+            throw std::bad_alloc();
+        }
+        data = static_cast<std::uint8_t*>(p);
+        std::memset(&info, 0, sizeof(info));
+    }
+    ~AlignedBuffer() { std::free(data); }
+
+    std::uint8_t* data;
+    std::size_t capacity;
+    std::size_t size; // bytes to write, multiple of kXvRecAlign
+    XvRecChunkInfo info;
+};
+
+void XvRecWriter::BufferDeleter::operator()(AlignedBuffer* b) const
+{
+    delete b;
+}
+
+XvRecWriter::XvRecWriter()
+    : m_fd(-1), m_direct(false), m_queuedBytes(0), m_closing(false), m_fileOffset(0), m_bytesWritten(0)
+{
+}
+
+XvRecWriter::~XvRecWriter()
+{
+    if (m_fd >= 0) {
+        close();
+    }
+}
+
+std::string XvRecWriter::error() const
+{
+    std::lock_guard<std::mutex> l(m_errorMtx);
+    return m_error;
+}
+
+void XvRecWriter::setError(std::string const& e)
+{
+    std::lock_guard<std::mutex> l(m_errorMtx);
+    if (m_error.empty()) {
+        m_error = e;
+    }
+}
+
+bool XvRecWriter::open(std::string const& filename, std::string const& description, Options const& options)
+{
+    if (m_fd >= 0) {
+        close();
+    }
+    m_options = options;
+    m_direct = false;
+    m_error.clear();
+#ifdef O_DIRECT
+    if (options.directIo) {
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        m_direct = m_fd >= 0;
+    }
+#endif
+    if (m_fd < 0) {
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (m_fd < 0) {
+        setError("cannot create " + filename + ": " + std::strerror(errno));
+        return false;
+    }
+
+    for (auto& t : m_tracks) {
+        t.chunk.reset();
+        t.index.clear();
+        t.used = 0;
+        t.records = 0;
+        t.dropped = 0;
+    }
+    m_queue.clear();
+    m_queuedBytes = 0;
+    m_closing = false;
+    m_directory.clear();
+    m_bytesWritten = 0;
+
+    AlignedBuffer head(kXvRecAlign);
+    std::memset(head.data, 0, kXvRecAlign);
+    std::memset(&m_header, 0, sizeof(m_header));
+    m_header.magic = kXvRecMagic;
+    m_header.version = kXvRecVersion;
+    m_header.createdUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::strncpy(m_header.description, description.c_str(), sizeof(m_header.description) - 1);
+    std::memcpy(head.data, &m_header, sizeof(m_header));
+    if (!writeAll(head.data, kXvRecAlign, 0)) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_fileOffset = kXvRecAlign;
+
+    m_thread = std::thread(&XvRecWriter::run, this);
+    return true;
+}
+
+XvRecWriter::BufferPtr XvRecWriter::takeBuffer(std::size_t minSize)
+{
+    std::unique_lock<std::mutex> l(m_queueMtx);
+    if (m_options.waitWhenBehind) {
+        m_spaceCv.wait(l, [&]{ return m_closing || m_queuedBytes == 0 || m_queuedBytes + minSize <= m_options.maxQueuedBytes; });
+    } else if (m_queuedBytes + minSize > m_options.maxQueuedBytes) {
+        return nullptr;
+    }
+    if (m_closing) {
+        return nullptr;
+    }
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+        if ((*it)->capacity >= minSize && (*it)->capacity <= 2 * minSize) {
+            BufferPtr b = std::move(*it);
+            m_free.erase(it);
+            return b;
+        }
+    }
+    return BufferPtr(new AlignedBuffer(minSize));
+}
+
+bool XvRecWriter::append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp, Part const* parts, std::size_t partCount)
+{
+    const int id = static_cast<int>(track);
+    if (id <= 0 || id >= kXvRecTrackCount || m_fd < 0) {
+        return false;
+    }
+    Track& t = m_tracks[id];
+    std::lock_guard<std::mutex> l(t.mtx);
+
+    std::size_t recordSize = 0;
+    for (std::size_t i = 0; i < partCount; ++i) {
+        recordSize += parts[i].size;
+    }
+    const std::size_t padded = alignUp(recordSize, 8);
+    if (t.chunk) {
+        const std::size_t needed = t.used + padded + (t.index.size() + 1) * sizeof(XvRecIndexEntry);
+        if (needed > t.chunk->capacity || hostTimestamp - t.index.front().hostTimestamp > kMaxChunkDuration) {
+            seal(track, t);
+        }
+    }
+    if (!t.chunk) {
+        const bool small = track == XvRecTrack::Imu || track == XvRecTrack::Pose;
+        const std::size_t target = small ? m_options.smallChunkSize : m_options.chunkSize;
+        const std::size_t single = alignUp(sizeof(XvRecChunkHeader) + padded + sizeof(XvRecIndexEntry), kXvRecAlign);
+        t.chunk = takeBuffer(std::max(alignUp(target, kXvRecAlign), single));
+        if (!t.chunk) {
+            ++t.dropped;
+            return false;
+        }
+        t.used = sizeof(XvRecChunkHeader);
+    }
+
+    std::uint8_t* dst = t.chunk->data + t.used;
+    for (std::size_t i = 0; i < partCount; ++i) {
+        if (parts[i].size) {
+            std::memcpy(dst, parts[i].data, parts[i].size);
+            dst += parts[i].size;
+        }
+    }
+    if (padded > recordSize) {
+        std::memset(dst, 0, padded - recordSize);
+    }
+    XvRecIndexEntry e;
+    e.edgeTimestampUs = edgeTimestampUs;
+    e.hostTimestamp = hostTimestamp;
+    e.offset = t.used;
+    e.size = static_cast<std::uint32_t>(recordSize);
+    e.reserved = 0;
+    t.index.push_back(e);
+    t.used += padded;
+    ++t.records;
+    return true;
+}
+
+void XvRecWriter::seal(XvRecTrack track, Track& t)
+{
+    BufferPtr b = std::move(t.chunk);
+    const std::size_t indexBytes = t.index.size() * sizeof(XvRecIndexEntry);
+    std::memcpy(b->data + t.used, t.index.data(), indexBytes);
+    const std::size_t end = t.used + indexBytes;
+    b->size = alignUp(end, kXvRecAlign);
+    std::memset(b->data + end, 0, b->size - end);
+
+    XvRecChunkHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = kXvRecChunkMagic;
+    h.track = static_cast<std::uint16_t>(track);
+    h.recordCount = static_cast<std::uint32_t>(t.index.size());
+    h.chunkSize = b->size;
+    h.indexOffset = t.used;
+    h.firstEdgeTimestampUs = t.index.front().edgeTimestampUs;
+    h.lastEdgeTimestampUs = t.index.back().edgeTimestampUs;
+    h.firstHostTimestamp = t.index.front().hostTimestamp;
+    h.lastHostTimestamp = t.index.back().hostTimestamp;
+    std::memcpy(b->data, &h, sizeof(h));
+
+    b->info.track = h.track;
+    b->info.recordCount = h.recordCount;
+    b->info.firstHostTimestamp = h.firstHostTimestamp;
+    b->info.lastHostTimestamp = h.lastHostTimestamp;
+
+    t.index.clear();
+    t.used = 0;
+
+    std::lock_guard<std::mutex> l(m_queueMtx);
+    m_queuedBytes += b->size;
+    m_queue.push_back(std::move(b));
+    m_queueCv.notify_one();
+}
+
+bool XvRecWriter::writeAll(void const* data, std::size_t size, std::uint64_t offset)
+{
+    auto p = static_cast<char const*>(data);
+    while (size > 0) {
+        ssize_t n = ::pwrite(m_fd, p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+#ifdef O_DIRECT
+            // some file systems accept O_DIRECT at open time but not for writes
+            if (errno == EINVAL && m_direct) {
+                m_direct = false;
+                ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+#endif
+            setError(std::string("write failed: ") + std::strerror(errno));
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+void XvRecWriter::run()
+{
+    while (true) {
+        BufferPtr b;
+        {
+            std::unique_lock<std::mutex> l(m_queueMtx);
+            m_queueCv.wait(l, [this]{ return !m_queue.empty() || m_closing; });
+            if (m_queue.empty()) {
+                break;
+            }
+            b = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        if (writeAll(b->data, b->size, m_fileOffset)) {
+            b->info.offset = m_fileOffset;
+            m_directory.push_back(b->info);
+            m_fileOffset += b->size;
+            m_bytesWritten += b->size;
+        }
+        std::lock_guard<std::mutex> l(m_queueMtx);
+        m_queuedBytes -= b->size;
+        m_spaceCv.notify_all();
+        if (m_free.size() < kMaxFreeBuffers) {
+            m_free.push_back(std::move(b));
+        }
+    }
+}
+
+bool XvRecWriter::close()
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    for (int id = 1; id < kXvRecTrackCount; ++id) {
+        Track& t = m_tracks[id];
+        std::lock_guard<std::mutex> l(t.mtx);
+        if (t.chunk && !t.index.empty()) {
+            seal(static_cast<XvRecTrack>(id), t);
+        }
+        t.chunk.reset();
+    }
+    {
+        std::lock_guard<std::mutex> l(m_queueMtx);
+        m_closing = true;
+        m_queueCv.notify_one();
+        m_spaceCv.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // directory, then the header pointing to it
+    const std::size_t dirBytes = m_directory.size() * sizeof(XvRecChunkInfo);
+    AlignedBuffer dir(std::max(alignUp(dirBytes, kXvRecAlign), kXvRecAlign));
+    std::memset(dir.data, 0, dir.capacity);
+    if (dirBytes) {
+        std::memcpy(dir.data, m_directory.data(), dirBytes);
+    }
+    bool ok = writeAll(dir.data, alignUp(dirBytes, kXvRecAlign), m_fileOffset);
+
+    AlignedBuffer head(kXvRecAlign);
+    std::memset(head.data, 0, kXvRecAlign);
+    m_header.directoryOffset = dirBytes ? m_fileOffset : 0;
+    m_header.directoryCount = m_directory.size();
+    std::memcpy(head.data, &m_header, sizeof(m_header));
+    ok = ok && writeAll(head.data, kXvRecAlign, 0);
+
+    ok = (::fdatasync(m_fd) == 0) && ok;
+    ok = (::close(m_fd) == 0) && ok;
+    m_fd = -1;
+    m_free.clear();
+    return ok && error().empty();
+}
+
+XvRecReader::XvRecReader() : m_base(nullptr), m_size(0), m_hasDirectory(false)
+{
+    std::memset(&m_header, 0, sizeof(m_header));
+}
+
+XvRecReader::~XvRecReader()
+{
+    close();
+}
+
+void XvRecReader::close()
+{
+    m_mapping.reset();
+    m_base = nullptr;
+    m_size = 0;
+    m_chunks.clear();
+    for (auto& r : m_records) {
+        r.clear();
+    }
+}
+
+bool XvRecReader::readChunk(std::uint64_t offset, XvRecChunkInfo* info)
+{
+    if (offset + sizeof(XvRecChunkHeader) > m_size) {
+        return false;
+    }
+    XvRecChunkHeader const* h = reinterpret_cast<XvRecChunkHeader const*>(m_base + offset);
+    if (h->magic != kXvRecChunkMagic || h->track == 0 || h->track >= kXvRecTrackCount
+        || h->chunkSize == 0 || offset + h->chunkSize > m_size
+        || h->indexOffset + static_cast<std::uint64_t>(h->recordCount) * sizeof(XvRecIndexEntry) > h->chunkSize) {
+        return false;
+    }
+    XvRecIndexEntry const* index = reinterpret_cast<XvRecIndexEntry const*>(m_base + offset + h->indexOffset);
+    for (std::uint32_t i = 0; i < h->recordCount; ++i) {
+        if (index[i].offset + index[i].size > h->indexOffset) {
+            return false;
+        }
+    }
+    for (std::uint32_t i = 0; i < h->recordCount; ++i) {
+        m_records[h->track].push_back(RecordRef{m_base + offset, index + i});
+    }
+    info->offset = offset;
+    info->track = h->track;
+    info->reserved = 0;
+    info->recordCount = h->recordCount;
+    info->firstHostTimestamp = h->firstHostTimestamp;
+    info->lastHostTimestamp = h->lastHostTimestamp;
+    return true;
+}
+
+bool XvRecReader::open(std::string const& filename)
+{
+    close();
+    m_error.clear();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_error = "cannot open " + filename + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < kXvRecAlign) {
+        ::close(fd);
+        m_error = filename + " is not an xvrec file";
+        return false;
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        m_error = std::string("mmap failed: ") + std::strerror(errno);
+        return false;
+    }
+    m_mapping = std::shared_ptr<const void>(p, [size](void const* q){ ::munmap(const_cast<void*>(q), size); });
+    m_base = static_cast<std::uint8_t const*>(p);
+    m_size = size;
+
+    std::memcpy(&m_header, m_base, sizeof(m_header));
+    if (m_header.magic != kXvRecMagic || m_header.version != kXvRecVersion) {
+        m_error = filename + " is not an xvrec v1 file";
+        close();
+        return false;
+    }
+
+    m_hasDirectory = m_header.directoryOffset != 0
+        && m_header.directoryOffset + m_header.directoryCount * sizeof(XvRecChunkInfo) <= m_size;
+    if (m_hasDirectory) {
+        XvRecChunkInfo const* dir = reinterpret_cast<XvRecChunkInfo const*>(m_base + m_header.directoryOffset);
+        for (std::uint64_t i = 0; i < m_header.directoryCount; ++i) {
+            XvRecChunkInfo info;
+            if (!readChunk(dir[i].offset, &info)) {
+                m_error = "corrupted chunk in directory";
+                close();
+                return false;
+            }
+            m_chunks.push_back(info);
+        }
+    } else {
+        // interrupted recording: walk the chunks until the first invalid one
+        std::uint64_t offset = kXvRecAlign;
+        XvRecChunkInfo info;
+        while (readChunk(offset, &info)) {
+            m_chunks.push_back(info);
+            offset += reinterpret_cast<XvRecChunkHeader const*>(m_base + offset)->chunkSize;
+        }
+    }
+    ::madvise(const_cast<std::uint8_t*>(m_base), m_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+XvRecRecord XvRecReader::record(XvRecTrack track, std::size_t i) const
+{
+    RecordRef const& r = m_records[static_cast<int>(track)].at(i);
+    XvRecRecord rec;
+    rec.track = track;
+    rec.edgeTimestampUs = r.entry->edgeTimestampUs;
+    rec.hostTimestamp = r.entry->hostTimestamp;
+    rec.data = r.chunk + r.entry->offset;
+    rec.size = r.entry->size;
+    return rec;
+}
+
+std::size_t XvRecReader::lowerBound(XvRecTrack track, double hostTimestamp) const
+{
+    auto const& refs = m_records[static_cast<int>(track)];
+    auto it = std::lower_bound(refs.begin(), refs.end(), hostTimestamp,
+                               [](RecordRef const& r, double t){ return r.entry->hostTimestamp < t; });
+    return static_cast<std::size_t>(it - refs.begin());
+}
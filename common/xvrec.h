@@ -0,0 +1,299 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief xvrec: chunked, memory mappable recording container
+ *
+ * Layout (little endian, every block aligned to 4 KiB so the writer can use O_DIRECT):
+ *
+ *     [XvRecFileHeader, padded to 4096]
+ *     [chunk][chunk]...         one track per chunk, chunks of all tracks interleaved
+ *     [directory]               XvRecChunkInfo[], written by close()
+ *
+ * A chunk is `XvRecChunkHeader`, the record payloads (8-byte aligned), then the time index
+ * of the chunk (`XvRecIndexEntry[recordCount]` at `indexOffset`). Payloads are stored as
+ * given, see xvrec_xv.h for the layout of the xvsdk types. If the directory is missing
+ * (recording interrupted) the reader rebuilds it by walking the chunk headers.
+ */
+
+enum class XvRecTrack : std::uint16_t
+{
+    Imu = 1,
+    Fisheye = 2,
+    Depth = 3,
+    Color = 4,
+    Sgbm = 5,
+    Pose = 6,
+};
+static const int kXvRecTrackCount = 7; // ids are < kXvRecTrackCount
+
+const char* xvrecTrackName(XvRecTrack track);
+
+static const std::uint32_t kXvRecMagic = 0x43455258;      // "XREC"
+static const std::uint32_t kXvRecChunkMagic = 0x4b484358; // "XCHK"
+static const std::uint32_t kXvRecVersion = 1;
+static const std::size_t kXvRecAlign = 4096;
+
+struct XvRecFileHeader
+{
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t directoryOffset; // 0: no directory, scan the chunks
+    std::uint64_t directoryCount;
+    std::int64_t createdUs;        // wall clock, us since epoch
+    char description[256];
+};
+
+struct XvRecChunkHeader
+{
+    std::uint32_t magic;
+    std::uint16_t track;
+    std::uint16_t reserved;
+    std::uint32_t recordCount;
+    std::uint32_t reserved2;
+    std::uint64_t chunkSize;   // including padding
+    std::uint64_t indexOffset; // from the chunk start
+    std::int64_t firstEdgeTimestampUs;
+    std::int64_t lastEdgeTimestampUs;
+    double firstHostTimestamp;
+    double lastHostTimestamp;
+};
+
+struct XvRecIndexEntry
+{
+    std::int64_t edgeTimestampUs;
+    double hostTimestamp;
+    std::uint64_t offset; // from the chunk start
+    std::uint32_t size;
+    std::uint32_t reserved;
+};
+
+struct XvRecChunkInfo
+{
+    std::uint64_t offset; // from the file start
+    std::uint16_t track;
+    std::uint16_t reserved;
+    std::uint32_t recordCount;
+    double firstHostTimestamp;
+    double lastHostTimestamp;
+};
+
+// Payload heads of the tracks, see xvrec_xv.h for the conversions from/to the xvsdk types
+
+struct XvRecImuPayload
+{
+    double gyro[3];
+    double accel[3];
+    double magneto[3];
+    double temperature;
+};
+
+/// XvRecImagePayload::type flag of Depth / Sgbm data compressed with the depth codec (depth_codec.h)
+static const std::uint32_t kXvRecDepthCodec = 0x10000;
+
+/// Head of Depth / Color / Sgbm payloads, followed by `dataSize` bytes
+struct XvRecImagePayload
+{
+    std::uint32_t type; // DepthImage::Type, ColorImage::Codec or SgbmImage::Type, | kXvRecDepthCodec
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t dataSize;
+    double confidence; // DepthImage only
+};
+
+/// Head of Fisheye payloads: `count` sizes, then the images (width * height bytes each)
+struct XvRecFisheyePayload
+{
+    std::uint32_t count;
+    std::uint32_t reserved;
+    std::int64_t id;
+    std::uint32_t size[4][2]; // width, height
+};
+
+struct XvRecPosePayload
+{
+    double translation[3];
+    double rotation[9]; // row major
+    double confidence;
+};
+// Pose records written by PoseLogger carry a float after the payload: CPU usage of the
+// process when the pose was logged, % of one core (NaN if unknown)
+
+/**
+ * @brief Writes an xvrec file
+ *
+ * append() copies the payload into the open chunk of its track and returns; full chunks
+ * are written by a background thread with O_DIRECT (or aligned buffered writes when the
+ * file system does not support it). append() never waits for the disk: when more than
+ * `maxQueuedBytes` are waiting the record is dropped and counted (unless `waitWhenBehind`).
+ * append() is thread safe, records of one track must be appended in time order.
+ */
+class XvRecWriter
+{
+public:
+    struct Options
+    {
+        Options() : chunkSize(4 << 20), smallChunkSize(256 << 10), maxQueuedBytes(512u << 20), directIo(true), waitWhenBehind(false) {}
+        std::size_t chunkSize;      ///< target chunk size of image tracks
+        std::size_t smallChunkSize; ///< target chunk size of Imu / Pose
+        std::size_t maxQueuedBytes; ///< sealed chunks waiting for the disk before records are dropped
+        bool directIo;              ///< try O_DIRECT
+        bool waitWhenBehind;        ///< append() waits for the disk instead of dropping (offline writers)
+    };
+
+    XvRecWriter();
+    ~XvRecWriter();
+
+    XvRecWriter(XvRecWriter const&) = delete;
+    XvRecWriter& operator=(XvRecWriter const&) = delete;
+
+    /// Creates `filename` and starts the writer thread. Returns false on error, see error().
+    bool open(std::string const& filename, std::string const& description = "", Options const& options = Options());
+
+    struct Part
+    {
+        void const* data;
+        std::size_t size;
+    };
+
+    /**
+     * @brief Appends one record, the payload is the concatenation of `parts`
+     * @return false if the record was dropped (queue full, writer closed or I/O error)
+     */
+    bool append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp, Part const* parts, std::size_t partCount);
+
+    bool append(XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp,
+                void const* head, std::size_t headSize, void const* body = nullptr, std::size_t bodySize = 0)
+    {
+        Part parts[2] = {{head, headSize}, {body, bodySize}};
+        return append(track, edgeTimestampUs, hostTimestamp, parts, 2);
+    }
+
+    /// Seals the open chunks, writes the directory and closes the file
+    bool close();
+
+    bool isOpen() const { return m_fd >= 0; }
+    bool usesDirectIo() const { return m_direct; }
+    std::string error() const;
+
+    std::uint64_t records(XvRecTrack track) const { return m_tracks[static_cast<int>(track)].records.load(); }
+    std::uint64_t dropped(XvRecTrack track) const { return m_tracks[static_cast<int>(track)].dropped.load(); }
+    std::uint64_t bytesWritten() const { return m_bytesWritten.load(); }
+
+private:
+    struct AlignedBuffer;
+    struct BufferDeleter { void operator()(AlignedBuffer* b) const; };
+    typedef std::unique_ptr<AlignedBuffer, BufferDeleter> BufferPtr;
+
+    struct Track
+    {
+        Track() : records(0), dropped(0) {}
+        std::mutex mtx;
+        BufferPtr chunk;
+        std::vector<XvRecIndexEntry> index;
+        std::size_t used = 0;
+        std::atomic<std::uint64_t> records;
+        std::atomic<std::uint64_t> dropped;
+    };
+
+    BufferPtr takeBuffer(std::size_t minSize);
+    void seal(XvRecTrack track, Track& t);
+    void run();
+    bool writeAll(void const* data, std::size_t size, std::uint64_t offset);
+    void setError(std::string const& e);
+
+    int m_fd;
+    std::atomic<bool> m_direct;
+    Options m_options;
+    XvRecFileHeader m_header;
+    Track m_tracks[kXvRecTrackCount];
+
+    std::mutex m_queueMtx;
+    std::condition_variable m_queueCv;
+    std::condition_variable m_spaceCv;
+    std::deque<BufferPtr> m_queue;
+    std::vector<BufferPtr> m_free;
+    std::size_t m_queuedBytes;
+    bool m_closing;
+    std::thread m_thread;
+
+    // writer thread
+    std::uint64_t m_fileOffset;
+    std::vector<XvRecChunkInfo> m_directory;
+
+    std::atomic<std::uint64_t> m_bytesWritten;
+    mutable std::mutex m_errorMtx;
+    std::string m_error;
+};
+
+/// One record of a mapped xvrec file, `data` points into the mapping
+struct XvRecRecord
+{
+    XvRecTrack track;
+    std::int64_t edgeTimestampUs;
+    double hostTimestamp;
+    std::uint8_t const* data;
+    std::size_t size;
+};
+
+/**
+ * @brief Reads an xvrec file through mmap, records are not copied
+ *
+ * The mapping stays valid as long as the reader or a copy of mapping() is alive, so
+ * payloads can be handed out as shared buffers (see xvrec_xv.h).
+ */
+class XvRecReader
+{
+public:
+    XvRecReader();
+    ~XvRecReader();
+
+    XvRecReader(XvRecReader const&) = delete;
+    XvRecReader& operator=(XvRecReader const&) = delete;
+
+    bool open(std::string const& filename);
+    void close();
+    std::string const& error() const { return m_error; }
+
+    XvRecFileHeader const& header() const { return m_header; }
+    std::vector<XvRecChunkInfo> const& chunks() const { return m_chunks; }
+    /// false when the directory was rebuilt by scanning (interrupted recording)
+    bool hasDirectory() const { return m_hasDirectory; }
+
+    std::size_t recordCount(XvRecTrack track) const { return m_records[static_cast<int>(track)].size(); }
+    XvRecRecord record(XvRecTrack track, std::size_t i) const;
+
+    /// Index of the first record of `track` with hostTimestamp >= t (recordCount() if none)
+    std::size_t lowerBound(XvRecTrack track, double hostTimestamp) const;
+
+    /// Keeps the file mapped while payloads are referenced
+    std::shared_ptr<const void> mapping() const { return m_mapping; }
+
+private:
+    struct RecordRef
+    {
+        std::uint8_t const* chunk;
+        XvRecIndexEntry const* entry;
+    };
+
+    bool readChunk(std::uint64_t offset, XvRecChunkInfo* info);
+
+    std::shared_ptr<const void> m_mapping;
+    std::uint8_t const* m_base;
+    std::size_t m_size;
+    XvRecFileHeader m_header;
+    std::vector<XvRecChunkInfo> m_chunks;
+    std::vector<RecordRef> m_records[kXvRecTrackCount];
+    bool m_hasDirectory;
+    std::string m_error;
+};
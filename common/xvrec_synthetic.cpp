@@ -0,0 +1,300 @@
+#include "xvrec_synthetic.h"
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "slam_log.h"
+#include "xvrec.h"
+#include "xvrec_xv.h"
+
+#ifdef USE_OPENCV_
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace {
+
+// host clock of the first record, the device clock starts at 0
+const double kHostStart = 1000.;
+const double kImuRate = 1000.;
+const double kCameraRate = 30.;
+const double kSlamRate = 500.;
+
+const int kFisheyeWidth = 640, kFisheyeHeight = 400;
+const int kTofWidth = 224, kTofHeight = 172;
+const int kRgbWidth = 640, kRgbHeight = 480;
+const int kSgbmWidth = 640, kSgbmHeight = 400;
+
+inline std::int64_t edgeUs(double t)
+{
+    return static_cast<std::int64_t>(std::llround(t * 1e6));
+}
+
+/// Gray 640x400 fixture, or a checkerboard with a gradient when it cannot be loaded
+std::vector<std::uint8_t> loadFisheye(std::string const& path, int seed)
+{
+    std::vector<std::uint8_t> gray(kFisheyeWidth * kFisheyeHeight);
+#ifdef USE_OPENCV_
+    cv::Mat img = cv::imread(path, cv::IMREAD_GRAYSCALE);
+    if (!img.empty()) {
+        cv::resize(img, img, cv::Size(kFisheyeWidth, kFisheyeHeight));
+        for (int y = 0; y < kFisheyeHeight; ++y) {
+            std::memcpy(&gray[y * kFisheyeWidth], img.ptr(y), kFisheyeWidth);
+        }
+        return gray;
+    }
+#else
+    (void)path;
+#endif
+    for (int y = 0; y < kFisheyeHeight; ++y) {
+        for (int x = 0; x < kFisheyeWidth; ++x) {
+            const bool cell = (((x + seed) / 40) ^ (y / 40)) & 1;
+            gray[y * kFisheyeWidth + x] = static_cast<std::uint8_t>((cell ? 160 : 60) + (x * 64) / kFisheyeWidth);
+        }
+    }
+    return gray;
+}
+
+struct SlamSample
+{
+    double t; // seconds from the first pose
+    double position[3];
+    double orientation[4]; // x y z w
+    double confidence;
+};
+
+/// Poses of data/slam_data.txt, time relative to the first one
+std::vector<SlamSample> loadSlamData(std::string const& path)
+{
+    std::vector<SlamSample> samples;
+    SlamTrajectory trajectory;
+    if (!slamLogLoad(path, trajectory)) {
+        return samples;
+    }
+    for (std::size_t i = 0; i < trajectory.size(); ++i) {
+        SlamSample s;
+        s.t = trajectory.timestamp[i] - trajectory.timestamp[0];
+        for (int k = 0; k < 3; ++k) {
+            s.position[k] = trajectory.position[k][i];
+        }
+        for (int k = 0; k < 4; ++k) {
+            s.orientation[k] = trajectory.orientation[k][i];
+        }
+        s.confidence = trajectory.confidence[i];
+        if (samples.empty() || s.t > samples.back().t) {
+            samples.push_back(s);
+        }
+    }
+    return samples;
+}
+
+xv::Matrix3d quaternionToMatrix(double const* q)
+{
+    const double x = q[0], y = q[1], z = q[2], w = q[3];
+    xv::Matrix3d r;
+    r[0] = 1 - 2 * (y * y + z * z); r[1] = 2 * (x * y - z * w);     r[2] = 2 * (x * z + y * w);
+    r[3] = 2 * (x * y + z * w);     r[4] = 1 - 2 * (x * x + z * z); r[5] = 2 * (y * z - x * w);
+    r[6] = 2 * (x * z - y * w);     r[7] = 2 * (y * z + x * w);     r[8] = 1 - 2 * (x * x + y * y);
+    return r;
+}
+
+void writeImu(XvRecWriter& w, double duration)
+{
+    const int n = static_cast<int>(duration * kImuRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kImuRate;
+        xv::Imu imu;
+        imu.gyro[0] = 0.2 * std::sin(2 * M_PI * 0.5 * t);
+        imu.gyro[1] = 0.1 * std::cos(2 * M_PI * 0.3 * t);
+        imu.gyro[2] = 0.05;
+        imu.accel[0] = 0.3 * std::sin(2 * M_PI * 1.0 * t);
+        imu.accel[1] = 9.81;
+        imu.accel[2] = 0.3 * std::cos(2 * M_PI * 1.0 * t);
+        imu.temperature = 40.;
+        imu.edgeTimestampUs = edgeUs(t);
+        imu.hostTimestamp = kHostStart + t;
+        xvrecAppend(w, imu);
+    }
+}
+
+void writeFisheye(XvRecWriter& w, double duration, std::string const& dataDir)
+{
+    const std::vector<std::uint8_t> left = loadFisheye(dataDir + "/left_image_0.png", 0);
+    const std::vector<std::uint8_t> right = loadFisheye(dataDir + "/right_image_0.png", 8);
+    std::vector<std::uint8_t> frame[2] = {left, right};
+    const int n = static_cast<int>(duration * kCameraRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kCameraRate;
+        // slow horizontal pan so consecutive frames differ
+        const int shift = static_cast<int>(8 * std::sin(2 * M_PI * 0.2 * t)) + 8;
+        xv::FisheyeImages fe;
+        for (int c = 0; c < 2; ++c) {
+            std::vector<std::uint8_t> const& src = c == 0 ? left : right;
+            for (int y = 0; y < kFisheyeHeight; ++y) {
+                std::uint8_t* dst = &frame[c][y * kFisheyeWidth];
+                std::memcpy(dst, &src[y * kFisheyeWidth + shift], kFisheyeWidth - shift);
+                std::memset(dst + kFisheyeWidth - shift, 0, shift);
+            }
+            xv::GrayScaleImage image;
+            image.width = kFisheyeWidth;
+            image.height = kFisheyeHeight;
+            image.data = std::shared_ptr<const std::uint8_t>(frame[c].data(), [](std::uint8_t const*) {});
+            fe.images.push_back(image);
+        }
+        fe.id = i;
+        fe.edgeTimestampUs = edgeUs(t);
+        fe.hostTimestamp = kHostStart + t;
+        xvrecAppend(w, fe);
+    }
+}
+
+void writeTof(XvRecWriter& w, double duration)
+{
+    std::vector<float> depth(kTofWidth * kTofHeight);
+    const int n = static_cast<int>(duration * kCameraRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kCameraRate;
+        // tilted plane moving between 0.5m and 2.5m
+        const double base = 1.5 + std::sin(2 * M_PI * 0.1 * t);
+        for (int y = 0; y < kTofHeight; ++y) {
+            for (int x = 0; x < kTofWidth; ++x) {
+                depth[y * kTofWidth + x] = static_cast<float>(base + 0.002 * x + 0.001 * y);
+            }
+        }
+        xv::DepthImage tof;
+        tof.type = xv::DepthImage::Type::Depth_32;
+        tof.width = kTofWidth;
+        tof.height = kTofHeight;
+        tof.confidence = 1.;
+        tof.dataSize = static_cast<unsigned int>(depth.size() * sizeof(float));
+        tof.data = std::shared_ptr<const std::uint8_t>(reinterpret_cast<std::uint8_t const*>(depth.data()), [](std::uint8_t const*) {});
+        tof.edgeTimestampUs = edgeUs(t) + 5000;
+        tof.hostTimestamp = kHostStart + t + 0.005;
+        xvrecAppend(w, tof);
+    }
+}
+
+void writeRgb(XvRecWriter& w, double duration)
+{
+    // NV12: Y plane then interleaved UV at half resolution
+    std::vector<std::uint8_t> nv12(kRgbWidth * kRgbHeight * 3 / 2);
+    const int n = static_cast<int>(duration * kCameraRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kCameraRate;
+        for (int y = 0; y < kRgbHeight; ++y) {
+            for (int x = 0; x < kRgbWidth; ++x) {
+                nv12[y * kRgbWidth + x] = static_cast<std::uint8_t>(16 + ((x + i * 4) & 0xff) * 219 / 255);
+            }
+        }
+        std::uint8_t* uv = &nv12[kRgbWidth * kRgbHeight];
+        for (int y = 0; y < kRgbHeight / 2; ++y) {
+            for (int x = 0; x < kRgbWidth / 2; ++x) {
+                uv[y * kRgbWidth + 2 * x] = static_cast<std::uint8_t>(128 + (x * 64) / (kRgbWidth / 2) - 32);
+                uv[y * kRgbWidth + 2 * x + 1] = static_cast<std::uint8_t>(128 + (y * 64) / (kRgbHeight / 2) - 32);
+            }
+        }
+        xv::ColorImage rgb;
+        rgb.codec = xv::ColorImage::Codec::NV12;
+        rgb.width = kRgbWidth;
+        rgb.height = kRgbHeight;
+        rgb.dataSize = nv12.size();
+        rgb.data = std::shared_ptr<const std::uint8_t>(nv12.data(), [](std::uint8_t const*) {});
+        rgb.edgeTimestampUs = edgeUs(t) + 10000;
+        rgb.hostTimestamp = kHostStart + t + 0.010;
+        xvrecAppend(w, rgb);
+    }
+}
+
+void writeSgbm(XvRecWriter& w, double duration)
+{
+    std::vector<std::uint16_t> depth(kSgbmWidth * kSgbmHeight);
+    const int n = static_cast<int>(duration * kCameraRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kCameraRate;
+        const int base = static_cast<int>(1500 + 1000 * std::sin(2 * M_PI * 0.1 * t));
+        for (int y = 0; y < kSgbmHeight; ++y) {
+            for (int x = 0; x < kSgbmWidth; ++x) {
+                // invalid border like the device output
+                const bool valid = x >= 32 && x < kSgbmWidth - 32;
+                depth[y * kSgbmWidth + x] = static_cast<std::uint16_t>(valid ? base + 2 * x + y : 0);
+            }
+        }
+        xv::SgbmImage sgbm;
+        sgbm.type = xv::SgbmImage::Type::Depth;
+        sgbm.width = kSgbmWidth;
+        sgbm.height = kSgbmHeight;
+        sgbm.dataSize = static_cast<unsigned int>(depth.size() * sizeof(std::uint16_t));
+        sgbm.data = std::shared_ptr<const std::uint8_t>(reinterpret_cast<std::uint8_t const*>(depth.data()), [](std::uint8_t const*) {});
+        sgbm.edgeTimestampUs = edgeUs(t) + 20000;
+        sgbm.hostTimestamp = kHostStart + t + 0.020;
+        xvrecAppend(w, sgbm);
+    }
+}
+
+void writeSlam(XvRecWriter& w, double duration, std::string const& dataDir)
+{
+    const std::vector<SlamSample> samples = loadSlamData(dataDir + "/slam_data.txt");
+    if (!samples.empty()) {
+        const double span = samples.back().t;
+        // loop the fixture when the recording is longer than it
+        for (double offset = 0; offset < duration && span > 0; offset += span + 1. / kSlamRate) {
+            for (auto const& s : samples) {
+                const double t = offset + s.t;
+                if (t >= duration) {
+                    break;
+                }
+                xv::Vector3d p = {{s.position[0], s.position[1], s.position[2]}};
+                xvrecAppend(w, xv::Pose(p, quaternionToMatrix(s.orientation), kHostStart + t, edgeUs(t), s.confidence));
+            }
+        }
+        return;
+    }
+    const int n = static_cast<int>(duration * kSlamRate);
+    for (int i = 0; i < n; ++i) {
+        const double t = i / kSlamRate;
+        const double a = 2 * M_PI * 0.1 * t;
+        const double q[4] = {0., std::sin(a / 2), 0., std::cos(a / 2)};
+        xv::Vector3d p = {{std::cos(a), 0., std::sin(a)}};
+        xvrecAppend(w, xv::Pose(p, quaternionToMatrix(q), kHostStart + t, edgeUs(t), 1.));
+    }
+}
+
+} // namespace
+
+bool xvrecWriteSynthetic(std::string const& filename, XvRecSyntheticOptions const& options, std::string* error)
+{
+    XvRecWriter writer;
+    XvRecWriter::Options wo;
+    wo.waitWhenBehind = true;
+    if (!writer.open(filename, "synthetic", wo)) {
+        if (error) {
+            *error = writer.error();
+        }
+        return false;
+    }
+    if (options.imu) {
+        writeImu(writer, options.duration);
+    }
+    if (options.fisheye) {
+        writeFisheye(writer, options.duration, options.dataDir);
+    }
+    if (options.tof) {
+        writeTof(writer, options.duration);
+    }
+    if (options.rgb) {
+        writeRgb(writer, options.duration);
+    }
+    if (options.sgbm) {
+        writeSgbm(writer, options.duration);
+    }
+    if (options.slam) {
+        writeSlam(writer, options.duration, options.dataDir);
+    }
+    const bool ok = writer.close();
+    if (!ok && error) {
+        *error = writer.error();
+    }
+    return ok;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Generates a deterministic xvrec recording without a device
+ *
+ * The streams are built from the fixtures in data/:
+ *  - fisheye: left_image_0.png / right_image_0.png (needs OpenCV to decode them, a test
+ *    pattern of the same size is used otherwise), shifted a little every frame
+ *  - slam: the poses and timing of slam_data.txt, or a circle when it is missing
+ *  - imu / tof / rgb / sgbm: synthetic signals with the device rates and formats
+ *
+ * The same options always produce the same file, so replays of it are comparable.
+ */
+struct XvRecSyntheticOptions
+{
+    XvRecSyntheticOptions()
+        : dataDir("data"), duration(10.), imu(true), fisheye(true), tof(true), rgb(true), sgbm(true), slam(true)
+    {
+    }
+
+    std::string dataDir; ///< directory of the fixtures
+    double duration;     ///< seconds
+    bool imu, fisheye, tof, rgb, sgbm, slam;
+};
+
+/// Writes the synthetic recording to `filename`, returns false and fills `error` on failure
+bool xvrecWriteSynthetic(std::string const& filename, XvRecSyntheticOptions const& options, std::string* error = nullptr);
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <xv-sdk.h>
+
+#include "depth_codec.h"
+#include "xvrec.h"
+
+/**
+ * @brief Payload layouts of the xvsdk streams in an xvrec file
+ *
+ * Every payload starts with a small POD head (declared in xvrec.h) followed by the raw sensor
+ * bytes exactly as the SDK delivered them (no re-encoding, JPEG stays JPEG). Timestamps live
+ * in the record index, not in the payload. The one exception is 16-bit depth appended with a
+ * DepthEncoder: the data is then a depth codec stream, flagged with kXvRecDepthCodec.
+ *
+ * xvrecAppend() works with any writer that has XvRecWriter's append() (XvRecWriter,
+ * ShmPublisher). xvrecDecode() rebuilds the SDK type; image buffers alias the file or
+ * segment mapping (shared_ptr aliasing constructor), so decoding a frame does not copy
+ * its pixels, except compressed depth which is decoded into a new buffer.
+ */
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::Imu const& imu)
+{
+    XvRecImuPayload p;
+    for (int i = 0; i < 3; ++i) {
+        p.gyro[i] = imu.gyro[i];
+        p.accel[i] = imu.accel[i];
+        p.magneto[i] = imu.magneto[i];
+    }
+    p.temperature = imu.temperature;
+    return w.append(XvRecTrack::Imu, imu.edgeTimestampUs, imu.hostTimestamp, &p, sizeof(p));
+}
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::FisheyeImages const& fe)
+{
+    XvRecFisheyePayload p;
+    std::memset(&p, 0, sizeof(p));
+    XvRecWriter::Part parts[5];
+    parts[0].data = &p;
+    parts[0].size = sizeof(p);
+    std::size_t n = 1;
+    for (auto const& image : fe.images) {
+        if (p.count == 4) {
+            break;
+        }
+        p.size[p.count][0] = static_cast<std::uint32_t>(image.width);
+        p.size[p.count][1] = static_cast<std::uint32_t>(image.height);
+        parts[n].data = image.data.get();
+        parts[n].size = image.data ? image.width * image.height : 0;
+        ++p.count;
+        ++n;
+    }
+    p.id = fe.id;
+    return w.append(XvRecTrack::Fisheye, fe.edgeTimestampUs, fe.hostTimestamp, parts, n);
+}
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::DepthImage const& tof)
+{
+    XvRecImagePayload p = {static_cast<std::uint32_t>(tof.type), static_cast<std::uint32_t>(tof.width),
+                           static_cast<std::uint32_t>(tof.height), tof.data ? tof.dataSize : 0u, tof.confidence};
+    return w.append(XvRecTrack::Depth, tof.edgeTimestampUs, tof.hostTimestamp, &p, sizeof(p), tof.data.get(), p.dataSize);
+}
+
+/// Compressed depth: the stream of `encoder`, or the raw samples when it is not smaller
+template <class Writer>
+bool xvrecAppendDepth(Writer& w, XvRecTrack track, std::int64_t edgeTimestampUs, double hostTimestamp, XvRecImagePayload p,
+                      std::uint8_t const* data, DepthEncoder& encoder)
+{
+    const std::size_t raw = static_cast<std::size_t>(p.width) * p.height * sizeof(std::uint16_t);
+    if (data && p.dataSize >= raw) {
+        std::vector<std::uint8_t> const& stream = encoder.encode(reinterpret_cast<std::uint16_t const*>(data),
+                                                                 static_cast<int>(p.width), static_cast<int>(p.height));
+        if (!stream.empty() && stream.size() < raw) {
+            p.type |= kXvRecDepthCodec;
+            p.dataSize = static_cast<std::uint32_t>(stream.size());
+            return w.append(track, edgeTimestampUs, hostTimestamp, &p, sizeof(p), stream.data(), stream.size());
+        }
+    }
+    return w.append(track, edgeTimestampUs, hostTimestamp, &p, sizeof(p), data, p.dataSize);
+}
+
+/// Depth_16 frames (IR too with a lossless encoder) compressed with `encoder`, other types stored raw
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::DepthImage const& tof, DepthEncoder& encoder)
+{
+    const bool compress = tof.type == xv::DepthImage::Type::Depth_16
+                          || (tof.type == xv::DepthImage::Type::IR && encoder.options().mode == DepthCodecMode::Lossless);
+    if (!compress) {
+        return xvrecAppend(w, tof);
+    }
+    XvRecImagePayload p = {static_cast<std::uint32_t>(tof.type), static_cast<std::uint32_t>(tof.width),
+                           static_cast<std::uint32_t>(tof.height), tof.data ? tof.dataSize : 0u, tof.confidence};
+    return xvrecAppendDepth(w, XvRecTrack::Depth, tof.edgeTimestampUs, tof.hostTimestamp, p, tof.data.get(), encoder);
+}
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::ColorImage const& rgb)
+{
+    XvRecImagePayload p = {static_cast<std::uint32_t>(rgb.codec), static_cast<std::uint32_t>(rgb.width),
+                           static_cast<std::uint32_t>(rgb.height),
+                           rgb.data ? static_cast<std::uint32_t>(rgb.dataSize) : 0u, 0.};
+    return w.append(XvRecTrack::Color, rgb.edgeTimestampUs, rgb.hostTimestamp, &p, sizeof(p), rgb.data.get(), p.dataSize);
+}
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::SgbmImage const& sgbm)
+{
+    XvRecImagePayload p = {static_cast<std::uint32_t>(sgbm.type), static_cast<std::uint32_t>(sgbm.width),
+                           static_cast<std::uint32_t>(sgbm.height), sgbm.data ? sgbm.dataSize : 0u, 0.};
+    return w.append(XvRecTrack::Sgbm, sgbm.edgeTimestampUs, sgbm.hostTimestamp, &p, sizeof(p), sgbm.data.get(), p.dataSize);
+}
+
+/// Depth frames (mm) compressed with `encoder`, disparity and point clouds stored raw
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::SgbmImage const& sgbm, DepthEncoder& encoder)
+{
+    if (sgbm.type != xv::SgbmImage::Type::Depth) {
+        return xvrecAppend(w, sgbm);
+    }
+    XvRecImagePayload p = {static_cast<std::uint32_t>(sgbm.type), static_cast<std::uint32_t>(sgbm.width),
+                           static_cast<std::uint32_t>(sgbm.height), sgbm.data ? sgbm.dataSize : 0u, 0.};
+    return xvrecAppendDepth(w, XvRecTrack::Sgbm, sgbm.edgeTimestampUs, sgbm.hostTimestamp, p, sgbm.data.get(), encoder);
+}
+
+template <class Writer>
+bool xvrecAppend(Writer& w, xv::Pose const& pose)
+{
+    XvRecPosePayload p;
+    for (int i = 0; i < 3; ++i) {
+        p.translation[i] = pose.translation()[i];
+    }
+    for (int i = 0; i < 9; ++i) {
+        p.rotation[i] = pose.rotation()[i];
+    }
+    p.confidence = pose.confidence();
+    return w.append(XvRecTrack::Pose, pose.edgeTimestampUs(), pose.hostTimestamp(), &p, sizeof(p));
+}
+
+template <class Payload>
+inline Payload const* xvrecHead(XvRecRecord const& r, XvRecTrack track)
+{
+    if (r.track != track || r.size < sizeof(Payload)) {
+        return nullptr;
+    }
+    return reinterpret_cast<Payload const*>(r.data);
+}
+
+/// Shares ownership of the mapping, points at `p`
+inline std::shared_ptr<const std::uint8_t> xvrecAlias(std::shared_ptr<const void> const& mapping, std::uint8_t const* p)
+{
+    return std::shared_ptr<const std::uint8_t>(mapping, p);
+}
+
+/**
+ * @brief Data of a Depth / Sgbm payload: aliases the mapping, or decodes a compressed one
+ * @return false if the payload is truncated or its depth codec stream corrupted
+ */
+inline bool xvrecImageData(XvRecRecord const& r, std::shared_ptr<const void> const& mapping, XvRecImagePayload const* p,
+                           std::shared_ptr<const std::uint8_t>& data, unsigned int& dataSize)
+{
+    std::uint8_t const* bytes = r.data + sizeof(XvRecImagePayload);
+    if (!(p->type & kXvRecDepthCodec)) {
+        data = xvrecAlias(mapping, bytes);
+        dataSize = p->dataSize;
+        return true;
+    }
+    const std::size_t count = static_cast<std::size_t>(p->width) * p->height;
+    std::shared_ptr<std::uint16_t> depth(new std::uint16_t[count], std::default_delete<std::uint16_t[]>());
+    if (!depthDecode(bytes, p->dataSize, depth.get(), count)) {
+        return false;
+    }
+    data = std::shared_ptr<const std::uint8_t>(depth, reinterpret_cast<std::uint8_t const*>(depth.get()));
+    dataSize = static_cast<unsigned int>(count * sizeof(std::uint16_t));
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const&, xv::Imu& imu)
+{
+    auto p = xvrecHead<XvRecImuPayload>(r, XvRecTrack::Imu);
+    if (!p) {
+        return false;
+    }
+    imu = xv::Imu();
+    for (int i = 0; i < 3; ++i) {
+        imu.gyro[i] = p->gyro[i];
+        imu.accel[i] = p->accel[i];
+        imu.magneto[i] = p->magneto[i];
+    }
+    imu.temperature = p->temperature;
+    imu.edgeTimestampUs = r.edgeTimestampUs;
+    imu.hostTimestamp = r.hostTimestamp;
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const& mapping, xv::FisheyeImages& fe)
+{
+    auto p = xvrecHead<XvRecFisheyePayload>(r, XvRecTrack::Fisheye);
+    if (!p || p->count > 4) {
+        return false;
+    }
+    fe = xv::FisheyeImages();
+    std::uint8_t const* data = r.data + sizeof(XvRecFisheyePayload);
+    std::uint8_t const* end = r.data + r.size;
+    for (std::uint32_t i = 0; i < p->count; ++i) {
+        xv::GrayScaleImage image;
+        image.width = p->size[i][0];
+        image.height = p->size[i][1];
+        const std::size_t bytes = image.width * image.height;
+        if (bytes > static_cast<std::size_t>(end - data)) {
+            return false;
+        }
+        image.data = xvrecAlias(mapping, data);
+        data += bytes;
+        fe.images.push_back(image);
+    }
+    fe.id = p->id;
+    fe.edgeTimestampUs = r.edgeTimestampUs;
+    fe.hostTimestamp = r.hostTimestamp;
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const& mapping, xv::DepthImage& tof)
+{
+    auto p = xvrecHead<XvRecImagePayload>(r, XvRecTrack::Depth);
+    if (!p || p->dataSize > r.size - sizeof(XvRecImagePayload)) {
+        return false;
+    }
+    tof = xv::DepthImage();
+    if (!xvrecImageData(r, mapping, p, tof.data, tof.dataSize)) {
+        return false;
+    }
+    tof.type = static_cast<xv::DepthImage::Type>(p->type & ~kXvRecDepthCodec);
+    tof.width = p->width;
+    tof.height = p->height;
+    tof.confidence = p->confidence;
+    tof.edgeTimestampUs = r.edgeTimestampUs;
+    tof.hostTimestamp = r.hostTimestamp;
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const& mapping, xv::ColorImage& rgb)
+{
+    auto p = xvrecHead<XvRecImagePayload>(r, XvRecTrack::Color);
+    if (!p || p->dataSize > r.size - sizeof(XvRecImagePayload)) {
+        return false;
+    }
+    rgb = xv::ColorImage();
+    rgb.codec = static_cast<xv::ColorImage::Codec>(p->type);
+    rgb.width = p->width;
+    rgb.height = p->height;
+    rgb.dataSize = p->dataSize;
+    rgb.data = xvrecAlias(mapping, r.data + sizeof(XvRecImagePayload));
+    rgb.edgeTimestampUs = r.edgeTimestampUs;
+    rgb.hostTimestamp = r.hostTimestamp;
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const& mapping, xv::SgbmImage& sgbm)
+{
+    auto p = xvrecHead<XvRecImagePayload>(r, XvRecTrack::Sgbm);
+    if (!p || p->dataSize > r.size - sizeof(XvRecImagePayload)) {
+        return false;
+    }
+    sgbm = xv::SgbmImage();
+    if (!xvrecImageData(r, mapping, p, sgbm.data, sgbm.dataSize)) {
+        return false;
+    }
+    sgbm.type = static_cast<xv::SgbmImage::Type>(p->type & ~kXvRecDepthCodec);
+    sgbm.width = p->width;
+    sgbm.height = p->height;
+    sgbm.edgeTimestampUs = r.edgeTimestampUs;
+    sgbm.hostTimestamp = r.hostTimestamp;
+    return true;
+}
+
+inline bool xvrecDecode(XvRecRecord const& r, std::shared_ptr<const void> const&, xv::Pose& pose)
+{
+    auto p = xvrecHead<XvRecPosePayload>(r, XvRecTrack::Pose);
+    if (!p) {
+        return false;
+    }
+    xv::Vector3d t;
+    xv::Matrix3d rot;
+    for (int i = 0; i < 3; ++i) {
+        t[i] = p->translation[i];
+    }
+    for (int i = 0; i < 9; ++i) {
+        rot[i] = p->rotation[i];
+    }
+    pose = xv::Pose(t, rot, r.hostTimestamp, r.edgeTimestampUs, p->confidence);
+    return true;
+}
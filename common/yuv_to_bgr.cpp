@@ -0,0 +1,445 @@
+#include "yuv_to_bgr.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+// The AVX2 kernel is compiled whatever the -m flags of the build (the samples are built for
+// the baseline x86-64) and only called when the CPU has AVX2, see hasAvx2(); SSE2 otherwise.
+#include <immintrin.h>
+#define YUV_TO_BGR_SSE2
+#define YUV_TO_BGR_AVX2
+#define YUV_TO_BGR_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define YUV_TO_BGR_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_TO_BGR_NEON
+#endif
+
+namespace {
+
+// output pixels are produced in blocks so the box sums and the BGRx words stay in L1
+const int kBlock = 256;
+
+// BT.601 limited range, 13-bit fixed point (fits the 16-bit multipliers of every kernel)
+const int kShift = 13;
+const int kRound = 1 << (kShift - 1);
+const int kCY = 9539;   // 1.164383
+const int kCVR = 13075; // 1.596027
+const int kCVG = -6660; // -0.812968
+const int kCUG = -3209; // -0.391762
+const int kCUB = 16525; // 2.017232
+
+inline std::uint32_t clamp8(int v)
+{
+    return static_cast<std::uint32_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+inline std::uint32_t pixel(int y, int u, int v)
+{
+    const int yy = std::max(y - 16, 0) * kCY + kRound;
+    u -= 128;
+    v -= 128;
+    return clamp8((yy + kCUB * u) >> kShift)
+         | clamp8((yy + kCUG * u + kCVG * v) >> kShift) << 8
+         | clamp8((yy + kCVR * v) >> kShift) << 16;
+}
+
+#if defined(YUV_TO_BGR_SSE2)
+// the pair (a, b) repeated, multiplier of _mm_madd_epi16 on interleaved (x, y) samples
+inline __m128i pair16(int a, int b)
+{
+    return _mm_set1_epi32(static_cast<int>((static_cast<std::uint32_t>(b) << 16) | (static_cast<std::uint32_t>(a) & 0xffff)));
+}
+
+// (lo, hi) 32-bit sums of 8 pixels to 16-bit channel values
+inline __m128i finish(__m128i lo, __m128i hi)
+{
+    const __m128i round = _mm_set1_epi32(kRound);
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, round), kShift),
+                           _mm_srai_epi32(_mm_add_epi32(hi, round), kShift));
+}
+
+// 8 pixels: y already minus 16 (saturated), u / v minus 128, all 16-bit
+inline void convert8(__m128i y, __m128i u, __m128i v, std::uint32_t* bgrx)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i yuLo = _mm_unpacklo_epi16(y, u), yuHi = _mm_unpackhi_epi16(y, u);
+    const __m128i yvLo = _mm_unpacklo_epi16(y, v), yvHi = _mm_unpackhi_epi16(y, v);
+    const __m128i v0Lo = _mm_unpacklo_epi16(v, zero), v0Hi = _mm_unpackhi_epi16(v, zero);
+
+    const __m128i kb = pair16(kCY, kCUB), kg = pair16(kCY, kCUG), kgv = pair16(kCVG, 0), kr = pair16(kCY, kCVR);
+    __m128i b = finish(_mm_madd_epi16(yuLo, kb), _mm_madd_epi16(yuHi, kb));
+    __m128i g = finish(_mm_add_epi32(_mm_madd_epi16(yuLo, kg), _mm_madd_epi16(v0Lo, kgv)),
+                       _mm_add_epi32(_mm_madd_epi16(yuHi, kg), _mm_madd_epi16(v0Hi, kgv)));
+    __m128i r = finish(_mm_madd_epi16(yvLo, kr), _mm_madd_epi16(yvHi, kr));
+    b = _mm_min_epi16(_mm_max_epi16(b, zero), max);
+    g = _mm_min_epi16(_mm_max_epi16(g, zero), max);
+    r = _mm_min_epi16(_mm_max_epi16(r, zero), max);
+
+    const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bgrx), _mm_unpacklo_epi16(bg, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bgrx + 4), _mm_unpackhi_epi16(bg, r));
+}
+#endif
+
+#if defined(YUV_TO_BGR_AVX2)
+YUV_TO_BGR_AVX2_TARGET inline __m256i finish(__m256i lo, __m256i hi)
+{
+    const __m256i round = _mm256_set1_epi32(kRound);
+    return _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(lo, round), kShift),
+                              _mm256_srai_epi32(_mm256_add_epi32(hi, round), kShift));
+}
+
+// 16 pixels, same as the SSE2 kernel: unpack / madd / packs work within 128-bit lanes,
+// so packs restores the pixel order that unpacklo / unpackhi split
+YUV_TO_BGR_AVX2_TARGET inline void convert16(__m256i y, __m256i u, __m256i v, std::uint32_t* bgrx)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i yuLo = _mm256_unpacklo_epi16(y, u), yuHi = _mm256_unpackhi_epi16(y, u);
+    const __m256i yvLo = _mm256_unpacklo_epi16(y, v), yvHi = _mm256_unpackhi_epi16(y, v);
+    const __m256i v0Lo = _mm256_unpacklo_epi16(v, zero), v0Hi = _mm256_unpackhi_epi16(v, zero);
+
+    const __m256i kb = _mm256_broadcastsi128_si256(pair16(kCY, kCUB));
+    const __m256i kg = _mm256_broadcastsi128_si256(pair16(kCY, kCUG));
+    const __m256i kgv = _mm256_broadcastsi128_si256(pair16(kCVG, 0));
+    const __m256i kr = _mm256_broadcastsi128_si256(pair16(kCY, kCVR));
+    __m256i b = finish(_mm256_madd_epi16(yuLo, kb), _mm256_madd_epi16(yuHi, kb));
+    __m256i g = finish(_mm256_add_epi32(_mm256_madd_epi16(yuLo, kg), _mm256_madd_epi16(v0Lo, kgv)),
+                       _mm256_add_epi32(_mm256_madd_epi16(yuHi, kg), _mm256_madd_epi16(v0Hi, kgv)));
+    __m256i r = finish(_mm256_madd_epi16(yvLo, kr), _mm256_madd_epi16(yvHi, kr));
+    b = _mm256_min_epi16(_mm256_max_epi16(b, zero), max);
+    g = _mm256_min_epi16(_mm256_max_epi16(g, zero), max);
+    r = _mm256_min_epi16(_mm256_max_epi16(r, zero), max);
+
+    // lo: pixels 0-3 | 8-11, hi: pixels 4-7 | 12-15
+    const __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    const __m256i lo = _mm256_unpacklo_epi16(bg, r), hi = _mm256_unpackhi_epi16(bg, r);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgrx), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgrx + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+/// AVX2 part of convertBlock(), returns the number of pixels converted (a multiple of 16)
+YUV_TO_BGR_AVX2_TARGET int convertBlock16(std::uint8_t const* y, std::uint8_t const* u, std::uint8_t const* v, int count,
+                                          bool sharedChroma, std::uint32_t* bgrx)
+{
+    const __m128i c16 = _mm_set1_epi8(16);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i y8 = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(y + i)), c16);
+        __m128i u8, v8;
+        if (sharedChroma) {
+            u8 = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(u + i / 2));
+            v8 = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(v + i / 2));
+            u8 = _mm_unpacklo_epi8(u8, u8);
+            v8 = _mm_unpacklo_epi8(v8, v8);
+        } else {
+            u8 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(u + i));
+            v8 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(v + i));
+        }
+        convert16(_mm256_cvtepu8_epi16(y8), _mm256_sub_epi16(_mm256_cvtepu8_epi16(u8), c128),
+                  _mm256_sub_epi16(_mm256_cvtepu8_epi16(v8), c128), bgrx + i);
+    }
+    return i;
+}
+#endif
+
+/// Whether convertBlock16 may be called on this CPU
+bool hasAvx2()
+{
+#if defined(YUV_TO_BGR_AVX2) && !defined(__AVX2__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#elif defined(YUV_TO_BGR_AVX2)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(YUV_TO_BGR_NEON)
+// 8 pixels, vqrshrn rounds like kRound and vqmovun clamps like clamp8()
+inline void convert8(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, std::uint32_t* bgrx)
+{
+    const int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(vqsub_u8(y8, vdup_n_u8(16))));
+    const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+    const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+    const int32x4_t yLo = vmull_n_s16(vget_low_s16(y), kCY), yHi = vmull_n_s16(vget_high_s16(y), kCY);
+
+    const int32x4_t bLo = vmlal_n_s16(yLo, vget_low_s16(u), kCUB), bHi = vmlal_n_s16(yHi, vget_high_s16(u), kCUB);
+    int32x4_t gLo = vmlal_n_s16(yLo, vget_low_s16(u), kCUG), gHi = vmlal_n_s16(yHi, vget_high_s16(u), kCUG);
+    gLo = vmlal_n_s16(gLo, vget_low_s16(v), kCVG);
+    gHi = vmlal_n_s16(gHi, vget_high_s16(v), kCVG);
+    const int32x4_t rLo = vmlal_n_s16(yLo, vget_low_s16(v), kCVR), rHi = vmlal_n_s16(yHi, vget_high_s16(v), kCVR);
+
+    uint8x8x4_t out;
+    out.val[0] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(bLo, kShift), vqrshrn_n_s32(bHi, kShift)));
+    out.val[1] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(gLo, kShift), vqrshrn_n_s32(gHi, kShift)));
+    out.val[2] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(rLo, kShift), vqrshrn_n_s32(rHi, kShift)));
+    out.val[3] = vdup_n_u8(0);
+    vst4_u8(reinterpret_cast<std::uint8_t*>(bgrx), out);
+}
+#endif
+
+/**
+ * Converts `count` pixels to packed BGRx words. u / v hold one sample per pixel, or one
+ * per pixel pair when `sharedChroma` (full resolution 4:2:0 / 4:2:2, `count` even).
+ * `avx2`: hasAvx2(), the SSE2 kernel converts what the AVX2 one leaves.
+ */
+void convertBlock(std::uint8_t const* y, std::uint8_t const* u, std::uint8_t const* v, int count,
+                  bool sharedChroma, bool avx2, std::uint32_t* bgrx)
+{
+    int i = 0;
+#if defined(YUV_TO_BGR_AVX2)
+    if (avx2) {
+        i = convertBlock16(y, u, v, count, sharedChroma, bgrx);
+    }
+#else
+    (void)avx2;
+#endif
+#if defined(YUV_TO_BGR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c16 = _mm_set1_epi8(16);
+    const __m128i c128 = _mm_set1_epi16(128);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i y8 = _mm_subs_epu8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(y + i)), c16);
+        __m128i u8, v8;
+        if (sharedChroma) {
+            std::int32_t u4, v4;
+            std::memcpy(&u4, u + i / 2, 4);
+            std::memcpy(&v4, v + i / 2, 4);
+            u8 = _mm_cvtsi32_si128(u4);
+            v8 = _mm_cvtsi32_si128(v4);
+            u8 = _mm_unpacklo_epi8(u8, u8);
+            v8 = _mm_unpacklo_epi8(v8, v8);
+        } else {
+            u8 = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(u + i));
+            v8 = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(v + i));
+        }
+        convert8(_mm_unpacklo_epi8(y8, zero), _mm_sub_epi16(_mm_unpacklo_epi8(u8, zero), c128),
+                 _mm_sub_epi16(_mm_unpacklo_epi8(v8, zero), c128), bgrx + i);
+    }
+#elif defined(YUV_TO_BGR_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t y16 = vld1q_u8(y + i);
+        if (sharedChroma) {
+            const uint8x8_t u8 = vld1_u8(u + i / 2), v8 = vld1_u8(v + i / 2);
+            const uint8x8x2_t uu = vzip_u8(u8, u8), vv = vzip_u8(v8, v8);
+            convert8(vget_low_u8(y16), uu.val[0], vv.val[0], bgrx + i);
+            convert8(vget_high_u8(y16), uu.val[1], vv.val[1], bgrx + i + 8);
+        } else {
+            const uint8x16_t u16 = vld1q_u8(u + i), v16 = vld1q_u8(v + i);
+            convert8(vget_low_u8(y16), vget_low_u8(u16), vget_low_u8(v16), bgrx + i);
+            convert8(vget_high_u8(y16), vget_high_u8(u16), vget_high_u8(v16), bgrx + i + 8);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        const int c = sharedChroma ? i / 2 : i;
+        bgrx[i] = pixel(y[i], u[c], v[c]);
+    }
+}
+
+/**
+ * Writes `count` BGR pixels. Every pixel but the last one of the row is stored with a
+ * 4-byte write whose spare byte is overwritten by the next pixel.
+ */
+inline void store(std::uint32_t const* bgrx, int count, std::uint8_t* bgr, bool rowEnd)
+{
+    const int n = rowEnd ? count - 1 : count;
+    for (int i = 0; i < n; ++i) {
+        std::memcpy(bgr + 3 * i, &bgrx[i], 4);
+    }
+    if (rowEnd) {
+        std::memcpy(bgr + 3 * n, &bgrx[n], 3);
+    }
+}
+
+struct Frame
+{
+    std::uint8_t const* y;
+    std::uint8_t const* u;
+    std::uint8_t const* v;
+    std::size_t yStride;
+    std::size_t cStride;
+};
+
+// byte step between horizontally adjacent Y / chroma samples, chroma rows per Y row
+template <YuvLayout L> struct Layout;
+template <> struct Layout<YuvLayout::I420> { enum { kYStep = 1, kCStep = 1, kCSub = 2 }; };
+template <> struct Layout<YuvLayout::NV12> { enum { kYStep = 1, kCStep = 2, kCSub = 2 }; };
+template <> struct Layout<YuvLayout::YUYV> { enum { kYStep = 2, kCStep = 4, kCSub = 1 }; };
+
+/**
+ * Samples of output pixels [x0, x0 + n) of row `oy`: Y and chroma averaged over the box
+ * of each pixel (chroma per pixel pair at scale 1). Returns pointers into the frame when
+ * the samples are contiguous there, into the buffers otherwise.
+ */
+template <int S, YuvLayout L>
+void gather(Frame const& f, int oy, int x0, int n, std::uint8_t* ybuf, std::uint8_t* ubuf, std::uint8_t* vbuf,
+            std::uint8_t const*& y, std::uint8_t const*& u, std::uint8_t const*& v)
+{
+    typedef Layout<L> T;
+    if (S == 1) {
+        std::uint8_t const* row = f.y + oy * f.yStride;
+        std::uint8_t const* crowU = f.u + (oy / T::kCSub) * f.cStride;
+        std::uint8_t const* crowV = f.v + (oy / T::kCSub) * f.cStride;
+        if (T::kYStep == 1) {
+            y = row + x0;
+        } else {
+            for (int i = 0; i < n; ++i) {
+                ybuf[i] = row[(x0 + i) * T::kYStep];
+            }
+            y = ybuf;
+        }
+        if (T::kCStep == 1) {
+            u = crowU + x0 / 2;
+            v = crowV + x0 / 2;
+        } else {
+            for (int i = 0; i < n / 2; ++i) {
+                ubuf[i] = crowU[(x0 / 2 + i) * T::kCStep];
+                vbuf[i] = crowV[(x0 / 2 + i) * T::kCStep];
+            }
+            u = ubuf;
+            v = vbuf;
+        }
+        return;
+    }
+
+    std::uint16_t sum[kBlock];
+    std::fill(sum, sum + n, 0);
+    for (int dy = 0; dy < S; ++dy) {
+        std::uint8_t const* row = f.y + (oy * S + dy) * f.yStride + x0 * S * T::kYStep;
+        for (int i = 0; i < n; ++i) {
+            for (int dx = 0; dx < S; ++dx) {
+                sum[i] += row[(i * S + dx) * T::kYStep];
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        ybuf[i] = static_cast<std::uint8_t>((sum[i] + S * S / 2) / (S * S));
+    }
+    y = ybuf;
+
+    // chroma box: S/2 samples wide, S/2 (4:2:0) or S (4:2:2) rows high
+    const int cw = S / 2, ch = T::kCSub == 2 ? S / 2 : S, cn = cw * ch;
+    std::uint16_t sumV[kBlock];
+    std::fill(sum, sum + n, 0);
+    std::fill(sumV, sumV + n, 0);
+    for (int dy = 0; dy < ch; ++dy) {
+        const std::size_t offset = (oy * ch + dy) * f.cStride + x0 * cw * T::kCStep;
+        std::uint8_t const* rowU = f.u + offset;
+        std::uint8_t const* rowV = f.v + offset;
+        for (int i = 0; i < n; ++i) {
+            for (int dx = 0; dx < cw; ++dx) {
+                sum[i] += rowU[(i * cw + dx) * T::kCStep];
+                sumV[i] += rowV[(i * cw + dx) * T::kCStep];
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        ubuf[i] = static_cast<std::uint8_t>((sum[i] + cn / 2) / cn);
+        vbuf[i] = static_cast<std::uint8_t>((sumV[i] + cn / 2) / cn);
+    }
+    u = ubuf;
+    v = vbuf;
+}
+
+template <int S, YuvLayout L>
+void convert(Frame const& f, int outWidth, int outHeight, bool avx2, std::uint8_t* bgr, std::size_t bgrStride)
+{
+    alignas(32) std::uint8_t ybuf[kBlock];
+    alignas(32) std::uint8_t ubuf[kBlock];
+    alignas(32) std::uint8_t vbuf[kBlock];
+    alignas(32) std::uint32_t bgrx[kBlock];
+    for (int oy = 0; oy < outHeight; ++oy) {
+        std::uint8_t* out = bgr + oy * bgrStride;
+        for (int x0 = 0; x0 < outWidth; x0 += kBlock) {
+            const int n = std::min(kBlock, outWidth - x0);
+            std::uint8_t const *y, *u, *v;
+            gather<S, L>(f, oy, x0, n, ybuf, ubuf, vbuf, y, u, v);
+            convertBlock(y, u, v, n, S == 1, avx2, bgrx);
+            store(bgrx, n, out + 3 * x0, x0 + n == outWidth);
+        }
+    }
+}
+
+template <YuvLayout L>
+void convert(Frame const& f, int scale, int outWidth, int outHeight, std::uint8_t* bgr, std::size_t bgrStride)
+{
+    const bool avx2 = hasAvx2();
+    switch (scale) {
+    case 1: convert<1, L>(f, outWidth, outHeight, avx2, bgr, bgrStride); break;
+    case 2: convert<2, L>(f, outWidth, outHeight, avx2, bgr, bgrStride); break;
+    case 4: convert<4, L>(f, outWidth, outHeight, avx2, bgr, bgrStride); break;
+    }
+}
+
+} // namespace
+
+std::size_t yuvFrameSize(YuvLayout layout, int width, int height)
+{
+    const std::size_t pixels = static_cast<std::size_t>(width) * height;
+    return layout == YuvLayout::YUYV ? 2 * pixels : pixels * 3 / 2;
+}
+
+bool yuvToBgr(YuvLayout layout, std::uint8_t const* src, int width, int height, int scale,
+              std::uint8_t* bgr, std::size_t bgrStride)
+{
+    if (!src || !bgr || (scale != 1 && scale != 2 && scale != 4) || width <= 0 || height <= 0
+        || width % 2 || height % 2 || width < scale || height < scale) {
+        return false;
+    }
+    const int outWidth = yuvScaledSize(width, scale), outHeight = yuvScaledSize(height, scale);
+    if (bgrStride < 3 * static_cast<std::size_t>(outWidth)) {
+        return false;
+    }
+
+    const std::size_t w = width, h = height;
+    Frame f;
+    f.y = src;
+    switch (layout) {
+    case YuvLayout::I420:
+        f.yStride = w;
+        f.u = src + w * h;
+        f.v = f.u + (w / 2) * (h / 2);
+        f.cStride = w / 2;
+        convert<YuvLayout::I420>(f, scale, outWidth, outHeight, bgr, bgrStride);
+        break;
+    case YuvLayout::NV12:
+        f.yStride = w;
+        f.u = src + w * h;
+        f.v = f.u + 1;
+        f.cStride = w;
+        convert<YuvLayout::NV12>(f, scale, outWidth, outHeight, bgr, bgrStride);
+        break;
+    case YuvLayout::YUYV:
+        f.yStride = 2 * w;
+        f.u = src + 1;
+        f.v = src + 3;
+        f.cStride = 2 * w;
+        convert<YuvLayout::YUYV>(f, scale, outWidth, outHeight, bgr, bgrStride);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+const char* yuvToBgrKernel()
+{
+#if defined(YUV_TO_BGR_AVX2)
+    return hasAvx2() ? "AVX2" : "SSE2";
+#elif defined(YUV_TO_BGR_SSE2)
+    return "SSE2";
+#elif defined(YUV_TO_BGR_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Conversion of raw ColorImage frames (YUV420p, NV12, YUYV) into packed BGR,
+ *        optionally downscaled by 2 or 4 in the same pass
+ *
+ * Colors follow BT.601 limited range, with the fixed-point coefficients (13-bit) shared
+ * by every code path: the SSE2 / NEON kernels (selected at compile time), the AVX2 kernel
+ * (used on x86 when the CPU has it) and the scalar fallback give bit-exact results. At scale 1 the result is within 1-2 levels of
+ * cv::cvtColor(COLOR_YUV2BGR_I420 / _YUYV).
+ *
+ * Downscaling box-filters Y over scale x scale pixels and the chroma samples covering the
+ * same area before converting, so only the output pixels go through the color math: a
+ * 1/4 preview costs a fraction of a full conversion followed by cv::resize().
+ *
+ * The output goes to a caller-provided buffer (e.g. a cv::Mat reused across frames);
+ * the functions keep no state and may be called from several threads.
+ */
+enum class YuvLayout
+{
+    I420, ///< Y plane, U plane, V plane (xv::ColorImage::Codec::YUV420p)
+    NV12, ///< Y plane, interleaved UV plane
+    YUYV, ///< packed Y0 U Y1 V
+};
+
+/// Bytes of a `width` x `height` frame in `layout`
+std::size_t yuvFrameSize(YuvLayout layout, int width, int height);
+
+/// Output size for `scale` (1, 2 or 4): trailing pixels that do not fill a box are dropped
+inline int yuvScaledSize(int size, int scale) { return size / scale; }
+
+/**
+ * @brief Converts a frame to BGR, downscaled by `scale`
+ * @param src: frame data, at least yuvFrameSize() bytes
+ * @param width, height: frame size, even
+ * @param scale: 1, 2 or 4
+ * @param bgr: yuvScaledSize(height, scale) rows of 3 * yuvScaledSize(width, scale) bytes
+ * @param bgrStride: bytes between output rows
+ * @return false (and nothing written) for unsupported sizes or scales
+ */
+bool yuvToBgr(YuvLayout layout, std::uint8_t const* src, int width, int height, int scale,
+              std::uint8_t* bgr, std::size_t bgrStride);
+
+/// Kernel used on this CPU: "AVX2", "SSE2", "NEON" or "scalar"
+const char* yuvToBgrKernel();
@@ -12,8 +12,13 @@
 #include <atomic>
 #include <iterator>
 #include <mutex>
+#include <memory>
 #include "../../include2/xv-sdk-ex.h"
-#include "fps_count.hpp"
+#include "stream_stats.hpp"
+#include "async_log.h"
+#include "frame_trace.hpp"
+#include "pose_timeline.h"
+#include "detection_stage.hpp"
 #include "pipe_srv.h"
 #ifdef _WIN32
 #include <corecrt_math_defines.h>
@@ -65,26 +70,54 @@ int requestCmdAllPlatform(const char* tip_info, int size)
 #endif
 }
 
+// pushes the health of a stream to the pipe_srv controllers, never blocks the callback
+void reportTelemetry(const char* stream, StreamStats const& fc, double hostTimestamp, xv::Pose const* pose = nullptr)
+{
+#ifndef _WIN32
+    vsc_telemetry t;
+    std::memset(&t, 0, sizeof(t));
+    std::strncpy(t.stream, stream, sizeof(t.stream) - 1);
+    t.host_timestamp = hostTimestamp;
+    t.fps = fc.fps();
+    t.latency_p50_ms = fc.latencyMs(50);
+    t.latency_p99_ms = fc.latencyMs(99);
+    t.count = fc.count();
+    t.dropped = fc.dropped();
+    if (pose) {
+        auto p = pose->translation();
+        auto r = xv::rotationToPitchYawRoll(pose->rotation());
+        t.has_pose = 1;
+        t.confidence = static_cast<float>(pose->confidence());
+        for (int i = 0; i < 3; ++i) {
+            t.position[i] = p[i];
+            t.pitch_yaw_roll[i] = r[i];
+        }
+    }
+    vsc_client_send_telemetry(&t);
+#endif
+}
+
 std::string map_filename = "map.bin";
 std::string map_shared_filename = "map_shared.bin";
 std::atomic_int localized_on_reference_percent(0);
 std::filebuf mapStream;
 bool enable_output_log = true;
+static AsyncLog s_log;
+// poses of the slam callback, for the consumers needing the pose at the time of their data
+static PoseTimeline s_poseTimeline;
 int slamStartMode = 0;
 
 void imuCallback(std::shared_ptr<const xv::Imu> imu)
 {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 100 == 0) {
+    TraceScope trace("callback", "imu", imu->edgeTimestampUs, imu->hostTimestamp);
+    static StreamStats fc;
+    fc.tic(imu->edgeTimestampUs, imu->hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("imu");
+    if (limit.allow()) {
+        reportTelemetry("imu", fc, imu->hostTimestamp);
         if(enable_output_log){
-            std::cout << "imu" << "@" << std::round(fc.fps()) << "fps"
-                      << " Time=(" << imu->edgeTimestampUs << " " << imu->hostTimestamp << "),"
-                      << " Gyro=(" << imu->gyro[0] << " " << imu->gyro[1] << " " << imu->gyro[2] << "),"
-                      << " Accel=(" << imu->accel[0] << " " << imu->accel[1] << " " << imu->accel[2] << "),"
-                      << " Temperature=" << imu->temperature
-                      << std::endl;
+            s_log.imu(id, imu->edgeTimestampUs, imu->hostTimestamp, fc.fps(), imu->gyro.data(), imu->accel.data(), imu->temperature);
         }
     }
 }
@@ -132,74 +165,83 @@ void eventCallback(xv::Event const& event)
     default:
         break;
     }
+    static const std::uint16_t id = s_log.stream("event");
     if(enable_output_log){
-        std::cout << "****Event@" << "edgeTimestampUs:" << event.edgeTimestampUs
-                  << ";  Type:" << strType << ";  State:" << strEvent << std::endl;
+        char text[96];
+        std::snprintf(text, sizeof(text), "edgeTimestampUs:%lld;  Type:%s;  State:%s",
+                      static_cast<long long>(event.edgeTimestampUs), strType.c_str(), strEvent.c_str());
+        s_log.message(id, text);
     }
 }
 
 //add CNN callback
 void cnnCallback(std::vector<xv::Object> objs)
 {
-    static int k = 0;
-    if (k++ % 5 == 0) {
-        for (int i = 0; i < objs.size(); i++)
-        {
-            xv::Object obj = objs.at(i);
-            if(enable_output_log){
-                std::cout << obj.width << "x" << obj.height << " # " << obj.type << " # confidence:" << obj.confidence << "; " << std::endl;
-            }
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("cnn");
+    if (enable_output_log && limit.allow()) {
+        for (auto const& obj : objs) {
+            // width, height, confidence
+            const double v[] = {static_cast<double>(obj.width), static_cast<double>(obj.height), static_cast<double>(obj.confidence)};
+            s_log.values(id, obj.type.c_str(), v, 3);
         }
     }
 }
 
 void  fisheyeLCallback(xv::FisheyeImages const& fisheye) {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 50 == 0 && fisheye.images.size() >= 1) {
+    TraceScope trace("callback", "fisheye left", fisheye.edgeTimestampUs, fisheye.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(fisheye.edgeTimestampUs, fisheye.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("fisheye");
+    if (fisheye.images.size() >= 1 && limit.allow()) {
+        reportTelemetry("fisheye", fc, fisheye.hostTimestamp);
         if(enable_output_log){
-            std::cout << fisheye.images.at(0).width << "x" << fisheye.images.at(0).height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, fisheye.edgeTimestampUs, fisheye.hostTimestamp, fc.fps(), fisheye.images.at(0).width, fisheye.images.at(0).height, "left");
         }
     }
 }
 
 void  fisheyeRCallback(xv::FisheyeImages const& fisheye) {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 50 == 0 && fisheye.images.size() >= 2) {
+    TraceScope trace("callback", "fisheye right", fisheye.edgeTimestampUs, fisheye.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(fisheye.edgeTimestampUs, fisheye.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("fisheye");
+    if (fisheye.images.size() >= 2 && limit.allow()) {
         if(enable_output_log){
-            std::cout << "Right image" << fisheye.images.at(1).width << "x" << fisheye.images.at(1).height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, fisheye.edgeTimestampUs, fisheye.hostTimestamp, fc.fps(), fisheye.images.at(1).width, fisheye.images.at(1).height, "right");
         }
     }
 }
 
 void orientationCallback(xv::Orientation const& o)
 {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 100 == 0) {
+    static StreamStats fc;
+    fc.tic(o.edgeTimestampUs, o.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("orientation");
+    if (limit.allow()) {
         auto& q = o.quaternion();
         if(enable_output_log){
-            std::cout << "orientation" << "@" << std::round(fc.fps()) << "fps"
-                      << " 3dof=(" << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << "),"
-                      << std::endl;
+            s_log.values(id, o.edgeTimestampUs, o.hostTimestamp, fc.fps(), "3dof", q.data(), q.size());
         }
     }
 }
 
 void GestureCallbackEX(xv::GestureData const& gesture)
 {
-    for (int i = 0; i < 2; i++)
-    {
-        if (gesture.index[i] != -1)
-        {
-            if(enable_output_log){
-                std::cout << "gesture host timestamp = " << gesture.hostTimestamp << std::endl;
-                std::cout << "gesture edge timestamp = " << gesture.edgeTimestampUs << std::endl;
-                std::cout << "gesture index = " << gesture.index[i] << std::endl;
+    static StreamStats fc;
+    fc.tic(gesture.edgeTimestampUs, gesture.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("gesture");
+    if (enable_output_log && limit.allow()) {
+        for (int i = 0; i < 2; i++)
+        {
+            if (gesture.index[i] != -1)
+            {
+                const double index = gesture.index[i];
+                s_log.values(id, gesture.edgeTimestampUs, gesture.hostTimestamp, fc.fps(), i ? "hand1" : "hand0", &index, 1);
             }
         }
     }
@@ -207,53 +249,55 @@ void GestureCallbackEX(xv::GestureData const& gesture)
 
 void GesturePosCallbackEX(std::shared_ptr<const std::vector<xv::Pose>> poses)
 {
-    if(enable_output_log){
-        std::cout << "keypoints 21Dof is : " << std::endl;
-        for (auto pose : *poses.get())
-        {
-            std::cout << "x = " << pose.x() << " " << "y = " << pose.y() << " " << "z = " << pose.z() << std::endl;
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("keypoints 21Dof");
+    if (enable_output_log && limit.allow()) {
+        for (auto const& pose : *poses) {
+            s_log.values(id, "xyz", pose.translation().data(), 3);
         }
     }
 }
 
 void eyetrackingCallback(xv::EyetrackingImage const& o)
 {
-    static FpsCount fc;
+    static StreamStats fc;
     fc.tic();
-    static int k = 0;
-    if (k++ % 30 == 0) {
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("eyetracking");
+    if (limit.allow()) {
         if(enable_output_log){
-            std::cout << "[eyetracking]" << o.images[0].width << "x" << o.images[0].height << "@" << std::round(fc.fps()) << "fps"
-                      << std::endl;
+            s_log.frame(id, o.hostTimestamp, fc.fps(), o.images[0].width, o.images[0].height);
         }
     }
 }
 
 void stereoCallback(std::shared_ptr<const xv::FisheyeImages> stereo)
 {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 50 == 0) {
+    TraceScope trace("callback", "stereo", stereo->edgeTimestampUs, stereo->hostTimestamp);
+    static StreamStats fc;
+    fc.tic(stereo->edgeTimestampUs, stereo->hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("stereo");
+    if (limit.allow()) {
+        reportTelemetry("stereo", fc, stereo->hostTimestamp);
         if(enable_output_log){
-            std::cout << stereo->images[0].width << "x" << stereo->images[0].height + stereo->images[1].height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, stereo->edgeTimestampUs, stereo->hostTimestamp, fc.fps(), stereo->images[0].width, stereo->images[0].height + stereo->images[1].height);
         }
     }
 }
 
 void poseCallback(xv::Pose const& pose) {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 100 == 0) {
-        auto t = pose.translation();
-        auto r = xv::rotationToPitchYawRoll(pose.rotation());
+    TraceScope trace("callback", "slam", pose.edgeTimestampUs(), pose.hostTimestamp());
+    s_poseTimeline.push(pose);
+    static StreamStats fc;
+    fc.tic(pose.edgeTimestampUs(), pose.hostTimestamp());
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("slam-callback-pose");
+    if (limit.allow()) {
+        reportTelemetry("slam", fc, pose.hostTimestamp(), &pose);
         if(enable_output_log){
-            std::cout << "slam-callback-pose" << "@" << std::round(fc.fps()) << "fps"
-                      << " p=(" << t[0] << " " << t[1] << " " << t[2]
-                      << " ), r=(" << r[0] << " " << r[1] << " " << r[2] << " )"
-                      << ", Confidence= " << pose.confidence()
-                      << std::endl;
+            auto r = xv::rotationToPitchYawRoll(pose.rotation());
+            s_log.pose(id, pose.edgeTimestampUs(), pose.hostTimestamp(), fc.fps(), pose.translation().data(), r.data(), pose.confidence());
         }
     }
 }
@@ -446,23 +490,28 @@ void cslamSwitchedCallback(int map_quality)
 
 
 void rgbCallback(xv::ColorImage const& rgb) {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 10 == 0) {
+    TraceScope trace("callback", "rgb", rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("rgb");
+    if (limit.allow()) {
+        reportTelemetry("rgb", fc, rgb.hostTimestamp);
         if(enable_output_log){
-            std::cout << "rgb: " << rgb.width << "x" << rgb.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
         }
     }
 }
 
 void rgb2Callback(xv::ColorImage const& rgb) {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 10 == 0) {
+    TraceScope trace("callback", "rgb2", rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("rgb2");
+    if (limit.allow()) {
         if(enable_output_log){
-            std::cout << "rgb2: " << rgb.width << "x" << rgb.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
         }
     }
 }
@@ -470,34 +519,35 @@ void rgb2Callback(xv::ColorImage const& rgb) {
 
 void planeCallback(std::shared_ptr<const std::vector<xv::Plane>> planes)
 {
-    if (planes)
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("plane");
+    if (planes && enable_output_log && limit.allow())
     {
-        for (auto const& plane : *planes.get()) {
-            static int k;
-            if (k++ % 20 == 0) {
-                if(enable_output_log){
-                    std::cout << "got plane, id: " << plane.id << ", [" << plane.normal[0] << "," << plane.normal[1] << "," << plane.normal[2] << "]" << std::endl;
-                    for (auto const& x : plane.points)
-                        std::cout << "(" << x[0] << "," << x[1] << " " << x[2] << ")";
-                    std::cout << std::endl;
-                }
-            }
+        for (auto const& plane : *planes) {
+            char label[16];
+            std::snprintf(label, sizeof(label), "id %s", plane.id.c_str());
+            const double v[] = {plane.normal[0], plane.normal[1], plane.normal[2], static_cast<double>(plane.points.size())};
+            // normal and number of points of the contour
+            s_log.values(id, label, v, 4);
         }
     }
 }
 
 void gestureCallback(xv::GestureData const& gesture)
 {
-    for (int i = 0; i < 2; i++)
-    {
-        if (gesture.index[i] != -1)
-        {
-            if(enable_output_log){
-                std::cout << "gesture host timestamp = " << gesture.hostTimestamp << std::endl;
-                std::cout << "gesture edge timestamp = " << gesture.edgeTimestampUs << std::endl;
-                std::cout << "gesture pos x = " << gesture.position[i].x << std::endl;
-                std::cout << "gesture pos y = " << gesture.position[i].y << std::endl;
-                std::cout << "gesture index = " << gesture.index[i] << std::endl;
+    static StreamStats fc;
+    fc.tic(gesture.edgeTimestampUs, gesture.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("gesture");
+    if (enable_output_log && limit.allow()) {
+        for (int i = 0; i < 2; i++)
+        {
+            if (gesture.index[i] != -1)
+            {
+                // index, pos x, pos y
+                const double v[] = {static_cast<double>(gesture.index[i]), static_cast<double>(gesture.position[i].x),
+                                    static_cast<double>(gesture.position[i].y)};
+                s_log.values(id, gesture.edgeTimestampUs, gesture.hostTimestamp, fc.fps(), i ? "hand1" : "hand0", v, 3);
             }
         }
     }
@@ -505,14 +555,17 @@ void gestureCallback(xv::GestureData const& gesture)
 
 void dynamicgestureCallback(xv::GestureData const& gesture)
 {
-    for (int i = 0; i < 2; i++)
-    {
-        if (gesture.index[i] != -1)
-        {
-            if(enable_output_log){
-                std::cout << "dynamic gesture host timestamp = " << gesture.hostTimestamp << std::endl;
-                std::cout << "dynamic gesture edge timestamp = " << gesture.edgeTimestampUs << std::endl;
-                std::cout << "dynamic gesture index = " << gesture.index[i] << std::endl;
+    static StreamStats fc;
+    fc.tic(gesture.edgeTimestampUs, gesture.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("dynamic gesture");
+    if (enable_output_log && limit.allow()) {
+        for (int i = 0; i < 2; i++)
+        {
+            if (gesture.index[i] != -1)
+            {
+                const double index = gesture.index[i];
+                s_log.values(id, gesture.edgeTimestampUs, gesture.hostTimestamp, fc.fps(), i ? "hand1" : "hand0", &index, 1);
             }
         }
     }
@@ -520,50 +573,54 @@ void dynamicgestureCallback(xv::GestureData const& gesture)
 
 void keypointsCallback(std::shared_ptr<const std::vector<xv::keypoint>> keypoints)
 {
-    if (keypoints->size() == 21 || keypoints->size() == 42)
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("keypoints 21Dof");
+    if ((keypoints->size() == 21 || keypoints->size() == 42) && enable_output_log && limit.allow())
     {
-        if(enable_output_log){
-            std::cout << "keypoints 21Dof is : " << std::endl;
-            for (auto keypoint : *keypoints.get())
-            {
-                std::cout << "x = " << keypoint.x << " " << "y = " << keypoint.y << " " << "z = " << keypoint.z << std::endl;
-            }
+        for (auto const& keypoint : *keypoints)
+        {
+            const double v[] = {keypoint.x, keypoint.y, keypoint.z};
+            s_log.values(id, "xyz", v, 3);
         }
     }
 }
 
 void slamkeypointsCallback(std::shared_ptr<const xv::HandPose> keypoints)
 {
-    if(enable_output_log){
-        int count = 0;
-        auto results = *keypoints;
-        std::cout << "scale: " << results.scale[0] << " " << results.scale[1] << std::endl;
-        for (auto keypoint : results.pose)
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("keypoints slam");
+    if (enable_output_log && limit.allow()) {
+        auto const& results = *keypoints;
+        const double scale[] = {results.scale[0], results.scale[1]};
+        s_log.values(id, "scale", scale, 2);
+        for (auto const& keypoint : results.pose)
         {
             if((keypoint.x() + keypoint.y() + keypoint.z()) > 1e-3)
             {
-                std::cout << "x = " << keypoint.x() << " " << "y = " << keypoint.y() << " " << "z = " << keypoint.z() << std::endl;
-                count++;
+                const double v[] = {keypoint.x(), keypoint.y(), keypoint.z()};
+                s_log.values(id, "xyz", v, 3);
             }
         }
-        double left_timestamp = results.timestamp[0];
-        double right_timestamp = results.timestamp[1];
-        double fisheye_timestamp = results.fisheye_timestamp;
-        std::cout << "left_result interval: " << fisheye_timestamp-left_timestamp << std::endl;
-        std::cout << "right_result interval: " << fisheye_timestamp-right_timestamp << std::endl;
-        // std::cout << "keypoints 26Dof base on slam is : " << count << std::endl;
+        // left_result and right_result intervals
+        const double intervals[] = {results.fisheye_timestamp - results.timestamp[0], results.fisheye_timestamp - results.timestamp[1]};
+        s_log.values(id, "interval", intervals, 2);
     }
 }
 
 void objDetRKNN3588Callback(const std::vector<xv::Det2dObject>& res)
 {
-    if(enable_output_log){
-        std::cout << "******************" << std::endl;
-        for (int i=0; i<res.size(); ++i){
-            printf("obj: %d id: %i name: %s score: %f box: [%f, %f, %f, %f], keypoints_size: %li \n", 
-                    i, res[i].idx, res[i].name.c_str(), res[i].score, res[i].top, res[i].left, res[i].width, res[i].height, res[i].keypoints.size());
-            for (int j=0; j<res[i].keypoints.size(); ++j){
-                printf("x:%f y:%f z:%f \n", res[i].keypoints[j].x, res[i].keypoints[j].y, res[i].keypoints[j].z);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("obj");
+    if (enable_output_log && limit.allow()) {
+        for (auto const& obj : res) {
+            // id, score, box top, left, width, height, keypoints size
+            const double v[] = {static_cast<double>(obj.idx), static_cast<double>(obj.score), static_cast<double>(obj.top),
+                                static_cast<double>(obj.left), static_cast<double>(obj.width), static_cast<double>(obj.height),
+                                static_cast<double>(obj.keypoints.size())};
+            s_log.values(id, obj.name.c_str(), v, 7);
+            for (auto const& keypoint : obj.keypoints) {
+                const double xyz[] = {keypoint.x, keypoint.y, keypoint.z};
+                s_log.values(id, "xyz", xyz, 3);
             }
         }
     }
@@ -571,19 +628,18 @@ void objDetRKNN3588Callback(const std::vector<xv::Det2dObject>& res)
 
 void gazeCallback(xv::XV_ET_EYE_DATA_EX const& gazeData)
 {
-    if(enable_output_log){
-        std::cout << "enter gazeCallback" << std::endl;
-        printf("xvsdk_gaze timestamp = %lld\n", gazeData.timestamp);
-        printf("xvsdk_gaze ipd = %f\n", gazeData.ipd);
-        // printf("xvsdk_gaze recommend = %d\n", gazeData.recommend);
-        printf("xvsdk_gaze leftGaze gazePoint x = %f, y = %f, z = %f\n", gazeData.leftGaze.gazePoint.x, gazeData.leftGaze.gazePoint.y, gazeData.leftGaze.gazePoint.z);
-        // printf("xvsdk_gaze leftGaze rawPoint x = %f, y = %f, z = %f\n", gazeData.leftGaze.rawPoint.x, gazeData.leftGaze.rawPoint.y, gazeData.leftGaze.rawPoint.z);
-        // printf("xvsdk_gaze leftGaze smoothPoint x = %f, y = %f, z = %f\n", gazeData.leftGaze.smoothPoint.x, gazeData.leftGaze.smoothPoint.y, gazeData.leftGaze.smoothPoint.z);
-        printf("xvsdk_gaze rightGaze gazePoint x = %f, y = %f, z = %f\n", gazeData.rightGaze.gazePoint.x, gazeData.rightGaze.gazePoint.y, gazeData.rightGaze.gazePoint.z);
-        // printf("xvsdk_gaze rightGaze rawPoint x = %f, y = %f, z = %f\n", gazeData.rightGaze.rawPoint.x, gazeData.rightGaze.rawPoint.y, gazeData.rightGaze.rawPoint.z);
-        // printf("xvsdk_gaze rightGaze smoothPoint x = %f, y = %f, z = %f\n", gazeData.rightGaze.smoothPoint.x, gazeData.rightGaze.smoothPoint.y, gazeData.rightGaze.smoothPoint.z);
-        printf("xvsdk_gaze left pupil x = %f, y = %f\n", gazeData.leftPupil.pupilCenter.x, gazeData.leftPupil.pupilCenter.y);
-        printf("xvsdk_gaze right pupil x = %f, y = %f\n", gazeData.rightPupil.pupilCenter.x, gazeData.rightPupil.pupilCenter.y);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("xvsdk_gaze");
+    if (enable_output_log && limit.allow()) {
+        const double header[] = {static_cast<double>(gazeData.timestamp), gazeData.ipd};
+        s_log.values(id, "timestamp ipd", header, 2);
+        const double left[] = {gazeData.leftGaze.gazePoint.x, gazeData.leftGaze.gazePoint.y, gazeData.leftGaze.gazePoint.z};
+        s_log.values(id, "leftGaze", left, 3);
+        const double right[] = {gazeData.rightGaze.gazePoint.x, gazeData.rightGaze.gazePoint.y, gazeData.rightGaze.gazePoint.z};
+        s_log.values(id, "rightGaze", right, 3);
+        const double pupils[] = {gazeData.leftPupil.pupilCenter.x, gazeData.leftPupil.pupilCenter.y,
+                                 gazeData.rightPupil.pupilCenter.x, gazeData.rightPupil.pupilCenter.y};
+        s_log.values(id, "pupils", pupils, 4);
     }
 }
 
@@ -778,12 +834,13 @@ bool SetTofStreamMode(int cmd, std::shared_ptr<xv::TofCamera> camera)
 
 void cslamLocalizedCallback(float percent)
 {
-    static int k = 0;
-    if (k++ % 100 == 0) {
-        localized_on_reference_percent = static_cast<int>(percent * 100);
-        if(enable_output_log){
-            std::cout << "localized: " << localized_on_reference_percent << "%" << std::endl;
-        }
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("localized");
+    localized_on_reference_percent = static_cast<int>(percent * 100);
+    if (enable_output_log && limit.allow()) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%d%%", localized_on_reference_percent.load());
+        s_log.message(id, text);
     }
 }
 
@@ -851,80 +908,137 @@ void cameraOnOffSwitch(int switchMode, std::shared_ptr<xv::Device> device)
     }
 }
 
+// The tag detectors started with startTagDetector run in the SDK: their latest detections are
+// read when a new frame arrives, at most once per second, instead of every 25 ms. They are not
+// computed on that frame and carry no timestamp of their own.
+static int s_tagFisheyeId = -1;
+static int s_tagColorId = -1;
+// Get4EyeTagDetection detects on the host, on the frames themselves
+static std::shared_ptr<DetectionStage<xv::FisheyeImages, std::vector<xv::TagPose>>> s_fisheyeTagPoses;
+static int s_tag4EyeId = -1;
+
+/// Called from the frame callbacks: enqueues the detections into s_log, no I/O there
+template <class Detections>
+void printTagDetections(std::uint16_t id, Detections const& detections, std::string const& tagDetectorId, bool qrCode)
+{
+    if (detections.empty()) {
+        s_log.message(id, "Tag empty");
+        return;
+    }
+    for (auto const& d : detections) {
+        auto const& pose = d.second;
+        auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
+        if (qrCode) {
+            std::string codeStr = std::dynamic_pointer_cast<xv::ColorCameraEx>(device->colorCamera())->getCode(tagDetectorId,0);
+            s_log.message(id, ("qr code: " + codeStr).c_str());
+        }
+        char label[16];
+        std::snprintf(label, sizeof(label), "id=%d", static_cast<int>(d.first));
+        const double v[] = {pose.x(), pose.y(), pose.z(), pitchYawRoll[0] * 180 / M_PI, pitchYawRoll[1] * 180 / M_PI,
+                            pitchYawRoll[2] * 180 / M_PI, pose.confidence()};
+        s_log.values(id, label, v, 7);
+    }
+}
+
 void GetTagDetection(std::shared_ptr<xv::FisheyeCameras> fisheye, std::string tagDetectorId)
 {
-    stop = false;
-    tpos = std::thread ([fisheye, tagDetectorId]{
-        while (!stop) {
-            auto t0 = std::chrono::steady_clock::now();
-            std::this_thread::sleep_until(t0 + std::chrono::milliseconds(25));
-            auto detections = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(fisheye)->getTagDetections(tagDetectorId);
-            if (!detections.empty())
-            {
-                if(enable_output_log){
-                    std::cout << "Tag detections: ";
-                    for (auto const& d : detections) {
-                        auto const& pose = d.second;
-                        auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                        std::cout << "id=" << d.first
-                                  << " (" << pose.x() << "," << pose.y() << "," << pose.z() << ","
-                                  << pitchYawRoll[0] * 180 / M_PI << "," << pitchYawRoll[1] * 180 / M_PI << "," << pitchYawRoll[2] * 180 / M_PI << ") " << pose.confidence() << std::endl;
-                    }
-                }
-            }
-            else {
-                if(enable_output_log){
-                    std::cout << "Tag empty " << std::endl;;
-                }
-            }
-        }
-        });
+    if (s_tagFisheyeId >= 0) {
+        fisheye->unregisterCallback(s_tagFisheyeId);
+    }
+    auto fisheyeEx = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(fisheye);
+    s_tagFisheyeId = fisheye->registerCallback([fisheyeEx, tagDetectorId](xv::FisheyeImages const&) {
+        static LogRateLimiter limit;
+        static const std::uint16_t id = s_log.stream("fisheye tag");
+        if (enable_output_log && limit.allow()) {
+            printTagDetections(id, fisheyeEx->getTagDetections(tagDetectorId), tagDetectorId, false);
+        }
+    });
 }
 
 void GetTagDetectionrgb(std::shared_ptr<xv::ColorCamera> fisheye, std::string tagDetectorId)
 {
-    stop = false;
-    tpos = std::thread ([fisheye, tagDetectorId]{
-        while (!stop) {
-            auto t0 = std::chrono::steady_clock::now();
-            std::this_thread::sleep_until(t0 + std::chrono::milliseconds(25));
-            auto detections = std::dynamic_pointer_cast<xv::ColorCameraEx>(fisheye)->getTagDetections(tagDetectorId);
-            if (!detections.empty())
+    if (s_tagColorId >= 0) {
+        fisheye->unregisterCallback(s_tagColorId);
+    }
+    auto colorEx = std::dynamic_pointer_cast<xv::ColorCameraEx>(fisheye);
+    s_tagColorId = fisheye->registerCallback([colorEx, tagDetectorId](xv::ColorImage const&) {
+        static LogRateLimiter limit;
+        static const std::uint16_t id = s_log.stream("rgb tag");
+        if (enable_output_log && limit.allow()) {
+            printTagDetections(id, colorEx->getTagDetections(tagDetectorId), tagDetectorId, true);
+        }
+    });
+}
+
+/**
+ * @brief Detects the tags on the images of the first two fisheyes, on the host
+ *
+ * The tag poses are composed with the pose of the device at the time of the images, so slam
+ * must be running with poseCallback registered.
+ */
+void Get4EyeTagDetection(std::vector<xv::CalibrationEx> const& calibration)
+{
+    typedef DetectionStage<xv::FisheyeImages, std::vector<xv::TagPose>> Stage;
+    // no frame is submitted to the previous stage once its callback is gone
+    if (s_tag4EyeId >= 0) {
+        device->fisheyeCameras()->unregisterCallback(s_tag4EyeId);
+        s_tag4EyeId = -1;
+    }
+    s_fisheyeTagPoses = std::make_shared<Stage>(
+        [calibration]() -> Stage::Detector {
+            // one detector per worker, owned by the stage
+            auto detector = std::make_shared<xv::AprilTagDetector>(calibration);
+            return [detector](xv::FisheyeImages const& images) { return detector->detect(images, 0.16); };
+        },
+        [](Stage::Detection const& d) {
+            // pose of the device when the images were taken
+            xv::Pose pose;
+            if (!s_poseTimeline.poseAt(d.hostTimestamp, pose)) {
+                return;
+            }
+            std::cout << d.result.size() << std::endl;
+            for(auto p : d.result)
             {
-                if(enable_output_log){
-                    std::cout << "Tag detections: ";
-                    for (auto const& d : detections) {
-                        auto const& pose = d.second;
-                        auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                        std::string codeStr = std::dynamic_pointer_cast<xv::ColorCameraEx>(device->colorCamera())->getCode(tagDetectorId,0);
-                        printf("qr code: %s\n", codeStr.c_str());
-                        std::cout << "id=" << d.first
-                                  << " (" << pose.x() << "," << pose.y() << "," << pose.z() << ","
-                                  << pitchYawRoll[0] * 180 / M_PI << "," << pitchYawRoll[1] * 180 / M_PI << "," << pitchYawRoll[2] * 180 / M_PI << ") " << pose.confidence() << std::endl;
-                    }
-                }
-            }
-            else {
-                if(enable_output_log){
-                    std::cout << "Tag empty " << std::endl;;
-                }
+                auto tagPose = pose * p.transform;
+                auto pitchYawRoll = xv::rotationToPitchYawRoll(tagPose.rotation());
+                std::cout << "tag pose: " << tagPose.x() << "," << tagPose.y() << "," << tagPose.z() << "," << pitchYawRoll[0]*180/M_PI << "," << pitchYawRoll[1]*180/M_PI << "," << pitchYawRoll[2]*180/M_PI << std::endl;
             }
-        }
         });
+    // the callback keeps its stage alive, even if it runs while the stage is replaced or stopped
+    std::shared_ptr<Stage> stage = s_fisheyeTagPoses;
+    s_tag4EyeId = device->fisheyeCameras()->registerCallback([stage](xv::FisheyeImages const& stereo) {
+        if (stereo.images.size() < 2) {
+            return;
+        }
+        // the detector is calibrated for the first two cameras
+        xv::FisheyeImages images;
+        images.edgeTimestampUs = stereo.edgeTimestampUs;
+        images.hostTimestamp = stereo.hostTimestamp;
+        images.id = stereo.id;
+        images.images.assign(stereo.images.begin(), stereo.images.begin() + 2);
+        stage->submit(images);
+    });
 }
 
 void StopGetTag()
 {
-    stop = true;
-    if (tpos.joinable())
-    {
-        tpos.join();
+    if (s_tagFisheyeId >= 0) {
+        device->fisheyeCameras()->unregisterCallback(s_tagFisheyeId);
+        s_tagFisheyeId = -1;
     }
+    if (s_tagColorId >= 0) {
+        device->colorCamera()->unregisterCallback(s_tagColorId);
+        s_tagColorId = -1;
+    }
+    // no more frames submitted, then wait for the detections in progress
+    if (s_tag4EyeId >= 0) {
+        device->fisheyeCameras()->unregisterCallback(s_tag4EyeId);
+        s_tag4EyeId = -1;
+    }
+    s_fisheyeTagPoses.reset();
 }
 
 class TOFCallBackFun;
-std::string timeShowStr(std::int64_t edgeTimestampUs, double hostTimestamp);
-std::string timeShowStr(double hostTimestamp);
 
 
 std::string  tagDetectorId;
@@ -1070,8 +1184,9 @@ class TOFCallBackFun
 public:
     static void tofCallback(xv::DepthImage const& tof)
     {
-        std::string types[] = { "Depth_16", "Depth_32", "IR", "Cloud", "Raw", "Eeprom" };
-        static FpsCount fc;
+        TraceScope trace("callback", "tof", tof.edgeTimestampUs, tof.hostTimestamp);
+        static const char* const types[] = { "Depth_16", "Depth_32", "IR", "Cloud", "Raw", "Eeprom" };
+        static StreamStats fc;
         int type = static_cast<int>(tof.type);
         if (tof.type != xv::DepthImage::Type::Depth_16 &&
             tof.type != xv::DepthImage::Type::Depth_32 &&
@@ -1079,10 +1194,12 @@ public:
         {
             return;
         }
-        fc.tic();
-        static int k = 1;
-        if (k++ % 20 == 0)
+        fc.tic(tof.edgeTimestampUs, tof.hostTimestamp);
+        static LogRateLimiter limit;
+        static const std::uint16_t id = s_log.stream("tof");
+        if (limit.allow())
         {
+            reportTelemetry("tof", fc, tof.hostTimestamp);
             xv::TofCamera::Manufacturer manufacturer = m_tofCamera->getManufacturer();
             if (m_tofCamera && m_tofCameraParas.getStreamMode() == xv::TofCamera::StreamMode::CloudOnly &&
                 manufacturer == xv::TofCamera::Manufacturer::Sony)
@@ -1090,30 +1207,29 @@ public:
                 auto points = m_tofCamera->depthImageToPointCloud(tof)->points;
                 auto firstPoint = points.begin();
                 if(enable_output_log){
-                    std::cout << "type:sony tof cloud point@" << tof.width << "x" << tof.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+                    s_log.frame(id, tof.edgeTimestampUs, tof.hostTimestamp, fc.fps(), tof.width, tof.height, "sony cloud point");
                 }
             }
             else if (m_tofCamera)
             {
                 if(enable_output_log){
-                    std::cout << "type:" << types[type] << "@" << tof.width << "x" << tof.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+                    s_log.frame(id, tof.edgeTimestampUs, tof.hostTimestamp, fc.fps(), tof.width, tof.height, types[type]);
                 }
             }
-            k = 1;
         }
     }
 
     static void colorDepthImageCallback(const xv::DepthColorImage& depthColor)
     {
-        static FpsCount fc;
-        fc.tic();
-        static int k = 0;
-        if (k++ % 15 == 0)
+        TraceScope trace("callback", "rgbd", depthColor.edgeTimestampUs, depthColor.hostTimestamp);
+        static StreamStats fc;
+        fc.tic(depthColor.hostTimestamp);
+        static LogRateLimiter limit;
+        static const std::uint16_t id = s_log.stream("RGBD");
+        if (limit.allow())
         {
             if(enable_output_log){
-                std::cout << "[ RGBD ]" << timeShowStr(depthColor.hostTimestamp)
-                          << depthColor.width << "x" << depthColor.height << "@"
-                          << std::round(fc.fps()) << "fps" << std::endl;
+                s_log.frame(id, depthColor.hostTimestamp, fc.fps(), depthColor.width, depthColor.height);
             }
         }
     }
@@ -1184,22 +1300,24 @@ class SGBMCallback
 public:
     static void sgbmCallback(const xv::SgbmImage& sgbm_image)
     {
-        static FpsCount fc;
+        TraceScope trace("callback", "sgbm", sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp);
+        static StreamStats fc;
         fc.tic();
-        static int k = 0;
-        if (k++ % 10 == 0) {
+        static LogRateLimiter limit;
+        static const std::uint16_t id = s_log.stream("sgbm");
+        if (limit.allow()) {
             xv::SgbmImage::Type streamMode = paras.getStreamMode();
             if (streamMode == xv::SgbmImage::Type::Depth)
             {
                 if(enable_output_log){
-                    std::cout << "ImageType:Depth@" << "sgbm_image " << sgbm_image.width << "x" << sgbm_image.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+                    s_log.frame(id, sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp, fc.fps(), sgbm_image.width, sgbm_image.height, "Depth");
                 }
             }
             else if (streamMode == xv::SgbmImage::Type::PointCloud)
             {
                 auto pointcloud = sgbmCamera->depthImageToPointCloud(sgbm_image);
                 if(enable_output_log){
-                    std::cout << "ImageType:PointCloud@" << "sgbm_image " << sgbm_image.width << "x" << sgbm_image.height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+                    s_log.frame(id, sgbm_image.edgeTimestampUs, sgbm_image.hostTimestamp, fc.fps(), sgbm_image.width, sgbm_image.height, "PointCloud");
                 }
             }
         }
@@ -1597,33 +1715,17 @@ void setTofParas(const std::shared_ptr<xv::Device> device)
     }
 }
 
-std::string timeShowStr(std::int64_t edgeTimestampUs, double hostTimestamp)
-{
-    char s[1024];
-    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() * 1e-6;
-    std::sprintf(s, " (device=%lld host=%.4f now=%.4f delay=%.4f) ", (long long)edgeTimestampUs, hostTimestamp, now, now - hostTimestamp);
-    return std::string(s);
-}
-
-std::string timeShowStr(double hostTimestamp)
-{
-    char s[1024];
-    double now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() * 1e-6;
-    std::sprintf(s, " (host=%.4f now=%.4f delay=%.4f) ", hostTimestamp, now, now - hostTimestamp);
-    return std::string(s);
-}
-
 void colorCameraCallback(xv::ColorImage const& rgb)
 {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if (k++ % 25 == 0)
+    TraceScope trace("callback", "rgb", rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(rgb.edgeTimestampUs, rgb.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("rgb");
+    if (limit.allow())
     {
         if(enable_output_log){
-            std::cout << "rgb@" << timeShowStr(rgb.edgeTimestampUs, rgb.hostTimestamp)
-                      << rgb.width << "x" << rgb.height << "@"
-                      << std::round(fc.fps()) << "fps" << std::endl;
+            s_log.frame(id, rgb.edgeTimestampUs, rgb.hostTimestamp, fc.fps(), rgb.width, rgb.height);
         }
     }
 }
@@ -1829,11 +1931,13 @@ void gpsDistanceDataCallback(const xv::GPSDistanceData &gpsDistanceData)
 
 void feDewarpCallback(xv::FisheyeImages const & stereo)
 {
-    static FpsCount fc;
-    fc.tic();
-    static int k = 0;
-    if(k++%50==0){
-        std::cout << "stereo dewarp "  << timeShowStr(stereo.edgeTimestampUs, stereo.hostTimestamp) << stereo.images[0].width << "x" << stereo.images[0].height << "@" << std::round(fc.fps()) << "fps" << std::endl;
+    TraceScope trace("callback", "stereo dewarp", stereo.edgeTimestampUs, stereo.hostTimestamp);
+    static StreamStats fc;
+    fc.tic(stereo.edgeTimestampUs, stereo.hostTimestamp);
+    static LogRateLimiter limit;
+    static const std::uint16_t id = s_log.stream("stereo dewarp");
+    if(limit.allow()){
+        s_log.frame(id, stereo.edgeTimestampUs, stereo.hostTimestamp, fc.fps(), stereo.images[0].width, stereo.images[0].height);
     }
 }
 
@@ -1862,28 +1966,6 @@ bool xvhandOpenCLEnvCheck()
     return true;
 }
 
-xv::FisheyeImages s_images;
-std::mutex s_fe_mutex;
-xv::Pose s_pose;
-void Get4EyeTagDetection(xv::AprilTagDetector& detector)
-{
-    stop = false;
-    tpos = std::thread ([&detector]{
-        while (!stop) {
-            auto t0 = std::chrono::steady_clock::now();
-            std::this_thread::sleep_until(t0 + std::chrono::milliseconds(25));
-            std::vector<xv::TagPose> tags = detector.detect(s_images, 0.16);
-            std::cout << tags.size() << std::endl;
-            for(auto p : tags)
-            {
-                auto tagPose = s_pose * p.transform;
-                auto pitchYawRoll = xv::rotationToPitchYawRoll(tagPose.rotation());
-                std::cout << "tag pose: " << tagPose.x() << "," << tagPose.y() << "," << tagPose.z() << "," << pitchYawRoll[0]*180/M_PI << "," << pitchYawRoll[1]*180/M_PI << "," << pitchYawRoll[2]*180/M_PI << std::endl;
-            }
-        }
-        });
-}
-
 int main( int argc, char* argv[] ) try
 {
     // may change the log level this way :
@@ -1997,6 +2079,8 @@ int main( int argc, char* argv[] ) try
         "110: Stop STM callback\n"
         "111: Get four eye apriltag\n"
         "112: Get QRcode apriltag\n"
+        "116: Start/Stop latency trace\n"
+        "117: Write latency trace (demo_api_trace.json, demo_api_trace.bin)\n"
         "0 : exit program\n"
         "------------------------------\n"
         "enter select:"
@@ -4216,25 +4300,12 @@ int main( int argc, char* argv[] ) try
             auto c = std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->calibrationEx();
             c.pop_back();
             c.pop_back();
-            xv::AprilTagDetector detector(c);
-
-            device->fisheyeCameras()->registerCallback([](xv::FisheyeImages const & stereo){
-                s_fe_mutex.lock();
-                s_images.edgeTimestampUs = stereo.edgeTimestampUs;
-                s_images.hostTimestamp = stereo.hostTimestamp;
-                s_images.id = stereo.id;
-                s_images.images.resize(0);
-                s_images.images.push_back(stereo.images[0]);
-                s_images.images.push_back(stereo.images[1]);
-                s_fe_mutex.unlock();
-            });
+            Get4EyeTagDetection(c);
 
             device->fisheyeCameras()->start();
 
             device->slam()->start();
-            device->slam()->getPoseAt(s_pose, s_images.hostTimestamp);
-
-            Get4EyeTagDetection(detector);
+            poseId = device->slam()->registerCallback(poseCallback);
 
             break;
         }
@@ -4315,6 +4386,22 @@ int main( int argc, char* argv[] ) try
             std::cout << "register imu successfully" << std::endl;
             break;
         }
+        case 116:
+        {
+            FrameTrace::enable(!FrameTrace::enabled());
+            std::cout << "latency trace " << (FrameTrace::enabled() ? "started" : "stopped") << std::endl;
+            break;
+        }
+        case 117:
+        {
+            FrameTraceSnapshot trace = FrameTrace::snapshot();
+            if (trace.writeChrome("demo_api_trace.json") && trace.writeBinary("demo_api_trace.bin")) {
+                std::cout << trace.spans.size() << " spans written to demo_api_trace.json / .bin" << std::endl;
+            } else {
+                std::cout << "Cannot write demo_api_trace.json / .bin" << std::endl;
+            }
+            break;
+        }
         default:
             printf("bad command\n");
         }
@@ -4323,6 +4410,7 @@ int main( int argc, char* argv[] ) try
     if (tpos.joinable()) {
         tpos.join();
     }
+    StopGetTag();
 #ifdef _WIN32
 #else
     vsc_client_pipe_terminal_srv();
@@ -5,7 +5,7 @@
 #include <mutex>
 #include <cmath>
 
-#include "fps_count.hpp"
+#include "stream_stats.hpp"
 #define USE_GET_DEVICES_UNTIL_TIMEOUT 1
 
 class CameraDevice {
@@ -17,9 +17,6 @@ public:
 	CameraDevice(const CameraDevice& cam) {
 		this->m_device = cam.m_device;
 		this->m_deviceName = cam.m_deviceName;
-		this->imu_fc = cam.imu_fc;
-		this->fe_fc = cam.fe_fc;
-		this->slam_fc = cam.slam_fc;
 	}
 
 	void start()
@@ -76,10 +73,10 @@ public:
 private:
 	std::shared_ptr<xv::Device> m_device = {};
 	std::string m_deviceName = "";
-	FpsCount imu_fc;
-	FpsCount fe_fc;
-	FpsCount slam_fc;
-    FpsCount rgb_fc;
+	StreamStats imu_fc;
+	StreamStats fe_fc;
+	StreamStats slam_fc;
+    StreamStats rgb_fc;
 	std::mutex m_imumtx;
 	std::mutex m_femtx;
 	std::mutex m_slammtx;
@@ -1,5 +1,4 @@
 
-
 #ifdef _WIN32
 int main()
 {
@@ -14,12 +13,6 @@ int main()
 
 #include "pipe_srv.h"
 
-static int vsc_srv_recv_pipe_fd = -1;
-static int vsc_srv_send_pipe_fd = -1;
-
-#define MENU_INFO_LEN		(4096)
-static char menu_info[MENU_INFO_LEN] = { 0 };
-
 
 void vsc_srv_sig_handler(int sig)
 {
@@ -36,43 +29,27 @@ void vsc_srv_sig_handler(int sig)
 		printf("catch SIGTERM\n");
 		break;
 	}printf("%s\n", __func__);
-	vsc_srv_release_handle(&vsc_srv_send_pipe_fd, &vsc_srv_recv_pipe_fd);
-	exit(0);
+	vsc_srv_quit = 1;
 }
 
 int main(void)
 {
 	int retval;
-	int cmdbuf[4] = { SRV_CMD_FLAG1, SRV_CMD_FLAG2, SRV_CMD_FLAG3, -1 };
+	struct sigaction sa;
 
-	retval = vsc_pipe_init();
-	if (retval != 0) {
-		printf("vsc cmd pipe init fail: %d\n", retval);
-		return retval;
-	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = vsc_srv_sig_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
 
-	printf("wait for client connect....\n");
-	retval = vsc_server_get_handle(&vsc_srv_send_pipe_fd, &vsc_srv_recv_pipe_fd);
+	printf("wait for clients on %s ....\n", VSC_SRV_SOCKET);
+	// menus are printed here, a number typed answers the oldest one
+	retval = vsc_server_run(VSC_SRV_SOCKET, STDIN_FILENO);
 	if (retval != 0) {
-		printf("vsc pipe server get handler fail: %d\n", retval);
+		printf("vsc pipe server fail: %d\n", retval);
 		return retval;
 	}
-	signal(SIGINT, vsc_srv_sig_handler);
-
-	printf("ready handle: send:%d,recv:%d\n", vsc_srv_send_pipe_fd, vsc_srv_recv_pipe_fd);
-	while (1) {
-		retval = read(vsc_srv_recv_pipe_fd, menu_info, sizeof(menu_info) - 2);
-		menu_info[retval] = '\0';
-		printf("%s", menu_info);
-		//// only get input when have predefined header
-		//if (strncmp(menu_info, "\n\nDemo\n", 6) == 0) {
-		scanf("%d", &cmdbuf[3]);
-		write(vsc_srv_send_pipe_fd, cmdbuf, sizeof(cmdbuf));
-		//}
-	}
-
-	vsc_srv_release_handle(&vsc_srv_send_pipe_fd, &vsc_srv_recv_pipe_fd);
 	return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
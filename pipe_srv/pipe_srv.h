@@ -4,166 +4,660 @@
 #ifdef _WIN32
 
 #else
-#include <stdio.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Command / telemetry channel between demo-api (device client), pipe_srv (server) and
+ * controllers over a Unix domain socket. Every message is a vsc_msg_header followed by
+ * `length` payload bytes:
+ *
+ *   device     -> srv         : HELLO(role), MENU(id, menu text), TELEMETRY(vsc_telemetry)
+ *   srv        -> controllers : MENU(srv id, menu text), TELEMETRY
+ *   controller -> srv         : HELLO(role), COMMAND(srv id, int32)
+ *   srv        -> device      : COMMAND(id, int32)
+ *
+ * A menu is answered by the first COMMAND carrying its id, sent by a controller or typed
+ * on the pipe_srv console. The server runs one epoll loop and never blocks on a client:
+ * telemetry for a controller that does not keep up is dropped.
+ */
+#define VSC_SRV_SOCKET		"./vscSrv.sock"
+
+#define VSC_MSG_HELLO		(1)
+#define VSC_MSG_MENU		(2)
+#define VSC_MSG_COMMAND		(3)
+#define VSC_MSG_TELEMETRY	(4)
 
+#define VSC_ROLE_DEVICE		(1)
+#define VSC_ROLE_CONTROLLER	(2)
 
-#define VSC_SRV_RECV_PIPE	"./vscSrvRfifo"   // client write,
-#define VSC_SRV_SEND_PIPE	"./vscSrvWfifo"   // client read
+#define VSC_MSG_MAX_PAYLOAD	(64 * 1024)
 
-#define SRV_CMD_FLAG1	('C')
-#define SRV_CMD_FLAG2	('M')
-#define SRV_CMD_FLAG3	('D')
+struct vsc_msg_header {
+	uint32_t length;	/* payload bytes */
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t id;		/* request id of MENU / COMMAND */
+};
 
-#define IS_PIPE_SRV_CMD(cmd1, cmd2, cmd3) \
-	((cmd1==SRV_CMD_FLAG1) && (cmd2==SRV_CMD_FLAG2) && (cmd3==SRV_CMD_FLAG3))
+/* stream health, pushed by the device client */
+struct vsc_telemetry {
+	char stream[16];
+	double host_timestamp;
+	double fps;
+	double latency_p50_ms;
+	double latency_p99_ms;
+	uint64_t count;
+	uint64_t dropped;
+	int32_t has_pose;
+	float confidence;
+	double position[3];
+	double pitch_yaw_roll[3];
+};
 
-static int vsc_pipe_init(void)
+/*--------------  common ------------------------------------------- */
+static inline int vsc_write_all(int fd, const void *data, size_t size)
 {
-	int ret;
+	const char *p = (const char *)data;
 
-	if (access(VSC_SRV_RECV_PIPE, F_OK) != 0) {
-		ret = mkfifo(VSC_SRV_RECV_PIPE, 0666);
-		if (0 != ret) {
-			printf("mkfifo server recv pipe fail, ret: %d\n", ret);
+	while (size > 0) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
 			return -1;
-		}
-		printf("create server recv pipe\n");
-	} else {
-		printf("pipe server recv has already exist\n");
+		p += n;
+		size -= n;
 	}
+	return 0;
+}
 
-	if (access(VSC_SRV_SEND_PIPE, F_OK) != 0) {
-		ret = mkfifo(VSC_SRV_SEND_PIPE, 0666);
-		if (0 != ret) {
-			printf("mkfifo server send pipe fail, ret: %d\n", ret);
+static inline int vsc_read_all(int fd, void *data, size_t size)
+{
+	char *p = (char *)data;
+
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
 			return -1;
-		}
-		printf("create server send pipe\n");
-	} else {
-		printf("pipe server send has already exist\n");
+		p += n;
+		size -= n;
 	}
-
 	return 0;
 }
 
+/* blocking, header and payload in one system call */
+static inline int vsc_send_msg(int fd, int type, uint32_t id, const void *payload, uint32_t length)
+{
+	struct vsc_msg_header hdr;
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t n;
+
+	if (length > VSC_MSG_MAX_PAYLOAD)
+		return -1;
+	hdr.length = length;
+	hdr.type = (uint16_t)type;
+	hdr.reserved = 0;
+	hdr.id = id;
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = length;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	do {
+		n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0)
+		return -1;
+	if ((size_t)n < sizeof(hdr))
+		return vsc_write_all(fd, (const char *)&hdr + n, sizeof(hdr) - n) ||
+		       vsc_write_all(fd, payload, length);
+	n -= sizeof(hdr);
+	return vsc_write_all(fd, (const char *)payload + n, length - n);
+}
+
+/* blocking, payload bytes beyond `max` are discarded; returns the payload length */
+static inline int vsc_recv_msg(int fd, struct vsc_msg_header *hdr, void *payload, uint32_t max)
+{
+	char discard[256];
+	uint32_t left;
+
+	if (vsc_read_all(fd, hdr, sizeof(*hdr)) != 0 || hdr->length > VSC_MSG_MAX_PAYLOAD)
+		return -1;
+	left = hdr->length;
+	if (max > left)
+		max = left;
+	if (max > 0 && vsc_read_all(fd, payload, max) != 0)
+		return -1;
+	left -= max;
+	while (left > 0) {
+		uint32_t n = left < sizeof(discard) ? left : sizeof(discard);
+		if (vsc_read_all(fd, discard, n) != 0)
+			return -1;
+		left -= n;
+	}
+	return (int)hdr->length;
+}
+
+static inline int vsc_connect(const char *path, int role)
+{
+	struct sockaddr_un addr;
+	int32_t r = role;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    vsc_send_msg(fd, VSC_MSG_HELLO, 0, &r, sizeof(r)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* sends menu `id` and waits for its COMMAND, other messages are skipped */
+static inline int vsc_request_cmd(int fd, pthread_mutex_t *send_mtx, uint32_t id, const char *tip_info, int size)
+{
+	struct vsc_msg_header hdr;
+	int32_t cmd;
+	int ret;
+
+	pthread_mutex_lock(send_mtx);
+	ret = vsc_send_msg(fd, VSC_MSG_MENU, id, tip_info, (uint32_t)size);
+	pthread_mutex_unlock(send_mtx);
+	if (ret != 0)
+		return -1;
+
+	while (vsc_recv_msg(fd, &hdr, &cmd, sizeof(cmd)) >= 0) {
+		if (hdr.type == VSC_MSG_COMMAND && hdr.id == id && hdr.length == sizeof(cmd))
+			return cmd;
+	}
+	return -1;
+}
+
 /*--------------  server API -------------------------------------- */
-static int vsc_server_get_handle(int *sendfd, int *recvfd)
+#define VSC_SRV_MAX_CLIENTS	(64)
+#define VSC_SRV_MAX_PENDING	(64)
+#define VSC_SRV_MAX_QUEUED	(4 << 20)	/* output bytes before a client is disconnected */
+#define VSC_SRV_TELEMETRY_BACKLOG	(64 << 10)	/* output bytes before telemetry is dropped */
+
+#define VSC_SRV_EV_LISTEN	(VSC_SRV_MAX_CLIENTS)
+#define VSC_SRV_EV_CONSOLE	(VSC_SRV_MAX_CLIENTS + 1)
+
+struct vsc_srv_client {
+	int fd;				/* -1: free */
+	int role;
+	char *in;			/* header + VSC_MSG_MAX_PAYLOAD */
+	size_t in_used;
+	char *out;
+	size_t out_used;
+	size_t out_cap;
+	int want_out;			/* EPOLLOUT registered */
+	unsigned long telemetry_dropped;
+};
+
+struct vsc_srv_pending {
+	uint32_t srv_id;		/* 0: free */
+	int device;			/* client index */
+	uint32_t device_id;
+};
+
+struct vsc_srv {
+	int epfd;
+	int listenfd;
+	int consolefd;
+	struct vsc_srv_client clients[VSC_SRV_MAX_CLIENTS];
+	struct vsc_srv_pending pending[VSC_SRV_MAX_PENDING];
+	uint32_t next_id;
+	char line[256];
+	size_t line_used;
+};
+
+static volatile sig_atomic_t vsc_srv_quit = 0;
+
+static inline void vsc_srv_drop_client(struct vsc_srv *srv, int i)
 {
-	int ret = 0;
+	struct vsc_srv_client *c = &srv->clients[i];
+	int k;
 
-	ret = open(VSC_SRV_SEND_PIPE, O_WRONLY);
-	if (ret < 0) {
-		printf("open vsc cmd pipe for server fail, %d\n", ret);
-		return ret;
+	epoll_ctl(srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+	for (k = 0; k < VSC_SRV_MAX_PENDING; k++) {
+		if (srv->pending[k].srv_id && srv->pending[k].device == i)
+			srv->pending[k].srv_id = 0;
 	}
-	*sendfd = ret;
-	printf("pipe server get send handle: %d\n", *sendfd);
+}
+
+static inline int vsc_srv_flush(struct vsc_srv *srv, int i)
+{
+	struct vsc_srv_client *c = &srv->clients[i];
+	struct epoll_event ev;
+	size_t done = 0;
 
-	ret = open(VSC_SRV_RECV_PIPE, O_RDONLY);
-	if (ret < 0) {
-		printf("open vsc cmd pipe for server fail, %d\n", ret);
-		return ret;
+	while (done < c->out_used) {
+		ssize_t n = send(c->fd, c->out + done, c->out_used - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n <= 0)
+			return -1;
+		done += n;
+	}
+	if (done) {
+		memmove(c->out, c->out + done, c->out_used - done);
+		c->out_used -= done;
 	}
-	*recvfd = ret;
-	printf("pipe server get recv handle: %d\n", *recvfd);
 
+	if ((c->out_used > 0) != (c->want_out != 0)) {
+		c->want_out = c->out_used > 0;
+		ev.events = EPOLLIN | (c->want_out ? (uint32_t)EPOLLOUT : 0u);
+		ev.data.u32 = i;
+		epoll_ctl(srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
 	return 0;
 }
 
-static void vsc_srv_release_handle(int *sendfd, int *recvfd)
+/* queues one message for client `i` and writes what the socket takes */
+static inline void vsc_srv_queue(struct vsc_srv *srv, int i, int type, uint32_t id, const void *payload, uint32_t length, int droppable)
 {
-	if (*recvfd > 0)
-		close(*recvfd);
+	struct vsc_srv_client *c = &srv->clients[i];
+	struct vsc_msg_header hdr;
+	size_t need = sizeof(hdr) + length;
 
-	if (*sendfd > 0)
-		close(*sendfd);
-	return;
+	if (droppable && c->out_used > VSC_SRV_TELEMETRY_BACKLOG) {
+		c->telemetry_dropped++;
+		return;
+	}
+	if (c->out_used + need > c->out_cap) {
+		size_t cap = c->out_cap ? c->out_cap : 4096;
+		char *p;
+		while (cap < c->out_used + need)
+			cap *= 2;
+		p = cap <= VSC_SRV_MAX_QUEUED ? (char *)realloc(c->out, cap) : NULL;
+		if (!p) {
+			printf("client %d does not read, disconnected\n", c->fd);
+			vsc_srv_drop_client(srv, i);
+			return;
+		}
+		c->out = p;
+		c->out_cap = cap;
+	}
+	hdr.length = length;
+	hdr.type = (uint16_t)type;
+	hdr.reserved = 0;
+	hdr.id = id;
+	memcpy(c->out + c->out_used, &hdr, sizeof(hdr));
+	if (length)
+		memcpy(c->out + c->out_used + sizeof(hdr), payload, length);
+	c->out_used += need;
+	if (vsc_srv_flush(srv, i) != 0)
+		vsc_srv_drop_client(srv, i);
+}
+
+static inline void vsc_srv_answer(struct vsc_srv *srv, uint32_t srv_id, int32_t cmd)
+{
+	int k;
+
+	for (k = 0; k < VSC_SRV_MAX_PENDING; k++) {
+		struct vsc_srv_pending *p = &srv->pending[k];
+		if (p->srv_id && p->srv_id == srv_id) {
+			p->srv_id = 0;
+			vsc_srv_queue(srv, p->device, VSC_MSG_COMMAND, p->device_id, &cmd, sizeof(cmd), 0);
+			return;
+		}
+	}
+	/* already answered by another controller */
+}
+
+static inline void vsc_srv_handle(struct vsc_srv *srv, int i, const struct vsc_msg_header *hdr, const char *payload)
+{
+	struct vsc_srv_client *c = &srv->clients[i];
+	int k;
+
+	switch (hdr->type) {
+	case VSC_MSG_HELLO:
+		if (hdr->length == sizeof(int32_t))
+			memcpy(&c->role, payload, sizeof(int32_t));
+		break;
+	case VSC_MSG_MENU: {
+		struct vsc_srv_pending *slot = NULL;
+		uint32_t srv_id;
+		for (k = 0; k < VSC_SRV_MAX_PENDING && !slot; k++) {
+			if (!srv->pending[k].srv_id)
+				slot = &srv->pending[k];
+		}
+		if (!slot)
+			break;
+		srv_id = ++srv->next_id ? srv->next_id : ++srv->next_id;
+		slot->srv_id = srv_id;
+		slot->device = i;
+		slot->device_id = hdr->id;
+		if (srv->consolefd >= 0) {
+			fwrite(payload, 1, strnlen(payload, hdr->length), stdout);
+			fflush(stdout);
+		}
+		for (k = 0; k < VSC_SRV_MAX_CLIENTS; k++) {
+			if (srv->clients[k].fd >= 0 && srv->clients[k].role == VSC_ROLE_CONTROLLER)
+				vsc_srv_queue(srv, k, VSC_MSG_MENU, srv_id, payload, hdr->length, 0);
+		}
+		break;
+	}
+	case VSC_MSG_COMMAND:
+		if (hdr->length == sizeof(int32_t)) {
+			int32_t cmd;
+			memcpy(&cmd, payload, sizeof(cmd));
+			vsc_srv_answer(srv, hdr->id, cmd);
+		}
+		break;
+	case VSC_MSG_TELEMETRY:
+		for (k = 0; k < VSC_SRV_MAX_CLIENTS; k++) {
+			if (srv->clients[k].fd >= 0 && srv->clients[k].role == VSC_ROLE_CONTROLLER)
+				vsc_srv_queue(srv, k, VSC_MSG_TELEMETRY, hdr->id, payload, hdr->length, 1);
+		}
+		break;
+	default:
+		break;
+	}
 }
-/*------------------------------------------------------------------------- */
-static int vsc_cmd_recv_fd = -1;
-static int vsc_cmd_send_fd = -1;
-static int vsc_pipe_srv_pid = -1;
 
-static int vsc_client_pipe_init(void)
+static inline void vsc_srv_read(struct vsc_srv *srv, int i)
 {
-	int ret = 0;
+	struct vsc_srv_client *c = &srv->clients[i];
+	const size_t cap = sizeof(struct vsc_msg_header) + VSC_MSG_MAX_PAYLOAD;
 
-	ret = vsc_pipe_init();
-	if (ret != 0) return ret;
+	for (;;) {
+		ssize_t n = read(c->fd, c->in + c->in_used, cap - c->in_used);
+		size_t used = 0;
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0) {
+			vsc_srv_drop_client(srv, i);
+			return;
+		}
+		c->in_used += n;
 
-	ret = open(VSC_SRV_SEND_PIPE, O_RDONLY);
-	if (ret < 0) {
-		printf("open vsc cmd pipe for client recv fail, %d\n", ret);
-		return ret;
+		/* complete frames; the payload is followed by a NUL for the menu text */
+		while (c->in_used - used >= sizeof(struct vsc_msg_header)) {
+			struct vsc_msg_header hdr;
+			memcpy(&hdr, c->in + used, sizeof(hdr));
+			if (hdr.length > VSC_MSG_MAX_PAYLOAD) {
+				printf("client %d: bad message, disconnected\n", c->fd);
+				vsc_srv_drop_client(srv, i);
+				return;
+			}
+			if (c->in_used - used < sizeof(hdr) + hdr.length)
+				break;
+			{
+				char *payload = c->in + used + sizeof(hdr);
+				char saved = payload[hdr.length];
+				payload[hdr.length] = '\0';
+				vsc_srv_handle(srv, i, &hdr, payload);
+				if (c->fd < 0)
+					return;
+				payload[hdr.length] = saved;
+			}
+			used += sizeof(hdr) + hdr.length;
+		}
+		memmove(c->in, c->in + used, c->in_used - used);
+		c->in_used -= used;
 	}
-	vsc_cmd_recv_fd = ret;
-	printf("client pipe get recv handle: %d\n", vsc_cmd_recv_fd);
+}
 
-	ret = open(VSC_SRV_RECV_PIPE, O_WRONLY);
-	if (ret < 0) {
-		printf("open vsc cmd pipe for client send fail, %d\n", ret);
-		return ret;
+/* a number typed on the console answers the oldest pending menu */
+static inline void vsc_srv_console(struct vsc_srv *srv)
+{
+	ssize_t n = read(srv->consolefd, srv->line + srv->line_used, sizeof(srv->line) - 1 - srv->line_used);
+	char *eol;
+
+	if (n <= 0) {
+		epoll_ctl(srv->epfd, EPOLL_CTL_DEL, srv->consolefd, NULL);
+		srv->consolefd = -1;
+		return;
+	}
+	srv->line_used += n;
+	srv->line[srv->line_used] = '\0';
+	while ((eol = strchr(srv->line, '\n')) != NULL) {
+		uint32_t oldest = 0;
+		int k;
+		*eol = '\0';
+		for (k = 0; k < VSC_SRV_MAX_PENDING; k++) {
+			uint32_t id = srv->pending[k].srv_id;
+			if (id && (!oldest || id < oldest))
+				oldest = id;
+		}
+		if (oldest)
+			vsc_srv_answer(srv, oldest, atoi(srv->line));
+		else
+			printf("no menu waiting for a command\n");
+		srv->line_used -= eol + 1 - srv->line;
+		memmove(srv->line, eol + 1, srv->line_used + 1);
 	}
-	vsc_cmd_send_fd = ret;
-	printf("client pipe get send handle:%d\n", vsc_cmd_send_fd);
+	if (srv->line_used == sizeof(srv->line) - 1)
+		srv->line_used = 0;
+}
+
+static inline int vsc_srv_accept(struct vsc_srv *srv)
+{
+	struct epoll_event ev;
+	int fd, i;
 
-	printf("command pipe init for client successful\n");
+	while ((fd = accept4(srv->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		for (i = 0; i < VSC_SRV_MAX_CLIENTS && srv->clients[i].fd >= 0; i++)
+			;
+		if (i == VSC_SRV_MAX_CLIENTS) {
+			printf("too many clients\n");
+			close(fd);
+			continue;
+		}
+		srv->clients[i].fd = fd;
+		srv->clients[i].in = (char *)malloc(sizeof(struct vsc_msg_header) + VSC_MSG_MAX_PAYLOAD + 1);
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (!srv->clients[i].in || epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+			vsc_srv_drop_client(srv, i);
+	}
 	return 0;
 }
 
-static void vsc_client_pipe_deinit(void)
+/*
+ * Serves `path` until vsc_srv_quit is set. `consolefd` (usually 0, -1 for none) prints the
+ * menus and answers them with the numbers typed.
+ */
+static inline int vsc_server_run(const char *path, int consolefd)
 {
-	if (vsc_cmd_send_fd > 0)
-		close(vsc_cmd_send_fd);
+	struct vsc_srv *srv;
+	struct sockaddr_un addr;
+	struct epoll_event ev, events[16];
+	int i, n, ret = 0;
+
+	srv = (struct vsc_srv *)calloc(1, sizeof(*srv));
+	if (!srv)
+		return -1;
+	for (i = 0; i < VSC_SRV_MAX_CLIENTS; i++)
+		srv->clients[i].fd = -1;
+	srv->consolefd = consolefd;
 
-	if (vsc_cmd_recv_fd > 0)
-		close(vsc_cmd_recv_fd);
+	unlink(path);
+	srv->listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (srv->listenfd < 0 || bind(srv->listenfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(srv->listenfd, 16) != 0) {
+		printf("cannot listen on %s: %s\n", path, strerror(errno));
+		if (srv->listenfd >= 0)
+			close(srv->listenfd);
+		free(srv);
+		return -1;
+	}
+	srv->epfd = epoll_create1(EPOLL_CLOEXEC);
+	ev.events = EPOLLIN;
+	ev.data.u32 = VSC_SRV_EV_LISTEN;
+	epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->listenfd, &ev);
+	if (srv->consolefd >= 0) {
+		ev.data.u32 = VSC_SRV_EV_CONSOLE;
+		if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->consolefd, &ev) != 0)
+			srv->consolefd = -1;
+	}
 
+	while (!vsc_srv_quit) {
+		n = epoll_wait(srv->epfd, events, sizeof(events) / sizeof(events[0]), 500);
+		if (n < 0 && errno != EINTR) {
+			ret = -1;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			uint32_t k = events[i].data.u32;
+			if (k == VSC_SRV_EV_LISTEN) {
+				vsc_srv_accept(srv);
+			} else if (k == VSC_SRV_EV_CONSOLE) {
+				if (srv->consolefd >= 0)
+					vsc_srv_console(srv);
+			} else if (srv->clients[k].fd >= 0) {
+				if ((events[i].events & EPOLLOUT) && vsc_srv_flush(srv, k) != 0)
+					vsc_srv_drop_client(srv, k);
+				else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+					vsc_srv_read(srv, k);
+			}
+		}
+	}
+
+	for (i = 0; i < VSC_SRV_MAX_CLIENTS; i++) {
+		if (srv->clients[i].fd >= 0)
+			vsc_srv_drop_client(srv, i);
+	}
+	close(srv->epfd);
+	close(srv->listenfd);
+	unlink(path);
+	free(srv);
+	return ret;
+}
+
+/*-------------- device client API (demo-api) ---------------------- */
+static int vsc_cmd_fd = -1;
+static int vsc_pipe_srv_pid = -1;
+static uint32_t vsc_cmd_request_id = 0;
+static pthread_mutex_t vsc_cmd_send_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static inline int vsc_client_pipe_init(void)
+{
+	int waiting = 0;
+
+	/* waits for the server, as opening the FIFOs used to */
+	while ((vsc_cmd_fd = vsc_connect(VSC_SRV_SOCKET, VSC_ROLE_DEVICE)) < 0) {
+		if (errno != ENOENT && errno != ECONNREFUSED) {
+			printf("connect to %s fail: %s\n", VSC_SRV_SOCKET, strerror(errno));
+			return -1;
+		}
+		if (!waiting++)
+			printf("wait for pipe server on %s ...\n", VSC_SRV_SOCKET);
+		usleep(100000);
+	}
+	printf("command channel init for client successful\n");
+	return 0;
+}
+
+static inline void vsc_client_pipe_deinit(void)
+{
+	if (vsc_cmd_fd >= 0)
+		close(vsc_cmd_fd);
+	vsc_cmd_fd = -1;
 	return;
 }
-static int vsc_client_pipe_get_srv_pid()
+
+static inline int vsc_client_pipe_get_srv_pid()
 {
-	FILE *fp = popen("ps -e | grep \'pipe_srv\' | awk \'{print $1}\'", "r");
-	char buffer[10] = {0};
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
 
-    if (fp == NULL) {
+	if (vsc_cmd_fd < 0 || getsockopt(vsc_cmd_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
 		printf("Cannot find pipe service process\n");
-        return -1;
-    }
-
-	while (NULL != fgets(buffer, 10, fp)) {
-		vsc_pipe_srv_pid = atoi(buffer);
-		printf("vsc pipe server pid: %d\n", vsc_pipe_srv_pid);
+		return -1;
 	}
-	pclose(fp);
+	vsc_pipe_srv_pid = cred.pid;
+	printf("vsc pipe server pid: %d\n", vsc_pipe_srv_pid);
 	return 0;
 }
 
-static int vsc_client_pipe_request_cmd(const char *tip_info, int size)
+static inline int vsc_client_pipe_request_cmd(const char *tip_info, int size)
 {
-	int cmdbuf[16] = {0};
-	int retval;
+	int cmd;
 
-	retval = write(vsc_cmd_send_fd, tip_info, size);
-	retval = read(vsc_cmd_recv_fd, cmdbuf, sizeof(cmdbuf));
-	if (IS_PIPE_SRV_CMD(cmdbuf[0], cmdbuf[1], cmdbuf[2])) {
-		printf("recv cmd %d\n", cmdbuf[3]);
-		return cmdbuf[3];
-	}
-	return -1;
+	if (vsc_cmd_fd < 0)
+		return -1;
+	cmd = vsc_request_cmd(vsc_cmd_fd, &vsc_cmd_send_mtx, ++vsc_cmd_request_id, tip_info, size);
+	if (cmd >= 0)
+		printf("recv cmd %d\n", cmd);
+	return cmd;
 }
 
-static int vsc_client_pipe_terminal_srv(void)
+/* never blocks the caller (stream callbacks): dropped when the socket buffer is full */
+static inline int vsc_client_send_telemetry(const struct vsc_telemetry *t)
+{
+	struct pollfd pfd;
+	int ret;
+
+	if (vsc_cmd_fd < 0)
+		return -1;
+	pfd.fd = vsc_cmd_fd;
+	pfd.events = POLLOUT;
+	if (pthread_mutex_trylock(&vsc_cmd_send_mtx) != 0)
+		return -1;
+	ret = (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT)) ?
+	      vsc_send_msg(vsc_cmd_fd, VSC_MSG_TELEMETRY, 0, t, sizeof(*t)) : -1;
+	pthread_mutex_unlock(&vsc_cmd_send_mtx);
+	return ret;
+}
+
+static inline int vsc_client_pipe_terminal_srv(void)
 {
 	if (vsc_pipe_srv_pid > 0)
 		kill(vsc_pipe_srv_pid, SIGTERM);
 	return 0;
 }
+
+/*-------------- controller API ------------------------------------ */
+/* then vsc_recv_msg(): MENU (answer with vsc_controller_send_command) and TELEMETRY */
+static inline int vsc_controller_connect(void)
+{
+	return vsc_connect(VSC_SRV_SOCKET, VSC_ROLE_CONTROLLER);
+}
+
+static inline int vsc_controller_send_command(int fd, uint32_t menu_id, int cmd)
+{
+	int32_t c = cmd;
+	return vsc_send_msg(fd, VSC_MSG_COMMAND, menu_id, &c, sizeof(c));
+}
 #endif
 
 #endif //__VSC_CLIENT_H_
@@ -0,0 +1,56 @@
+
+#ifdef _WIN32
+int main()
+{
+
+}
+
+#else
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pipe_srv.h"
+
+/*
+ * Controller of pipe_srv: prints the telemetry pushed by demo-api and answers its next
+ * menus with the commands given on the command line, in order.
+ *
+ * usage: vsc_ctl [cmd ...]        e.g. vsc_ctl 1 5   (start, then the 5th menu entry)
+ */
+int main(int argc, char *argv[])
+{
+	struct vsc_msg_header hdr;
+	union {
+		struct vsc_telemetry telemetry;
+		char text[4096];
+	} payload;
+	int next = 1;
+	int fd;
+
+	fd = vsc_controller_connect();
+	if (fd < 0) {
+		printf("cannot connect to %s: %s\n", VSC_SRV_SOCKET, strerror(errno));
+		return 1;
+	}
+
+	while (vsc_recv_msg(fd, &hdr, &payload, sizeof(payload)) >= 0) {
+		if (hdr.type == VSC_MSG_TELEMETRY && hdr.length == sizeof(payload.telemetry)) {
+			const struct vsc_telemetry *t = &payload.telemetry;
+			printf("%-8s %6.1ffps latency p50=%.2fms p99=%.2fms frames=%llu dropped=%llu",
+			       t->stream, t->fps, t->latency_p50_ms, t->latency_p99_ms,
+			       (unsigned long long)t->count, (unsigned long long)t->dropped);
+			if (t->has_pose)
+				printf(" p=(%.3f %.3f %.3f) r=(%.1f %.1f %.1f) confidence=%.2f",
+				       t->position[0], t->position[1], t->position[2],
+				       t->pitch_yaw_roll[0], t->pitch_yaw_roll[1], t->pitch_yaw_roll[2], t->confidence);
+			printf("\n");
+		} else if (hdr.type == VSC_MSG_MENU && next < argc) {
+			printf("menu %u -> %s\n", hdr.id, argv[next]);
+			vsc_controller_send_command(fd, hdr.id, atoi(argv[next++]));
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include <xv-sdk.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "depth_codec.h"
+#include "stream_stats.hpp"
+#include "xvrec.h"
+#include "xvrec_xv.h"
+
+/**
+ * Records the device streams into one .xvrec file, see common/xvrec.h for the format.
+ *
+ * usage: record [output.xvrec] [--depth-codec] [--sgbm-error mm] [imu] [fisheye] [tof] [rgb] [sgbm] [slam]
+ *
+ * Without stream names every stream the device supports is recorded. The callbacks only
+ * copy the payload into the writer's chunk buffer, the disk is written on the writer thread.
+ *
+ * --depth-codec compresses ToF Depth_16 / IR and SGBM depth losslessly (common/depth_codec.h),
+ * --sgbm-error compresses SGBM depth within `mm` of the original, depths outside the
+ * min_distance / max_distance of the sgbm_config dropped (0).
+ */
+
+static struct xv::sgbm_config s_sgbmConfig = {
+    1 ,//enable_dewarp
+    1.0, //dewarp_zoom_factor
+    0, //enable_disparity
+    1, //enable_depth
+    0, //enable_point_cloud
+    0.08, //baseline
+    96, //fov
+    255, //disparity_confidence_threshold
+    {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}, //homography
+    1, //enable_gamma
+    2.2, //gamma_value
+    0, //enable_gaussian
+    0, //mode
+    8000, //max_distance
+    100, //min_distance
+};
+
+static XvRecWriter s_writer;
+static StreamStats s_stats[kXvRecTrackCount];
+// null: depth recorded raw
+static std::unique_ptr<DepthEncoder> s_tofEncoder;
+static std::unique_ptr<DepthEncoder> s_sgbmEncoder;
+
+template <class T>
+static void record(XvRecTrack track, T const& data, std::int64_t edgeTimestampUs, double hostTimestamp)
+{
+    s_stats[static_cast<int>(track)].tic(edgeTimestampUs, hostTimestamp);
+    xvrecAppend(s_writer, data);
+}
+
+/// ToF / SGBM frames, through the depth codec when enabled
+template <class T>
+static void recordDepth(XvRecTrack track, T const& data, std::unique_ptr<DepthEncoder> const& encoder)
+{
+    if (!encoder) {
+        record(track, data, data.edgeTimestampUs, data.hostTimestamp);
+        return;
+    }
+    s_stats[static_cast<int>(track)].tic(data.edgeTimestampUs, data.hostTimestamp);
+    xvrecAppend(s_writer, data, *encoder);
+}
+
+int main(int argc, char* argv[]) try
+{
+    std::string filename = "record.xvrec";
+    std::set<std::string> streams;
+    bool depthCodec = false;
+    int sgbmError = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() > 6 && arg.compare(arg.size() - 6, 6, ".xvrec") == 0) {
+            filename = arg;
+        } else if (arg == "--depth-codec") {
+            depthCodec = true;
+        } else if (arg == "--sgbm-error" && i + 1 < argc) {
+            sgbmError = std::max(0, std::atoi(argv[++i]));
+        } else {
+            streams.insert(arg);
+        }
+    }
+    if (depthCodec) {
+        s_tofEncoder.reset(new DepthEncoder());
+        s_sgbmEncoder.reset(new DepthEncoder());
+    }
+    if (sgbmError >= 0) {
+        DepthEncoder::Options options;
+        options.mode = DepthCodecMode::Bounded;
+        options.minDepth = s_sgbmConfig.min_distance;
+        options.maxDepth = s_sgbmConfig.max_distance;
+        options.maxError = static_cast<std::uint16_t>(std::min(sgbmError, 32767));
+        s_sgbmEncoder.reset(new DepthEncoder(options));
+    }
+    auto wanted = [&streams](std::string const& name) { return streams.empty() || streams.count(name) > 0; };
+
+    std::cout << "xvsdk version: " << xv::version() << std::endl;
+    auto devices = xv::getDevices(10.);
+    if (devices.empty()) {
+        std::cout << "Timeout: no device found\n";
+        return EXIT_FAILURE;
+    }
+    auto device = devices.begin()->second;
+
+    if (!s_writer.open(filename, "xvsdk " + device->id())) {
+        std::cerr << "Cannot open " << filename << ": " << s_writer.error() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Recording to " << filename << (s_writer.usesDirectIo() ? " (O_DIRECT)" : "") << std::endl;
+
+    std::map<XvRecTrack, std::function<void()>> stops;
+
+    if (wanted("imu") && device->imuSensor()) {
+        int id = device->imuSensor()->registerCallback([](xv::Imu const& imu) {
+            record(XvRecTrack::Imu, imu, imu.edgeTimestampUs, imu.hostTimestamp);
+        });
+        device->imuSensor()->start();
+        stops[XvRecTrack::Imu] = [device, id] { device->imuSensor()->unregisterCallback(id); device->imuSensor()->stop(); };
+    }
+    if (wanted("fisheye") && device->fisheyeCameras()) {
+        int id = device->fisheyeCameras()->registerCallback([](xv::FisheyeImages const& fe) {
+            record(XvRecTrack::Fisheye, fe, fe.edgeTimestampUs, fe.hostTimestamp);
+        });
+        device->fisheyeCameras()->start();
+        stops[XvRecTrack::Fisheye] = [device, id] { device->fisheyeCameras()->unregisterCallback(id); device->fisheyeCameras()->stop(); };
+    }
+    if (wanted("tof") && device->tofCamera()) {
+        int id = device->tofCamera()->registerCallback([](xv::DepthImage const& tof) {
+            recordDepth(XvRecTrack::Depth, tof, s_tofEncoder);
+        });
+        device->tofCamera()->start();
+        stops[XvRecTrack::Depth] = [device, id] { device->tofCamera()->unregisterCallback(id); device->tofCamera()->stop(); };
+    }
+    if (wanted("rgb") && device->colorCamera()) {
+        int id = device->colorCamera()->registerCallback([](xv::ColorImage const& rgb) {
+            record(XvRecTrack::Color, rgb, rgb.edgeTimestampUs, rgb.hostTimestamp);
+        });
+        device->colorCamera()->start();
+        stops[XvRecTrack::Color] = [device, id] { device->colorCamera()->unregisterCallback(id); device->colorCamera()->stop(); };
+    }
+    if (wanted("sgbm") && device->sgbmCamera()) {
+        int id = device->sgbmCamera()->registerCallback([](xv::SgbmImage const& sgbm) {
+            recordDepth(XvRecTrack::Sgbm, sgbm, s_sgbmEncoder);
+        });
+        device->sgbmCamera()->start(s_sgbmConfig);
+        stops[XvRecTrack::Sgbm] = [device, id] { device->sgbmCamera()->unregisterCallback(id); device->sgbmCamera()->stop(); };
+    }
+    if (wanted("slam") && device->slam()) {
+        int id = device->slam()->registerCallback([](xv::Pose const& pose) {
+            record(XvRecTrack::Pose, pose, pose.edgeTimestampUs(), pose.hostTimestamp());
+        });
+        device->slam()->start();
+        stops[XvRecTrack::Pose] = [device, id] { device->slam()->unregisterCallback(id); device->slam()->stop(); };
+    }
+
+    std::atomic<bool> stop(false);
+    std::thread status([&stop, &stops] {
+        while (!stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (stop) {
+                break;
+            }
+            std::cout << "\n" << (s_writer.bytesWritten() >> 20) << " MB written" << std::endl;
+            for (auto const& s : stops) {
+                const int i = static_cast<int>(s.first);
+                std::cout << "  " << xvrecTrackName(s.first) << ": " << s_stats[i].summary()
+                          << " records=" << s_writer.records(s.first) << " not recorded=" << s_writer.dropped(s.first) << std::endl;
+            }
+            for (int i = 0; i < 4 && !stop; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+        }
+    });
+
+    std::cout << "Press ENTER to stop the recording" << std::endl;
+    std::cin.get();
+
+    stop = true;
+    status.join();
+    for (auto const& s : stops) {
+        s.second();
+    }
+
+    if (!s_writer.close()) {
+        std::cerr << "Error while writing " << filename << ": " << s_writer.error() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << filename << ": " << (s_writer.bytesWritten() >> 20) << " MB" << std::endl;
+    for (auto const& s : stops) {
+        std::cout << "  " << xvrecTrackName(s.first) << ": " << s_writer.records(s.first) << " records, "
+                  << s_writer.dropped(s.first) << " not recorded" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "slam_log.h"
+
+/**
+ * Loads a SLAM trajectory (ROS style pose dump such as data/slam_data.txt, or .xvrec file
+ * written by record or PoseLogger), prints a summary and converts it.
+ *
+ * usage: slam_log input [-o output.xvrec] [-c output.csv] [-t output.tum] [-k output.kitti]
+ *
+ *  -o  writes the poses as the Pose track of an xvrec file: reloaded by this tool without
+ *      parsing, and playable by `replay`
+ *  -c  writes timestamp,x,y,z,qx,qy,qz,qw,confidence (scripts/draw_slampath.py reads it), plus
+ *      cpu_usage for files logged by PoseLogger with it
+ *  -t  writes the TUM trajectory format (evo, TUM benchmark tools)
+ *  -k  writes the KITTI odometry format
+ */
+
+int main(int argc, char* argv[])
+{
+    std::string input, xvrecOutput;
+    std::vector<std::pair<SlamLogFormat, std::string>> exports;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+            xvrecOutput = argv[++i];
+        } else if (!std::strcmp(argv[i], "-c") && i + 1 < argc) {
+            exports.emplace_back(SlamLogFormat::Csv, argv[++i]);
+        } else if (!std::strcmp(argv[i], "-t") && i + 1 < argc) {
+            exports.emplace_back(SlamLogFormat::Tum, argv[++i]);
+        } else if (!std::strcmp(argv[i], "-k") && i + 1 < argc) {
+            exports.emplace_back(SlamLogFormat::Kitti, argv[++i]);
+        } else if (input.empty() && argv[i][0] != '-') {
+            input = argv[i];
+        } else {
+            input.clear();
+            break;
+        }
+    }
+    if (input.empty()) {
+        std::fprintf(stderr, "usage: %s input [-o output.xvrec] [-c output.csv] [-t output.tum] [-k output.kitti]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SlamTrajectory trajectory;
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    if (!slamLogLoad(input, trajectory, &error)) {
+        std::fprintf(stderr, "%s: %s\n", input.c_str(), error.c_str());
+        return EXIT_FAILURE;
+    }
+    const double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const std::size_t n = trajectory.size();
+    std::printf("%s: %zu poses loaded in %.2f ms\n", input.c_str(), n, loadMs);
+    if (n > 0) {
+        double length = 0, minConfidence = trajectory.confidence[0], sumConfidence = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (i > 0) {
+                const double dx = trajectory.position[0][i] - trajectory.position[0][i - 1];
+                const double dy = trajectory.position[1][i] - trajectory.position[1][i - 1];
+                const double dz = trajectory.position[2][i] - trajectory.position[2][i - 1];
+                length += std::sqrt(dx * dx + dy * dy + dz * dz);
+            }
+            minConfidence = std::min(minConfidence, trajectory.confidence[i]);
+            sumConfidence += trajectory.confidence[i];
+        }
+        const double span = trajectory.timestamp[n - 1] - trajectory.timestamp[0];
+        std::printf("  %.3f .. %.3f s  %.1f Hz  path %.3f m  confidence min %.2f mean %.2f\n", trajectory.timestamp[0],
+                    trajectory.timestamp[n - 1], span > 0 ? (n - 1) / span : 0., length, minConfidence, sumConfidence / n);
+    }
+
+    if (!xvrecOutput.empty()) {
+        if (!slamLogWriteXvRec(xvrecOutput, trajectory, &error)) {
+            std::fprintf(stderr, "%s: %s\n", xvrecOutput.c_str(), error.c_str());
+            return EXIT_FAILURE;
+        }
+        std::printf("wrote %s\n", xvrecOutput.c_str());
+    }
+    for (auto const& e : exports) {
+        if (!slamLogExport(e.second, trajectory, e.first, &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return EXIT_FAILURE;
+        }
+        std::printf("wrote %s\n", e.second.c_str());
+    }
+    return EXIT_SUCCESS;
+}
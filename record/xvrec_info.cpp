@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "xvrec.h"
+
+/**
+ * Prints the tracks of an .xvrec file: record count, time span and rate.
+ *
+ * usage: xvrec_info file.xvrec
+ */
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s file.xvrec\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    XvRecReader reader;
+    if (!reader.open(argv[1])) {
+        std::fprintf(stderr, "%s: %s\n", argv[1], reader.error().c_str());
+        return EXIT_FAILURE;
+    }
+    std::printf("%s: %s\n", argv[1], reader.header().description);
+    std::printf("%zu chunks%s\n", reader.chunks().size(), reader.hasDirectory() ? "" : " (no directory, recording was interrupted)");
+
+    for (int t = 1; t < kXvRecTrackCount; ++t) {
+        const XvRecTrack track = static_cast<XvRecTrack>(t);
+        const std::size_t n = reader.recordCount(track);
+        if (n == 0) {
+            continue;
+        }
+        const XvRecRecord first = reader.record(track, 0);
+        const XvRecRecord last = reader.record(track, n - 1);
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            bytes += reader.record(track, i).size;
+        }
+        const double span = last.hostTimestamp - first.hostTimestamp;
+        std::printf("  %-8s %8zu records  %10.3f .. %10.3f s  %7.1f Hz  %8.1f MB\n", xvrecTrackName(track), n,
+                    first.hostTimestamp, last.hostTimestamp, span > 0 ? (n - 1) / span : 0., bytes / 1048576.);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "replay_device.h"
+#include "stream_stats.hpp"
+#include "xvrec_synthetic.h"
+
+/**
+ * Plays a recording (see record/) or a synthetic one through ReplayDevice and reports the
+ * rate, latency and delivery lag of every stream. No device is needed.
+ *
+ * usage: replay [file.xvrec] [--synthetic seconds] [--data dir] [--speed x | --asap] [--loop] [--rebase]
+ *
+ *  --synthetic: generate a recording from the fixtures of data/ (written to file.xvrec,
+ *               default synthetic.xvrec) and play it
+ *  --speed: 1 real time (default), 2 twice as fast ...; --asap: as fast as possible
+ *  --rebase: host timestamps are moved onto the local clock so latencies are meaningful
+ */
+
+static StreamStats s_imuStats, s_fisheyeStats, s_tofStats, s_rgbStats, s_sgbmStats, s_slamStats;
+
+static void printStats()
+{
+    std::cout << "imu     " << s_imuStats.summary() << "\n"
+              << "fisheye " << s_fisheyeStats.summary() << "\n"
+              << "tof     " << s_tofStats.summary() << "\n"
+              << "rgb     " << s_rgbStats.summary() << "\n"
+              << "sgbm    " << s_sgbmStats.summary() << "\n"
+              << "slam    " << s_slamStats.summary() << std::endl;
+}
+
+/// Same calls as with an xv::Device, `Device` is ReplayDevice here
+template <class Device>
+static void registerStreams(Device& device)
+{
+    if (device.imuSensor()) {
+        device.imuSensor()->registerCallback([](xv::Imu const& imu) { s_imuStats.tic(imu.edgeTimestampUs, imu.hostTimestamp); });
+        device.imuSensor()->start();
+    }
+    if (device.fisheyeCameras()) {
+        device.fisheyeCameras()->registerCallback([](xv::FisheyeImages const& fe) { s_fisheyeStats.tic(fe.edgeTimestampUs, fe.hostTimestamp); });
+        device.fisheyeCameras()->start();
+    }
+    if (device.tofCamera()) {
+        device.tofCamera()->registerCallback([](xv::DepthImage const& tof) { s_tofStats.tic(tof.edgeTimestampUs, tof.hostTimestamp); });
+        device.tofCamera()->start();
+    }
+    if (device.colorCamera()) {
+        device.colorCamera()->registerCallback([](xv::ColorImage const& rgb) { s_rgbStats.tic(rgb.edgeTimestampUs, rgb.hostTimestamp); });
+        device.colorCamera()->start();
+    }
+    if (device.sgbmCamera()) {
+        device.sgbmCamera()->registerCallback([](xv::SgbmImage const& sgbm) { s_sgbmStats.tic(sgbm.edgeTimestampUs, sgbm.hostTimestamp); });
+        device.sgbmCamera()->start();
+    }
+    if (device.slam()) {
+        device.slam()->registerCallback([](xv::Pose const& pose) { s_slamStats.tic(pose.edgeTimestampUs(), pose.hostTimestamp()); });
+        device.slam()->start();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filename;
+    XvRecSyntheticOptions synthetic;
+    bool generate = false;
+    ReplayDevice::Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--synthetic") && i + 1 < argc) {
+            generate = true;
+            synthetic.duration = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--data") && i + 1 < argc) {
+            synthetic.dataDir = argv[++i];
+        } else if (!std::strcmp(argv[i], "--speed") && i + 1 < argc) {
+            options.speed = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--asap")) {
+            options.speed = 0;
+        } else if (!std::strcmp(argv[i], "--loop")) {
+            options.loop = true;
+        } else if (!std::strcmp(argv[i], "--rebase")) {
+            options.rebaseHostTimestamps = true;
+        } else if (argv[i][0] != '-') {
+            filename = argv[i];
+        } else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (filename.empty()) {
+        if (!generate) {
+            std::cerr << "usage: " << argv[0] << " [file.xvrec] [--synthetic seconds] [--data dir] [--speed x | --asap] [--loop] [--rebase]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        filename = "synthetic.xvrec";
+    }
+
+    if (generate) {
+        std::string error;
+        auto t = std::chrono::steady_clock::now();
+        if (!xvrecWriteSynthetic(filename, synthetic, &error)) {
+            std::cerr << "Cannot write " << filename << ": " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Generated " << filename << " in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count() << "s" << std::endl;
+    }
+
+    ReplayDevice device;
+    if (!device.open(filename, options)) {
+        std::cerr << device.error() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Replaying " << filename << " (" << device.id() << ", " << device.duration() << "s)" << std::endl;
+
+    registerStreams(device);
+
+    auto t0 = std::chrono::steady_clock::now();
+    device.play();
+    std::atomic<bool> done(false);
+    std::thread status([&done] {
+        while (!done) {
+            for (int i = 0; i < 10 && !done; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (!done) {
+                std::cout << std::endl;
+                printStats();
+            }
+        }
+    });
+    device.wait();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    done = true;
+    status.join();
+
+    std::cout << "\n" << device.delivered() << " records in " << elapsed << "s ("
+              << device.delivered() / elapsed << " records/s, " << device.duration() / elapsed << "x real time)";
+    if (options.speed > 0) {
+        std::cout << ", lag mean " << device.meanLagMs() << "ms max " << device.maxLagMs() << "ms";
+    }
+    std::cout << std::endl;
+    std::cout << "frames: imu=" << s_imuStats.count() << " fisheye=" << s_fisheyeStats.count() << " tof=" << s_tofStats.count()
+              << " rgb=" << s_rgbStats.count() << " sgbm=" << s_sgbmStats.count() << " slam=" << s_slamStats.count() << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -1,3 +1,6 @@
+import csv
+import sys
+
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 
@@ -6,6 +9,14 @@ def parse_slam_data(file_path):
     从 txt 文件中解析 SLAM 数据，提取位置信息 (x, y, z)。
     """
     x_coords, y_coords, z_coords = [], [], []
+    if file_path.endswith('.csv'):
+        # slam_log -c 导出的 CSV：timestamp,x,y,z,qx,qy,qz,qw,confidence
+        with open(file_path, 'r') as file:
+            for row in csv.DictReader(file):
+                x_coords.append(float(row['x']))
+                y_coords.append(float(row['y']))
+                z_coords.append(float(row['z']))
+        return x_coords, y_coords, z_coords
     with open(file_path, 'r') as file:
         lines = file.readlines()
         for i in range(len(lines)):
@@ -45,8 +56,9 @@ def plot_3d_slam_path(file_path):
     # 显示图形
     plt.show()
 
-# 文件路径
-file_path = r'/home/gym/data/ros/slam_data3.txt'  # 替换为你的文件路径
+# 文件路径：ROS 位姿导出（如 data/slam_data.txt）或 slam_log -c 导出的 CSV
+# 大文件先用 record/slam_log 转成 CSV 再画，比逐行 split 快得多
+file_path = sys.argv[1] if len(sys.argv) > 1 else 'data/slam_data.txt'
 
 # 绘制三维 SLAM Path
 plot_3d_slam_path(file_path)
\ No newline at end of file
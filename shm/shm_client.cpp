@@ -0,0 +1,142 @@
+#include <xv-sdk.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shm_ring.h"
+#include "stream_stats.hpp"
+#include "xvrec_xv.h"
+
+/**
+ * Reads the streams of a shm_publisher: rate, latency (publisher host timestamp to
+ * decoding here), overruns and torn frames of every stream. Start as many as needed.
+ *
+ * usage: shm_client [--prefix name] [--latest] [imu] [fisheye] [tof] [rgb] [sgbm] [slam]
+ *
+ *  --latest: only the most recent frame of each wake-up is read (display style),
+ *            by default every frame is read (recorder style)
+ */
+
+static std::atomic<bool> s_stop(false);
+
+struct Subscription
+{
+    XvRecTrack track;
+    std::string name;
+    StreamStats stats;
+    std::atomic<std::uint64_t> overruns;
+    std::atomic<std::uint64_t> torn;
+};
+
+/// Decodes to the SDK type, pixels stay in the segment (zero copy)
+template <class T>
+static bool decode(ShmRingReader const& reader, ShmFrame const& frame)
+{
+    T data;
+    return xvrecDecode(frame.record, reader.mapping(), data);
+}
+
+static bool decode(ShmRingReader const& reader, ShmFrame const& frame)
+{
+    switch (frame.record.track) {
+    case XvRecTrack::Imu: return decode<xv::Imu>(reader, frame);
+    case XvRecTrack::Fisheye: return decode<xv::FisheyeImages>(reader, frame);
+    case XvRecTrack::Depth: return decode<xv::DepthImage>(reader, frame);
+    case XvRecTrack::Color: return decode<xv::ColorImage>(reader, frame);
+    case XvRecTrack::Sgbm: return decode<xv::SgbmImage>(reader, frame);
+    case XvRecTrack::Pose: return decode<xv::Pose>(reader, frame);
+    }
+    return false;
+}
+
+static void subscribe(Subscription* s, bool latest)
+{
+    ShmRingReader reader;
+    while (!s_stop) {
+        if (!reader.isOpen() || reader.closed()) {
+            // publisher not started yet, or restarted: follow the new segment
+            if (!reader.open(s->name)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                continue;
+            }
+        }
+        if (!reader.wait(100)) {
+            continue;
+        }
+        ShmFrame frame;
+        while (latest ? reader.latest(frame) : reader.next(frame)) {
+            if (decode(reader, frame) && reader.valid(frame)) {
+                s->stats.tic(frame.record.edgeTimestampUs, frame.record.hostTimestamp);
+            } else {
+                ++s->torn;
+            }
+        }
+        s->overruns = reader.overruns();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string prefix = "xvsdk";
+    bool latest = false;
+    std::vector<std::string> streams;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--prefix") && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (!std::strcmp(argv[i], "--latest")) {
+            latest = true;
+        } else if (argv[i][0] != '-') {
+            streams.push_back(argv[i]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--prefix name] [--latest] [imu] [fisheye] [tof] [rgb] [sgbm] [slam]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::unique_ptr<Subscription>> subscriptions;
+    for (int t = 1; t < kXvRecTrackCount; ++t) {
+        const XvRecTrack track = static_cast<XvRecTrack>(t);
+        bool wanted = streams.empty();
+        for (auto const& s : streams) {
+            wanted = wanted || s == xvrecTrackName(track);
+        }
+        if (wanted) {
+            std::unique_ptr<Subscription> s(new Subscription);
+            s->track = track;
+            s->name = shmRingName(prefix, track);
+            s->overruns = 0;
+            s->torn = 0;
+            subscriptions.push_back(std::move(s));
+        }
+    }
+
+    std::signal(SIGINT, [](int) { s_stop = true; });
+    std::signal(SIGTERM, [](int) { s_stop = true; });
+
+    std::vector<std::thread> threads;
+    for (auto& s : subscriptions) {
+        threads.emplace_back(subscribe, s.get(), latest);
+    }
+    while (!s_stop) {
+        for (int i = 0; i < 10 && !s_stop; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        std::cout << std::endl;
+        for (auto const& s : subscriptions) {
+            std::cout << "  " << s->name << ": " << s->stats.summary() << " overruns=" << s->overruns
+                      << " torn=" << s->torn << std::endl;
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+#include <xv-sdk.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "depth_codec.h"
+#include "replay_device.h"
+#include "shm_ring.h"
+#include "stream_stats.hpp"
+#include "xvrec_xv.h"
+
+/**
+ * Publishes the device streams in shared memory so several local processes (recorder,
+ * perception, visualization...) see the same frames, see common/shm_ring.h.
+ *
+ * usage: shm_publisher [--prefix name] [--mode 0660] [--replay file.xvrec [--loop]] [--depth-codec] [--sgbm-error mm]
+ *                      [imu] [fisheye] [tof] [rgb] [sgbm] [slam]
+ *
+ * Without stream names every stream is published. With --replay a recording (see record/)
+ * is published instead of the device. Stop with Ctrl-C; read with shm_client.
+ *
+ * The segments are readable by the user running the publisher only (0600); --mode sets other
+ * permissions, e.g. 0660 for the clients of its group. Clients need read and write access.
+ *
+ * --depth-codec publishes ToF Depth_16 / IR and SGBM depth compressed losslessly (common/depth_codec.h),
+ * --sgbm-error compresses SGBM depth within `mm`, in the min_distance / max_distance of the
+ * sgbm_config. Readers decode them transparently with xvrecDecode().
+ */
+
+static struct xv::sgbm_config s_sgbmConfig = {
+    1 ,//enable_dewarp
+    1.0, //dewarp_zoom_factor
+    0, //enable_disparity
+    1, //enable_depth
+    0, //enable_point_cloud
+    0.08, //baseline
+    96, //fov
+    255, //disparity_confidence_threshold
+    {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}, //homography
+    1, //enable_gamma
+    2.2, //gamma_value
+    0, //enable_gaussian
+    0, //mode
+    8000, //max_distance
+    100, //min_distance
+};
+
+static ShmPublisher* s_publisher = nullptr;
+static StreamStats s_stats[kXvRecTrackCount];
+static std::atomic<bool> s_stop(false);
+// null: depth published raw
+static std::unique_ptr<DepthEncoder> s_tofEncoder;
+static std::unique_ptr<DepthEncoder> s_sgbmEncoder;
+
+template <class T>
+static void publish(XvRecTrack track, T const& data, std::int64_t edgeTimestampUs, double hostTimestamp)
+{
+    s_stats[static_cast<int>(track)].tic(edgeTimestampUs, hostTimestamp);
+    xvrecAppend(*s_publisher, data);
+}
+
+/// ToF / SGBM frames, through the depth codec when enabled
+template <class T>
+static void publishDepth(XvRecTrack track, T const& data, std::unique_ptr<DepthEncoder> const& encoder)
+{
+    if (!encoder) {
+        publish(track, data, data.edgeTimestampUs, data.hostTimestamp);
+        return;
+    }
+    s_stats[static_cast<int>(track)].tic(data.edgeTimestampUs, data.hostTimestamp);
+    xvrecAppend(*s_publisher, data, *encoder);
+}
+
+/// Same calls for xv::Device and ReplayDevice
+template <class Device>
+static std::set<XvRecTrack> startStreams(Device& device, std::set<std::string> const& streams)
+{
+    auto wanted = [&streams](std::string const& name) { return streams.empty() || streams.count(name) > 0; };
+    std::set<XvRecTrack> started;
+    if (wanted("imu") && device.imuSensor()) {
+        device.imuSensor()->registerCallback([](xv::Imu const& imu) {
+            publish(XvRecTrack::Imu, imu, imu.edgeTimestampUs, imu.hostTimestamp);
+        });
+        device.imuSensor()->start();
+        started.insert(XvRecTrack::Imu);
+    }
+    if (wanted("fisheye") && device.fisheyeCameras()) {
+        device.fisheyeCameras()->registerCallback([](xv::FisheyeImages const& fe) {
+            publish(XvRecTrack::Fisheye, fe, fe.edgeTimestampUs, fe.hostTimestamp);
+        });
+        device.fisheyeCameras()->start();
+        started.insert(XvRecTrack::Fisheye);
+    }
+    if (wanted("tof") && device.tofCamera()) {
+        device.tofCamera()->registerCallback([](xv::DepthImage const& tof) {
+            publishDepth(XvRecTrack::Depth, tof, s_tofEncoder);
+        });
+        device.tofCamera()->start();
+        started.insert(XvRecTrack::Depth);
+    }
+    if (wanted("rgb") && device.colorCamera()) {
+        device.colorCamera()->registerCallback([](xv::ColorImage const& rgb) {
+            publish(XvRecTrack::Color, rgb, rgb.edgeTimestampUs, rgb.hostTimestamp);
+        });
+        device.colorCamera()->start();
+        started.insert(XvRecTrack::Color);
+    }
+    if (wanted("sgbm") && device.sgbmCamera()) {
+        device.sgbmCamera()->registerCallback([](xv::SgbmImage const& sgbm) {
+            publishDepth(XvRecTrack::Sgbm, sgbm, s_sgbmEncoder);
+        });
+        device.sgbmCamera()->start(s_sgbmConfig);
+        started.insert(XvRecTrack::Sgbm);
+    }
+    if (wanted("slam") && device.slam()) {
+        device.slam()->registerCallback([](xv::Pose const& pose) {
+            publish(XvRecTrack::Pose, pose, pose.edgeTimestampUs(), pose.hostTimestamp());
+        });
+        device.slam()->start();
+        started.insert(XvRecTrack::Pose);
+    }
+    return started;
+}
+
+template <class Device>
+static void stopStreams(Device& device, std::set<XvRecTrack> const& started)
+{
+    if (started.count(XvRecTrack::Imu)) device.imuSensor()->stop();
+    if (started.count(XvRecTrack::Fisheye)) device.fisheyeCameras()->stop();
+    if (started.count(XvRecTrack::Depth)) device.tofCamera()->stop();
+    if (started.count(XvRecTrack::Color)) device.colorCamera()->stop();
+    if (started.count(XvRecTrack::Sgbm)) device.sgbmCamera()->stop();
+    if (started.count(XvRecTrack::Pose)) device.slam()->stop();
+}
+
+static void printStatus(std::set<XvRecTrack> const& started)
+{
+    std::cout << std::endl;
+    for (XvRecTrack track : started) {
+        const int i = static_cast<int>(track);
+        std::cout << "  " << shmRingName(s_publisher->options().prefix, track) << ": " << s_stats[i].summary()
+                  << " published=" << s_publisher->published(track) << " not published=" << s_publisher->dropped(track) << std::endl;
+    }
+    const std::string error = s_publisher->error();
+    if (!error.empty()) {
+        std::cout << "  error: " << error << std::endl;
+    }
+}
+
+static void waitForStop(std::set<XvRecTrack> const& started, std::function<bool()> finished)
+{
+    while (!s_stop && !finished()) {
+        for (int i = 0; i < 10 && !s_stop && !finished(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        printStatus(started);
+    }
+}
+
+int main(int argc, char* argv[]) try
+{
+    ShmPublisher::Options options;
+    std::string replay;
+    bool loop = false;
+    bool depthCodec = false;
+    int sgbmError = -1;
+    std::set<std::string> streams;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--prefix") && i + 1 < argc) {
+            options.prefix = argv[++i];
+        } else if (!std::strcmp(argv[i], "--mode") && i + 1 < argc) {
+            options.mode = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 8));
+        } else if (!std::strcmp(argv[i], "--replay") && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (!std::strcmp(argv[i], "--loop")) {
+            loop = true;
+        } else if (!std::strcmp(argv[i], "--depth-codec")) {
+            depthCodec = true;
+        } else if (!std::strcmp(argv[i], "--sgbm-error") && i + 1 < argc) {
+            sgbmError = std::max(0, std::atoi(argv[++i]));
+        } else if (argv[i][0] != '-') {
+            streams.insert(argv[i]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--prefix name] [--mode 0660] [--replay file.xvrec [--loop]] [--depth-codec] [--sgbm-error mm]"
+                      << " [imu] [fisheye] [tof] [rgb] [sgbm] [slam]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (depthCodec) {
+        s_tofEncoder.reset(new DepthEncoder());
+        s_sgbmEncoder.reset(new DepthEncoder());
+    }
+    if (sgbmError >= 0) {
+        DepthEncoder::Options codec;
+        codec.mode = DepthCodecMode::Bounded;
+        codec.minDepth = s_sgbmConfig.min_distance;
+        codec.maxDepth = s_sgbmConfig.max_distance;
+        codec.maxError = static_cast<std::uint16_t>(std::min(sgbmError, 32767));
+        s_sgbmEncoder.reset(new DepthEncoder(codec));
+    }
+
+    ShmPublisher publisher(options);
+    s_publisher = &publisher;
+    std::signal(SIGINT, [](int) { s_stop = true; });
+    std::signal(SIGTERM, [](int) { s_stop = true; });
+
+    if (!replay.empty()) {
+        ReplayDevice device;
+        ReplayDevice::Options replayOptions;
+        replayOptions.loop = loop;
+        // host timestamps on the local clock, so the clients measure the transport latency
+        replayOptions.rebaseHostTimestamps = true;
+        if (!device.open(replay, replayOptions)) {
+            std::cerr << device.error() << std::endl;
+            return EXIT_FAILURE;
+        }
+        auto started = startStreams(device, streams);
+        std::cout << "Publishing " << replay << " as /" << options.prefix << ".*" << std::endl;
+        device.play();
+        waitForStop(started, [&device] { return device.finished(); });
+        device.stop();
+        stopStreams(device, started);
+    } else {
+        std::cout << "xvsdk version: " << xv::version() << std::endl;
+        auto devices = xv::getDevices(10.);
+        if (devices.empty()) {
+            std::cout << "Timeout: no device found\n";
+            return EXIT_FAILURE;
+        }
+        auto device = devices.begin()->second;
+        auto started = startStreams(*device, streams);
+        std::cout << "Publishing " << device->id() << " as /" << options.prefix << ".*" << std::endl;
+        waitForStop(started, [] { return false; });
+        stopStreams(*device, started);
+    }
+
+    publisher.close();
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
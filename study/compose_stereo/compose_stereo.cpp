@@ -1,8 +1,14 @@
 #include <iostream>  
+#include <atomic>
+#include <mutex>
+#include <cstring>
 #include <opencv2/opencv.hpp>  
 #include <Eigen/Eigen>  
 #include <pcl/point_cloud.h>  
 #include <pcl/visualization/pcl_visualizer.h>  
+#include <xv-sdk.h>
+
+#include "stereo_depth.h"
 
 void showPointCloudPCL(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr& pointcloud)  
 {  
@@ -19,44 +25,109 @@ void showPointCloudCV(const std::vector<cv::Vec3f>& cloudpos, const std::vector<
     window.spin();  
 }  
 
-int main()  
+// 有序点云(NaN 为无效点) -> 彩色 PCL 点云, 一次性分配
+void toPclCloud(const StereoDepthEngine& engine, const cv::Mat& color, pcl::PointCloud<pcl::PointXYZRGB>& cloud)
 {  
+    const cv::Mat& xyz = engine.pointCloud();
+    cloud.clear();
+    cloud.reserve(engine.validPoints());
+    for (int v = 0; v < xyz.rows; v++)
+    {
+        const cv::Vec3f* p = xyz.ptr<cv::Vec3f>(v);
+        for (int u = 0; u < xyz.cols; u++)
+        {
+            if (!(p[u][2] > 0)) continue;
+            pcl::PointXYZRGB point;
+            point.x = p[u][0];
+            point.y = p[u][1];
+            point.z = p[u][2];
+            if (color.channels() == 3)
+            {
+                const cv::Vec3b& c = color.at<cv::Vec3b>(v, u);
+                point.b = c[0];
+                point.g = c[1];
+                point.r = c[2];
+            }
+            else
+            {
+                point.r = point.g = point.b = color.at<unsigned char>(v, u);
+            }
+            cloud.push_back(point);
+        }
+    }
+}
+
+// 使用设备的鱼眼双目: 标定只读取一次, 校正映射表在引擎构造时计算一次
+int runDevice()
+{
+    auto devices = xv::getDevices(10.);
+    if (devices.empty())
+    {
+        std::cerr << "Timeout for device detection." << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto device = devices.begin()->second;
+    auto fisheye = device->fisheyeCameras();
+    if (!fisheye)
+    {
+        std::cerr << "No fisheye cameras." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    StereoDepthEngine engine(stereoRigFromCalibration(fisheye->calibration()));
+    std::mutex mtx;
+    cv::Mat disparity;
+    std::atomic<bool> updated(false);
+    fisheye->registerCallback([&](xv::FisheyeImages const& fe) {
+        if (engine.computeFisheye(fe))
+        {
+            std::lock_guard<std::mutex> l(mtx);
+            engine.disparity().copyTo(disparity);
+            updated = true;
+        }
+    });
+    fisheye->start();
+
+    while (cv::waitKey(10) != 27)
+    {
+        if (updated.exchange(false))
+        {
+            std::lock_guard<std::mutex> l(mtx);
+            cv::imshow("disparity", disparity / 96);
+        }
+    }
+    fisheye->stop();
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && !std::strcmp(argv[1], "--device"))
+    {
+        return runDevice();
+    }
+
     double f = 718.856, cx = 607.1928, cy = 185.2157;  
     double b = 0.573;  
 
-    cv::Mat left_img = cv::imread("/home/gym/code/edge/xvsdk/left_image_0.png");  
-    cv::Mat right_img = cv::imread("/home/gym/code/edge/xvsdk/right_image_0.png");  
+    std::string dir = argc > 1 ? argv[1] : "../../../data";
+    cv::Mat left_img = cv::imread(dir + "/left_image_0.png");
+    cv::Mat right_img = cv::imread(dir + "/right_image_0.png");
+    if (left_img.empty() || right_img.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [data dir | --device]" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    // StereoSGBM parameters  
-    cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(0, 96, 9, 8 * 9 * 9, 32 * 9 * 9, 1, 63, 10, 100, 32);  
-    cv::Mat disparity_sgbm, disparity;  
-    sgbm->compute(left_img, right_img, disparity_sgbm);  
-    disparity_sgbm.convertTo(disparity, CV_32F, 1.0 / 16.0);  
+    // 图像已校正: 不需要映射表, SGBM 按行带并行计算
+    StereoDepthEngine engine(stereoRigRectified(left_img.size(), f, cx, cy, b));
+    engine.compute(left_img, right_img);
 
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointcloud(new pcl::PointCloud<pcl::PointXYZRGB>);  
-    for (int v = 0; v < left_img.rows; v++)  
-    {  
-        for (int u = 0; u < left_img.cols; u++) // 注意这里为 left_img.cols  
-        {  
-            float disp = disparity.at<float>(v, u);  
-            if (disp <= 10 || disp >= 96) continue;  
-
-            pcl::PointXYZRGB point;  
-            double x = (u - cx) / f;  
-            double y = (v - cy) / f;  
-            double depth = f * b / disp;  
-            point.x = x * depth;  
-            point.y = y * depth;  
-            point.z = depth;  
-            point.b = left_img.at<cv::Vec3b>(v, u)[0];  
-            point.g = left_img.at<cv::Vec3b>(v, u)[1];  
-            point.r = left_img.at<cv::Vec3b>(v, u)[2];  
-            pointcloud->push_back(point);  
-        }  
-    }  
+    toPclCloud(engine, left_img, *pointcloud);
     // showPointCloudPCL(pointcloud);
 
-    cv::imshow("disparity", disparity / 96);  
+    cv::imshow("disparity", engine.disparity() / 96);
     cv::waitKey(0);  
 
     return 0;  
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <memory>
 #include <functional>
+#include "imu_cache.h"
 
 class IMUDataInterface {
 public:
@@ -21,9 +22,10 @@ public:
 
         m_callback = callback;
         
-        // 注册回调函数
+        // 注册回调函数，每个样本先写入缓存
         m_callbackId = m_device->imuSensor()->registerCallback(
             [this](xv::Imu const& imu) {
+                m_cache.push(imu);
                 if (m_callback) {
                     m_callback(imu);
                 }
@@ -82,18 +84,30 @@ public:
         return true;
     }
 
-    // 获取单次IMU数据 - 修改后的版本
+    // 获取最新的一个IMU数据（来自缓存，不需要回调）
     bool getIMUData(xv::Imu& imuData) {
-        if (!m_device || !m_device->imuSensor()) {
-            std::cerr << "Device or IMU sensor not available" << std::endl;
+        ImuCache::Sample s;
+        if (!m_cache.latest(s)) {
             return false;
         }
+        imuData.hostTimestamp = s.hostTimestamp;
+        imuData.edgeTimestampUs = s.edgeTimestampUs;
+        for (int i = 0; i < 3; ++i) {
+            imuData.gyro[i] = s.gyro[i];
+            imuData.accel[i] = s.accel[i];
+        }
+        imuData.temperature = s.temperature;
+        return true;
+    }
 
-        // 根据文档2，IMU数据主要通过回调获取
-        // 这里我们只能返回最后接收到的IMU数据
-        // 或者你需要实现一个缓存机制来存储最新的IMU数据
-        std::cerr << "Warning: getIMUData() may not work as expected. Consider using callback instead." << std::endl;
-        return false;
+    // 获取主机时间戳在 [t0, t1] 内的IMU数据，返回个数
+    std::size_t getIMUData(double t0, double t1, ImuCache::Batch& batch) const {
+        return m_cache.range(t0, t1, batch);
+    }
+
+    // 获取最新的 n 个IMU数据，返回个数
+    std::size_t getRecentIMUData(std::size_t n, ImuCache::Batch& batch) const {
+        return m_cache.batch(n, batch);
     }
 
     // 检查是否正在运行
@@ -109,6 +123,7 @@ public:
 private:
     std::shared_ptr<xv::Device> m_device;
     IMUCallback m_callback;
+    ImuCache m_cache;
     int m_callbackId;
     bool m_isRunning;
 };
@@ -142,6 +157,14 @@ int main() {
     if (imuInterface.registerIMUCallback(imuCallback) && imuInterface.start()) {
         std::cout << "IMU data collection started. Press Enter to stop..." << std::endl;
         std::cin.get();  // 等待用户输入停止
+
+        // 查询缓存中最近1秒的IMU数据
+        xv::Imu latest;
+        ImuCache::Batch batch;
+        if (imuInterface.getIMUData(latest)) {
+            std::size_t n = imuInterface.getIMUData(latest.hostTimestamp - 1.0, latest.hostTimestamp, batch);
+            std::cout << n << " IMU samples in the last second" << std::endl;
+        }
         
         // 停止IMU数据流
         imuInterface.stop();
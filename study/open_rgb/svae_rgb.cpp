@@ -1,13 +1,13 @@
 #include <iostream>
 #include <xv-sdk.h> // Stereo PRO SDK 头文件
-#include "fps_count.hpp"
+#include "stream_stats.hpp"
 #include <opencv2/opencv.hpp> // OpenCV 头文件，用于图像处理和显示
 
 // 回调函数，用于处理 RGB 图像数据
 void rgbCallback(const xv::ColorImage &rgb)
 {
     static int frameCount = 0;
-    static FpsCount fc;
+    static StreamStats fc;
     fc.tic();
     // 打印调试信息
     std::cout << "RGB Frame: " << rgb.width << "x" << rgb.height << " @ " << std::round(fc.fps()) << "fps" << std::endl;
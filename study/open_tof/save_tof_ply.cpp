@@ -6,6 +6,7 @@
 #include <chrono>
 #include <fstream>
 #include "colors.h"
+#include "point_cloud_recorder.hpp"
 
 // 全局变量
 std::shared_ptr<const xv::DepthImage> s_tof = nullptr;
@@ -14,12 +15,18 @@ bool s_stop = false;
 int s_frame_count = 0;
 double s_fps = 0.0;
 std::chrono::steady_clock::time_point s_last_time = std::chrono::steady_clock::now();
+// 连续录制：每帧一个PLY文件，在后台线程写入，不阻塞回调
+std::atomic<bool> s_recording(false);
+std::unique_ptr<PointCloudRecorder<xv::DepthImage>> s_recorder;
 
 // TOF相机回调函数
 void tofCallback(const xv::DepthImage& tof) {
     if (tof.type == xv::DepthImage::Type::Depth_16 || tof.type == xv::DepthImage::Type::Depth_32) {
         std::lock_guard<std::mutex> l(s_mtx_tof);
         s_tof = std::make_shared<xv::DepthImage>(tof);
+        if (s_recording) {
+            s_recorder->push(tof);
+        }
 
         // 计算帧率
         s_frame_count++;
@@ -65,83 +72,56 @@ cv::Mat raw_to_opencv(std::shared_ptr<const xv::DepthImage> tof) {
     return out;
 }
 
-// 保存点云为PLY文件
-void savePointCloud(const xv::DepthImage& tof, const std::string& filename) {
-    std::ofstream plyFile(filename);
-    if (!plyFile.is_open()) {
-        std::cerr << "Failed to open file for saving point cloud: " << filename << std::endl;
-        return;
-    }
-
+// 将深度图转换为点云，逐点写入 writer（单次遍历，无需预先统计点数）
+void appendTofPoints(const xv::DepthImage& tof, PointCloudWriter& writer) {
     // 相机内参（假设值，需要根据实际相机设置）
     float fx = 513.336f; // 焦距 x
     float fy = 513.336f; // 焦距 y
     float cx = 322.987f; // 主点 x
     float cy = 243.861f; // 主点 y
 
-    // 统计有效点数
-    size_t validPointCount = 0;
     if (tof.type == xv::DepthImage::Type::Depth_32) {
         const auto tmp_d = reinterpret_cast<float const*>(tof.data.get());
-        for (unsigned int i = 0; i < tof.height * tof.width; i++) {
-            float d = tmp_d[i];
-            if (d >= 0.01 && d <= 5.0) validPointCount++;
+        for (unsigned int v = 0; v < tof.height; v++) {
+            for (unsigned int u = 0; u < tof.width; u++) {
+                float d = tmp_d[v * tof.width + u];
+                if (d < 0.01 || d > 9.9) continue; // 过滤无效点
+                writer.append((u - cx) * d / fx, (v - cy) * d / fy, d);
+            }
         }
     } else if (tof.type == xv::DepthImage::Type::Depth_16) {
         const auto tmp_d = reinterpret_cast<int16_t const*>(tof.data.get());
-        for (unsigned int i = 0; i < tof.height * tof.width; i++) {
-            float d = tmp_d[i] / 1000.0f; // 转换为米
-            if (d >= 0.01 && d <= 5.0) validPointCount++;
+        for (unsigned int v = 0; v < tof.height; v++) {
+            for (unsigned int u = 0; u < tof.width; u++) {
+                float d = tmp_d[v * tof.width + u] / 1000.0f; // 转换为米
+                if (d < 0.01 || d > 9.9) continue; // 过滤无效点
+                writer.append((u - cx) * d / fx, (v - cy) * d / fy, d);
+            }
         }
     }
+}
 
+// 保存点云为二进制PLY文件
+void savePointCloud(const xv::DepthImage& tof, const std::string& filename) {
+    PointCloudWriter writer;
+    if (!writer.open(filename, PointCloudFormat::PlyBinary)) {
+        std::cerr << "Failed to open file for saving point cloud: " << filename << std::endl;
+        return;
+    }
+    appendTofPoints(tof, writer);
+    size_t validPointCount = writer.count();
+    // close() 回填文件头中的点数
+    if (!writer.close()) {
+        std::cerr << "Failed to write point cloud: " << filename << std::endl;
+        return;
+    }
     if (validPointCount == 0) {
         std::cerr << "No valid points to save!" << std::endl;
-        plyFile.close();
         return;
     }
-
-    // PLY文件头
-    plyFile << "ply\n";
-    plyFile << "format ascii 1.0\n";
-    plyFile << "element vertex " << validPointCount << "\n";
-    plyFile << "property float x\n";
-    plyFile << "property float y\n";
-    plyFile << "property float z\n";
-    plyFile << "end_header\n";
-
-    // 写入点云数据
-    if (tof.type == xv::DepthImage::Type::Depth_32) {
-        const auto tmp_d = reinterpret_cast<float const*>(tof.data.get());
-        for (unsigned int i = 0; i < tof.height * tof.width; i++) {
-            float d = tmp_d[i];
-            if (d < 0.01 || d > 9.9) continue; // 过滤无效点
-            int u = i % tof.width; // 像素坐标 x
-            int v = i / tof.width; // 像素坐标 y
-            // 将像素坐标转换为3D坐标
-            float x = (u - cx) * d / fx;
-            float y = (v - cy) * d / fy;
-            float z = d;
-            plyFile << x << " " << y << " " << z << "\n"; // 保存为3D点云
-        }
-    } else if (tof.type == xv::DepthImage::Type::Depth_16) {
-        const auto tmp_d = reinterpret_cast<int16_t const*>(tof.data.get());
-        for (unsigned int i = 0; i < tof.height * tof.width; i++) {
-            float d = tmp_d[i] / 1000.0f; // 转换为米
-            if (d < 0.01 || d > 9.9) continue; // 过滤无效点
-            int u = i % tof.width; // 像素坐标 x
-            int v = i / tof.width; // 像素坐标 y
-            // 将像素坐标转换为3D坐标
-            float x = (u - cx) * d / fx;
-            float y = (v - cy) * d / fy;
-            float z = d;
-            plyFile << x << " " << y << " " << z << "\n"; // 保存为3D点云
-        }
-    }
-
-    plyFile.close();
     std::cout << "Point cloud saved to " << filename << " with " << validPointCount << " points." << std::endl;
 }
+
 // 显示TOF图像
 void display() {
     cv::namedWindow("TOF");
@@ -164,9 +144,14 @@ void display() {
                 cv::putText(img, fps, cv::Point(10, 40), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1);
                 cv::imshow("TOF", img);
 
-                // 按 's' 键保存点云
-                if (cv::waitKey(1) == 's') {
+                // 按 's' 键保存点云，按 'r' 键开始/停止连续录制
+                int key = cv::waitKey(1);
+                if (key == 's') {
                     savePointCloud(*tof, "point_cloud.ply");
+                } else if (key == 'r') {
+                    s_recording = !s_recording;
+                    std::cout << (s_recording ? "Recording started" : "Recording stopped")
+                              << " (written " << s_recorder->written() << ", dropped " << s_recorder->dropped() << ")" << std::endl;
                 }
             }
         }
@@ -182,6 +167,8 @@ int main(int argc, char* argv[]) try {
 
     auto device = devices.begin()->second;
 
+    s_recorder.reset(new PointCloudRecorder<xv::DepthImage>("point_cloud_%06llu.ply", PointCloudFormat::PlyBinary, appendTofPoints));
+
     if (device->tofCamera()) {
         device->tofCamera()->registerCallback(tofCallback);
         device->tofCamera()->start();
@@ -204,6 +191,8 @@ int main(int argc, char* argv[]) try {
     if (device->tofCamera()) {
         device->tofCamera()->stop();
     }
+    s_recording = false;
+    s_recorder.reset();
 
     return EXIT_SUCCESS;
 } catch (const std::exception& e) {
@@ -12,7 +12,7 @@
 
 #include <xv-sdk.h>
 #include "colors.h"
-#include "fps_count.hpp"
+#include "stream_stats.hpp"
 
 
 bool s_stop = false;
@@ -107,7 +107,7 @@ int main( int argc, char* argv[] ) try
           device->tofCamera()->start();
 
           device->tofCamera()->registerColorDepthImageCallback([deviceId](const xv::DepthColorImage& depthColor){
-              static FpsCount fc;
+              static StreamStats fc;
               fc.tic();
               static int k = 0;
               if(k++%15==0){
@@ -13,9 +13,19 @@
 
 #include "../../include2/xv-sdk-ex.h"
 
+#include "depth_cloud.h"
+#include "point_cloud_recorder.hpp"
+#ifdef USE_REPLAY
+#include "replay_device.h"
+#endif
+
 //enable fillholes
 // #define USE_FILLHOLES
 
+#ifdef USE_FILLHOLES
+#include "hole_filler.h"
+#endif
+
 using std::cerr;
 using std::cin;
 using std::cout;
@@ -72,95 +82,6 @@ static struct xv::sgbm_config global_config = {
     100, //min_distance
 };
 
-#ifdef USE_FILLHOLES
-/**
- * @brief Fill the holes
- * @param inputImage: depth input image (uint16_t values)
- * @param isHole: function to determine if a value of the image correspond to a hole
- * @param holeSize: size of the biggest holes to fill (in pxl)
- * @return the input image with holes filled
- */
-template <class InputImage = xv::SgbmImage>
-InputImage fillHoles(InputImage const& inputImage, std::function<bool(uint16_t)> isHole, float holeSize=1) {
-
-    // pointer on input data (assume input data is float)
-    const auto inputImagePtr = reinterpret_cast<uint16_t const*>(inputImage.data.get());
-
-    // binary image of holes
-    cv::Mat holesBinaryImage = cv::Mat::zeros(inputImage.height, inputImage.width, CV_16UC1);
-    for (std::size_t i=0; i< inputImage.height*inputImage.width; i++) {
-        const auto &d = inputImagePtr[i];
-        // cout<<"d "<<d<<endl;
-        if( isHole(d)) {
-            holesBinaryImage.at<uint16_t>(i / inputImage.width, i % inputImage.width) = 0;
-        } else {
-            holesBinaryImage.at<uint16_t>(i / inputImage.width, i % inputImage.width) = 65535;
-        }
-    }
-
-    // Create structuring element
-    int elementSize = (holeSize+1)/2;
-    cv::Mat element = cv::getStructuringElement(
-                cv::MORPH_ELLIPSE,
-                cv::Size(2 * elementSize + 1,
-                         2 * elementSize + 1),
-                cv::Point(elementSize, elementSize));
-    cv::Mat holesFilledBinaryImage;
-
-    // Closing to fill the holes
-    cv::morphologyEx(holesBinaryImage, holesFilledBinaryImage,
-                     cv::MORPH_CLOSE, element,
-                     cv::Point(-1, -1), 2);
-
-    cv::Mat onlyFilledHolesImage;
-    // extract only the filled holes in a binary image
-    {
-        cv::Mat tmp;
-        cv::bitwise_not(holesBinaryImage, tmp);
-        cv::bitwise_and(tmp, holesFilledBinaryImage, onlyFilledHolesImage);
-    }
-
-    auto median = [] (std::vector<uint16_t> &v)
-    {
-        size_t n = v.size() / 2;
-        std::nth_element(v.begin(), v.begin()+n, v.end());
-        return v[n];
-    };
-
-    // copy the input image to output image
-    InputImage outputImage = inputImage;
-    std::shared_ptr<std::uint8_t> data(new std::uint8_t[inputImage.dataSize], std::default_delete<std::uint8_t[]>());
-    std::memcpy(data.get(), inputImage.data.get(), inputImage.dataSize);
-
-    const auto outputImagePtr = reinterpret_cast<uint16_t*>(data.get());
-
-    for (std::size_t c=0; c< inputImage.height*inputImage.width; c++) {
-        auto i = c / inputImage.width;
-        auto j = c % inputImage.width;
-
-        // if it is a filled hole, compute the median to fill the depth image data
-        if( onlyFilledHolesImage.at<uint16_t>(i, j)>0 ) {
-            std::vector<uint16_t> pixels;
-            // compute the median based on non-hole input pixels
-            for (int ii=-holeSize; ii<holeSize; ++ii) {
-                if (i+ii<0 || i+ii>inputImage.height) continue;
-                for (int jj=-holeSize; jj<holeSize; ++jj) {
-                    if (j+jj<0 || j+jj>inputImage.width) continue;
-                    uint16_t v = inputImagePtr[(i+ii)*inputImage.width+(j+jj)];
-                    if (!isHole(v)) {
-                        pixels.push_back(v);
-                    }
-                }
-            }
-            if (!pixels.empty())
-                outputImagePtr[c] = median(pixels);
-        }
-    }
-    outputImage.data = data;
-
-    return outputImage;
-}
-#endif
 
 
 void dump(const char *name, const void *data, int len)
@@ -233,9 +154,13 @@ void Display()
             {   
             #ifdef USE_FILLHOLES
                 {
-                    int hole = 1;
-                    xv::SgbmImage img = fillHoles(*ptr_sgbm.get(), [](uint16_t d){return d < d1  || d > d2; }, hole);
-                    ptr_sgbm = make_shared<xv::SgbmImage>(img);
+                    static HoleFiller filler([]{
+                        HoleFiller::Options options;
+                        options.minValid = d1;
+                        options.maxValid = d2;
+                        return options;
+                    }());
+                    ptr_sgbm = make_shared<xv::SgbmImage>(filler.apply(*ptr_sgbm));
                 }
             #endif
                 cv::Mat img = raw_to_opencv(ptr_sgbm);               
@@ -272,44 +197,13 @@ void Display()
 
 }
 
-std::shared_ptr<xv::PointCloud> s_ptr_pointcloud;
-
-mutex s_mtx_pointcloud;
-ofstream ofs;
-
-void printPointCloud()
-{
-    char buff[128];
-    auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    struct tm *ptm = localtime(&time);
-    sprintf(buff, "pointcloud-%d-%d-%d-%d-%d.txt", ptm->tm_year+1900,ptm->tm_mon+1,ptm->tm_mday,ptm->tm_hour,ptm->tm_min);
-    ofs.open(buff, std::ios::out);
-    while (!s_stop)
-    {
-        std::shared_ptr<xv::PointCloud> pointcloud = nullptr;
-        s_mtx_pointcloud.lock();
-        pointcloud = s_ptr_pointcloud;
-        s_mtx_pointcloud.unlock();
-        if(pointcloud)
-        {
-            auto points = pointcloud->points;
-            for (auto iter = points.begin(); iter != points.end();iter++)
-            {
-                auto point = *iter;
-                char buff[128];
-                sprintf(buff, "x:%f ,y:%f ,z:%f\n", point[0], point[1], point[2]);
-                ofs << buff;
-            }
-        }
-
-    }
-}
+// 点云在后台线程转换、体素降采样后写入，每帧一个 PLY 文件
+std::unique_ptr<PointCloudRecorder<xv::SgbmImage>> s_sgbmRecorder;
 
 void handle(int sig)
 {
     cout << "kill program" << endl;
     s_stop = true;
-    ofs.close();
     signal(sig, SIG_DFL);
     raise(sig);
 }
@@ -323,36 +217,40 @@ long findInvalid(const xv::SgbmImage& image)
     });
 }
 
-int main(int argc ,char** argv)
+/**
+ * @brief Registers the display and point cloud callbacks and starts the streams
+ *
+ * `Device` is xv::Device, or ReplayDevice to run on a recording (--replay).
+ */
+template <class Device>
+void startStreams(Device& device)
 {
-    auto devices = xv::getDevices(10., json);
-    if(devices.empty())
+    if(device.fisheyeCameras())
     {
-        cerr<<"Timeout: no device found"<<endl;
-    }
-
-    auto device = devices.begin()->second;
-#ifdef USE_FILLHOLES
-    d1 = atoi(argv[1]);
-    d2 = atoi(argv[2]);
-#endif
-
-    xv::setLogLevel(xv::LogLevel::debug);
-    if(device->fisheyeCameras())
-    {
-        device->fisheyeCameras()->registerCallback([](xv::FisheyeImages const & stereo){
+        device.fisheyeCameras()->registerCallback([](xv::FisheyeImages const & stereo){
             s_mtx_stereo.lock();
             s_ptr_stereo = make_shared<const xv::FisheyeImages>(stereo);
             s_mtx_stereo.unlock();        
         });
-        std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->setResolutionMode(xv::FisheyeCamerasEx::ResolutionMode::HIGH);
-        //         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->setResolutionMode(xv::FisheyeCamerasEx::ResolutionMode::MEDIUM);
-        device->fisheyeCameras()->start();
+        device.fisheyeCameras()->start();
     }
     
-    if(device->sgbmCamera())
+    if(device.sgbmCamera())
     {
-        device->sgbmCamera()->registerCallback([=](const xv::SgbmImage& sgbm_image){
+        // 去畸变后的深度图：由 fov 得到内参，深度单位 mm，2 cm 体素
+        std::shared_ptr<DepthCloudBuilder> builder = std::make_shared<DepthCloudBuilder>();
+        std::shared_ptr<vector<std::array<float, 3>>> points = std::make_shared<vector<std::array<float, 3>>>();
+        s_sgbmRecorder.reset(new PointCloudRecorder<xv::SgbmImage>("./sgbm_pointcloud_%06llu.ply", PointCloudFormat::PlyBinary,
+            [builder, points](xv::SgbmImage const & sgbm_image, PointCloudWriter & writer){
+                const int width = static_cast<int>(sgbm_image.width);
+                const int height = static_cast<int>(sgbm_image.height);
+                if (builder->camera().width != width || builder->camera().height != height) {
+                    builder->setCamera(DepthCamera::fromFov(width, height, global_config.fov));
+                }
+                builder->build(reinterpret_cast<uint16_t const*>(sgbm_image.data.get()), width, height, 0.001f, *points);
+                writer.append(*points);
+            }));
+        device.sgbmCamera()->registerCallback([=](const xv::SgbmImage& sgbm_image){
             if(sgbm_image.type == xv::SgbmImage::Type::Depth)
             {  
                 s_mtx_sgbm.lock();
@@ -360,17 +258,63 @@ int main(int argc ,char** argv)
                 s_mtx_sgbm.unlock();
                 long invalidNum = findInvalid(sgbm_image);
                 cout << "invalid : " << (100.0 * invalidNum) / (sgbm_image.width * sgbm_image.height) << "%" << endl;
-                auto pointcloud = device->sgbmCamera()->depthImageToPointCloud(sgbm_image);
-                s_mtx_pointcloud.lock();
-                s_ptr_pointcloud = pointcloud;
-                s_mtx_pointcloud.unlock();
+                s_sgbmRecorder->push(sgbm_image);
             }
         });
-        device->sgbmCamera()->start(global_config);
+        device.sgbmCamera()->start(global_config);
+    }
+}
+
+#ifdef USE_REPLAY
+/// Same display and point clouds on an xvrec recording (see record/), without a device
+int replay(std::string const& filename)
+{
+    ReplayDevice device;
+    if (!device.open(filename)) {
+        cerr << device.error() << endl;
+        return 1;
+    }
+    startStreams(device);
+    signal(SIGINT,handle);
+    thread t(Display);
+    device.play();
+    device.wait();
+    s_stop = true;
+    t.join();
+    return 0;
+}
+#endif
+
+int main(int argc ,char** argv)
+{
+#ifdef USE_REPLAY
+    if (argc > 2 && string(argv[1]) == "--replay") {
+        return replay(argv[2]);
+    }
+#endif
+    auto devices = xv::getDevices(10., json);
+    if(devices.empty())
+    {
+        cerr<<"Timeout: no device found"<<endl;
+    }
+
+    auto device = devices.begin()->second;
+#ifdef USE_FILLHOLES
+    if (argc > 2) {
+        d1 = atoi(argv[1]);
+        d2 = atoi(argv[2]);
+    }
+#endif
+
+    xv::setLogLevel(xv::LogLevel::debug);
+    if(device->fisheyeCameras())
+    {
+        std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->setResolutionMode(xv::FisheyeCamerasEx::ResolutionMode::HIGH);
+        //         std::dynamic_pointer_cast<xv::FisheyeCamerasEx>(device->fisheyeCameras())->setResolutionMode(xv::FisheyeCamerasEx::ResolutionMode::MEDIUM);
     }
+    startStreams(*device);
     signal(SIGINT,handle);
     thread t(Display);
-    thread t2(printPointCloud);
 
     // cin.get();
     int count = 0;
@@ -387,7 +331,6 @@ int main(int argc ,char** argv)
         device->sgbmCamera()->start(global_config);
     }
     t.join();
-    t2.join();
     device->fisheyeCameras()->stop();
     // device->sgbmCamera()->stop();
 
@@ -5,50 +5,25 @@
 #include <thread>
 #include <atomic>
 #include <cmath>
-#include <fstream> // 用于文件操作
-#include "frequency_counter.hpp"
+#include "stream_stats.hpp"
+#include "pose_logger.h"
+#include "pose_timeline.h"
 #include <iomanip>
 
-std::ofstream outFile("slam_data.csv"); // 打开文件写入数据
-
-// 回调函数，用于处理SLAM的位姿数据
-void savePoseToCSV(const xv::Pose &pose)
-{
-    // 获取姿态的旋转数据
-    auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-
-    // 打印获取的位姿数据
-    std::cout << "Saving pose to CSV: "
-              << "timestamp=" << pose.hostTimestamp() << ", "
-              << "x=" << pose.x() << ", "
-              << "y=" << pose.y() << ", "
-              << "z=" << pose.z() << ", "
-              << "pitch=" << pitchYawRoll[0] * 180.0 / M_PI << "°, "
-              << "yaw=" << pitchYawRoll[1] * 180.0 / M_PI << "°, "
-              << "roll=" << pitchYawRoll[2] * 180.0 / M_PI << "°, "
-              << "confidence=" << pose.confidence()
-              << std::endl;
-
-    // 将数据写入CSV文件
-    outFile << pose.hostTimestamp() << ","
-            << pose.x() << ","
-            << pose.y() << ","
-            << pose.z() << ","
-            << pitchYawRoll[0] * 180.0 / M_PI << "," // pitch
-            << pitchYawRoll[1] * 180.0 / M_PI << "," // yaw
-            << pitchYawRoll[2] * 180.0 / M_PI << "," // roll
-            << pose.confidence() << std::endl;       // confidence
-}
+PoseLogger s_poseLog; // 位姿日志：回调里只拷贝到预分配的内存块，由后台线程写盘
+PoseTimeline s_poseTimeline; // 回调位姿的历史，供其他线程按时间戳查询
 
 // 回调函数，用于处理SLAM的位姿数据
 void onPose(xv::Pose const &pose)
 {
-    // 保存姿态数据到CSV并打印调试信息
-    savePoseToCSV(pose);
+    s_poseTimeline.push(pose);
+
+    // 记录位姿：一次内存拷贝，不写文件也不打印
+    s_poseLog.log(pose);
 
     // 获取姿态的旋转数据
     auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-    static FrequencyCounter fps;
+    static StreamStats fps;
     fps.tic();
     if (fps.count() % 500 == 1)
     {
@@ -63,8 +38,11 @@ void onPose(xv::Pose const &pose)
 
 int main(int /*argc*/, char * /*argv*/[])
 {
-    // 打开CSV文件并写入标题
-    outFile << "timestamp,x,y,z,pitch,yaw,roll,confidence" << std::endl;
+    // 打开位姿日志，用 record/slam_log 导出 CSV/TUM/KITTI
+    if (!s_poseLog.open("slam_data.xvrec")) {
+        std::cerr << s_poseLog.error() << std::endl;
+        return EXIT_FAILURE;
+    }
 
     // 设置日志级别
     xv::setLogLevel(xv::LogLevel::debug);
@@ -102,15 +80,16 @@ int main(int /*argc*/, char * /*argv*/[])
 
     // 模拟60Hz循环来获取SLAM位姿
     std::atomic<bool> stop(false);
-    std::thread threadLoop60Hz([&stop, &device]
+    std::thread threadLoop60Hz([&stop]
                                {
         while (!stop) {
             auto now = std::chrono::steady_clock::now();
             xv::Pose pose;
-            // 获取当前位姿（没有延迟，因为内部补偿了最后一次IMU数据接收到的预测）
-            if (device->slam()->getPose(pose)) {
+            // 当前时刻的位姿：由回调位姿插值或外推得到，不调用 SDK
+            const double nowSeconds = std::chrono::duration<double>(now.time_since_epoch()).count();
+            if (s_poseTimeline.poseAt(nowSeconds, pose)) {
                 auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                static FrequencyCounter fps;
+                static StreamStats fps;
                 fps.tic();
                 if (fps.count() % 120 == 1) {
                     std::cout << "Current SLAM : " << fps.fps() << " Hz [timestamp=" << pose.hostTimestamp() << " x=" << pose.x() << " y=" << pose.y() << " z=" << pose.z()
@@ -142,7 +121,8 @@ int main(int /*argc*/, char * /*argv*/[])
     }
 
     // 关闭文件
-    outFile.close();
+    s_poseLog.close();
+    std::cout << s_poseLog.summary() << std::endl;
 
     return EXIT_SUCCESS;
 }
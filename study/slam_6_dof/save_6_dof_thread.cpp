@@ -6,76 +6,29 @@
 #include <atomic>
 #include <cmath>
 #include <fstream> // 用于文件操作
-#include <mutex> // 引入互斥锁
 #include <chrono>
-#include <sys/resource.h>  // 引入获取 CPU 使用情况的头文件
-#include "frequency_counter.hpp"
+#include "stream_stats.hpp"
+#include "pose_logger.h"
+#include "resource_profiler.h"
+#include "pose_timeline.h"
 #include <iomanip>
 
-std::ofstream outFile("slam_data.csv"); // 打开文件写入数据
-std::mutex fileMutex; // 互斥锁，确保写入文件时的线程安全
-
-// 获取CPU使用情况（以百分比形式返回）
-double getCPUUsage() {
-    struct rusage usage;
-    if (getrusage(RUSAGE_SELF, &usage) == 0) {
-        // 获取进程的用户态时间和内核态时间（单位：秒）
-        double user_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
-        double sys_time = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
-
-        // 返回总的 CPU 使用时间，作为示例我们可以计算进程的总使用时间
-        // 在实际应用中，你可能需要根据时间间隔来计算进程的 CPU 使用率
-        double total_time = user_time + sys_time;
-        return total_time * 100; // 以百分比形式返回
-    }
-    return 0.0; // 如果获取失败，返回0
-}
-
-// 回调函数，用于处理SLAM的位姿数据
-void savePoseToCSV(const xv::Pose &pose)
-{
-    // 获取姿态的旋转数据
-    auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
+PoseLogger s_poseLog;
+PoseTimeline s_poseTimeline; // 回调位姿的历史，供其他线程按时间戳查询
 
-    // 获取当前CPU使用情况
-    double cpuUsage = getCPUUsage();
-
-    // 打印获取的位姿数据
-    std::cout << "Saving pose to CSV: "
-              << "timestamp=" << pose.hostTimestamp() << ", "
-              << "x=" << pose.x() << ", "
-              << "y=" << pose.y() << ", "
-              << "z=" << pose.z() << ", "
-              << "pitch=" << pitchYawRoll[0] * 180.0 / M_PI << "°, "
-              << "yaw=" << pitchYawRoll[1] * 180.0 / M_PI << "°, "
-              << "roll=" << pitchYawRoll[2] * 180.0 / M_PI << "°, "
-              << "confidence=" << pose.confidence()
-              << ", CPU Usage=" << cpuUsage << "%" << std::endl;
-
-    // 加锁，确保写入文件时线程安全
-    std::lock_guard<std::mutex> lock(fileMutex);
-    
-    // 将数据写入CSV文件
-    outFile << pose.hostTimestamp() << ","
-            << pose.x() << ","
-            << pose.y() << ","
-            << pose.z() << ","
-            << pitchYawRoll[0] * 180.0 / M_PI << "," // pitch
-            << pitchYawRoll[1] * 180.0 / M_PI << "," // yaw
-            << pitchYawRoll[2] * 180.0 / M_PI << "," // roll
-            << pose.confidence() << ","
-            << cpuUsage << std::endl;       // 写入 CPU 使用率
-}
+std::ofstream resourceFile("resource_usage.csv"); // 进程和各线程的资源使用情况，每秒一次
 
 // 回调函数，用于处理SLAM的位姿数据
-void onPose(xv::Pose const &pose)
+// cpuPercent: 最近一秒的进程 CPU 使用率（100% 为一个核），由 main() 里的 ResourceProfiler 提供
+void onPose(xv::Pose const &pose, double cpuPercent)
 {
-    // 保存姿态数据到CSV并打印调试信息
-    savePoseToCSV(pose);
+    s_poseTimeline.push(pose);
+
+    s_poseLog.log(pose, cpuPercent);
 
     // 获取姿态的旋转数据
     auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-    static FrequencyCounter fps;
+    static StreamStats fps;
     fps.tic();
     if (fps.count() % 500 == 1)
     {
@@ -90,8 +43,19 @@ void onPose(xv::Pose const &pose)
 
 int main(int /*argc*/, char * /*argv*/[])
 {
-    // 打开CSV文件并写入标题
-    outFile << "timestamp,x,y,z,pitch,yaw,roll,confidence,cpu_usage" << std::endl;
+    // 打开位姿日志，用 record/slam_log 导出 CSV/TUM/KITTI
+    if (!s_poseLog.open("slam_data.xvrec")) {
+        std::cerr << s_poseLog.error() << std::endl;
+        return EXIT_FAILURE;
+    }
+    ResourceProfiler::writeCsvHeader(resourceFile);
+
+    // 表头写完后才启动采样线程，之后只有它写 resourceFile
+    // 后台线程每秒读取 /proc/self/stat 和 /proc/self/task/*/stat，计算这一秒内的 CPU%、上下文切换和缺页率
+    ResourceProfiler profiler(ResourceProfiler::Options(), [](ResourceProfiler::Snapshot const& snapshot) {
+        ResourceProfiler::writeCsv(resourceFile, snapshot);
+        std::cout << ResourceProfiler::format(snapshot, 5.0) << std::endl; // 只列出 CPU 超过 5% 的线程
+    });
 
     // 设置日志级别
     xv::setLogLevel(xv::LogLevel::debug);
@@ -128,19 +92,22 @@ int main(int /*argc*/, char * /*argv*/[])
     }
 
     // 注册回调函数，获取SLAM的位姿
-    device->slam()->registerCallback(onPose);
+    // cpuPercent() 只读一个原子变量，不做系统调用
+    device->slam()->registerCallback([&profiler](xv::Pose const &pose) { onPose(pose, profiler.cpuPercent()); });
 
     // 模拟60Hz循环来获取SLAM位姿
     std::atomic<bool> stop(false);
-    std::thread threadLoop60Hz([&stop, &device]
+    std::thread threadLoop60Hz([&stop]
                                {
+        ResourceProfiler::nameCurrentThread("loop60Hz"); // 在资源统计中区分本线程和 SDK 的线程
         while (!stop) {
             auto now = std::chrono::steady_clock::now();
             xv::Pose pose;
-            // 获取当前位姿（没有延迟，因为内部补偿了最后一次IMU数据接收到的预测）
-            if (device->slam()->getPose(pose)) {
+            // 当前时刻的位姿：由回调位姿插值或外推得到，不调用 SDK
+            const double nowSeconds = std::chrono::duration<double>(now.time_since_epoch()).count();
+            if (s_poseTimeline.poseAt(nowSeconds, pose)) {
                 auto pitchYawRoll = xv::rotationToPitchYawRoll(pose.rotation());
-                static FrequencyCounter fps;
+                static StreamStats fps;
                 fps.tic();
                 if (fps.count() % 120 == 1) {
                     std::cout << "Current SLAM : " << fps.fps() << " Hz [timestamp=" << pose.hostTimestamp() << " x=" << pose.x() << " y=" << pose.y() << " z=" << pose.z()
@@ -173,7 +140,8 @@ int main(int /*argc*/, char * /*argv*/[])
     }
 
     // 关闭文件
-    outFile.close();
+    s_poseLog.close();
+    std::cout << s_poseLog.summary() << std::endl;
 
     return EXIT_SUCCESS;
 }